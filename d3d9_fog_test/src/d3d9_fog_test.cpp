@@ -2,12 +2,14 @@
 #include <d3d9.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+
+#include "fog_model.h"
+#include "test_log.h"
+#include "test_runner.h"
+#include "up_batcher.h"
 
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof(*(a)))
-#define ok(c, ...) {{if (!(c)) fprintf(stdout, "fail %s ", __func__); else fprintf(stdout, "succ %s ", __func__); fprintf(stdout, __VA_ARGS__);}}
-#define skip(...) {fprintf(stdout, "skip "); fprintf(stdout, __VA_ARGS__);}
-#define win_skip(...) {fprintf(stdout, "skip "); fprintf(stdout, __VA_ARGS__);}
-#define trace(...) {fprintf(stdout, "trace ");fprintf(stdout, __VA_ARGS__);}
 
 struct vec3
 {
@@ -34,18 +36,6 @@ static BOOL color_match(D3DCOLOR c1, D3DCOLOR c2, BYTE max_diff)
 		&& compare_uint((c1 >> 24) & 0xff, (c2 >> 24) & 0xff, max_diff);
 }
 
-static HWND create_window(void)
-{
-	HWND hwnd;
-	RECT rect;
-
-	SetRect(&rect, 0, 0, 640, 480);
-	AdjustWindowRect(&rect, WS_OVERLAPPEDWINDOW | WS_VISIBLE, FALSE);
-	hwnd = CreateWindowA("static", "d3d9_test", WS_OVERLAPPEDWINDOW | WS_VISIBLE,
-		0, 0, rect.right - rect.left, rect.bottom - rect.top, 0, 0, 0, 0);
-	return hwnd;
-}
-
 struct surface_readback
 {
 	IDirect3DSurface9* surface;
@@ -137,263 +127,489 @@ static DWORD getPixelColor(IDirect3DDevice9* device, UINT x, UINT y)
 	return ret;
 }
 
-static IDirect3DDevice9* create_device(IDirect3D9* d3d, HWND device_window, HWND focus_window, BOOL windowed)
+/* Fog state of a quad at depth z. All transforms are identity, so z is both
+ * the window depth and the view space depth; the specular alpha is 1. */
+static void fog_test_case(struct fog_case *c, const D3DCAPS9 *caps, D3DFOGMODE table_mode,
+		D3DFOGMODE vertex_mode, float start, float end, enum fog_vertex_source source, float z)
 {
-	D3DPRESENT_PARAMETERS present_parameters = { 0 };
-	IDirect3DDevice9* device;
+	fog_case_init(c);
+	c->table_mode = table_mode;
+	c->vertex_mode = vertex_mode;
+	c->start = start;
+	c->end = end;
+	c->table_fog_caps = !!(caps->RasterCaps & D3DPRASTERCAPS_FOGTABLE);
+	c->source = source;
+	c->z = z;
+	c->eye_z = z;
+}
+
+/* The quad's diffuse color fogged towards the green fog color. */
+static D3DCOLOR fogged_color(const struct fog_case *c, D3DCOLOR diffuse)
+{
+	return fog_blend(diffuse, 0x0000ff00, fog_factor(c)) & 0x00ffffff;
+}
+
+/* Randomized sweep: many fog configurations per frame, each one a small
+ * pretransformed quad in a grid on a large render target, read back once per
+ * frame and checked against the reference model. A frame is split into
+ * groups sharing the table fog state; within a group z, rhw, the specular
+ * alpha (the fog factor with table fog NONE) and the diffuse color vary per
+ * quad. */
+enum
+{
+	SWEEP_SIZE = 1024,          /* render target width and height */
+	SWEEP_CELL = 4,             /* quad size in pixels */
+	SWEEP_GRID = SWEEP_SIZE / SWEEP_CELL,
+	SWEEP_GROUPS = 16,          /* fog states per frame */
+	SWEEP_TOLERANCE = 3,        /* per channel, hardware fog is not exact */
+	SWEEP_REPORTED = 8,         /* mismatches traced in full */
+};
 
-	present_parameters.Windowed = windowed;
-	present_parameters.hDeviceWindow = device_window;
-	present_parameters.SwapEffect = D3DSWAPEFFECT_DISCARD;
-	present_parameters.BackBufferWidth = 640;
-	present_parameters.BackBufferHeight = 480;
-	present_parameters.BackBufferFormat = D3DFMT_A8R8G8B8;
-	present_parameters.EnableAutoDepthStencil = TRUE;
-	present_parameters.AutoDepthStencilFormat = D3DFMT_D24S8;
+struct sweep_vertex
+{
+	float x, y, z, rhw;
+	D3DCOLOR diffuse;
+	D3DCOLOR specular;
+};
 
-	if (SUCCEEDED(IDirect3D9_CreateDevice(d3d, D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL, focus_window,
-		D3DCREATE_HARDWARE_VERTEXPROCESSING, &present_parameters, &device)))
-		return device;
+static unsigned int sweep_random(unsigned int *state)
+{
+	unsigned int x = *state;
 
-	return NULL;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
 }
 
-// main ... The main function, right now it just calls the initialization of SDL.
-int main(int argc, char* argv[]) {
+static float sweep_random_float(unsigned int *state, float min, float max)
+{
+	return min + (max - min) * (float)(sweep_random(state) >> 8) / (float)(1u << 24);
+}
 
-	float start = 0.0f, end = 1.0f;
-	IDirect3DDevice9* device;
-	IDirect3D9* d3d;
-	D3DCOLOR color;
-	ULONG refcount;
-	D3DCAPS9 caps;
-	HWND window;
+static void sweep_set_fog_state(struct up_batcher *batcher, const struct fog_case *c)
+{
+	union
+	{
+		float f;
+		DWORD d;
+	} start, end, density;
 	HRESULT hr;
-	int i;
 
-	/* Gets full z based fog with linear fog, no fog with specular color. */
-	static const struct
-	{
-		float x, y, z;
-		D3DCOLOR diffuse;
-		D3DCOLOR specular;
-	}
-	untransformed_1[] =
-	{
-		{-1.0f, -1.0f, 0.1f, 0xffff0000, 0xff000000},
-		{-1.0f,  0.0f, 0.1f, 0xffff0000, 0xff000000},
-		{ 0.0f,  0.0f, 0.1f, 0xffff0000, 0xff000000},
-		{ 0.0f, -1.0f, 0.1f, 0xffff0000, 0xff000000},
-	},
-	/* Ok, I am too lazy to deal with transform matrices. */
-	untransformed_2[] =
-	{
-		{-1.0f,  0.0f, 1.0f, 0xffff0000, 0xff000000},
-		{-1.0f,  1.0f, 1.0f, 0xffff0000, 0xff000000},
-		{ 0.0f,  1.0f, 1.0f, 0xffff0000, 0xff000000},
-		{ 0.0f,  0.0f, 1.0f, 0xffff0000, 0xff000000},
-	},
-	untransformed_3[] =
-	{
-		{-1.0f, -1.0f, 0.5f, 0xffff0000, 0xff000000},
-		{-1.0f,  1.0f, 0.5f, 0xffff0000, 0xff000000},
-		{ 1.0f, -1.0f, 0.5f, 0xffff0000, 0xff000000},
-		{ 1.0f,  1.0f, 0.5f, 0xffff0000, 0xff000000},
-	},
-	far_quad1[] =
-	{
-		{-1.0f, -1.0f, 0.5f, 0xffff0000, 0xff000000},
-		{-1.0f,  0.0f, 0.5f, 0xffff0000, 0xff000000},
-		{ 0.0f,  0.0f, 0.5f, 0xffff0000, 0xff000000},
-		{ 0.0f, -1.0f, 0.5f, 0xffff0000, 0xff000000},
-	},
-	far_quad2[] =
-	{
-		{-1.0f,  0.0f, 1.5f, 0xffff0000, 0xff000000},
-		{-1.0f,  1.0f, 1.5f, 0xffff0000, 0xff000000},
-		{ 0.0f,  1.0f, 1.5f, 0xffff0000, 0xff000000},
-		{ 0.0f,  0.0f, 1.5f, 0xffff0000, 0xff000000},
-	};
-	/* Untransformed ones. Give them a different diffuse color to make the
-	 * test look nicer. It also makes making sure that they are drawn
-	 * correctly easier. */
-	static const struct
+	start.f = c->start;
+	end.f = c->end;
+	density.f = c->density;
+	hr = up_batcher_set_render_state(batcher, D3DRS_FOGTABLEMODE, c->table_mode);
+	ok(SUCCEEDED(hr), "Failed to set fog table mode, hr %#x.\n", hr);
+	hr = up_batcher_set_render_state(batcher, D3DRS_FOGSTART, start.d);
+	ok(SUCCEEDED(hr), "Failed to set fog start, hr %#x.\n", hr);
+	hr = up_batcher_set_render_state(batcher, D3DRS_FOGEND, end.d);
+	ok(SUCCEEDED(hr), "Failed to set fog end, hr %#x.\n", hr);
+	hr = up_batcher_set_render_state(batcher, D3DRS_FOGDENSITY, density.d);
+	ok(SUCCEEDED(hr), "Failed to set fog density, hr %#x.\n", hr);
+}
+
+static void fog_sweep(IDirect3DDevice9 *device, struct up_batcher *batcher, const D3DCAPS9 *caps,
+		unsigned int case_count, unsigned int seed)
+{
+	static const D3DFOGMODE modes[] = { D3DFOG_NONE, D3DFOG_LINEAR, D3DFOG_EXP, D3DFOG_EXP2 };
+	static const D3DMATRIX identity = { {{
+		1.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f
+	}} };
+	const unsigned int frame_cases = SWEEP_GRID * SWEEP_GRID, group_cases = frame_cases / SWEEP_GROUPS;
+	unsigned int state = seed ? seed : 1, done_cases = 0, frames = 0, failures = 0, i, j, g;
+	const float cell = SWEEP_CELL;
+	IDirect3DSurface9 *rt = NULL, *old_rt = NULL, *old_ds = NULL;
+	struct sweep_vertex *vertices;
+	struct surface_readback rb;
+	struct fog_case *cases;
+	D3DCOLOR *diffuse;
+	LARGE_INTEGER frequency, begin, end;
+	D3DCOLOR fog_color;
+	float *factors;
+	double seconds;
+	HRESULT hr;
+
+	vertices = (struct sweep_vertex *)malloc(frame_cases * 6 * sizeof(*vertices));
+	cases = (struct fog_case *)malloc(frame_cases * sizeof(*cases));
+	diffuse = (D3DCOLOR *)malloc(frame_cases * sizeof(*diffuse));
+	factors = (float *)malloc(frame_cases * sizeof(*factors));
+	if (!vertices || !cases || !diffuse || !factors)
 	{
-		float x, y, z, rhw;
-		D3DCOLOR diffuse;
-		D3DCOLOR specular;
+		skip("Out of memory, skipping the fog sweep.\n");
+		goto done;
 	}
-	transformed_1[] =
-	{
-		{320.0f,   0.0f, 1.0f, 1.0f, 0xffffff00, 0xff000000},
-		{640.0f,   0.0f, 1.0f, 1.0f, 0xffffff00, 0xff000000},
-		{640.0f, 240.0f, 1.0f, 1.0f, 0xffffff00, 0xff000000},
-		{320.0f, 240.0f, 1.0f, 1.0f, 0xffffff00, 0xff000000},
-	},
-	transformed_2[] =
-	{
-		{320.0f, 240.0f, 1.0f, 1.0f, 0xffffff00, 0xff000000},
-		{640.0f, 240.0f, 1.0f, 1.0f, 0xffffff00, 0xff000000},
-		{640.0f, 480.0f, 1.0f, 1.0f, 0xffffff00, 0xff000000},
-		{320.0f, 480.0f, 1.0f, 1.0f, 0xffffff00, 0xff000000},
-	};
-	static const struct
+
+	hr = IDirect3DDevice9_CreateRenderTarget(device, SWEEP_SIZE, SWEEP_SIZE, D3DFMT_A8R8G8B8,
+		D3DMULTISAMPLE_NONE, 0, FALSE, &rt, NULL);
+	if (FAILED(hr))
 	{
-		struct vec3 position;
-		DWORD diffuse;
+		skip("Failed to create a %ux%u render target, hr %#x, skipping the fog sweep.\n",
+			SWEEP_SIZE, SWEEP_SIZE, hr);
+		goto done;
 	}
-	rev_fog_quads[] =
-	{
-		{{-1.0f, -1.0f, 0.1f}, 0x000000ff},
-		{{-1.0f,  0.0f, 0.1f}, 0x000000ff},
-		{{ 0.0f,  0.0f, 0.1f}, 0x000000ff},
-		{{ 0.0f, -1.0f, 0.1f}, 0x000000ff},
-
-		{{ 0.0f, -1.0f, 0.9f}, 0x000000ff},
-		{{ 0.0f,  0.0f, 0.9f}, 0x000000ff},
-		{{ 1.0f,  0.0f, 0.9f}, 0x000000ff},
-		{{ 1.0f, -1.0f, 0.9f}, 0x000000ff},
-
-		{{ 0.0f,  0.0f, 0.4f}, 0x000000ff},
-		{{ 0.0f,  1.0f, 0.4f}, 0x000000ff},
-		{{ 1.0f,  1.0f, 0.4f}, 0x000000ff},
-		{{ 1.0f,  0.0f, 0.4f}, 0x000000ff},
-
-		{{-1.0f,  0.0f, 0.7f}, 0x000000ff},
-		{{-1.0f,  1.0f, 0.7f}, 0x000000ff},
-		{{ 0.0f,  1.0f, 0.7f}, 0x000000ff},
-		{{ 0.0f,  0.0f, 0.7f}, 0x000000ff},
-	};
-	static const D3DMATRIX ident_mat =
-	{ {{
-		1.0f, 0.0f,  0.0f, 0.0f,
-		0.0f, 1.0f,  0.0f, 0.0f,
-		0.0f, 0.0f,  1.0f, 0.0f,
-		0.0f, 0.0f,  0.0f, 1.0f
-	}} };
-	static const D3DMATRIX world_mat1 =
-	{ {{
-		1.0f, 0.0f,  0.0f, 0.0f,
-		0.0f, 1.0f,  0.0f, 0.0f,
-		0.0f, 0.0f,  1.0f, 0.0f,
-		0.0f, 0.0f, -0.5f, 1.0f
-	}} };
-	static const D3DMATRIX world_mat2 =
-	{ {{
-		1.0f, 0.0f,  0.0f, 0.0f,
-		0.0f, 1.0f,  0.0f, 0.0f,
-		0.0f, 0.0f,  1.0f, 0.0f,
-		0.0f, 0.0f,  1.0f, 1.0f
-	}} };
-	static const D3DMATRIX proj_mat =
-	{ {{
-		1.0f, 0.0f,  0.0f, 0.0f,
-		0.0f, 1.0f,  0.0f, 0.0f,
-		0.0f, 0.0f,  1.0f, 0.0f,
-		0.0f, 0.0f, -1.0f, 1.0f
-	}} };
-	static const WORD Indices[] = { 0, 1, 2, 2, 3, 0 };
-	static const WORD Indices2[] =
-	{
-		 0,  1,  2,  2,  3,  0,
-		 4,  5,  6,  6,  7,  4,
-		 8,  9, 10, 10, 11,  8,
-		12, 13, 14, 14, 15, 12,
-	};
+	/* The depth buffer is smaller than the render target, and not needed. */
+	IDirect3DDevice9_GetRenderTarget(device, 0, &old_rt);
+	IDirect3DDevice9_GetDepthStencilSurface(device, &old_ds);
+	hr = IDirect3DDevice9_SetRenderTarget(device, 0, rt);
+	ok(SUCCEEDED(hr), "Failed to set the render target, hr %#x.\n", hr);
+	hr = IDirect3DDevice9_SetDepthStencilSurface(device, NULL);
+	ok(SUCCEEDED(hr), "Failed to unset the depth stencil surface, hr %#x.\n", hr);
+
+	hr = up_batcher_set_transform(batcher, D3DTS_PROJECTION, &identity);
+	ok(SUCCEEDED(hr), "Failed to set projection transform, hr %#x.\n", hr);
+	hr = up_batcher_set_fvf(batcher, D3DFVF_XYZRHW | D3DFVF_DIFFUSE | D3DFVF_SPECULAR);
+	ok(SUCCEEDED(hr), "Failed to set FVF, hr %#x.\n", hr);
+	hr = up_batcher_set_render_state(batcher, D3DRS_FOGVERTEXMODE, D3DFOG_NONE);
+	ok(SUCCEEDED(hr), "Failed to set fog vertex mode, hr %#x.\n", hr);
 
-	window = create_window();
-	d3d = Direct3DCreate9(D3D_SDK_VERSION);
-	ok(!!d3d, "Failed to create a D3D object.\n");
-	if (!(device = create_device(d3d, window, window, TRUE)))
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&begin);
+	while (done_cases < case_count)
 	{
-		skip("Failed to create a D3D device, skipping tests.\n");
-		goto done;
+		unsigned int count = case_count - done_cases < frame_cases ? case_count - done_cases : frame_cases;
+
+		fog_color = sweep_random(&state) & 0x00ffffff;
+		hr = up_batcher_set_render_state(batcher, D3DRS_FOGCOLOR, fog_color);
+		ok(SUCCEEDED(hr), "Failed to set fog color, hr %#x.\n", hr);
+		hr = up_batcher_clear(batcher, 0, NULL, D3DCLEAR_TARGET, 0xff000000, 0.0f, 0);
+		ok(SUCCEEDED(hr), "Failed to clear, hr %#x.\n", hr);
+		hr = IDirect3DDevice9_BeginScene(device);
+		ok(SUCCEEDED(hr), "Failed to begin scene, hr %#x.\n", hr);
+
+		for (g = 0; g * group_cases < count; ++g)
+		{
+			unsigned int first = g * group_cases, n = count - first < group_cases ? count - first : group_cases;
+			struct fog_case group;
+
+			fog_case_init(&group);
+			group.table_mode = modes[sweep_random(&state) % ARRAY_SIZE(modes)];
+			group.table_fog_caps = !!(caps->RasterCaps & D3DPRASTERCAPS_FOGTABLE);
+			group.source = FOG_SOURCE_PRETRANSFORMED;
+			group.start = sweep_random_float(&state, -0.25f, 1.25f);
+			/* Reversed fog comes for free, start == end is rare otherwise. */
+			group.end = sweep_random(&state) % 16 ? sweep_random_float(&state, -0.25f, 1.25f) : group.start;
+			group.density = sweep_random_float(&state, 0.0f, 4.0f);
+			sweep_set_fog_state(batcher, &group);
+
+			for (i = first; i < first + n; ++i)
+			{
+				struct sweep_vertex *v = &vertices[i * 6];
+				float x = (float)(i % SWEEP_GRID * SWEEP_CELL) - 0.5f, y = (float)(i / SWEEP_GRID * SWEEP_CELL) - 0.5f;
+				unsigned int alpha = sweep_random(&state) & 0xff;
+
+				cases[i] = group;
+				cases[i].z = sweep_random_float(&state, 0.0f, 1.0f);
+				cases[i].w = 1.0f / sweep_random_float(&state, 0.05f, 2.0f);
+				cases[i].specular_alpha = alpha / 255.0f;
+				diffuse[i] = sweep_random(&state) & 0x00ffffff;
+
+				v[0].x = x;        v[0].y = y;
+				v[1].x = x + cell; v[1].y = y;
+				v[2].x = x;        v[2].y = y + cell;
+				v[3].x = x;        v[3].y = y + cell;
+				v[4].x = x + cell; v[4].y = y;
+				v[5].x = x + cell; v[5].y = y + cell;
+				for (j = 0; j < 6; ++j)
+				{
+					v[j].z = cases[i].z;
+					v[j].rhw = 1.0f / cases[i].w;
+					v[j].diffuse = 0xff000000 | diffuse[i];
+					v[j].specular = alpha << 24;
+				}
+			}
+			hr = up_batcher_draw_primitive_up(batcher, D3DPT_TRIANGLELIST, n * 2, &vertices[first * 6], sizeof(*vertices));
+			ok(SUCCEEDED(hr), "Failed to draw, hr %#x.\n", hr);
+		}
+
+		hr = up_batcher_end_scene(batcher);
+		ok(SUCCEEDED(hr), "Failed to end scene, hr %#x.\n", hr);
+
+		/* Expected colors while the GPU draws. */
+		fog_factors(cases, count, factors);
+
+		get_rt_readback(rt, &rb);
+		for (i = 0; i < count; ++i)
+		{
+			unsigned int x = i % SWEEP_GRID * SWEEP_CELL + SWEEP_CELL / 2, y = i / SWEEP_GRID * SWEEP_CELL + SWEEP_CELL / 2;
+			D3DCOLOR expected = fog_blend(diffuse[i], fog_color, factors[i]) & 0x00ffffff;
+			D3DCOLOR color = get_readback_color(&rb, x, y) & 0x00ffffff;
+
+			if (color_match(color, expected, SWEEP_TOLERANCE))
+				continue;
+			if (failures++ < SWEEP_REPORTED)
+				trace("Fog sweep case %u: table mode %u, start %.8e, end %.8e, density %.8e, z %.8e, w %.8e, "
+					"specular alpha %.8e, got 0x%08x, expected 0x%08x.\n", done_cases + i, cases[i].table_mode,
+					cases[i].start, cases[i].end, cases[i].density, cases[i].z, cases[i].w,
+					cases[i].specular_alpha, color, expected);
+		}
+		release_surface_readback(&rb);
+
+		done_cases += count;
+		++frames;
 	}
+	QueryPerformanceCounter(&end);
 
-	memset(&caps, 0, sizeof(caps));
-	hr = IDirect3DDevice9_GetDeviceCaps(device, &caps);
-	ok(hr == D3D_OK, "IDirect3DDevice9_GetDeviceCaps returned %08x\n", hr);
-	hr = IDirect3DDevice9_Clear(device, 0, NULL, D3DCLEAR_TARGET, 0xffff00ff, 0.0, 0);
-	ok(hr == D3D_OK, "IDirect3DDevice9_Clear returned %08x\n", hr);
+	seconds = (double)(end.QuadPart - begin.QuadPart) / (double)frequency.QuadPart;
+	ok(!failures, "Fog sweep: %u of %u cases mismatched, seed %u.\n", failures, done_cases, seed);
+	trace("Fog sweep: %u cases in %u frames, %.3f s, %.0f cases/s.\n",
+		done_cases, frames, seconds, seconds > 0.0 ? done_cases / seconds : 0.0);
 
-	/* Setup initial states: No lighting, fog on, fog color */
-	hr = IDirect3DDevice9_SetRenderState(device, D3DRS_ZENABLE, FALSE);
+	IDirect3DDevice9_SetRenderTarget(device, 0, old_rt);
+	IDirect3DDevice9_SetDepthStencilSurface(device, old_ds);
+done:
+	if (old_ds)
+		IDirect3DSurface9_Release(old_ds);
+	if (old_rt)
+		IDirect3DSurface9_Release(old_rt);
+	if (rt)
+		IDirect3DSurface9_Release(rt);
+	free(factors);
+	free(diffuse);
+	free(cases);
+	free(vertices);
+}
+
+/* Gets full z based fog with linear fog, no fog with specular color. */
+static const struct
+{
+	float x, y, z;
+	D3DCOLOR diffuse;
+	D3DCOLOR specular;
+}
+untransformed_1[] =
+{
+	{-1.0f, -1.0f, 0.1f, 0xffff0000, 0xff000000},
+	{-1.0f,  0.0f, 0.1f, 0xffff0000, 0xff000000},
+	{ 0.0f,  0.0f, 0.1f, 0xffff0000, 0xff000000},
+	{ 0.0f, -1.0f, 0.1f, 0xffff0000, 0xff000000},
+},
+/* Ok, I am too lazy to deal with transform matrices. */
+untransformed_2[] =
+{
+	{-1.0f,  0.0f, 1.0f, 0xffff0000, 0xff000000},
+	{-1.0f,  1.0f, 1.0f, 0xffff0000, 0xff000000},
+	{ 0.0f,  1.0f, 1.0f, 0xffff0000, 0xff000000},
+	{ 0.0f,  0.0f, 1.0f, 0xffff0000, 0xff000000},
+},
+untransformed_3[] =
+{
+	{-1.0f, -1.0f, 0.5f, 0xffff0000, 0xff000000},
+	{-1.0f,  1.0f, 0.5f, 0xffff0000, 0xff000000},
+	{ 1.0f, -1.0f, 0.5f, 0xffff0000, 0xff000000},
+	{ 1.0f,  1.0f, 0.5f, 0xffff0000, 0xff000000},
+},
+far_quad1[] =
+{
+	{-1.0f, -1.0f, 0.5f, 0xffff0000, 0xff000000},
+	{-1.0f,  0.0f, 0.5f, 0xffff0000, 0xff000000},
+	{ 0.0f,  0.0f, 0.5f, 0xffff0000, 0xff000000},
+	{ 0.0f, -1.0f, 0.5f, 0xffff0000, 0xff000000},
+},
+far_quad2[] =
+{
+	{-1.0f,  0.0f, 1.5f, 0xffff0000, 0xff000000},
+	{-1.0f,  1.0f, 1.5f, 0xffff0000, 0xff000000},
+	{ 0.0f,  1.0f, 1.5f, 0xffff0000, 0xff000000},
+	{ 0.0f,  0.0f, 1.5f, 0xffff0000, 0xff000000},
+};
+/* Untransformed ones. Give them a different diffuse color to make the
+ * test look nicer. It also makes making sure that they are drawn
+ * correctly easier. */
+static const struct
+{
+	float x, y, z, rhw;
+	D3DCOLOR diffuse;
+	D3DCOLOR specular;
+}
+transformed_1[] =
+{
+	{320.0f,   0.0f, 1.0f, 1.0f, 0xffffff00, 0xff000000},
+	{640.0f,   0.0f, 1.0f, 1.0f, 0xffffff00, 0xff000000},
+	{640.0f, 240.0f, 1.0f, 1.0f, 0xffffff00, 0xff000000},
+	{320.0f, 240.0f, 1.0f, 1.0f, 0xffffff00, 0xff000000},
+},
+transformed_2[] =
+{
+	{320.0f, 240.0f, 1.0f, 1.0f, 0xffffff00, 0xff000000},
+	{640.0f, 240.0f, 1.0f, 1.0f, 0xffffff00, 0xff000000},
+	{640.0f, 480.0f, 1.0f, 1.0f, 0xffffff00, 0xff000000},
+	{320.0f, 480.0f, 1.0f, 1.0f, 0xffffff00, 0xff000000},
+};
+static const struct
+{
+	struct vec3 position;
+	DWORD diffuse;
+}
+rev_fog_quads[] =
+{
+	{{-1.0f, -1.0f, 0.1f}, 0x000000ff},
+	{{-1.0f,  0.0f, 0.1f}, 0x000000ff},
+	{{ 0.0f,  0.0f, 0.1f}, 0x000000ff},
+	{{ 0.0f, -1.0f, 0.1f}, 0x000000ff},
+
+	{{ 0.0f, -1.0f, 0.9f}, 0x000000ff},
+	{{ 0.0f,  0.0f, 0.9f}, 0x000000ff},
+	{{ 1.0f,  0.0f, 0.9f}, 0x000000ff},
+	{{ 1.0f, -1.0f, 0.9f}, 0x000000ff},
+
+	{{ 0.0f,  0.0f, 0.4f}, 0x000000ff},
+	{{ 0.0f,  1.0f, 0.4f}, 0x000000ff},
+	{{ 1.0f,  1.0f, 0.4f}, 0x000000ff},
+	{{ 1.0f,  0.0f, 0.4f}, 0x000000ff},
+
+	{{-1.0f,  0.0f, 0.7f}, 0x000000ff},
+	{{-1.0f,  1.0f, 0.7f}, 0x000000ff},
+	{{ 0.0f,  1.0f, 0.7f}, 0x000000ff},
+	{{ 0.0f,  0.0f, 0.7f}, 0x000000ff},
+};
+static const D3DMATRIX ident_mat =
+{ {{
+	1.0f, 0.0f,  0.0f, 0.0f,
+	0.0f, 1.0f,  0.0f, 0.0f,
+	0.0f, 0.0f,  1.0f, 0.0f,
+	0.0f, 0.0f,  0.0f, 1.0f
+}} };
+static const D3DMATRIX world_mat1 =
+{ {{
+	1.0f, 0.0f,  0.0f, 0.0f,
+	0.0f, 1.0f,  0.0f, 0.0f,
+	0.0f, 0.0f,  1.0f, 0.0f,
+	0.0f, 0.0f, -0.5f, 1.0f
+}} };
+static const D3DMATRIX world_mat2 =
+{ {{
+	1.0f, 0.0f,  0.0f, 0.0f,
+	0.0f, 1.0f,  0.0f, 0.0f,
+	0.0f, 0.0f,  1.0f, 0.0f,
+	0.0f, 0.0f,  1.0f, 1.0f
+}} };
+static const D3DMATRIX proj_mat =
+{ {{
+	1.0f, 0.0f,  0.0f, 0.0f,
+	0.0f, 1.0f,  0.0f, 0.0f,
+	0.0f, 0.0f,  1.0f, 0.0f,
+	0.0f, 0.0f, -1.0f, 1.0f
+}} };
+static const WORD Indices[] = { 0, 1, 2, 2, 3, 0 };
+static const WORD Indices2[] =
+{
+	 0,  1,  2,  2,  3,  0,
+	 4,  5,  6,  6,  7,  4,
+	 8,  9, 10, 10, 11,  8,
+	12, 13, 14, 14, 15, 12,
+};
+
+/* The state each case starts from: no lighting or depth test, green fog,
+ * an identity projection, and the given fog modes and range. */
+static void fog_set_states(struct up_batcher *batcher, D3DFOGMODE table_mode, D3DFOGMODE vertex_mode,
+		float start, float end)
+{
+	HRESULT hr;
+
+	hr = up_batcher_set_render_state(batcher, D3DRS_ZENABLE, FALSE);
 	ok(SUCCEEDED(hr), "Failed to disable D3DRS_ZENABLE, hr %#x.\n", hr);
-	hr = IDirect3DDevice9_SetRenderState(device, D3DRS_LIGHTING, FALSE);
+	hr = up_batcher_set_render_state(batcher, D3DRS_LIGHTING, FALSE);
 	ok(hr == D3D_OK, "Turning off lighting returned %08x\n", hr);
-	hr = IDirect3DDevice9_SetRenderState(device, D3DRS_FOGENABLE, TRUE);
+	hr = up_batcher_set_render_state(batcher, D3DRS_FOGENABLE, TRUE);
 	ok(hr == D3D_OK, "Turning on fog calculations returned %08x\n", hr);
-	hr = IDirect3DDevice9_SetRenderState(device, D3DRS_FOGCOLOR, 0xff00ff00 /* A nice green */);
+	hr = up_batcher_set_render_state(batcher, D3DRS_FOGCOLOR, 0xff00ff00 /* A nice green */);
 	ok(hr == D3D_OK, "Setting fog color returned %#08x\n", hr);
 	/* Some of the tests seem to depend on the projection matrix explicitly
 	 * being set to an identity matrix, even though that's the default.
 	 * (AMD Radeon HD 6310, Windows 7) */
-	hr = IDirect3DDevice9_SetTransform(device, D3DTS_PROJECTION, &ident_mat);
+	hr = up_batcher_set_transform(batcher, D3DTS_PROJECTION, &ident_mat);
 	ok(SUCCEEDED(hr), "Failed to set projection transform, hr %#x.\n", hr);
-
-	/* First test: Both table fog and vertex fog off */
-	hr = IDirect3DDevice9_SetRenderState(device, D3DRS_FOGTABLEMODE, D3DFOG_NONE);
-	ok(hr == D3D_OK, "Turning off table fog returned %08x\n", hr);
-	hr = IDirect3DDevice9_SetRenderState(device, D3DRS_FOGVERTEXMODE, D3DFOG_NONE);
-	ok(hr == D3D_OK, "Turning off vertex fog returned %08x\n", hr);
-
-	/* Start = 0, end = 1. Should be default, but set them */
-	hr = IDirect3DDevice9_SetRenderState(device, D3DRS_FOGSTART, *((DWORD*)&start));
+	hr = up_batcher_set_render_state(batcher, D3DRS_FOGTABLEMODE, table_mode);
+	ok(hr == D3D_OK, "Setting the fog table mode returned %08x\n", hr);
+	hr = up_batcher_set_render_state(batcher, D3DRS_FOGVERTEXMODE, vertex_mode);
+	ok(hr == D3D_OK, "Setting the fog vertex mode returned %08x\n", hr);
+	hr = up_batcher_set_render_state(batcher, D3DRS_FOGSTART, *((DWORD*)&start));
 	ok(hr == D3D_OK, "Setting fog start returned %08x\n", hr);
-	hr = IDirect3DDevice9_SetRenderState(device, D3DRS_FOGEND, *((DWORD*)&end));
+	hr = up_batcher_set_render_state(batcher, D3DRS_FOGEND, *((DWORD*)&end));
 	ok(hr == D3D_OK, "Setting fog end returned %08x\n", hr);
+}
+
+/* Table fog and vertex fog off, then on, with untransformed and transformed
+ * vertices. */
+static void test_fog_table_and_vertex(struct test_context *context, const void *param)
+{
+	const D3DCAPS9 *caps = &context->caps;
+	struct up_batcher *batcher = context->batcher;
+	IDirect3DDevice9 *device = context->device;
+	/* Start = 0, end = 1. Should be default, but set them */
+	float start = 0.0f, end = 1.0f;
+	struct fog_case fog_case;
+	D3DCOLOR color;
+	HRESULT hr;
+
+	hr = up_batcher_clear(batcher, 0, NULL, D3DCLEAR_TARGET, 0xffff00ff, 0.0, 0);
+	ok(hr == D3D_OK, "IDirect3DDevice9_Clear returned %08x\n", hr);
+	/* First test: Both table fog and vertex fog off */
+	fog_set_states(batcher, D3DFOG_NONE, D3DFOG_NONE, start, end);
 
 	hr = IDirect3DDevice9_BeginScene(device);
 	ok(SUCCEEDED(hr), "Failed to begin scene, hr %#x.\n", hr);
 
-	hr = IDirect3DDevice9_SetFVF(device, D3DFVF_XYZ | D3DFVF_DIFFUSE | D3DFVF_SPECULAR);
+	hr = up_batcher_set_fvf(batcher, D3DFVF_XYZ | D3DFVF_DIFFUSE | D3DFVF_SPECULAR);
 	ok(SUCCEEDED(hr), "Failed to set FVF, hr %#x.\n", hr);
 
 	/* Untransformed, vertex fog = NONE, table fog = NONE:
 	 * Read the fog weighting from the specular color. */
-	hr = IDirect3DDevice9_DrawIndexedPrimitiveUP(device, D3DPT_TRIANGLELIST, 0 /* MinIndex */, 4 /* NumVerts */,
+	hr = up_batcher_draw_indexed_primitive_up(batcher, D3DPT_TRIANGLELIST, 0 /* MinIndex */, 4 /* NumVerts */,
 		2 /* PrimCount */, Indices, D3DFMT_INDEX16, untransformed_1, sizeof(untransformed_1[0]));
 	ok(SUCCEEDED(hr), "Failed to draw, hr %#x.\n", hr);
 
 	/* That makes it use the Z value */
-	hr = IDirect3DDevice9_SetRenderState(device, D3DRS_FOGVERTEXMODE, D3DFOG_LINEAR);
+	hr = up_batcher_set_render_state(batcher, D3DRS_FOGVERTEXMODE, D3DFOG_LINEAR);
 	ok(SUCCEEDED(hr), "Failed to set D3DFOG_LINEAR fog vertex mode, hr %#x.\n", hr);
 	/* Untransformed, vertex fog != none (or table fog != none):
 	 * Use the Z value as input into the equation. */
-	hr = IDirect3DDevice9_DrawIndexedPrimitiveUP(device, D3DPT_TRIANGLELIST, 0 /* MinIndex */, 4 /* NumVerts */,
+	hr = up_batcher_draw_indexed_primitive_up(batcher, D3DPT_TRIANGLELIST, 0 /* MinIndex */, 4 /* NumVerts */,
 		2 /* PrimCount */, Indices, D3DFMT_INDEX16, untransformed_2, sizeof(untransformed_2[0]));
 	ok(SUCCEEDED(hr), "Failed to draw, hr %#x.\n", hr);
 
 	/* transformed verts */
-	hr = IDirect3DDevice9_SetFVF(device, D3DFVF_XYZRHW | D3DFVF_DIFFUSE | D3DFVF_SPECULAR);
+	hr = up_batcher_set_fvf(batcher, D3DFVF_XYZRHW | D3DFVF_DIFFUSE | D3DFVF_SPECULAR);
 	ok(SUCCEEDED(hr), "Failed to set FVF, hr %#x.\n", hr);
 	/* Transformed, vertex fog != NONE, pixel fog == NONE:
 	 * Use specular color alpha component. */
-	hr = IDirect3DDevice9_DrawIndexedPrimitiveUP(device, D3DPT_TRIANGLELIST, 0 /* MinIndex */, 4 /* NumVerts */,
+	hr = up_batcher_draw_indexed_primitive_up(batcher, D3DPT_TRIANGLELIST, 0 /* MinIndex */, 4 /* NumVerts */,
 		2 /* PrimCount */, Indices, D3DFMT_INDEX16, transformed_1, sizeof(transformed_1[0]));
 	ok(SUCCEEDED(hr), "Failed to draw, hr %#x.\n", hr);
 
-	hr = IDirect3DDevice9_SetRenderState(device, D3DRS_FOGTABLEMODE, D3DFOG_LINEAR);
+	hr = up_batcher_set_render_state(batcher, D3DRS_FOGTABLEMODE, D3DFOG_LINEAR);
 	ok(SUCCEEDED(hr), "Failed to set D3DFOG_LINEAR fog table mode, hr %#x.\n", hr);
 	/* Transformed, table fog != none, vertex anything:
 	 * Use Z value as input to the fog equation. */
-	hr = IDirect3DDevice9_DrawIndexedPrimitiveUP(device, D3DPT_TRIANGLELIST, 0 /* MinIndex */, 4 /* NumVerts */,
+	hr = up_batcher_draw_indexed_primitive_up(batcher, D3DPT_TRIANGLELIST, 0 /* MinIndex */, 4 /* NumVerts */,
 		2 /* PrimCount */, Indices, D3DFMT_INDEX16, transformed_2, sizeof(transformed_2[0]));
 	ok(SUCCEEDED(hr), "Failed to draw, hr %#x.\n", hr);
 
-	hr = IDirect3DDevice9_EndScene(device);
+	hr = up_batcher_end_scene(batcher);
 	ok(hr == D3D_OK, "EndScene returned %08x\n", hr);
 
+	fog_test_case(&fog_case, caps, D3DFOG_NONE, D3DFOG_NONE, start, end, FOG_SOURCE_FIXED_FUNCTION, 0.1f);
 	color = getPixelColor(device, 160, 360);
-	ok(color == 0x00ff0000, "Untransformed vertex with no table or vertex fog has color %08x\n", color);
+	ok(color == fogged_color(&fog_case, 0x00ff0000),
+			"Untransformed vertex with no table or vertex fog has color %08x\n", color);
+	fog_test_case(&fog_case, caps, D3DFOG_NONE, D3DFOG_LINEAR, start, end, FOG_SOURCE_FIXED_FUNCTION, 1.0f);
 	color = getPixelColor(device, 160, 120);
-	ok(color_match(color, 0x0000ff00, 1), "Untransformed vertex with linear vertex fog has color %08x\n", color);
+	ok(color_match(color, fogged_color(&fog_case, 0x00ff0000), 1),
+			"Untransformed vertex with linear vertex fog has color %08x\n", color);
+	fog_test_case(&fog_case, caps, D3DFOG_NONE, D3DFOG_LINEAR, start, end, FOG_SOURCE_PRETRANSFORMED, 1.0f);
 	color = getPixelColor(device, 480, 120);
-	ok(color == 0x00ffff00, "Transformed vertex with linear vertex fog has color %08x\n", color);
-	if (caps.RasterCaps & D3DPRASTERCAPS_FOGTABLE)
+	ok(color == fogged_color(&fog_case, 0x00ffff00), "Transformed vertex with linear vertex fog has color %08x\n", color);
+	if (caps->RasterCaps & D3DPRASTERCAPS_FOGTABLE)
 	{
+		fog_test_case(&fog_case, caps, D3DFOG_LINEAR, D3DFOG_LINEAR, start, end, FOG_SOURCE_PRETRANSFORMED, 1.0f);
+		fog_case.w_fog = fog_projection_uses_w(&ident_mat);
 		color = getPixelColor(device, 480, 360);
-		ok(color_match(color, 0x0000ff00, 1), "Transformed vertex with linear table fog has color %08x\n", color);
+		ok(color_match(color, fogged_color(&fog_case, 0x00ffff00), 1),
+				"Transformed vertex with linear table fog has color %08x\n", color);
 	}
 	else
 	{
@@ -401,31 +617,32 @@ int main(int argc, char* argv[]) {
 		 * The settings above result in no fogging with vertex fog
 		 */
 		color = getPixelColor(device, 480, 120);
-		ok(color == 0x00ffff00, "Transformed vertex with linear vertex fog has color %08x\n", color);
+		ok(color == fogged_color(&fog_case, 0x00ffff00), "Transformed vertex with linear vertex fog has color %08x\n", color);
 		trace("Info: Table fog not supported by this device\n");
 	}
 	IDirect3DDevice9_Present(device, NULL, NULL, NULL, NULL);
+}
 
-	/* Now test the special case fogstart == fogend */
-	hr = IDirect3DDevice9_Clear(device, 0, NULL, D3DCLEAR_TARGET, 0xff0000ff, 0.0, 0);
+/* The special case fogstart == fogend. */
+static void test_fog_start_equals_end(struct test_context *context, const void *param)
+{
+	const D3DCAPS9 *caps = &context->caps;
+	struct up_batcher *batcher = context->batcher;
+	IDirect3DDevice9 *device = context->device;
+	float start = 512.0f, end = 512.0f;
+	struct fog_case fog_case;
+	D3DCOLOR color;
+	HRESULT hr;
+
+	hr = up_batcher_clear(batcher, 0, NULL, D3DCLEAR_TARGET, 0xff0000ff, 0.0, 0);
 	ok(hr == D3D_OK, "IDirect3DDevice9_Clear returned %08x\n", hr);
+	fog_set_states(batcher, D3DFOG_NONE, D3DFOG_LINEAR, start, end);
 
 	hr = IDirect3DDevice9_BeginScene(device);
 	ok(SUCCEEDED(hr), "Failed to begin scene, hr %#x.\n", hr);
 
-	start = 512;
-	end = 512;
-	hr = IDirect3DDevice9_SetRenderState(device, D3DRS_FOGSTART, *((DWORD*)&start));
-	ok(SUCCEEDED(hr), "Failed to set fog start, hr %#x.\n", hr);
-	hr = IDirect3DDevice9_SetRenderState(device, D3DRS_FOGEND, *((DWORD*)&end));
-	ok(SUCCEEDED(hr), "Failed to set fog end, hr %#x.\n", hr);
-
-	hr = IDirect3DDevice9_SetFVF(device, D3DFVF_XYZ | D3DFVF_DIFFUSE | D3DFVF_SPECULAR);
+	hr = up_batcher_set_fvf(batcher, D3DFVF_XYZ | D3DFVF_DIFFUSE | D3DFVF_SPECULAR);
 	ok(SUCCEEDED(hr), "Failed to set FVF, hr %#x.\n", hr);
-	hr = IDirect3DDevice9_SetRenderState(device, D3DRS_FOGVERTEXMODE, D3DFOG_LINEAR);
-	ok(SUCCEEDED(hr), "Failed to set D3DFOG_LINEAR fog vertex mode, hr %#x.\n", hr);
-	hr = IDirect3DDevice9_SetRenderState(device, D3DRS_FOGTABLEMODE, D3DFOG_NONE);
-	ok(SUCCEEDED(hr), "Failed to set D3DFOG_NONE fog table mode, hr %#x.\n", hr);
 
 	/* Untransformed vertex, z coord = 0.1, fogstart = 512, fogend = 512.
 	 * Would result in a completely fog-free primitive because start > zcoord,
@@ -433,108 +650,145 @@ int main(int argc, char* argv[]) {
 	 * same happens to the 2nd untransformed quad with z = 1.0. The third
 	 * transformed quad remains unfogged because the fogcoords are read from
 	 * the specular color and has fixed fogstart and fogend. */
-	hr = IDirect3DDevice9_DrawIndexedPrimitiveUP(device, D3DPT_TRIANGLELIST, 0 /* MinIndex */, 4 /* NumVerts */,
+	hr = up_batcher_draw_indexed_primitive_up(batcher, D3DPT_TRIANGLELIST, 0 /* MinIndex */, 4 /* NumVerts */,
 		2 /* PrimCount */, Indices, D3DFMT_INDEX16, untransformed_1, sizeof(untransformed_1[0]));
 	ok(SUCCEEDED(hr), "Failed to draw, hr %#x.\n", hr);
-	hr = IDirect3DDevice9_DrawIndexedPrimitiveUP(device, D3DPT_TRIANGLELIST, 0 /* MinIndex */, 4 /* NumVerts */,
+	hr = up_batcher_draw_indexed_primitive_up(batcher, D3DPT_TRIANGLELIST, 0 /* MinIndex */, 4 /* NumVerts */,
 		2 /* PrimCount */, Indices, D3DFMT_INDEX16, untransformed_2, sizeof(untransformed_2[0]));
 	ok(SUCCEEDED(hr), "Failed to draw, hr %#x.\n", hr);
 
-	hr = IDirect3DDevice9_SetFVF(device, D3DFVF_XYZRHW | D3DFVF_DIFFUSE | D3DFVF_SPECULAR);
+	hr = up_batcher_set_fvf(batcher, D3DFVF_XYZRHW | D3DFVF_DIFFUSE | D3DFVF_SPECULAR);
 	ok(SUCCEEDED(hr), "Failed to set FVF, hr %#x.\n", hr);
 	/* Transformed, vertex fog != NONE, pixel fog == NONE:
 	 * Use specular color alpha component. */
-	hr = IDirect3DDevice9_DrawIndexedPrimitiveUP(device, D3DPT_TRIANGLELIST, 0 /* MinIndex */, 4 /* NumVerts */,
+	hr = up_batcher_draw_indexed_primitive_up(batcher, D3DPT_TRIANGLELIST, 0 /* MinIndex */, 4 /* NumVerts */,
 		2 /* PrimCount */, Indices, D3DFMT_INDEX16, transformed_1, sizeof(transformed_1[0]));
 	ok(SUCCEEDED(hr), "Failed to draw, hr %#x.\n", hr);
 
-	hr = IDirect3DDevice9_EndScene(device);
+	hr = up_batcher_end_scene(batcher);
 	ok(SUCCEEDED(hr), "Failed to end scene, hr %#x.\n", hr);
 
+	fog_test_case(&fog_case, caps, D3DFOG_NONE, D3DFOG_LINEAR, start, end, FOG_SOURCE_FIXED_FUNCTION, 0.1f);
 	color = getPixelColor(device, 160, 360);
-	ok(color_match(color, 0x0000ff00, 1), "Untransformed vertex with vertex fog and z = 0.1 has color %08x\n", color);
+	ok(color_match(color, fogged_color(&fog_case, 0x00ff0000), 1),
+			"Untransformed vertex with vertex fog and z = 0.1 has color %08x\n", color);
+	fog_case.eye_z = fog_case.z = 1.0f;
 	color = getPixelColor(device, 160, 120);
-	ok(color_match(color, 0x0000ff00, 1), "Untransformed vertex with vertex fog and z = 1.0 has color %08x\n", color);
+	ok(color_match(color, fogged_color(&fog_case, 0x00ff0000), 1),
+			"Untransformed vertex with vertex fog and z = 1.0 has color %08x\n", color);
+	fog_test_case(&fog_case, caps, D3DFOG_NONE, D3DFOG_LINEAR, start, end, FOG_SOURCE_PRETRANSFORMED, 1.0f);
 	color = getPixelColor(device, 480, 120);
-	ok(color == 0x00ffff00, "Transformed vertex with linear vertex fog has color %08x\n", color);
+	ok(color == fogged_color(&fog_case, 0x00ffff00), "Transformed vertex with linear vertex fog has color %08x\n", color);
 	IDirect3DDevice9_Present(device, NULL, NULL, NULL, NULL);
+}
 
-	/* Test "reversed" fog without shaders. With shaders this fails on a few Windows D3D implementations,
-	 * but without shaders it seems to work everywhere
-	 */
-	end = 0.2f;
-	start = 0.8f;
-	hr = IDirect3DDevice9_SetRenderState(device, D3DRS_FOGSTART, *((DWORD*)&start));
-	ok(hr == D3D_OK, "Setting fog start returned %08x\n", hr);
-	hr = IDirect3DDevice9_SetRenderState(device, D3DRS_FOGEND, *((DWORD*)&end));
-	ok(hr == D3D_OK, "Setting fog end returned %08x\n", hr);
-	hr = IDirect3DDevice9_SetFVF(device, D3DFVF_XYZ | D3DFVF_DIFFUSE);
-	ok(hr == D3D_OK, "IDirect3DDevice9_SetFVF returned %08x\n", hr);
+/* Test "reversed" fog without shaders. With shaders this fails on a few Windows D3D implementations,
+ * but without shaders it seems to work everywhere. ATI cards have problems with reversed fog and
+ * shaders, so it doesn't seem very important for games. param: TRUE for table fog.
+ */
+static void test_fog_reversed(struct test_context *context, const void *param)
+{
+	BOOL table = !!param;
+	const char *mode = (table ? "table" : "vertex");
+	D3DFOGMODE table_mode = table ? D3DFOG_LINEAR : D3DFOG_NONE, vertex_mode = table ? D3DFOG_NONE : D3DFOG_LINEAR;
+	const D3DCAPS9 *caps = &context->caps;
+	struct up_batcher *batcher = context->batcher;
+	IDirect3DDevice9 *device = context->device;
+	float start = 0.8f, end = 0.2f;
+	struct fog_case fog_case;
+	D3DCOLOR color, expected;
+	HRESULT hr;
 
-	MSG msg;
-	ZeroMemory(&msg, sizeof(MSG));
-	static float lastTime = (float)timeGetTime();
-	while (msg.message != WM_QUIT)
+	if (table && !(caps->RasterCaps & D3DPRASTERCAPS_FOGTABLE))
 	{
-		if (PeekMessage(&msg, 0, 0, 0, PM_REMOVE))
-		{
-			TranslateMessage(&msg);
-			DispatchMessage(&msg);
-		}
-		else
-		{
-			float currTime = (float)timeGetTime();
-			float timeDelta = (currTime - lastTime) * 0.001f;
+		skip("D3DPRASTERCAPS_FOGTABLE not supported, skipping reversed table fog test\n");
+		return;
+	}
 
-	/* Test reversed fog without shaders. ATI cards have problems with reversed fog and shaders, so
-	 * it doesn't seem very important for games. ATI cards also have problems with reversed table fog,
-	 * so skip this for now
-	 */
-	for(i = 0; i < 2 /*2 - Table fog test disabled, fails on ATI */; i++) {
-		const char *mode = (i ? "table" : "vertex");
-		hr = IDirect3DDevice9_Clear(device, 0, NULL, D3DCLEAR_TARGET, 0xffff0000, 0.0, 0);
-		ok(hr == D3D_OK, "IDirect3DDevice9_Clear returned %08x\n", hr);
-		hr = IDirect3DDevice9_SetRenderState(device, D3DRS_FOGVERTEXMODE, i == 0 ? D3DFOG_LINEAR : D3DFOG_NONE);
-		ok( hr == D3D_OK, "IDirect3DDevice9_SetRenderState returned %08x\n", hr);
-		hr = IDirect3DDevice9_SetRenderState(device, D3DRS_FOGTABLEMODE, i == 0 ? D3DFOG_NONE : D3DFOG_LINEAR);
-		ok( hr == D3D_OK, "IDirect3DDevice9_SetRenderState returned %08x\n", hr);
-		hr = IDirect3DDevice9_BeginScene(device);
-		ok(SUCCEEDED(hr), "Failed to begin scene, hr %#x.\n", hr);
-		hr = IDirect3DDevice9_DrawIndexedPrimitiveUP(device, D3DPT_TRIANGLELIST, 0 /* MinIndex */, 16 /* NumVerts */,
-				8 /* PrimCount */, Indices2, D3DFMT_INDEX16, rev_fog_quads, sizeof(rev_fog_quads[0]));
-		ok(SUCCEEDED(hr), "Failed to draw, hr %#x.\n", hr);
-		hr = IDirect3DDevice9_EndScene(device);
-		ok(SUCCEEDED(hr), "Failed to end scene, hr %#x.\n", hr);
+	hr = up_batcher_clear(batcher, 0, NULL, D3DCLEAR_TARGET, 0xffff0000, 0.0, 0);
+	ok(hr == D3D_OK, "IDirect3DDevice9_Clear returned %08x\n", hr);
+	fog_set_states(batcher, table_mode, vertex_mode, start, end);
+	hr = up_batcher_set_fvf(batcher, D3DFVF_XYZ | D3DFVF_DIFFUSE);
+	ok(hr == D3D_OK, "IDirect3DDevice9_SetFVF returned %08x\n", hr);
+	hr = IDirect3DDevice9_BeginScene(device);
+	ok(SUCCEEDED(hr), "Failed to begin scene, hr %#x.\n", hr);
+	hr = up_batcher_draw_indexed_primitive_up(batcher, D3DPT_TRIANGLELIST, 0 /* MinIndex */, 16 /* NumVerts */,
+			8 /* PrimCount */, Indices2, D3DFMT_INDEX16, rev_fog_quads, sizeof(rev_fog_quads[0]));
+	ok(SUCCEEDED(hr), "Failed to draw, hr %#x.\n", hr);
+	hr = up_batcher_end_scene(batcher);
+	ok(SUCCEEDED(hr), "Failed to end scene, hr %#x.\n", hr);
+
+	fog_test_case(&fog_case, caps, table_mode, vertex_mode, start, end, FOG_SOURCE_FIXED_FUNCTION, 0.1f);
+	expected = fogged_color(&fog_case, 0x000000ff);
+	color = getPixelColor(device, 160, 360);
+	ok(color_match(color, expected, 1),
+			"Reversed %s fog: z=0.1 has color 0x%08x, expected 0x%08x\n", mode, color, expected);
 
-		color = getPixelColor(device, 160, 360);
-		ok(color_match(color, 0x0000ff00, 1),
-				"Reversed %s fog: z=0.1 has color 0x%08x, expected 0x0000ff00 or 0x0000fe00\n", mode, color);
+	fog_case.eye_z = fog_case.z = 0.7f;
+	expected = fogged_color(&fog_case, 0x000000ff);
+	color = getPixelColor(device, 160, 120);
+	ok(color_match(color, expected, 2),
+			"Reversed %s fog: z=0.7 has color 0x%08x, expected 0x%08x\n", mode, color, expected);
 
-		color = getPixelColor(device, 160, 120);
-		ok(color_match(color, D3DCOLOR_ARGB(0x00, 0x00, 0x2b, 0xd4), 2),
-				"Reversed %s fog: z=0.7 has color 0x%08x\n", mode, color);
+	fog_case.eye_z = fog_case.z = 0.4f;
+	expected = fogged_color(&fog_case, 0x000000ff);
+	color = getPixelColor(device, 480, 120);
+	ok(color_match(color, expected, 2),
+			"Reversed %s fog: z=0.4 has color 0x%08x, expected 0x%08x\n", mode, color, expected);
 
-		color = getPixelColor(device, 480, 120);
-		ok(color_match(color, D3DCOLOR_ARGB(0x00, 0x00, 0xaa, 0x55), 2),
-				"Reversed %s fog: z=0.4 has color 0x%08x\n", mode, color);
+	fog_case.eye_z = fog_case.z = 0.9f;
+	expected = fogged_color(&fog_case, 0x000000ff);
+	color = getPixelColor(device, 480, 360);
+	ok(color == expected, "Reversed %s fog: z=0.9 has color 0x%08x, expected 0x%08x\n", mode, color, expected);
 
-		color = getPixelColor(device, 480, 360);
-		ok(color == 0x000000ff, "Reversed %s fog: z=0.9 has color 0x%08x, expected 0x000000ff\n", mode, color);
+	IDirect3DDevice9_Present(device, NULL, NULL, NULL, NULL);
+}
 
-		IDirect3DDevice9_Present(device, NULL, NULL, NULL, NULL);
+static unsigned int sweep_cases = 100000, sweep_seed = 1;
 
-		if(!(caps.RasterCaps & D3DPRASTERCAPS_FOGTABLE)) {
-			skip("D3DPRASTERCAPS_FOGTABLE not supported, skipping reversed table fog test\n");
-			break;
-		}
-	}
+static void test_fog_sweep(struct test_context *context, const void *param)
+{
+	fog_set_states(context->batcher, D3DFOG_NONE, D3DFOG_NONE, 0.0f, 1.0f);
+	fog_sweep(context->device, context->batcher, &context->caps, sweep_cases, sweep_seed);
+}
 
-			lastTime = currTime;
+// main ... The main function, right now it just calls the initialization of SDL.
+int main(int argc, char* argv[]) {
+
+	static const BOOL reversed_table = TRUE;
+	static struct test_case cases[] =
+	{
+		{"fog/table_and_vertex", test_fog_table_and_vertex, NULL},
+		{"fog/start_equals_end", test_fog_start_equals_end, NULL},
+		{"fog/reversed_vertex", test_fog_reversed, NULL},
+		{"fog/reversed_table", test_fog_reversed, &reversed_table},
+		{"fog/sweep", test_fog_sweep, NULL},
+	};
+	static const char *const options[] = {"--sweep", "--sweep=", "--seed=", NULL};
+	struct test_suite suite;
+	BOOL sweep = FALSE;
+	int i;
+
+	/* --sweep[=cases]: the randomized fog sweep instead of the tests.
+	 * --seed=n: sweep seed, to reproduce a failure. */
+	for (i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--sweep"))
+			sweep = TRUE;
+		else if (!strncmp(argv[i], "--sweep=", 8))
+		{
+			sweep = TRUE;
+			sweep_cases = strtoul(argv[i] + 8, NULL, 10);
 		}
+		else if (!strncmp(argv[i], "--seed=", 7))
+			sweep_seed = strtoul(argv[i] + 7, NULL, 10);
 	}
 
-done:
-	IDirect3D9_Release(d3d);
-	DestroyWindow(window);
-	return 0;
+	suite.name = "d3d9_fog_test";
+	suite.setup = NULL;
+	suite.teardown = NULL;
+	suite.cases = sweep ? &cases[ARRAY_SIZE(cases) - 1] : cases;
+	suite.case_count = sweep ? 1 : ARRAY_SIZE(cases) - 1;
+	suite.options = options;
+	return test_runner_main(&suite, argc, argv);
 }
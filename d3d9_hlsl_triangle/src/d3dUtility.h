@@ -34,7 +34,7 @@ namespace d3d
 		WPARAM wParam,
 		LPARAM lParam);
 
-	template<class T> void Release(T t)
+	template<class T> void Release(T& t)
 	{
 		if( t )
 		{
@@ -43,7 +43,7 @@ namespace d3d
 		}
 	}
 		
-	template<class T> void Delete(T t)
+	template<class T> void Delete(T& t)
 	{
 		if( t )
 		{
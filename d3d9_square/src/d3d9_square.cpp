@@ -3,11 +3,12 @@
 #include <string.h>
 #include <stdio.h>
 
+#include "fog_model.h"
+#include "test_log.h"
+#include "test_runner.h"
+#include "up_batcher.h"
+
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof(*(a)))
-#define ok(c, ...) {{if (!(c)) fprintf(stdout, "fail %s ", __func__); else fprintf(stdout, "succ %s ", __func__); fprintf(stdout, __VA_ARGS__);}}
-#define skip(...) {fprintf(stdout, "skip "); fprintf(stdout, __VA_ARGS__);}
-#define win_skip(...) {fprintf(stdout, "skip "); fprintf(stdout, __VA_ARGS__);}
-#define trace(...) {fprintf(stdout, "trace ");fprintf(stdout, __VA_ARGS__);}
 
 struct vec3
 {
@@ -34,18 +35,6 @@ static BOOL color_match(D3DCOLOR c1, D3DCOLOR c2, BYTE max_diff)
 		&& compare_uint((c1 >> 24) & 0xff, (c2 >> 24) & 0xff, max_diff);
 }
 
-static HWND create_window(void)
-{
-	HWND hwnd;
-	RECT rect;
-
-	SetRect(&rect, 0, 0, 640, 480);
-	AdjustWindowRect(&rect, WS_OVERLAPPEDWINDOW | WS_VISIBLE, FALSE);
-	hwnd = CreateWindowA("static", "d3d9_test", WS_OVERLAPPEDWINDOW | WS_VISIBLE,
-		0, 0, rect.right - rect.left, rect.bottom - rect.top, 0, 0, 0, 0);
-	return hwnd;
-}
-
 struct surface_readback
 {
 	IDirect3DSurface9* surface;
@@ -137,358 +126,407 @@ static DWORD getPixelColor(IDirect3DDevice9* device, UINT x, UINT y)
 	return ret;
 }
 
-static IDirect3DDevice9* create_device(IDirect3D9* d3d, HWND device_window, HWND focus_window, BOOL windowed)
+/* Fog state at the pixel in the middle of the quad, halfway along the v1 - v2
+ * diagonal: the average of those two vertices. Returns FALSE if the quad is
+ * clipped there and the clear color stays. */
+static BOOL square_fog_case(int vshader, int pshader, const D3DMATRIX *proj, float z, float rhw,
+		unsigned int format_bits, float depth_bias, BOOL odepth_fog, struct fog_case *c)
 {
-	D3DPRESENT_PARAMETERS present_parameters = { 0 };
-	IDirect3DDevice9* device;
-
-	present_parameters.Windowed = windowed;
-	present_parameters.hDeviceWindow = device_window;
-	present_parameters.SwapEffect = D3DSWAPEFFECT_DISCARD;
-	present_parameters.BackBufferWidth = 640;
-	present_parameters.BackBufferHeight = 480;
-	present_parameters.BackBufferFormat = D3DFMT_A8R8G8B8;
-	present_parameters.EnableAutoDepthStencil = TRUE;
-	present_parameters.AutoDepthStencilFormat = D3DFMT_D24S8;
+	float clip_z, clip_w;
 
-	if (SUCCEEDED(IDirect3D9_CreateDevice(d3d, D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL, focus_window,
-		D3DCREATE_HARDWARE_VERTEXPROCESSING, &present_parameters, &device)))
-		return device;
+	fog_case_init(c);
+	c->table_mode = D3DFOG_LINEAR;
+	c->start = 0.0f;
+	c->end = 1.5f;
+	c->w_fog = fog_projection_uses_w(proj);
+	c->odepth_fog = odepth_fog && pshader == 2;
+	c->odepth = 0.5f;
 
-	return NULL;
-}
-
-// main ... The main function, right now it just calls the initialization of SDL.
-int main(int argc, char* argv[]) {
-	
-	IDirect3DVertexShader9* vertex_shader[2] = { NULL, NULL, };
-	IDirect3DPixelShader9* pixel_shader[3] = { NULL, NULL, NULL, };
-	float start = 0.0f, end = 1.5f;
-	HRESULT hr;
-	IDirect3DDevice9* device;
-	IDirect3D9* d3d;
-	IDirect3DSurface9* ds;
-	ULONG refcount;
-	HWND window;
-	D3DCOLOR color;
-	D3DCAPS9 caps;
-	/* basic vertex shader with reversed fog computation ("foggy") */
-	static const DWORD vertex_shader_code1[] =
-	{
-		0xfffe0101,                                                             /* vs_1_1                        */
-		0x0000001f, 0x80000000, 0x900f0000,                                     /* dcl_position v0               */
-		0x0000001f, 0x8000000a, 0x900f0001,                                     /* dcl_color0 v1                 */
-		0x00000051, 0xa00f0000, 0xbfa00000, 0x00000000, 0xbf666666, 0x00000000, /* def c0, -1.25, 0.0, -0.9, 0.0 */
-		0x00000001, 0xc00f0000, 0x90e40000,                                     /* mov oPos, v0                  */
-		0x00000001, 0xd00f0000, 0x90e40001,                                     /* mov oD0, v1                   */
-		0x00000002, 0x800f0000, 0x90aa0000, 0xa0aa0000,                         /* add r0, v0.z, c0.z            */
-		0x00000005, 0xc00f0001, 0x80000000, 0xa0000000,                         /* mul oFog, r0.x, c0.x          */
-		0x0000ffff
-	};
-	/* basic pixel shader */
-	static const DWORD pixel_shader_code1[] =
+	if (format_bits == D3DFVF_XYZRHW)
 	{
-		0xffff0101,                                                             /* ps_1_1     */
-		0x00000001, 0x800f0000, 0x90e40000,                                     /* mov r0, v0 */
-		0x0000ffff
-	};
-	static const DWORD pixel_shader_code2[] =
-	{
-		0xffff0200,                                                             /* ps_2_0                     */
-		0x05000051, 0xa00f0000, 0x3f000000, 0x00000000, 0x00000000, 0x00000000, /* def c0, 0.5, 0.0, 0.0, 0.0 */
-		0x0200001f, 0x80000000, 0x900f0000,                                     /* dcl v0                     */
-		0x02000001, 0x800f0800, 0x90e40000,                                     /* mov oC0, v0                */
-		0x02000001, 0x900f0800, 0xa0000000,                                     /* mov oDepth, c0.x           */
-		0x0000ffff
-	};
-	static struct
-	{
-		struct vec4 position;
-		D3DCOLOR diffuse;
+		c->source = FOG_SOURCE_PRETRANSFORMED;
+		c->z = 0.25f + z + depth_bias;
+		c->w = 1.0f / (0.45f + rhw);
+		return TRUE;
 	}
-	untransformed_q[] =
-	{
-		{ {160.0f, 120.0f, 0.0f, 0.0f}, 0xffff0000},
-		{ {480.0f, 120.0f, 0.0f, 0.0f}, 0xffff0000},
-		{ {160.0f, 360.0f, 0.0f, 0.0f}, 0xffff0000},
-		{ {480.0f, 360.0f, 0.0f, 0.0f}, 0xffff0000},
-	};
-	static struct
-	{
-		struct vec3 position;
-		D3DCOLOR diffuse;
-	}
-	transformed_q[] =
-	{
-		{{-0.5f,  0.5f, 0.0f}, 0xffff0000},
-		{{ 0.5f,  0.5f, 0.0f}, 0xffff0000},
-		{{-0.5f, -0.5f, 0.0f}, 0xffff0000},
-		{{ 0.5f, -0.5f, 0.0f}, 0xffff0000},
-	};
-
-	// projection matrix.
-	static const D3DMATRIX proj[] =
-	{
-	{{{
-		0.75f, 0.0f,  0.0f,   0.0f,
-		0.0f,  1.0f,  0.0f,   0.0f,
-		0.0f,  0.0f,  0.202f, 1.0f,
-		0.0f,  0.0f, -0.202f, 0.0f
-	}}},
-	{{{
-		1.5f,  0.0f,  0.0f,   0.0f,
-		0.0f,  2.0f,  0.0f,   0.0f,
-		0.0f,  0.0f,  0.404f, 2.0f,
-		0.0f,  0.0f, -0.404f, 0.0f
-	}}},
-	{{{
-		1.0f,  0.0f,  0.0f,  0.0f,
-		0.0f,  1.0f,  0.0f,  0.0f,
-		0.0f,  0.0f,  1.0f,  0.0f,
-		0.0f,  0.0f,  0.0f,  1.0f
-	}}},
-	};
-	union
-	{
-		float f;
-		DWORD d;
-	} conv;
 
-	static const struct
+	z += 0.25f;
+	if (vshader)
 	{
-		int vshader, pshader;
-		unsigned int matrix_id;
-		float z, rhw;
-		unsigned int format_bits;
-		D3DCOLOR color1, color2;
+		/* The shader passes the position through and writes reversed fog. */
+		c->source = FOG_SOURCE_VERTEX_SHADER;
+		c->ofog = (z - 0.9f) * -1.25f;
+		clip_z = z;
+		clip_w = 1.0f;
 	}
-	tests[] =
+	else
 	{
-		//0-9
-		{0, 0, 0, 0.2f, 0.2f, D3DFVF_XYZRHW, 0x0000ff00, 0x0000ff00},
-		{0, 0, 0, 0.2f, 0.2f, D3DFVF_XYZ,    0x000000ff, 0x000000ff},
-		{0, 0, 0, 1.2f, 1.2f, D3DFVF_XYZRHW, 0x00986700, 0x00986700},
-		{0, 0, 0, 1.2f, 1.2f, D3DFVF_XYZ,    0x0008f600, 0x0008f600},
-		{0, 0, 1, 0.2f, 0.2f, D3DFVF_XYZRHW, 0x0000ff00, 0x0000ff00},
-		{0, 0, 1, 0.2f, 0.2f, D3DFVF_XYZ,    0x000000ff, 0x000000ff},
-		{0, 0, 1, 1.2f, 1.2f, D3DFVF_XYZRHW, 0x00986700, 0x00986700},
-		{0, 0, 1, 1.2f, 1.2f, D3DFVF_XYZ,    0x0000ff00, 0x0000ff00},
-		{0, 0, 2, 0.2f, 0.2f, D3DFVF_XYZRHW, 0x00b24c00, 0x00b24c00},
-		{0, 0, 2, 0.2f, 0.2f, D3DFVF_XYZ,    0x00b24c00, 0x00b24c00},
-		//10-19
-		{0, 0, 2, 1.2f, 1.2f, D3DFVF_XYZRHW, 0x0008f600, 0x0008f600},
-		{0, 0, 2, 1.2f, 1.2f, D3DFVF_XYZ,    0x000000ff, 0x000000ff},
-		{0, 1, 0, 0.2f, 0.2f, D3DFVF_XYZRHW, 0x0000ff00, 0x0000ff00},
-		{0, 1, 0, 0.2f, 0.2f, D3DFVF_XYZ,    0x000000ff, 0x000000ff},
-		{0, 1, 0, 1.2f, 1.2f, D3DFVF_XYZRHW, 0x00986700, 0x00986700},
-		{0, 1, 0, 1.2f, 1.2f, D3DFVF_XYZ,    0x0008f600, 0x0008f600},
-		{0, 1, 1, 0.2f, 0.2f, D3DFVF_XYZRHW, 0x0000ff00, 0x0000ff00},
-		{0, 1, 1, 0.2f, 0.2f, D3DFVF_XYZ,    0x000000ff, 0x000000ff},
-		{0, 1, 1, 1.2f, 1.2f, D3DFVF_XYZRHW, 0x00986700, 0x00986700},
-		{0, 1, 1, 1.2f, 1.2f, D3DFVF_XYZ,    0x0000ff00, 0x0000ff00},
-		//20-29
-		{0, 1, 2, 0.2f, 0.2f, D3DFVF_XYZRHW, 0x00b24c00, 0x00b24c00},
-		{0, 1, 2, 0.2f, 0.2f, D3DFVF_XYZ,    0x00b24c00, 0x00b24c00},
-		{0, 1, 2, 1.2f, 1.2f, D3DFVF_XYZRHW, 0x0008f600, 0x0008f600},
-		{0, 1, 2, 1.2f, 1.2f, D3DFVF_XYZ,    0x000000ff, 0x000000ff},
-		{1, 0, 0, 0.2f, 0.2f, D3DFVF_XYZRHW, 0x0000ff00, 0x0000ff00},
-		{1, 0, 0, 0.2f, 0.2f, D3DFVF_XYZ,    0x0055aa00, 0x0055aa00},//has different color compared to version without ps/vs
-		{1, 0, 0, 1.2f, 1.2f, D3DFVF_XYZRHW, 0x00986700, 0x00986700},
-		{1, 0, 0, 1.2f, 1.2f, D3DFVF_XYZ,    0x000000ff, 0x000000ff},//has different color compared to version without ps/vs
-		{1, 0, 1, 0.2f, 0.2f, D3DFVF_XYZRHW, 0x0000ff00, 0x0000ff00},
-		{1, 0, 1, 0.2f, 0.2f, D3DFVF_XYZ,    0x0055aa00, 0x0055aa00},//has different color compared to version without ps/vs
-		//30-39
-		{1, 0, 1, 1.2f, 1.2f, D3DFVF_XYZRHW, 0x00986700, 0x00986700},
-		{1, 0, 1, 1.2f, 1.2f, D3DFVF_XYZ,    0x000000ff, 0x000000ff},//has different color compared to version without ps/vs
-		{1, 0, 2, 0.2f, 0.2f, D3DFVF_XYZRHW, 0x00b24c00, 0x00b24c00},
-		{1, 0, 2, 0.2f, 0.2f, D3DFVF_XYZ,    0x00b24c00, 0x00b24c00},
-		{1, 0, 2, 1.2f, 1.2f, D3DFVF_XYZRHW, 0x0008f600, 0x0008f600},
-		{1, 0, 2, 1.2f, 1.2f, D3DFVF_XYZ,    0x000000ff, 0x000000ff},
-		{1, 1, 0, 0.2f, 0.2f, D3DFVF_XYZRHW, 0x0000ff00, 0x0000ff00},
-		{1, 1, 0, 0.2f, 0.2f, D3DFVF_XYZ,    0x0055aa00, 0x0055aa00},//has different color compared to version without ps/vs
-		{1, 1, 0, 1.2f, 1.2f, D3DFVF_XYZRHW, 0x00986700, 0x00986700},
-		{1, 1, 0, 1.2f, 1.2f, D3DFVF_XYZ,    0x000000ff, 0x000000ff},//has different color compared to version without ps/vs
-		//40-43
-		{1, 1, 1, 0.2f, 0.2f, D3DFVF_XYZRHW, 0x0000ff00, 0x0000ff00},
-		{1, 1, 1, 0.2f, 0.2f, D3DFVF_XYZ,    0x0055aa00, 0x0055aa00},//has different color compared to version without ps/vs
-		{1, 1, 1, 1.2f, 1.2f, D3DFVF_XYZRHW, 0x00986700, 0x00986700},
-		{1, 1, 1, 1.2f, 1.2f, D3DFVF_XYZ,    0x000000ff, 0x000000ff},//has different color compared to version without ps/vs
-
-		//44-53 - will have depth bias of 0.2
-		//colors 44-47 was equal to 32-35, colors 48-53 was equal to 0-5
-		//depth bias changed color:
-		{1, 1, 2, 0.2f, 0.2f, D3DFVF_XYZRHW, 0x00906e00, 0x00906e00},
-		{1, 1, 2, 0.2f, 0.2f, D3DFVF_XYZ,    0x00906e00, 0x00906e00},
-		{1, 1, 2, 1.2f, 1.2f, D3DFVF_XYZRHW, 0x0000ff00, 0x0000ff00},
-		//depth bias did not change color:
-		{1, 1, 2, 1.2f, 1.2f, D3DFVF_XYZ,    0x000000ff, 0x000000ff},
-		{0, 2, 0, 0.2f, 0.2f, D3DFVF_XYZRHW, 0x0000ff00, 0x0000ff00},
-		{0, 2, 0, 0.2f, 0.2f, D3DFVF_XYZ,    0x000000ff, 0x000000ff},
-		{0, 2, 0, 1.2f, 1.2f, D3DFVF_XYZRHW, 0x00986700, 0x00986700},
-		{0, 2, 0, 1.2f, 1.2f, D3DFVF_XYZ,    0x0008f600, 0x0008f600},
-		{0, 2, 1, 0.2f, 0.2f, D3DFVF_XYZRHW, 0x0000ff00, 0x0000ff00},
-		{0, 2, 1, 0.2f, 0.2f, D3DFVF_XYZ,    0x000000ff, 0x000000ff},
-
-		//54-59
-		{0, 2, 1, 1.2f, 1.2f, D3DFVF_XYZRHW, 0x00986700, 0x00986700},
-		{0, 2, 1, 1.2f, 1.2f, D3DFVF_XYZ,    0x0000ff00, 0x0000ff00},
-		{0, 2, 2, 0.2f, 0.2f, D3DFVF_XYZRHW, 0x00b24c00, 0x00aa5500},//Radeon HD8400-left, Ivy Bridge GT1-right
-		{0, 2, 2, 0.2f, 0.2f, D3DFVF_XYZ,    0x00b24c00, 0x00aa5500},//Radeon HD8400-left, Ivy Bridge GT1-right
-		{0, 2, 2, 1.2f, 1.2f, D3DFVF_XYZRHW, 0x0008f600, 0x00aa5500},//Radeon HD8400-left, Ivy Bridge GT1-right
-		{0, 2, 2, 1.2f, 1.2f, D3DFVF_XYZ,    0x000000ff, 0x000000ff},
-		//60-69
-		{1, 2, 0, 0.2f, 0.2f, D3DFVF_XYZRHW, 0x0000ff00, 0x0000ff00},
-		{1, 2, 0, 0.2f, 0.2f, D3DFVF_XYZ,    0x0055aa00, 0x0055aa00},
-		{1, 2, 0, 1.2f, 1.2f, D3DFVF_XYZRHW, 0x00986700, 0x00986700},
-		{1, 2, 0, 1.2f, 1.2f, D3DFVF_XYZ,    0x000000ff, 0x000000ff},
-		{1, 2, 1, 0.2f, 0.2f, D3DFVF_XYZRHW, 0x0000ff00, 0x0000ff00},
-		{1, 2, 1, 0.2f, 0.2f, D3DFVF_XYZ,    0x0055aa00, 0x0055aa00},
-		{1, 2, 1, 1.2f, 1.2f, D3DFVF_XYZRHW, 0x00986700, 0x00986700},
-		{1, 2, 1, 1.2f, 1.2f, D3DFVF_XYZ,    0x000000ff, 0x000000ff},
-		{1, 2, 2, 0.2f, 0.2f, D3DFVF_XYZRHW, 0x00b24c00, 0x00aa5500},//Radeon HD8400-left, Ivy Bridge GT1-right
-		{1, 2, 2, 0.2f, 0.2f, D3DFVF_XYZ,    0x00b24c00, 0x00aa5500},//Radeon HD8400-left, Ivy Bridge GT1-right
-		//70-71
-		{1, 2, 2, 1.2f, 1.2f, D3DFVF_XYZRHW, 0x0008f600, 0x00aa5500},//Radeon HD8400-left, Ivy Bridge GT1-right
-		{1, 2, 2, 1.2f, 1.2f, D3DFVF_XYZ,    0x000000ff, 0x000000ff},
-	};
-	unsigned int i;
+		clip_z = z * proj->_33 + proj->_43;
+		clip_w = z * proj->_34 + proj->_44;
+	}
+	if (clip_w <= 0.0f || clip_z < 0.0f || clip_z > clip_w)
+		return FALSE;
+	c->z = clip_z / clip_w + depth_bias;
+	c->w = clip_w;
+	return TRUE;
+}
+
+/* basic vertex shader with reversed fog computation ("foggy") */
+static const DWORD vertex_shader_code1[] =
+{
+	0xfffe0101,                                                             /* vs_1_1                        */
+	0x0000001f, 0x80000000, 0x900f0000,                                     /* dcl_position v0               */
+	0x0000001f, 0x8000000a, 0x900f0001,                                     /* dcl_color0 v1                 */
+	0x00000051, 0xa00f0000, 0xbfa00000, 0x00000000, 0xbf666666, 0x00000000, /* def c0, -1.25, 0.0, -0.9, 0.0 */
+	0x00000001, 0xc00f0000, 0x90e40000,                                     /* mov oPos, v0                  */
+	0x00000001, 0xd00f0000, 0x90e40001,                                     /* mov oD0, v1                   */
+	0x00000002, 0x800f0000, 0x90aa0000, 0xa0aa0000,                         /* add r0, v0.z, c0.z            */
+	0x00000005, 0xc00f0001, 0x80000000, 0xa0000000,                         /* mul oFog, r0.x, c0.x          */
+	0x0000ffff
+};
+/* basic pixel shader */
+static const DWORD pixel_shader_code1[] =
+{
+	0xffff0101,                                                             /* ps_1_1     */
+	0x00000001, 0x800f0000, 0x90e40000,                                     /* mov r0, v0 */
+	0x0000ffff
+};
+static const DWORD pixel_shader_code2[] =
+{
+	0xffff0200,                                                             /* ps_2_0                     */
+	0x05000051, 0xa00f0000, 0x3f000000, 0x00000000, 0x00000000, 0x00000000, /* def c0, 0.5, 0.0, 0.0, 0.0 */
+	0x0200001f, 0x80000000, 0x900f0000,                                     /* dcl v0                     */
+	0x02000001, 0x800f0800, 0x90e40000,                                     /* mov oC0, v0                */
+	0x02000001, 0x900f0800, 0xa0000000,                                     /* mov oDepth, c0.x           */
+	0x0000ffff
+};
 
-	window = create_window();
-	d3d = Direct3DCreate9(D3D_SDK_VERSION);
-	ok(!!d3d, "Failed to create a D3D object.\n");
+struct square_untransformed_vertex
+{
+	struct vec4 position;
+	D3DCOLOR diffuse;
+};
 
-	if (!(device = create_device(d3d, window, window, TRUE)))
-	{
-		skip("Failed to create a D3D device, skipping tests.\n");
-		IDirect3D9_Release(d3d);
-		DestroyWindow(window);
-		return 1;
-	}
-	
-	hr = IDirect3DDevice9_GetDeviceCaps(device, &caps);
-	ok(SUCCEEDED(hr), "Failed to get device caps, hr %#x.\n", hr);
-	if (!(caps.RasterCaps & D3DPRASTERCAPS_FOGTABLE))
+static const struct square_untransformed_vertex untransformed_q[] =
+{
+	{ {160.0f, 120.0f, 0.0f, 0.0f}, 0xffff0000},
+	{ {480.0f, 120.0f, 0.0f, 0.0f}, 0xffff0000},
+	{ {160.0f, 360.0f, 0.0f, 0.0f}, 0xffff0000},
+	{ {480.0f, 360.0f, 0.0f, 0.0f}, 0xffff0000},
+};
+struct square_transformed_vertex
+{
+	struct vec3 position;
+	D3DCOLOR diffuse;
+};
+
+static const struct square_transformed_vertex transformed_q[] =
+{
+	{{-0.5f,  0.5f, 0.0f}, 0xffff0000},
+	{{ 0.5f,  0.5f, 0.0f}, 0xffff0000},
+	{{-0.5f, -0.5f, 0.0f}, 0xffff0000},
+	{{ 0.5f, -0.5f, 0.0f}, 0xffff0000},
+};
+
+// projection matrix.
+static const D3DMATRIX proj[] =
+{
+{{{
+	0.75f, 0.0f,  0.0f,   0.0f,
+	0.0f,  1.0f,  0.0f,   0.0f,
+	0.0f,  0.0f,  0.202f, 1.0f,
+	0.0f,  0.0f, -0.202f, 0.0f
+}}},
+{{{
+	1.5f,  0.0f,  0.0f,   0.0f,
+	0.0f,  2.0f,  0.0f,   0.0f,
+	0.0f,  0.0f,  0.404f, 2.0f,
+	0.0f,  0.0f, -0.404f, 0.0f
+}}},
+{{{
+	1.0f,  0.0f,  0.0f,  0.0f,
+	0.0f,  1.0f,  0.0f,  0.0f,
+	0.0f,  0.0f,  1.0f,  0.0f,
+	0.0f,  0.0f,  0.0f,  1.0f
+}}},
+};
+
+static const struct square_test
+{
+	int vshader, pshader;
+	unsigned int matrix_id;
+	float z, rhw;
+	unsigned int format_bits;
+}
+square_tests[] =
+{
+	//0-9
+	{0, 0, 0, 0.2f, 0.2f, D3DFVF_XYZRHW},
+	{0, 0, 0, 0.2f, 0.2f, D3DFVF_XYZ},
+	{0, 0, 0, 1.2f, 1.2f, D3DFVF_XYZRHW},
+	{0, 0, 0, 1.2f, 1.2f, D3DFVF_XYZ},
+	{0, 0, 1, 0.2f, 0.2f, D3DFVF_XYZRHW},
+	{0, 0, 1, 0.2f, 0.2f, D3DFVF_XYZ},
+	{0, 0, 1, 1.2f, 1.2f, D3DFVF_XYZRHW},
+	{0, 0, 1, 1.2f, 1.2f, D3DFVF_XYZ},
+	{0, 0, 2, 0.2f, 0.2f, D3DFVF_XYZRHW},
+	{0, 0, 2, 0.2f, 0.2f, D3DFVF_XYZ},
+	//10-19
+	{0, 0, 2, 1.2f, 1.2f, D3DFVF_XYZRHW},
+	{0, 0, 2, 1.2f, 1.2f, D3DFVF_XYZ},
+	{0, 1, 0, 0.2f, 0.2f, D3DFVF_XYZRHW},
+	{0, 1, 0, 0.2f, 0.2f, D3DFVF_XYZ},
+	{0, 1, 0, 1.2f, 1.2f, D3DFVF_XYZRHW},
+	{0, 1, 0, 1.2f, 1.2f, D3DFVF_XYZ},
+	{0, 1, 1, 0.2f, 0.2f, D3DFVF_XYZRHW},
+	{0, 1, 1, 0.2f, 0.2f, D3DFVF_XYZ},
+	{0, 1, 1, 1.2f, 1.2f, D3DFVF_XYZRHW},
+	{0, 1, 1, 1.2f, 1.2f, D3DFVF_XYZ},
+	//20-29
+	{0, 1, 2, 0.2f, 0.2f, D3DFVF_XYZRHW},
+	{0, 1, 2, 0.2f, 0.2f, D3DFVF_XYZ},
+	{0, 1, 2, 1.2f, 1.2f, D3DFVF_XYZRHW},
+	{0, 1, 2, 1.2f, 1.2f, D3DFVF_XYZ},
+	{1, 0, 0, 0.2f, 0.2f, D3DFVF_XYZRHW},
+	{1, 0, 0, 0.2f, 0.2f, D3DFVF_XYZ},
+	{1, 0, 0, 1.2f, 1.2f, D3DFVF_XYZRHW},
+	{1, 0, 0, 1.2f, 1.2f, D3DFVF_XYZ},
+	{1, 0, 1, 0.2f, 0.2f, D3DFVF_XYZRHW},
+	{1, 0, 1, 0.2f, 0.2f, D3DFVF_XYZ},
+	//30-39
+	{1, 0, 1, 1.2f, 1.2f, D3DFVF_XYZRHW},
+	{1, 0, 1, 1.2f, 1.2f, D3DFVF_XYZ},
+	{1, 0, 2, 0.2f, 0.2f, D3DFVF_XYZRHW},
+	{1, 0, 2, 0.2f, 0.2f, D3DFVF_XYZ},
+	{1, 0, 2, 1.2f, 1.2f, D3DFVF_XYZRHW},
+	{1, 0, 2, 1.2f, 1.2f, D3DFVF_XYZ},
+	{1, 1, 0, 0.2f, 0.2f, D3DFVF_XYZRHW},
+	{1, 1, 0, 0.2f, 0.2f, D3DFVF_XYZ},
+	{1, 1, 0, 1.2f, 1.2f, D3DFVF_XYZRHW},
+	{1, 1, 0, 1.2f, 1.2f, D3DFVF_XYZ},
+	//40-43
+	{1, 1, 1, 0.2f, 0.2f, D3DFVF_XYZRHW},
+	{1, 1, 1, 0.2f, 0.2f, D3DFVF_XYZ},
+	{1, 1, 1, 1.2f, 1.2f, D3DFVF_XYZRHW},
+	{1, 1, 1, 1.2f, 1.2f, D3DFVF_XYZ},
+
+	//44-53 - will have depth bias of 0.2
+	{1, 1, 2, 0.2f, 0.2f, D3DFVF_XYZRHW},
+	{1, 1, 2, 0.2f, 0.2f, D3DFVF_XYZ},
+	{1, 1, 2, 1.2f, 1.2f, D3DFVF_XYZRHW},
+	{1, 1, 2, 1.2f, 1.2f, D3DFVF_XYZ},
+	{0, 2, 0, 0.2f, 0.2f, D3DFVF_XYZRHW},
+	{0, 2, 0, 0.2f, 0.2f, D3DFVF_XYZ},
+	{0, 2, 0, 1.2f, 1.2f, D3DFVF_XYZRHW},
+	{0, 2, 0, 1.2f, 1.2f, D3DFVF_XYZ},
+	{0, 2, 1, 0.2f, 0.2f, D3DFVF_XYZRHW},
+	{0, 2, 1, 0.2f, 0.2f, D3DFVF_XYZ},
+
+	//54-59
+	{0, 2, 1, 1.2f, 1.2f, D3DFVF_XYZRHW},
+	{0, 2, 1, 1.2f, 1.2f, D3DFVF_XYZ},
+	{0, 2, 2, 0.2f, 0.2f, D3DFVF_XYZRHW},
+	{0, 2, 2, 0.2f, 0.2f, D3DFVF_XYZ},
+	{0, 2, 2, 1.2f, 1.2f, D3DFVF_XYZRHW},
+	{0, 2, 2, 1.2f, 1.2f, D3DFVF_XYZ},
+	//60-69
+	{1, 2, 0, 0.2f, 0.2f, D3DFVF_XYZRHW},
+	{1, 2, 0, 0.2f, 0.2f, D3DFVF_XYZ},
+	{1, 2, 0, 1.2f, 1.2f, D3DFVF_XYZRHW},
+	{1, 2, 0, 1.2f, 1.2f, D3DFVF_XYZ},
+	{1, 2, 1, 0.2f, 0.2f, D3DFVF_XYZRHW},
+	{1, 2, 1, 0.2f, 0.2f, D3DFVF_XYZ},
+	{1, 2, 1, 1.2f, 1.2f, D3DFVF_XYZRHW},
+	{1, 2, 1, 1.2f, 1.2f, D3DFVF_XYZ},
+	{1, 2, 2, 0.2f, 0.2f, D3DFVF_XYZRHW},
+	{1, 2, 2, 0.2f, 0.2f, D3DFVF_XYZ},
+	//70-71
+	{1, 2, 2, 1.2f, 1.2f, D3DFVF_XYZRHW},
+	{1, 2, 2, 1.2f, 1.2f, D3DFVF_XYZ},
+};
+
+/* Resources shared by the cases of a process. */
+struct square_resources
+{
+	IDirect3DVertexShader9 *vertex_shader[2];
+	IDirect3DPixelShader9 *pixel_shader[3];
+	IDirect3DSurface9 *ds;
+};
+
+static BOOL square_setup(struct test_context *context)
+{
+	static struct square_resources resources;
+	float start = 0.0f, end = 1.5f;
+	struct up_batcher *batcher = context->batcher;
+	IDirect3DDevice9 *device = context->device;
+	HRESULT hr;
+
+	if (!(context->caps.RasterCaps & D3DPRASTERCAPS_FOGTABLE))
 	{
 		skip("D3DPRASTERCAPS_FOGTABLE not supported, skipping POSITIONT table fog test.\n");
-		goto done;
+		return FALSE;
 	}
 
-	hr = IDirect3DDevice9_CreateVertexShader(device, vertex_shader_code1, &vertex_shader[1]);
+	memset(&resources, 0, sizeof(resources));
+	context->data = &resources;
+	hr = IDirect3DDevice9_CreateVertexShader(device, vertex_shader_code1, &resources.vertex_shader[1]);
 	ok(SUCCEEDED(hr), "CreateVertexShader failed (%08x)\n", hr);
-	hr = IDirect3DDevice9_CreatePixelShader(device, pixel_shader_code1, &pixel_shader[1]);
+	hr = IDirect3DDevice9_CreatePixelShader(device, pixel_shader_code1, &resources.pixel_shader[1]);
 	ok(SUCCEEDED(hr), "CreatePixelShader failed (%08x)\n", hr);
-	hr = IDirect3DDevice9_CreatePixelShader(device, pixel_shader_code2, &pixel_shader[2]);
+	hr = IDirect3DDevice9_CreatePixelShader(device, pixel_shader_code2, &resources.pixel_shader[2]);
 	ok(SUCCEEDED(hr), "CreatePixelShader failed (%08x)\n", hr);
-	hr = IDirect3DDevice9_SetRenderState(device, D3DRS_LIGHTING, FALSE);
+	hr = up_batcher_set_render_state(batcher, D3DRS_LIGHTING, FALSE);
 	ok(SUCCEEDED(hr), "Failed to set render state, hr %#x.\n", hr);
-	hr = IDirect3DDevice9_SetRenderState(device, D3DRS_FOGENABLE, TRUE);
+	hr = up_batcher_set_render_state(batcher, D3DRS_FOGENABLE, TRUE);
 	ok(SUCCEEDED(hr), "Failed to set render state, hr %#x.\n", hr);
-	hr = IDirect3DDevice9_SetRenderState(device, D3DRS_FOGCOLOR, 0x0000ff00);
+	hr = up_batcher_set_render_state(batcher, D3DRS_FOGCOLOR, 0x0000ff00);
 	ok(SUCCEEDED(hr), "Failed to set render state, hr %#x.\n", hr);
-	hr = IDirect3DDevice9_SetRenderState(device, D3DRS_FOGSTART, *(DWORD*)(&start));
+	hr = up_batcher_set_render_state(batcher, D3DRS_FOGSTART, *(DWORD*)(&start));
 	ok(SUCCEEDED(hr), "Failed to set render state, hr %#x.\n", hr);
-	hr = IDirect3DDevice9_SetRenderState(device, D3DRS_FOGEND, *(DWORD*)(&end));
+	hr = up_batcher_set_render_state(batcher, D3DRS_FOGEND, *(DWORD*)(&end));
 	ok(SUCCEEDED(hr), "Failed to set render state, hr %#x.\n", hr);
-	hr = IDirect3DDevice9_SetRenderState(device, D3DRS_CLIPPING, FALSE);
+	hr = up_batcher_set_render_state(batcher, D3DRS_CLIPPING, FALSE);
 	ok(SUCCEEDED(hr), "SetRenderState failed, hr %#x.\n", hr);
-	hr = IDirect3DDevice9_SetRenderState(device, D3DRS_FOGTABLEMODE, D3DFOG_LINEAR);
+	hr = up_batcher_set_render_state(batcher, D3DRS_FOGTABLEMODE, D3DFOG_LINEAR);
 	ok(SUCCEEDED(hr), "Failed to set render state, hr %#x.\n", hr);
-	hr = IDirect3DDevice9_SetRenderState(device, D3DRS_ZENABLE, D3DZB_FALSE);
+	hr = up_batcher_set_render_state(batcher, D3DRS_ZENABLE, D3DZB_FALSE);
 	ok(SUCCEEDED(hr), "Failed to set render state, hr %#x.\n", hr);
-	hr = IDirect3DDevice9_SetRenderState(device, D3DRS_TEXTUREFACTOR, 0x00ff00ff);
+	hr = up_batcher_set_render_state(batcher, D3DRS_TEXTUREFACTOR, 0x00ff00ff);
 	ok(SUCCEEDED(hr), "Failed to set render state, hr %#x.\n", hr);
 	hr = IDirect3DDevice9_CreateDepthStencilSurface(device, 640, 480, D3DFMT_D24X8,
-		D3DMULTISAMPLE_NONE, 0, FALSE, &ds, NULL);
+		D3DMULTISAMPLE_NONE, 0, FALSE, &resources.ds, NULL);
 	ok(SUCCEEDED(hr), "Failed to create depth stencil surface, hr %#x.\n", hr);
-	hr = IDirect3DDevice9_SetDepthStencilSurface(device, ds);
+	hr = IDirect3DDevice9_SetDepthStencilSurface(device, resources.ds);
 	ok(SUCCEEDED(hr), "Failed to set depth stencil surface, hr %#x.\n", hr);
+	return TRUE;
+}
 
-	MSG msg;
-	ZeroMemory(&msg, sizeof(MSG));
-	static float lastTime = (float)timeGetTime();
-	while (msg.message != WM_QUIT)
+static void square_teardown(struct test_context *context)
+{
+	struct square_resources *resources = (struct square_resources *)context->data;
+
+	IDirect3DDevice9_SetDepthStencilSurface(context->device, NULL);
+	IDirect3DDevice9_SetVertexShader(context->device, NULL);
+	IDirect3DDevice9_SetPixelShader(context->device, NULL);
+	IDirect3DVertexShader9_Release(resources->vertex_shader[1]);
+	IDirect3DPixelShader9_Release(resources->pixel_shader[1]);
+	IDirect3DPixelShader9_Release(resources->pixel_shader[2]);
+	IDirect3DSurface9_Release(resources->ds);
+}
+
+/* One row of square_tests[]; everything that differs between rows is set
+ * here, the rest by square_setup(). */
+static void test_square_row(struct test_context *context, const void *param)
+{
+	const struct square_test *test = (const struct square_test *)param;
+	struct square_resources *resources = (struct square_resources *)context->data;
+	struct square_untransformed_vertex untransformed[ARRAY_SIZE(untransformed_q)];
+	struct square_transformed_vertex transformed[ARRAY_SIZE(transformed_q)];
+	struct up_batcher *batcher = context->batcher;
+	IDirect3DDevice9 *device = context->device;
+	unsigned int i = (unsigned int)(test - square_tests);
+	/* Without and with the oDepth table fog quirk. */
+	struct fog_case fog_cases[2];
+	D3DCOLOR expected[2], color;
+	float fog[2];
+	BOOL drawn;
+	union
 	{
-		if (PeekMessage(&msg, 0, 0, 0, PM_REMOVE))
-		{
-			TranslateMessage(&msg);
-			DispatchMessage(&msg);
-		}
-		else
-		{
-			float currTime = (float)timeGetTime();
-			float timeDelta = (currTime - lastTime) * 0.001f;
-
-	
-	for (i = 0; i < ARRAY_SIZE(tests); ++i)
+		float f;
+		DWORD d;
+	} conv;
+	HRESULT hr;
+
+	test_log_set_case(i);
+	conv.f = 44 <= i && i <= 53 ? 0.2f : 0.0f;
+
+	drawn = square_fog_case(test->vshader, test->pshader, &proj[test->matrix_id],
+			test->z, test->rhw, test->format_bits, conv.f, FALSE, &fog_cases[0]);
+	square_fog_case(test->vshader, test->pshader, &proj[test->matrix_id],
+			test->z, test->rhw, test->format_bits, conv.f, TRUE, &fog_cases[1]);
+	fog_factors(fog_cases, ARRAY_SIZE(fog_cases), fog);
+	for (i = 0; i < ARRAY_SIZE(expected); ++i)
+		expected[i] = drawn ? fog_blend(0x00ff0000, 0x0000ff00, fog[i]) : 0x000000ff;
+
+	hr = up_batcher_set_transform(batcher, D3DTS_PROJECTION, &proj[test->matrix_id]);
+	ok(SUCCEEDED(hr), "Failed to set projection transform, hr %#x.\n", hr);
+	hr = up_batcher_set_fvf(batcher, test->format_bits | D3DFVF_DIFFUSE);
+	ok(SUCCEEDED(hr), "Failed to set fvf, hr %#x.\n", hr);
+	hr = up_batcher_set_vertex_shader(batcher, resources->vertex_shader[test->vshader]);
+	ok(SUCCEEDED(hr), "SetVertexShader failed (%08x)\n", hr);
+	hr = up_batcher_set_pixel_shader(batcher, resources->pixel_shader[test->pshader]);
+	ok(SUCCEEDED(hr), "SetPixelShader failed (%08x)\n", hr);
+	hr = up_batcher_clear(batcher, 0, NULL, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER, 0x000000ff, 1.0f, 0);
+	ok(SUCCEEDED(hr), "Failed to clear, hr %#x.\n", hr);
+	hr = up_batcher_set_render_state(batcher, D3DRS_DEPTHBIAS, conv.d);
+	ok(SUCCEEDED(hr), "Failed to set render state, hr %#x.\n", hr);
+
+	if (test->format_bits == D3DFVF_XYZRHW)
 	{
-		hr = IDirect3DDevice9_SetTransform(device, D3DTS_PROJECTION, &proj[tests[i].matrix_id]);
-		ok(SUCCEEDED(hr), "Failed to set projection transform, hr %#x.\n", hr);
-		hr = IDirect3DDevice9_SetFVF(device, tests[i].format_bits | D3DFVF_DIFFUSE);
-		ok(SUCCEEDED(hr), "Failed to set fvf, hr %#x.\n", hr);
-		hr = IDirect3DDevice9_SetVertexShader(device, vertex_shader[tests[i].vshader]);
-		ok(SUCCEEDED(hr), "SetVertexShader failed (%08x)\n", hr);
-		hr = IDirect3DDevice9_SetPixelShader(device, pixel_shader[tests[i].pshader]);
-		ok(SUCCEEDED(hr), "SetPixelShader failed (%08x)\n", hr);
-		hr = IDirect3DDevice9_Clear(device, 0, NULL, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER, 0x000000ff, 1.0f, 0);
-		ok(SUCCEEDED(hr), "Failed to clear, hr %#x.\n", hr);
-
-		if (44 <= i && i <= 53)
-			conv.f = 0.2f;
-		else
-			conv.f = 0.0f;
-		hr = IDirect3DDevice9_SetRenderState(device, D3DRS_DEPTHBIAS, conv.d);
-		ok(SUCCEEDED(hr), "Failed to set render state, hr %#x.\n", hr);
-
-		if (tests[i].format_bits == D3DFVF_XYZRHW)
-		{
-			untransformed_q[0].position.z = 0.1f + tests[i].z;
-			untransformed_q[1].position.z = 0.2f + tests[i].z;
-			untransformed_q[2].position.z = 0.3f + tests[i].z;
-			untransformed_q[3].position.z = 0.4f + tests[i].z;
-			untransformed_q[0].position.w = 0.6f + tests[i].rhw;
-			untransformed_q[1].position.w = 0.5f + tests[i].rhw;
-			untransformed_q[2].position.w = 0.4f + tests[i].rhw;
-			untransformed_q[3].position.w = 0.3f + tests[i].rhw;
-			hr = IDirect3DDevice9_BeginScene(device);
-			ok(SUCCEEDED(hr), "Failed to begin scene, hr %#x.\n", hr);
-			hr = IDirect3DDevice9_DrawPrimitiveUP(device, D3DPT_TRIANGLESTRIP, 2, untransformed_q, sizeof(untransformed_q[0]));
-			ok(SUCCEEDED(hr), "Failed to draw, hr %#x.\n", hr);
-			hr = IDirect3DDevice9_EndScene(device);
-			ok(SUCCEEDED(hr), "Failed to end scene, hr %#x.\n", hr);
-		}
-		else
-		{
-			transformed_q[0].position.z = 0.1f + tests[i].z;
-			transformed_q[1].position.z = 0.2f + tests[i].z;
-			transformed_q[2].position.z = 0.3f + tests[i].z;
-			transformed_q[3].position.z = 0.4f + tests[i].z;
-			hr = IDirect3DDevice9_BeginScene(device);
-			ok(SUCCEEDED(hr), "Failed to begin scene, hr %#x.\n", hr);
-			hr = IDirect3DDevice9_DrawPrimitiveUP(device, D3DPT_TRIANGLESTRIP, 2, transformed_q, sizeof(transformed_q[0]));
-			ok(SUCCEEDED(hr), "Failed to draw, hr %#x.\n", hr);
-			hr = IDirect3DDevice9_EndScene(device);
-			ok(SUCCEEDED(hr), "Failed to end scene, hr %#x.\n", hr);
-		}
-
-		color = getPixelColor(device, 320, 240);
-		ok(color_match(color, tests[i].color1, 2) || color_match(color, tests[i].color2, 2),
-			"Got unexpected color 0x%08x, expected 0x%08x or 0x%08x, case %u.\n", color, tests[i].color1, tests[i].color2, i);
-		hr = IDirect3DDevice9_Present(device, NULL, NULL, NULL, NULL);
-		ok(SUCCEEDED(hr), "Failed to present, hr %#x.\n", hr);
+		memcpy(untransformed, untransformed_q, sizeof(untransformed));
+		untransformed[0].position.z = 0.1f + test->z;
+		untransformed[1].position.z = 0.2f + test->z;
+		untransformed[2].position.z = 0.3f + test->z;
+		untransformed[3].position.z = 0.4f + test->z;
+		untransformed[0].position.w = 0.6f + test->rhw;
+		untransformed[1].position.w = 0.5f + test->rhw;
+		untransformed[2].position.w = 0.4f + test->rhw;
+		untransformed[3].position.w = 0.3f + test->rhw;
+		hr = IDirect3DDevice9_BeginScene(device);
+		ok(SUCCEEDED(hr), "Failed to begin scene, hr %#x.\n", hr);
+		hr = up_batcher_draw_primitive_up(batcher, D3DPT_TRIANGLESTRIP, 2, untransformed, sizeof(untransformed[0]));
+		ok(SUCCEEDED(hr), "Failed to draw, hr %#x.\n", hr);
+		hr = up_batcher_end_scene(batcher);
+		ok(SUCCEEDED(hr), "Failed to end scene, hr %#x.\n", hr);
 	}
+	else
+	{
+		memcpy(transformed, transformed_q, sizeof(transformed));
+		transformed[0].position.z = 0.1f + test->z;
+		transformed[1].position.z = 0.2f + test->z;
+		transformed[2].position.z = 0.3f + test->z;
+		transformed[3].position.z = 0.4f + test->z;
+		hr = IDirect3DDevice9_BeginScene(device);
+		ok(SUCCEEDED(hr), "Failed to begin scene, hr %#x.\n", hr);
+		hr = up_batcher_draw_primitive_up(batcher, D3DPT_TRIANGLESTRIP, 2, transformed, sizeof(transformed[0]));
+		ok(SUCCEEDED(hr), "Failed to draw, hr %#x.\n", hr);
+		hr = up_batcher_end_scene(batcher);
+		ok(SUCCEEDED(hr), "Failed to end scene, hr %#x.\n", hr);
+	}
+
+	color = getPixelColor(device, 320, 240);
+	ok_values(color_match(color, expected[0], 2) || color_match(color, expected[1], 2), expected[0], color,
+		"Got unexpected color 0x%08x, expected 0x%08x or 0x%08x, case %u.\n",
+		color, expected[0], expected[1], (unsigned int)(test - square_tests));
+	hr = IDirect3DDevice9_Present(device, NULL, NULL, NULL, NULL);
+	ok(SUCCEEDED(hr), "Failed to present, hr %#x.\n", hr);
+}
+
+// main ... The main function, right now it just calls the initialization of SDL.
+int main(int argc, char* argv[]) {
+
+	static struct test_case cases[ARRAY_SIZE(square_tests)];
+	static char names[ARRAY_SIZE(square_tests)][32];
+	struct test_suite suite;
+	unsigned int i;
+
+	/* One case per row, named after its parameters. */
+	for (i = 0; i < ARRAY_SIZE(square_tests); ++i)
+	{
+		const struct square_test *test = &square_tests[i];
 
-			lastTime = currTime;
-		}
+		sprintf(names[i], "square/%02u_vs%d_ps%d_proj%u_z%.1f_%s", i, test->vshader, test->pshader,
+			test->matrix_id, test->z, test->format_bits == D3DFVF_XYZRHW ? "xyzrhw" : "xyz");
+		cases[i].name = names[i];
+		cases[i].run = test_square_row;
+		cases[i].param = test;
 	}
 
-	IDirect3DVertexShader9_Release(vertex_shader[1]);
-	IDirect3DPixelShader9_Release(pixel_shader[1]);
-	IDirect3DPixelShader9_Release(pixel_shader[2]);
-	IDirect3DSurface9_Release(ds);
-done:
-	refcount = IDirect3DDevice9_Release(device);
-	ok(!refcount, "Device has %u references left.\n", refcount);
-	IDirect3D9_Release(d3d);
-	DestroyWindow(window);
-	return 0;
+	suite.name = "d3d9_square";
+	suite.setup = square_setup;
+	suite.teardown = square_teardown;
+	suite.cases = cases;
+	suite.case_count = ARRAY_SIZE(cases);
+	suite.options = NULL;
+	return test_runner_main(&suite, argc, argv);
 }
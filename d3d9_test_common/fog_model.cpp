@@ -0,0 +1,251 @@
+#include "fog_model.h"
+
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FOG_SSE2 1
+#include <emmintrin.h>
+#endif
+
+enum fog_formula
+{
+	FOG_FORMULA_FACTOR,     /* the factor is given */
+	FOG_FORMULA_LINEAR,     /* (a - coord) * b, a = end, b = 1 / (end - start) */
+	FOG_FORMULA_EXP,        /* exp(-a * coord), a = density */
+	FOG_FORMULA_EXP2,       /* exp(-(a * coord)^2) */
+};
+
+enum
+{
+	FOG_BLOCK = 256,        /* cases resolved per fog_factors() pass */
+};
+
+/* What a case reduces to once the fog source is known. */
+struct fog_term
+{
+	enum fog_formula formula;
+	float coord;
+	float a, b;
+};
+
+void fog_case_init(struct fog_case *c)
+{
+	c->table_mode = D3DFOG_NONE;
+	c->vertex_mode = D3DFOG_NONE;
+	c->start = 0.0f;
+	c->end = 1.0f;
+	c->density = 1.0f;
+	c->table_fog_caps = TRUE;
+	c->w_fog = FALSE;
+	c->source = FOG_SOURCE_FIXED_FUNCTION;
+	c->pixel_shader_3 = FALSE;
+	c->z = 0.0f;
+	c->w = 1.0f;
+	c->eye_z = 0.0f;
+	c->specular_alpha = 1.0f;
+	c->ofog = 1.0f;
+	c->odepth_fog = FALSE;
+	c->odepth = 0.0f;
+}
+
+BOOL fog_projection_uses_w(const D3DMATRIX *projection)
+{
+	return !(projection->_14 == 0.0f && projection->_24 == 0.0f
+		&& projection->_34 == 0.0f && projection->_44 == 1.0f);
+}
+
+static struct fog_term fog_term_factor(float factor)
+{
+	struct fog_term t = { FOG_FORMULA_FACTOR, factor, 0.0f, 0.0f };
+	return t;
+}
+
+static struct fog_term fog_term_equation(const struct fog_case *c, D3DFOGMODE mode, float coord)
+{
+	struct fog_term t = { FOG_FORMULA_LINEAR, coord, c->end, 0.0f };
+
+	switch (mode)
+	{
+		case D3DFOG_LINEAR:
+			/* start == end: everything is fogged, whatever the distance. */
+			if (c->end == c->start)
+				return fog_term_factor(0.0f);
+			t.b = 1.0f / (c->end - c->start);
+			return t;
+		case D3DFOG_EXP:
+			t.formula = FOG_FORMULA_EXP;
+			t.a = c->density;
+			return t;
+		case D3DFOG_EXP2:
+			t.formula = FOG_FORMULA_EXP2;
+			t.a = c->density;
+			return t;
+		default:
+			return fog_term_factor(1.0f);
+	}
+}
+
+static struct fog_term fog_resolve(const struct fog_case *c)
+{
+	D3DFOGMODE table_mode = c->table_fog_caps ? c->table_mode : D3DFOG_NONE;
+
+	if (c->pixel_shader_3)
+		return fog_term_factor(1.0f);
+
+	if (table_mode != D3DFOG_NONE)
+		return fog_term_equation(c, table_mode, c->w_fog ? c->w : c->odepth_fog ? c->odepth : c->z);
+
+	switch (c->source)
+	{
+		case FOG_SOURCE_VERTEX_SHADER:
+			return fog_term_factor(c->ofog);
+		case FOG_SOURCE_PRETRANSFORMED:
+			return fog_term_factor(c->specular_alpha);
+		default:
+			if (c->vertex_mode == D3DFOG_NONE)
+				return fog_term_factor(c->specular_alpha);
+			return fog_term_equation(c, c->vertex_mode, c->eye_z);
+	}
+}
+
+static float fog_clamp(float f)
+{
+	return f < 0.0f ? 0.0f : f > 1.0f ? 1.0f : f;
+}
+
+static float fog_evaluate(const struct fog_term *t)
+{
+	switch (t->formula)
+	{
+		case FOG_FORMULA_LINEAR:
+			return fog_clamp((t->a - t->coord) * t->b);
+		case FOG_FORMULA_EXP:
+			return fog_clamp(expf(-t->a * t->coord));
+		case FOG_FORMULA_EXP2:
+			return fog_clamp(expf(-(t->a * t->coord) * (t->a * t->coord)));
+		default:
+			return fog_clamp(t->coord);
+	}
+}
+
+float fog_factor(const struct fog_case *c)
+{
+	struct fog_term t = fog_resolve(c);
+	return fog_evaluate(&t);
+}
+
+#if FOG_SSE2
+
+/* Cephes style expf: 2^n * exp(r) with |r| <= ln2 / 2 and a degree 5
+ * polynomial, about 1 ulp for the arguments fog produces. */
+static __m128 fog_exp_sse2(__m128 x)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	__m128 fx, floor_fx, y, z;
+	__m128i n;
+
+	x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-87.3f)), _mm_set1_ps(88.3f));
+
+	/* n = floor(x / ln2 + 0.5) */
+	fx = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(1.44269504088896341f)), _mm_set1_ps(0.5f));
+	floor_fx = _mm_cvtepi32_ps(_mm_cvttps_epi32(fx));
+	floor_fx = _mm_sub_ps(floor_fx, _mm_and_ps(_mm_cmpgt_ps(floor_fx, fx), one));
+
+	x = _mm_sub_ps(x, _mm_mul_ps(floor_fx, _mm_set1_ps(0.693359375f)));
+	x = _mm_sub_ps(x, _mm_mul_ps(floor_fx, _mm_set1_ps(-2.12194440e-4f)));
+	z = _mm_mul_ps(x, x);
+
+	y = _mm_set1_ps(1.9875691500e-4f);
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.3981999507e-3f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(8.3334519073e-3f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(4.1665795894e-2f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.6666665459e-1f));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(5.0000001201e-1f));
+	y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(y, z), x), one);
+
+	n = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(floor_fx), _mm_set1_epi32(127)), 23);
+	return _mm_mul_ps(y, _mm_castsi128_ps(n));
+}
+
+/* All formulas for 4 terms, then each lane picks its own. */
+static void fog_evaluate_sse2(const int *formula, const float *coord, const float *a, const float *b,
+		size_t count, float *factors)
+{
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+	size_t i;
+
+	for (i = 0; i + 4 <= count; i += 4)
+	{
+		__m128i kind = _mm_loadu_si128((const __m128i *)&formula[i]);
+		__m128 d = _mm_loadu_ps(&coord[i]), va = _mm_loadu_ps(&a[i]), vb = _mm_loadu_ps(&b[i]);
+		__m128 ad = _mm_mul_ps(va, d);
+		__m128 linear = _mm_mul_ps(_mm_sub_ps(va, d), vb);
+		__m128 exp1 = fog_exp_sse2(_mm_sub_ps(zero, ad));
+		__m128 exp2 = fog_exp_sse2(_mm_sub_ps(zero, _mm_mul_ps(ad, ad)));
+		__m128 is_linear = _mm_castsi128_ps(_mm_cmpeq_epi32(kind, _mm_set1_epi32(FOG_FORMULA_LINEAR)));
+		__m128 is_exp = _mm_castsi128_ps(_mm_cmpeq_epi32(kind, _mm_set1_epi32(FOG_FORMULA_EXP)));
+		__m128 is_exp2 = _mm_castsi128_ps(_mm_cmpeq_epi32(kind, _mm_set1_epi32(FOG_FORMULA_EXP2)));
+		__m128 is_factor = _mm_or_ps(_mm_or_ps(is_linear, is_exp), is_exp2);
+		__m128 f = _mm_or_ps(
+				_mm_or_ps(_mm_and_ps(is_linear, linear), _mm_and_ps(is_exp, exp1)),
+				_mm_or_ps(_mm_and_ps(is_exp2, exp2), _mm_andnot_ps(is_factor, d)));
+
+		_mm_storeu_ps(&factors[i], _mm_min_ps(_mm_max_ps(f, zero), one));
+	}
+	for (; i < count; ++i)
+	{
+		struct fog_term t = { (enum fog_formula)formula[i], coord[i], a[i], b[i] };
+		factors[i] = fog_evaluate(&t);
+	}
+}
+
+#endif /* FOG_SSE2 */
+
+void fog_factors(const struct fog_case *cases, size_t count, float *factors)
+{
+	int formula[FOG_BLOCK];
+	float coord[FOG_BLOCK], a[FOG_BLOCK], b[FOG_BLOCK];
+	size_t first, i;
+
+	/* The source selection branches, the math doesn't: resolve a block of
+	 * cases to SoA terms, then evaluate them 4 at a time. */
+	for (first = 0; first < count; first += FOG_BLOCK)
+	{
+		size_t n = count - first < (size_t)FOG_BLOCK ? count - first : (size_t)FOG_BLOCK;
+
+		for (i = 0; i < n; ++i)
+		{
+			struct fog_term t = fog_resolve(&cases[first + i]);
+			formula[i] = t.formula;
+			coord[i] = t.coord;
+			a[i] = t.a;
+			b[i] = t.b;
+		}
+
+#if FOG_SSE2
+		fog_evaluate_sse2(formula, coord, a, b, n, factors + first);
+#else
+		for (i = 0; i < n; ++i)
+		{
+			struct fog_term t = { (enum fog_formula)formula[i], coord[i], a[i], b[i] };
+			factors[first + i] = fog_evaluate(&t);
+		}
+#endif
+	}
+}
+
+D3DCOLOR fog_blend(D3DCOLOR color, D3DCOLOR fog_color, float factor)
+{
+	D3DCOLOR result = color & 0xff000000;
+	unsigned int shift;
+
+	factor = fog_clamp(factor);
+	for (shift = 0; shift < 24; shift += 8)
+	{
+		float c = (float)((color >> shift) & 0xff), fog = (float)((fog_color >> shift) & 0xff);
+		float v = c * factor + fog * (1.0f - factor) + 0.5f;
+
+		result |= (D3DCOLOR)(v > 255.0f ? 255.0f : v) << shift;
+	}
+	return result;
+}
@@ -0,0 +1,73 @@
+#ifndef __fog_model__
+#define __fog_model__
+
+#include <d3d9.h>
+#include <stddef.h>
+
+/* CPU reference model of Direct3D 9 fixed-function fog, so the tests can
+ * compute their expected colors instead of carrying values read back from
+ * particular GPUs.
+ *
+ * A fog_case holds the fog state and the values interpolated at one pixel.
+ * The fog factor (1 - no fog, 0 - fog color only) comes from:
+ *  - nothing with ps_3_0 and later shaders: no fixed-function fog;
+ *  - table fog, if the device supports it: the fog equation on the pixel's
+ *    depth, or on its eye distance w when the projection matrix is not
+ *    affine ("w fog"), for every kind of vertex;
+ *  - otherwise with a vertex shader: oFog is the factor, the vertex fog
+ *    mode is not used;
+ *  - otherwise with pretransformed vertices or vertex fog mode NONE: the
+ *    specular alpha is the factor;
+ *  - otherwise the vertex fog equation on the view space z.
+ * LINEAR with start == end fogs everything, start > end gives reversed fog,
+ * and the factor is clamped to [0, 1]. */
+
+enum fog_vertex_source
+{
+	FOG_SOURCE_FIXED_FUNCTION,  /* D3DFVF_XYZ through the transform pipeline */
+	FOG_SOURCE_PRETRANSFORMED,  /* D3DFVF_XYZRHW, a vertex shader is bypassed */
+	FOG_SOURCE_VERTEX_SHADER,
+};
+
+struct fog_case
+{
+	D3DFOGMODE table_mode;
+	D3DFOGMODE vertex_mode;
+	float start, end, density;
+	BOOL table_fog_caps;        /* D3DPRASTERCAPS_FOGTABLE */
+	BOOL w_fog;                 /* see fog_projection_uses_w() */
+	enum fog_vertex_source source;
+	BOOL pixel_shader_3;        /* ps_3_0 or later bound */
+
+	/* Interpolated at the pixel. */
+	float z;                    /* window depth, depth bias included */
+	float w;                    /* 1 / rhw, or clip space w */
+	float eye_z;                /* view space z */
+	float specular_alpha;       /* 0 - 1 */
+	float ofog;                 /* vertex shader oFog */
+
+	/* Some GPUs (Ivy Bridge) compute depth based table fog from the pixel
+	 * shader's oDepth instead of the interpolated depth. */
+	BOOL odepth_fog;
+	float odepth;
+};
+
+/* D3D9 defaults: no fog modes, start 0, end 1, density 1, table fog
+ * supported, fixed-function vertices, specular alpha 1. */
+void fog_case_init(struct fog_case *c);
+
+/* Table fog uses w instead of z unless the projection matrix is affine. */
+BOOL fog_projection_uses_w(const D3DMATRIX *projection);
+
+/* Scalar reference. */
+float fog_factor(const struct fog_case *c);
+
+/* Same factors for many cases at once, 4 per SSE2 instruction. Results are
+ * within 1e-6 of fog_factor(). */
+void fog_factors(const struct fog_case *cases, size_t count, float *factors);
+
+/* color * factor + fog_color * (1 - factor) per RGB channel, rounded; the
+ * alpha of color is kept. */
+D3DCOLOR fog_blend(D3DCOLOR color, D3DCOLOR fog_color, float factor);
+
+#endif /* __fog_model__ */
@@ -0,0 +1,353 @@
+#include "test_log.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum
+{
+	TEST_LOG_RING_SIZE = 4096,      /* records, a power of two */
+	TEST_LOG_MESSAGE_SIZE = 200,    /* longer messages are cut */
+	TEST_LOG_DRAIN_WAIT = 2,        /* ms the writer sleeps on an empty ring */
+};
+
+struct test_record
+{
+	enum test_result result;
+	const char *test;               /* __func__, never freed */
+	int case_index;
+	BOOL has_values;
+	DWORD expected, actual;
+	LONGLONG timestamp;             /* QueryPerformanceCounter ticks */
+	char message[TEST_LOG_MESSAGE_SIZE];
+};
+
+/* Bounded multi-producer, single-consumer queue: a slot's sequence tells
+ * whether it is free for the producer at that position (sequence == pos) or
+ * holds a record for the consumer (sequence == pos + 1). */
+struct test_slot
+{
+	volatile LONG sequence;
+	struct test_record record;
+};
+
+struct test_log
+{
+	struct test_slot *ring;
+	volatile LONG head;             /* next position to produce */
+	LONG tail;                      /* next position to consume, writer only */
+	volatile LONG stop;
+	volatile LONG stalls;           /* producer waits on a full ring */
+	volatile LONG failures;
+	volatile LONG current_case;
+	HANDLE thread;
+
+	const char *suite;
+	FILE *junit;
+	LARGE_INTEGER frequency, start;
+
+	/* Writer thread only. */
+	unsigned int checks, passed, failed, skipped;
+};
+
+static struct test_log test_log;
+
+static LONG test_log_load(volatile LONG *value)
+{
+	return InterlockedCompareExchange(value, 0, 0);
+}
+
+/* Positions only grow and are compared by difference, so they may wrap. */
+static LONG test_log_offset(LONG pos, LONG offset)
+{
+	return (LONG)((ULONG)pos + (ULONG)offset);
+}
+
+static void test_log_escape_xml(FILE *f, const char *s)
+{
+	for (; *s; ++s)
+	{
+		switch (*s)
+		{
+			case '<': fputs("&lt;", f); break;
+			case '>': fputs("&gt;", f); break;
+			case '&': fputs("&amp;", f); break;
+			case '"': fputs("&quot;", f); break;
+			case '\n': break;
+			default: fputc(*s, f); break;
+		}
+	}
+}
+
+static void test_log_write(const struct test_record *r)
+{
+	double ms = (double)(r->timestamp - test_log.start.QuadPart) * 1000.0 / (double)test_log.frequency.QuadPart;
+	char message[TEST_LOG_MESSAGE_SIZE];
+	size_t length;
+
+	/* Messages keep their printf style trailing newline, TAP wants one line. */
+	strcpy(message, r->message);
+	length = strlen(message);
+	while (length && (message[length - 1] == '\n' || message[length - 1] == '\r'))
+		message[--length] = 0;
+
+	if (r->result == TEST_TRACE)
+	{
+		fprintf(stdout, "# %s: %s\n", r->test, message);
+		return;
+	}
+
+	++test_log.checks;
+	switch (r->result)
+	{
+		case TEST_PASS:
+			++test_log.passed;
+			fprintf(stdout, "ok %u - %s: %s\n", test_log.checks, r->test, message);
+			break;
+		case TEST_SKIP:
+			++test_log.skipped;
+			fprintf(stdout, "ok %u - %s # SKIP %s\n", test_log.checks, r->test, message);
+			break;
+		default:
+			++test_log.failed;
+			fprintf(stdout, "not ok %u - %s: %s\n", test_log.checks, r->test, message);
+			fprintf(stdout, "  ---\n");
+			if (r->case_index >= 0)
+				fprintf(stdout, "  case: %d\n", r->case_index);
+			if (r->has_values)
+				fprintf(stdout, "  expected: 0x%08x\n  actual: 0x%08x\n", r->expected, r->actual);
+			fprintf(stdout, "  time_ms: %.3f\n  ...\n", ms);
+			break;
+	}
+
+	if (!test_log.junit)
+		return;
+	fprintf(test_log.junit, "    <testcase classname=\"%s.%s\" name=\"%u", test_log.suite, r->test, test_log.checks);
+	if (r->case_index >= 0)
+		fprintf(test_log.junit, " case %d", r->case_index);
+	fputs(": ", test_log.junit);
+	test_log_escape_xml(test_log.junit, message);
+	fputs("\" time=\"0\"", test_log.junit);
+	if (r->result == TEST_PASS)
+	{
+		fputs("/>\n", test_log.junit);
+		return;
+	}
+	fputs(">\n", test_log.junit);
+	if (r->result == TEST_SKIP)
+	{
+		fputs("      <skipped/>\n", test_log.junit);
+	}
+	else
+	{
+		fputs("      <failure message=\"", test_log.junit);
+		test_log_escape_xml(test_log.junit, message);
+		fputs("\">", test_log.junit);
+		if (r->has_values)
+			fprintf(test_log.junit, "expected 0x%08x, actual 0x%08x, ", r->expected, r->actual);
+		fprintf(test_log.junit, "at %.3f ms</failure>\n", ms);
+	}
+	fputs("    </testcase>\n", test_log.junit);
+}
+
+/* Writes out what the producers have finished. Returns the record count. */
+static unsigned int test_log_drain(void)
+{
+	unsigned int count = 0;
+
+	for (;;)
+	{
+		struct test_slot *slot = &test_log.ring[test_log.tail & (TEST_LOG_RING_SIZE - 1)];
+
+		if (test_log_load(&slot->sequence) != test_log_offset(test_log.tail, 1))
+			break;
+		test_log_write(&slot->record);
+		InterlockedExchange(&slot->sequence, test_log_offset(test_log.tail, TEST_LOG_RING_SIZE));
+		test_log.tail = test_log_offset(test_log.tail, 1);
+		++count;
+	}
+	if (count)
+	{
+		fflush(stdout);
+		if (test_log.junit)
+			fflush(test_log.junit);
+	}
+	return count;
+}
+
+static DWORD WINAPI test_log_thread(void *param)
+{
+	for (;;)
+	{
+		if (test_log_drain())
+			continue;
+		if (test_log_load(&test_log.stop))
+			break;
+		Sleep(TEST_LOG_DRAIN_WAIT);
+	}
+	test_log_drain();
+	return 0;
+}
+
+BOOL test_log_open(const char *suite, int argc, char *argv[])
+{
+	const char *junit = NULL;
+	LONG i;
+	int arg;
+
+	for (arg = 1; arg < argc; ++arg)
+	{
+		if (!strncmp(argv[arg], "--junit=", 8))
+			junit = argv[arg] + 8;
+	}
+
+	memset(&test_log, 0, sizeof(test_log));
+	test_log.suite = suite;
+	test_log.current_case = -1;
+	QueryPerformanceFrequency(&test_log.frequency);
+	QueryPerformanceCounter(&test_log.start);
+
+	if (!(test_log.ring = (struct test_slot *)malloc(TEST_LOG_RING_SIZE * sizeof(*test_log.ring))))
+		return FALSE;
+	for (i = 0; i < TEST_LOG_RING_SIZE; ++i)
+		test_log.ring[i].sequence = i;
+
+	if (junit)
+	{
+		if (!(test_log.junit = fopen(junit, "w")))
+			fprintf(stderr, "Can't open %s for writing, no JUnit output.\n", junit);
+		else
+			fprintf(test_log.junit, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<testsuites>\n  <testsuite name=\"%s\">\n", suite);
+	}
+
+	if (!(test_log.thread = CreateThread(NULL, 0, test_log_thread, NULL, 0, NULL)))
+	{
+		if (test_log.junit)
+			fclose(test_log.junit);
+		free(test_log.ring);
+		test_log.ring = NULL;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+unsigned int test_log_close(void)
+{
+	if (!test_log.ring)
+		return 0;
+
+	InterlockedExchange(&test_log.stop, 1);
+	WaitForSingleObject(test_log.thread, INFINITE);
+	CloseHandle(test_log.thread);
+
+	fprintf(stdout, "1..%u\n", test_log.checks);
+	fprintf(stdout, "# %s: %u passed, %u failed, %u skipped, %ld waits on a full log.\n",
+		test_log.suite, test_log.passed, test_log.failed, test_log.skipped, (long)test_log.stalls);
+	fflush(stdout);
+	if (test_log.junit)
+	{
+		fputs("  </testsuite>\n</testsuites>\n", test_log.junit);
+		fclose(test_log.junit);
+	}
+
+	free(test_log.ring);
+	test_log.ring = NULL;
+	return test_log.failed;
+}
+
+unsigned int test_log_failures(void)
+{
+	return (unsigned int)test_log_load(&test_log.failures);
+}
+
+void test_log_set_case(int index)
+{
+	InterlockedExchange(&test_log.current_case, index);
+}
+
+static void test_log_push(enum test_result result, const char *test, BOOL has_values,
+		DWORD expected, DWORD actual, const char *format, va_list args)
+{
+	struct test_record *r;
+	struct test_slot *slot;
+	LARGE_INTEGER now;
+	LONG pos;
+
+	if (result == TEST_FAIL)
+		InterlockedIncrement(&test_log.failures);
+	if (!test_log.ring)
+	{
+		/* Before test_log_open(): nowhere to queue, print it as it comes. */
+		fprintf(stdout, "%s %s: ", result == TEST_PASS ? "ok" : result == TEST_FAIL ? "not ok"
+				: result == TEST_SKIP ? "skip" : "#", test);
+		vfprintf(stdout, format, args);
+		return;
+	}
+
+	pos = test_log_load(&test_log.head);
+	for (;;)
+	{
+		LONG diff;
+
+		slot = &test_log.ring[pos & (TEST_LOG_RING_SIZE - 1)];
+		diff = test_log_offset(test_log_load(&slot->sequence), -pos);
+		if (!diff)
+		{
+			if (InterlockedCompareExchange(&test_log.head, test_log_offset(pos, 1), pos) == pos)
+				break;
+			pos = test_log_load(&test_log.head);
+		}
+		else if (diff < 0)
+		{
+			/* Full: the writer is behind. */
+			InterlockedIncrement(&test_log.stalls);
+			SwitchToThread();
+			pos = test_log_load(&test_log.head);
+		}
+		else
+		{
+			pos = test_log_load(&test_log.head);
+		}
+	}
+
+	r = &slot->record;
+	r->result = result;
+	r->test = test;
+	r->case_index = test_log_load(&test_log.current_case);
+	r->has_values = has_values;
+	r->expected = expected;
+	r->actual = actual;
+	QueryPerformanceCounter(&now);
+	r->timestamp = now.QuadPart;
+	vsnprintf(r->message, sizeof(r->message), format, args);
+	InterlockedExchange(&slot->sequence, test_log_offset(pos, 1));
+}
+
+void test_log_check(BOOL condition, const char *test, const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	test_log_push(condition ? TEST_PASS : TEST_FAIL, test, FALSE, 0, 0, format, args);
+	va_end(args);
+}
+
+void test_log_check_values(BOOL condition, const char *test, DWORD expected, DWORD actual,
+		const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	test_log_push(condition ? TEST_PASS : TEST_FAIL, test, TRUE, expected, actual, format, args);
+	va_end(args);
+}
+
+void test_log_record(enum test_result result, const char *test, const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	test_log_push(result, test, FALSE, 0, 0, format, args);
+	va_end(args);
+}
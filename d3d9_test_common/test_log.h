@@ -0,0 +1,48 @@
+#ifndef __test_log__
+#define __test_log__
+
+#include <windows.h>
+
+/* Structured test results. The ok / skip / trace macros append a record
+ * (test, case index, result, expected and actual values, timestamp, message)
+ * to a lock-free ring buffer and return; a background thread drains it to
+ * TAP on stdout and, with --junit=<file>, to JUnit XML. The render loop only
+ * pays for formatting the message.
+ *
+ * If the ring is full, the caller waits for the writer rather than dropping
+ * results; the summary counts how often that happened. */
+
+enum test_result
+{
+	TEST_PASS,
+	TEST_FAIL,
+	TEST_SKIP,
+	TEST_TRACE,
+};
+
+/* Starts the writer. Recognizes --junit=<file> in argv and ignores the rest. */
+BOOL test_log_open(const char *suite, int argc, char *argv[]);
+
+/* Drains everything, prints the TAP plan and a summary, finishes the JUnit
+ * file and stops the writer. Returns the number of failed checks. */
+unsigned int test_log_close(void);
+
+/* Failed checks so far, counted as they are made rather than as they are
+ * written out. */
+unsigned int test_log_failures(void);
+
+/* Case index attached to the following records, -1 for none. */
+void test_log_set_case(int index);
+
+void test_log_check(BOOL condition, const char *test, const char *format, ...);
+void test_log_check_values(BOOL condition, const char *test, DWORD expected, DWORD actual,
+		const char *format, ...);
+void test_log_record(enum test_result result, const char *test, const char *format, ...);
+
+#define ok(c, ...) test_log_check(!!(c), __func__, __VA_ARGS__)
+#define ok_values(c, expected, actual, ...) test_log_check_values(!!(c), __func__, (expected), (actual), __VA_ARGS__)
+#define skip(...) test_log_record(TEST_SKIP, __func__, __VA_ARGS__)
+#define win_skip(...) test_log_record(TEST_SKIP, __func__, __VA_ARGS__)
+#define trace(...) test_log_record(TEST_TRACE, __func__, __VA_ARGS__)
+
+#endif /* __test_log__ */
@@ -0,0 +1,779 @@
+#include "test_runner.h"
+#include "test_log.h"
+
+#include <math.h>
+#include <psapi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum
+{
+	TEST_RUNNER_MAX_JOBS = MAXIMUM_WAIT_OBJECTS,    /* worker processes */
+	TEST_RUNNER_SLOWEST = 10,
+	TEST_RUNNER_COMMAND_LINE = 32768,               /* CreateProcess limit */
+	TEST_RUNNER_SOAK_REPORTS = 10,                  /* progress lines per soak */
+};
+
+struct test_runner_options
+{
+	const char *filter;
+	unsigned int shard_index, shard_count;
+	unsigned int jobs;          /* 0: run in this process */
+	unsigned int slowest;
+	unsigned int iterations;    /* passes over the selection in this process */
+	double soak_seconds;        /* 0: no soak */
+	BOOL list, batch;
+	BOOL worker;
+	const char *cases;          /* worker: comma separated case indices */
+	const char *report;         /* worker: where the timings go */
+};
+
+/* What a soak watches for leaks: the process heap and the video memory the
+ * driver still has to give. */
+struct test_runner_memory
+{
+	double private_bytes, working_set;
+	double texture_memory;
+};
+
+/* What a worker reports for one case. */
+struct test_runner_result
+{
+	unsigned int index;         /* into suite->cases */
+	unsigned int worker;
+	double ms;
+	unsigned int failures;
+	BOOL skipped, reported;
+};
+
+/* Destroying the window posts WM_QUIT, which ends the run between cases. */
+static LRESULT CALLBACK test_runner_window_proc(HWND hwnd, UINT message, WPARAM wparam, LPARAM lparam)
+{
+	if (message == WM_DESTROY)
+		PostQuitMessage(0);
+	return DefWindowProcA(hwnd, message, wparam, lparam);
+}
+
+static HWND create_window(void)
+{
+	WNDCLASSA wc;
+	HWND hwnd;
+	RECT rect;
+
+	memset(&wc, 0, sizeof(wc));
+	wc.lpfnWndProc = test_runner_window_proc;
+	wc.hInstance = GetModuleHandleA(NULL);
+	wc.hCursor = LoadCursor(NULL, IDC_ARROW);
+	wc.lpszClassName = "d3d9_test";
+	if (!RegisterClassA(&wc) && GetLastError() != ERROR_CLASS_ALREADY_EXISTS)
+		return NULL;
+
+	SetRect(&rect, 0, 0, 640, 480);
+	AdjustWindowRect(&rect, WS_OVERLAPPEDWINDOW | WS_VISIBLE, FALSE);
+	hwnd = CreateWindowA("d3d9_test", "d3d9_test", WS_OVERLAPPEDWINDOW | WS_VISIBLE,
+		0, 0, rect.right - rect.left, rect.bottom - rect.top, 0, 0, wc.hInstance, 0);
+	return hwnd;
+}
+
+static IDirect3DDevice9* create_device(IDirect3D9* d3d, HWND device_window, HWND focus_window, BOOL windowed)
+{
+	D3DPRESENT_PARAMETERS present_parameters = { 0 };
+	IDirect3DDevice9* device;
+
+	present_parameters.Windowed = windowed;
+	present_parameters.hDeviceWindow = device_window;
+	present_parameters.SwapEffect = D3DSWAPEFFECT_DISCARD;
+	present_parameters.BackBufferWidth = 640;
+	present_parameters.BackBufferHeight = 480;
+	present_parameters.BackBufferFormat = D3DFMT_A8R8G8B8;
+	present_parameters.EnableAutoDepthStencil = TRUE;
+	present_parameters.AutoDepthStencilFormat = D3DFMT_D24S8;
+
+	if (SUCCEEDED(IDirect3D9_CreateDevice(d3d, D3DADAPTER_DEFAULT, D3DDEVTYPE_HAL, focus_window,
+		D3DCREATE_HARDWARE_VERTEXPROCESSING, &present_parameters, &device)))
+		return device;
+
+	return NULL;
+}
+
+static double test_runner_now_ms(void)
+{
+	LARGE_INTEGER frequency, now;
+
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&now);
+	return (double)now.QuadPart * 1000.0 / (double)frequency.QuadPart;
+}
+
+/* Options the parent handles itself and doesn't pass on to the workers. */
+static BOOL test_runner_parent_option(const char *arg)
+{
+	return !strcmp(arg, "--list") || !strcmp(arg, "--jobs") || !strncmp(arg, "--jobs=", 7)
+		|| !strcmp(arg, "--shard") || !strncmp(arg, "--shard=", 8) || !strncmp(arg, "--filter=", 9)
+		|| !strncmp(arg, "--slowest=", 10) || !strncmp(arg, "--junit=", 8)
+		|| !strncmp(arg, "--iterations=", 13) || !strncmp(arg, "--soak=", 7);
+}
+
+/* Suite options ending in '=' take a value, the others must match exactly. */
+static BOOL test_runner_suite_option(const struct test_suite *suite, const char *arg)
+{
+	const char *const *option;
+
+	for (option = suite->options; option && *option; ++option)
+	{
+		size_t length = strlen(*option);
+
+		if ((*option)[length - 1] == '=' ? !strncmp(arg, *option, length) : !strcmp(arg, *option))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+static void test_runner_usage(const struct test_suite *suite)
+{
+	const char *const *option;
+
+	fprintf(stderr, "Usage: %s [--list] [--filter=a,b] [--shard=i/n] [--jobs[=n]] [--slowest=n]\n"
+		"    [--iterations=K] [--soak=seconds] [--no-batch] [--junit=file]", suite->name);
+	for (option = suite->options; option && *option; ++option)
+		fprintf(stderr, " [%s%s]", *option, (*option)[strlen(*option) - 1] == '=' ? "..." : "");
+	fprintf(stderr, "\n");
+}
+
+static BOOL test_runner_parse(const struct test_suite *suite, int argc, char *argv[],
+		struct test_runner_options *o)
+{
+	const char *shard = NULL;
+	int i;
+
+	memset(o, 0, sizeof(*o));
+	o->shard_count = 1;
+	o->slowest = TEST_RUNNER_SLOWEST;
+	o->iterations = 1;
+	o->batch = TRUE;
+
+	for (i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--list"))
+			o->list = TRUE;
+		else if (!strcmp(argv[i], "--no-batch"))
+			o->batch = FALSE;
+		else if (!strncmp(argv[i], "--filter=", 9))
+			o->filter = argv[i] + 9;
+		else if (!strncmp(argv[i], "--shard=", 8))
+			shard = argv[i] + 8;
+		else if (!strcmp(argv[i], "--shard"))
+			shard = i + 1 < argc ? argv[++i] : "";
+		else if (!strcmp(argv[i], "--jobs"))
+		{
+			SYSTEM_INFO info;
+
+			GetSystemInfo(&info);
+			o->jobs = info.dwNumberOfProcessors;
+		}
+		else if (!strncmp(argv[i], "--jobs=", 7))
+			o->jobs = strtoul(argv[i] + 7, NULL, 10);
+		else if (!strncmp(argv[i], "--slowest=", 10))
+			o->slowest = strtoul(argv[i] + 10, NULL, 10);
+		else if (!strncmp(argv[i], "--iterations=", 13))
+			o->iterations = strtoul(argv[i] + 13, NULL, 10);
+		else if (!strncmp(argv[i], "--soak=", 7))
+			o->soak_seconds = atof(argv[i] + 7);
+		else if (!strcmp(argv[i], "--worker"))
+			o->worker = TRUE;
+		else if (!strncmp(argv[i], "--cases=", 8))
+			o->cases = argv[i] + 8;
+		else if (!strncmp(argv[i], "--report=", 9))
+			o->report = argv[i] + 9;
+		else if (!strncmp(argv[i], "--", 2) && strncmp(argv[i], "--junit=", 8)
+				&& !test_runner_suite_option(suite, argv[i]))
+		{
+			/* A misspelt option would otherwise be ignored without a word. */
+			fprintf(stderr, "Unknown option \"%s\".\n", argv[i]);
+			test_runner_usage(suite);
+			return FALSE;
+		}
+	}
+
+	if (shard && (sscanf(shard, "%u/%u", &o->shard_index, &o->shard_count) != 2
+		|| !o->shard_count || o->shard_index >= o->shard_count))
+	{
+		fprintf(stderr, "Invalid shard \"%s\", expected i/n with 0 <= i < n.\n", shard);
+		return FALSE;
+	}
+	if (!o->iterations || o->soak_seconds < 0.0)
+	{
+		fprintf(stderr, "--iterations wants at least 1, --soak a positive number of seconds.\n");
+		return FALSE;
+	}
+	if ((o->iterations > 1 || o->soak_seconds > 0.0) && (o->jobs || o->worker))
+	{
+		fprintf(stderr, "--iterations and --soak run in this process, not with --jobs.\n");
+		return FALSE;
+	}
+	if (o->jobs > TEST_RUNNER_MAX_JOBS)
+		o->jobs = TEST_RUNNER_MAX_JOBS;
+	return TRUE;
+}
+
+static BOOL test_runner_matches(const char *name, const char *filter)
+{
+	char pattern[256];
+
+	if (!filter || !*filter)
+		return TRUE;
+	while (*filter)
+	{
+		size_t length = strcspn(filter, ",");
+
+		if (length && length < sizeof(pattern))
+		{
+			memcpy(pattern, filter, length);
+			pattern[length] = 0;
+			if (strstr(name, pattern))
+				return TRUE;
+		}
+		filter += length;
+		if (*filter == ',')
+			++filter;
+	}
+	return FALSE;
+}
+
+/* Filter, then shard. Returns the number of indices written to selected. */
+static unsigned int test_runner_select(const struct test_suite *suite, const struct test_runner_options *o,
+		unsigned int *selected)
+{
+	unsigned int i, matched = 0, count = 0;
+
+	for (i = 0; i < suite->case_count; ++i)
+	{
+		if (!test_runner_matches(suite->cases[i].name, o->filter))
+			continue;
+		if (matched++ % o->shard_count == o->shard_index)
+			selected[count++] = i;
+	}
+	return count;
+}
+
+static BOOL test_runner_init(const struct test_suite *suite, const struct test_runner_options *o,
+		int argc, char *argv[], struct test_context *context)
+{
+	HRESULT hr;
+
+	memset(context, 0, sizeof(*context));
+	context->argc = argc;
+	context->argv = argv;
+	context->window = create_window();
+	context->d3d = Direct3DCreate9(D3D_SDK_VERSION);
+	ok(!!context->d3d, "Failed to create a D3D object.\n");
+	if (!context->d3d)
+		return FALSE;
+	if (!(context->device = create_device(context->d3d, context->window, context->window, TRUE)))
+	{
+		skip("Failed to create a D3D device, skipping tests.\n");
+		return FALSE;
+	}
+	hr = IDirect3DDevice9_GetDeviceCaps(context->device, &context->caps);
+	ok(SUCCEEDED(hr), "Failed to get device caps, hr %#x.\n", hr);
+	context->batcher = up_batcher_create(context->device, o->batch);
+	ok(!!context->batcher, "Failed to create the UP draw batcher.\n");
+	if (!context->batcher)
+		return FALSE;
+
+	return !suite->setup || suite->setup(context);
+}
+
+static void test_runner_cleanup(const struct test_suite *suite, struct test_context *context, BOOL set_up)
+{
+	unsigned int submitted, issued;
+	ULONG refcount;
+
+	if (context->batcher)
+	{
+		up_batcher_get_stats(context->batcher, &submitted, &issued);
+		trace("UP draws: %u submitted, %u issued.\n", submitted, issued);
+	}
+	if (set_up && suite->teardown)
+		suite->teardown(context);
+	if (context->batcher)
+		up_batcher_destroy(context->batcher);
+	if (context->device)
+	{
+		refcount = IDirect3DDevice9_Release(context->device);
+		ok(!refcount, "Device has %u references left.\n", refcount);
+	}
+	if (context->d3d)
+		IDirect3D9_Release(context->d3d);
+	DestroyWindow(context->window);
+}
+
+static double test_runner_run_case(const struct test_suite *suite, struct test_context *context, unsigned int index)
+{
+	double start = test_runner_now_ms();
+
+	suite->cases[index].run(context, suite->cases[index].param);
+	test_log_set_case(-1);
+	return test_runner_now_ms() - start;
+}
+
+/* One pass over the selection, with the window messages that came in
+ * between cases. Returns FALSE once the window is closed. */
+static BOOL test_runner_pass(const struct test_suite *suite, struct test_context *context,
+		const unsigned int *selected, unsigned int count, double *ms)
+{
+	double start = test_runner_now_ms();
+	unsigned int i;
+	MSG msg;
+
+	for (i = 0; i < count; ++i)
+	{
+		while (PeekMessage(&msg, 0, 0, 0, PM_REMOVE))
+		{
+			if (msg.message == WM_QUIT)
+				return FALSE;
+			TranslateMessage(&msg);
+			DispatchMessage(&msg);
+		}
+		if (!IsWindow(context->window))
+			return FALSE;
+		test_runner_run_case(suite, context, selected[i]);
+	}
+	*ms = test_runner_now_ms() - start;
+	return TRUE;
+}
+
+static void test_runner_sample_memory(IDirect3DDevice9 *device, struct test_runner_memory *memory)
+{
+	PROCESS_MEMORY_COUNTERS_EX counters;
+
+	memset(memory, 0, sizeof(*memory));
+	memset(&counters, 0, sizeof(counters));
+	counters.cb = sizeof(counters);
+	if (GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS *)&counters, sizeof(counters)))
+	{
+		memory->private_bytes = (double)counters.PrivateUsage;
+		memory->working_set = (double)counters.WorkingSetSize;
+	}
+	memory->texture_memory = (double)IDirect3DDevice9_GetAvailableTextureMem(device);
+}
+
+static int test_runner_compare_ms(const void *a, const void *b)
+{
+	double ms1 = *(const double *)a, ms2 = *(const double *)b;
+
+	return ms1 < ms2 ? -1 : ms1 > ms2 ? 1 : 0;
+}
+
+/* --iterations=K: K passes, then the spread of the pass times. The first
+ * pass creates what the driver caches and is reported on its own. */
+static void test_runner_iterations(const struct test_suite *suite, const struct test_runner_options *o,
+		struct test_context *context, const unsigned int *selected, unsigned int count)
+{
+	struct test_runner_memory before, after;
+	double *times, sum = 0.0, variance = 0.0, mean;
+	unsigned int done = 0, timed, i;
+
+	if (!(times = (double *)malloc(o->iterations * sizeof(*times))))
+	{
+		skip("Out of memory, skipping the run.\n");
+		return;
+	}
+
+	test_runner_sample_memory(context->device, &before);
+	while (done < o->iterations && test_runner_pass(suite, context, selected, count, &times[done]))
+		++done;
+	test_runner_sample_memory(context->device, &after);
+
+	if (done < o->iterations)
+		trace("Window closed after %u of %u passes.\n", done, o->iterations);
+	if (!done)
+	{
+		free(times);
+		return;
+	}
+	trace("%u cases, first pass %.3f ms.\n", count, times[0]);
+	if (done > 1)
+	{
+		timed = done - 1;
+		for (i = 1; i < done; ++i)
+			sum += times[i];
+		mean = sum / timed;
+		for (i = 1; i < done; ++i)
+			variance += (times[i] - mean) * (times[i] - mean);
+		qsort(times + 1, timed, sizeof(*times), test_runner_compare_ms);
+		trace("%u more passes: min %.3f ms, median %.3f ms, mean %.3f ms (sd %.3f), p95 %.3f ms, max %.3f ms.\n",
+			timed, times[1], times[1 + timed / 2], mean, sqrt(variance / timed),
+			times[1 + (unsigned int)((timed - 1) * 0.95 + 0.5)], times[done - 1]);
+	}
+	trace("Private bytes %+.1f KiB, available texture memory %+.1f KiB over the run.\n",
+		(after.private_bytes - before.private_bytes) / 1024.0,
+		(after.texture_memory - before.texture_memory) / 1024.0);
+	free(times);
+}
+
+/* --soak=seconds: passes until the time is up, with a progress line every
+ * tenth of it. Drift is the least squares slope of the pass time against
+ * the elapsed time; memory growth is counted from the end of the first
+ * pass, once the cases have created what they keep. Nothing per pass is
+ * stored, so the soak itself doesn't grow. */
+static void test_runner_soak(const struct test_suite *suite, const struct test_runner_options *o,
+		struct test_context *context, const unsigned int *selected, unsigned int count)
+{
+	double interval_ms = o->soak_seconds * 1000.0 / (double)TEST_RUNNER_SOAK_REPORTS;
+	double start, end, next_report, now, ms, minutes;
+	double n = 0.0, sum_t = 0.0, sum_ms = 0.0, sum_tt = 0.0, sum_tms = 0.0, slope = 0.0;
+	double interval_sum = 0.0, interval_max = 0.0, first_mean = 0.0, last_mean = 0.0;
+	unsigned int passes = 0, interval_passes = 0, reports = 0;
+	struct test_runner_memory baseline, memory;
+	BOOL open;
+
+	if (!test_runner_pass(suite, context, selected, count, &ms))
+		return;
+	test_runner_sample_memory(context->device, &baseline);
+	trace("Soaking %u cases for %.1f s, first pass %.3f ms.\n", count, o->soak_seconds, ms);
+
+	start = test_runner_now_ms();
+	end = start + o->soak_seconds * 1000.0;
+	next_report = start + interval_ms;
+	while ((open = test_runner_pass(suite, context, selected, count, &ms)))
+	{
+		now = test_runner_now_ms();
+		minutes = (now - start) / 60000.0;
+		++passes;
+		n += 1.0;
+		sum_t += minutes;
+		sum_ms += ms;
+		sum_tt += minutes * minutes;
+		sum_tms += minutes * ms;
+		++interval_passes;
+		interval_sum += ms;
+		if (ms > interval_max)
+			interval_max = ms;
+
+		if (now >= next_report || now >= end)
+		{
+			test_runner_sample_memory(context->device, &memory);
+			last_mean = interval_sum / interval_passes;
+			if (!reports++)
+				first_mean = last_mean;
+			trace("soak %8.1f s: %6u passes, %.3f ms mean, %.3f ms max, private bytes %+.1f KiB, "
+				"working set %+.1f KiB, available texture memory %+.1f KiB.\n",
+				(now - start) / 1000.0, interval_passes, last_mean, interval_max,
+				(memory.private_bytes - baseline.private_bytes) / 1024.0,
+				(memory.working_set - baseline.working_set) / 1024.0,
+				(memory.texture_memory - baseline.texture_memory) / 1024.0);
+			interval_passes = 0;
+			interval_sum = interval_max = 0.0;
+			next_report += interval_ms;
+		}
+		if (now >= end)
+			break;
+	}
+
+	if (!open)
+		trace("Window closed, soak stopped after %.1f s.\n", (test_runner_now_ms() - start) / 1000.0);
+	if (!passes)
+		return;
+	if (n * sum_tt - sum_t * sum_t > 0.0)
+		slope = (n * sum_tms - sum_t * sum_ms) / (n * sum_tt - sum_t * sum_t);
+	test_runner_sample_memory(context->device, &memory);
+	trace("Soak: %u passes, %.3f ms mean, drift %+.4f ms per minute (first interval %.3f ms, last %.3f ms).\n",
+		passes, sum_ms / n, slope, first_mean, last_mean);
+	trace("Soak: private bytes %+.1f KiB (%+.1f bytes per pass), available texture memory %+.1f KiB.\n",
+		(memory.private_bytes - baseline.private_bytes) / 1024.0,
+		(memory.private_bytes - baseline.private_bytes) / passes,
+		(memory.texture_memory - baseline.texture_memory) / 1024.0);
+}
+
+/* Without --jobs: one pass by default, K with --iterations, or a soak. The
+ * exit code is the same in every mode. */
+static int test_runner_in_process(const struct test_suite *suite, const struct test_runner_options *o,
+		int argc, char *argv[], const unsigned int *selected, unsigned int count)
+{
+	struct test_context context;
+	BOOL set_up;
+
+	set_up = test_runner_init(suite, o, argc, argv, &context);
+	if (set_up)
+	{
+		if (o->soak_seconds > 0.0)
+			test_runner_soak(suite, o, &context, selected, count);
+		else
+			test_runner_iterations(suite, o, &context, selected, count);
+	}
+	test_runner_cleanup(suite, &context, set_up);
+	return test_log_failures() ? 1 : 0;
+}
+
+/* --worker: the cases given by --cases, once, with their timings written to
+ * --report for the parent. */
+static int test_runner_worker(const struct test_suite *suite, const struct test_runner_options *o,
+		int argc, char *argv[])
+{
+	struct test_context context;
+	const char *cases = o->cases;
+	FILE *report;
+	BOOL set_up;
+
+	if (!o->report || !(report = fopen(o->report, "w")))
+	{
+		fprintf(stderr, "A worker needs a writable --report file.\n");
+		return 2;
+	}
+
+	set_up = test_runner_init(suite, o, argc, argv, &context);
+	while (cases && *cases)
+	{
+		unsigned int index = strtoul(cases, NULL, 10), failures = test_log_failures();
+		double ms = 0.0;
+
+		if (index < suite->case_count)
+		{
+			if (set_up)
+				ms = test_runner_run_case(suite, &context, index);
+			fprintf(report, "%u %.6f %u %d\n", index, ms, test_log_failures() - failures, !set_up);
+			fflush(report);
+		}
+		cases += strcspn(cases, ",");
+		if (*cases == ',')
+			++cases;
+	}
+	test_runner_cleanup(suite, &context, set_up);
+	fclose(report);
+	return test_log_failures() ? 1 : 0;
+}
+
+static void test_runner_quote(char *command_line, const char *arg)
+{
+	size_t length = strlen(command_line);
+
+	if (length + strlen(arg) + 4 >= TEST_RUNNER_COMMAND_LINE)
+		return;
+	sprintf(command_line + length, " \"%s\"", arg);
+}
+
+static HANDLE test_runner_spawn(const char *command_line, const char *log_path)
+{
+	SECURITY_ATTRIBUTES inherit = { sizeof(inherit), NULL, TRUE };
+	PROCESS_INFORMATION process;
+	STARTUPINFOA startup;
+	HANDLE log;
+	BOOL created;
+
+	log = CreateFileA(log_path, GENERIC_WRITE, FILE_SHARE_READ, &inherit, CREATE_ALWAYS,
+		FILE_ATTRIBUTE_NORMAL, NULL);
+	if (log == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	memset(&startup, 0, sizeof(startup));
+	startup.cb = sizeof(startup);
+	startup.dwFlags = STARTF_USESTDHANDLES;
+	startup.hStdOutput = log;
+	startup.hStdError = log;
+	startup.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+	created = CreateProcessA(NULL, (LPSTR)command_line, NULL, NULL, TRUE, 0, NULL, NULL, &startup, &process);
+	CloseHandle(log);
+	if (!created)
+		return NULL;
+	CloseHandle(process.hThread);
+	return process.hProcess;
+}
+
+/* Worker log lines worth repeating in the parent's output. */
+static void test_runner_trace_failures(unsigned int worker, const char *log_path)
+{
+	char line[512];
+	FILE *f;
+
+	if (!(f = fopen(log_path, "r")))
+		return;
+	while (fgets(line, sizeof(line), f))
+	{
+		if (!strncmp(line, "not ok", 6))
+			trace("worker %u: %s", worker, line);
+	}
+	fclose(f);
+}
+
+static int test_runner_compare_slowest(const void *a, const void *b)
+{
+	const struct test_runner_result *r1 = *(const struct test_runner_result * const *)a;
+	const struct test_runner_result *r2 = *(const struct test_runner_result * const *)b;
+
+	return r1->ms < r2->ms ? 1 : r1->ms > r2->ms ? -1 : 0;
+}
+
+/* --jobs: the selection dealt round-robin to worker processes, one check per
+ * case with its wall time, then the slowest cases. */
+static int test_runner_parent(const struct test_suite *suite, const struct test_runner_options *o,
+		int argc, char *argv[], const unsigned int *selected, unsigned int count)
+{
+	unsigned int jobs = o->jobs < count ? o->jobs : count, worker, i;
+	char exe[MAX_PATH], temp[MAX_PATH], log_paths[TEST_RUNNER_MAX_JOBS][MAX_PATH];
+	char report_paths[TEST_RUNNER_MAX_JOBS][MAX_PATH];
+	HANDLE processes[TEST_RUNNER_MAX_JOBS];
+	struct test_runner_result *results, **slowest;
+	double start, wall_ms, case_ms = 0.0;
+	char *command_line;
+	int arg;
+
+	if (!count)
+	{
+		skip("No cases selected.\n");
+		return 0;
+	}
+	results = (struct test_runner_result *)calloc(count, sizeof(*results));
+	slowest = (struct test_runner_result **)calloc(count, sizeof(*slowest));
+	command_line = (char *)malloc(TEST_RUNNER_COMMAND_LINE);
+	if (!results || !slowest || !command_line)
+	{
+		free(command_line);
+		free(slowest);
+		free(results);
+		skip("Out of memory, skipping the run.\n");
+		return 1;
+	}
+	for (i = 0; i < count; ++i)
+	{
+		results[i].index = selected[i];
+		results[i].worker = i % jobs;
+	}
+
+	GetModuleFileNameA(NULL, exe, sizeof(exe));
+	GetTempPathA(sizeof(temp), temp);
+	start = test_runner_now_ms();
+	for (worker = 0; worker < jobs; ++worker)
+	{
+		int length;
+
+		sprintf(log_paths[worker], "%s%s.%lu.%u.log", temp, suite->name, GetCurrentProcessId(), worker);
+		sprintf(report_paths[worker], "%s%s.%lu.%u.report", temp, suite->name, GetCurrentProcessId(), worker);
+
+		length = snprintf(command_line, TEST_RUNNER_COMMAND_LINE, "\"%s\" --worker \"--report=%s\" --cases=",
+			exe, report_paths[worker]);
+		for (i = worker; i < count && length < TEST_RUNNER_COMMAND_LINE; i += jobs)
+			length += snprintf(command_line + length, TEST_RUNNER_COMMAND_LINE - length, "%s%u",
+				i == worker ? "" : ",", selected[i]);
+		if (length >= TEST_RUNNER_COMMAND_LINE)
+		{
+			/* Its cases are reported as missing results. */
+			trace("Worker %u: the case list doesn't fit on a command line, use more --jobs.\n", worker);
+			processes[worker] = NULL;
+			continue;
+		}
+		for (arg = 1; arg < argc; ++arg)
+		{
+			if (!strcmp(argv[arg], "--shard"))
+				++arg;
+			else if (!test_runner_parent_option(argv[arg]))
+				test_runner_quote(command_line, argv[arg]);
+		}
+
+		if (!(processes[worker] = test_runner_spawn(command_line, log_paths[worker])))
+			trace("Failed to start worker %u, error %lu.\n", worker, GetLastError());
+	}
+
+	for (worker = 0; worker < jobs; ++worker)
+	{
+		DWORD exit_code = ~0u;
+		unsigned int index, failures;
+		int skipped;
+		double ms;
+		FILE *report;
+
+		if (!processes[worker])
+			continue;
+		WaitForSingleObject(processes[worker], INFINITE);
+		GetExitCodeProcess(processes[worker], &exit_code);
+		CloseHandle(processes[worker]);
+
+		if ((report = fopen(report_paths[worker], "r")))
+		{
+			while (fscanf(report, "%u %lf %u %d", &index, &ms, &failures, &skipped) == 4)
+			{
+				for (i = worker; i < count; i += jobs)
+				{
+					if (results[i].index != index)
+						continue;
+					results[i].ms = ms;
+					results[i].failures = failures;
+					results[i].skipped = skipped;
+					results[i].reported = TRUE;
+				}
+			}
+			fclose(report);
+		}
+		if (exit_code)
+		{
+			trace("Worker %u exited with %lu, log %s.\n", worker, exit_code, log_paths[worker]);
+			test_runner_trace_failures(worker, log_paths[worker]);
+		}
+		else
+		{
+			DeleteFileA(log_paths[worker]);
+		}
+		DeleteFileA(report_paths[worker]);
+	}
+	wall_ms = test_runner_now_ms() - start;
+
+	for (i = 0; i < count; ++i)
+	{
+		const struct test_runner_result *r = &results[i];
+		const char *name = suite->cases[r->index].name;
+
+		if (r->skipped)
+			test_log_record(TEST_SKIP, name, "worker %u could not set up the device.\n", r->worker);
+		else if (!r->reported)
+			test_log_check(FALSE, name, "no result from worker %u, log %s.\n", r->worker, log_paths[r->worker]);
+		else
+			test_log_check(!r->failures, name, "%.3f ms, %u failed checks.\n", r->ms, r->failures);
+		case_ms += r->ms;
+		slowest[i] = &results[i];
+	}
+
+	qsort(slowest, count, sizeof(*slowest), test_runner_compare_slowest);
+	trace("%u cases in %u workers: %.3f s wall time, %.3f s in cases.\n",
+		count, jobs, wall_ms / 1000.0, case_ms / 1000.0);
+	for (i = 0; i < count && i < o->slowest; ++i)
+		trace("slowest %2u: %10.3f ms  %s\n", i + 1, slowest[i]->ms, suite->cases[slowest[i]->index].name);
+
+	free(command_line);
+	free(slowest);
+	free(results);
+	return test_log_failures() ? 1 : 0;
+}
+
+int test_runner_main(const struct test_suite *suite, int argc, char *argv[])
+{
+	struct test_runner_options options;
+	unsigned int *selected, count, i;
+	int ret;
+
+	if (!test_runner_parse(suite, argc, argv, &options))
+		return 2;
+	if (!(selected = (unsigned int *)malloc((suite->case_count + 1) * sizeof(*selected))))
+		return 2;
+	count = test_runner_select(suite, &options, selected);
+
+	if (options.list)
+	{
+		for (i = 0; i < count; ++i)
+			printf("%s\n", suite->cases[selected[i]].name);
+		free(selected);
+		return 0;
+	}
+
+	test_log_open(suite->name, argc, argv);
+	if (options.worker)
+		ret = test_runner_worker(suite, &options, argc, argv);
+	else if (options.jobs)
+		ret = test_runner_parent(suite, &options, argc, argv, selected, count);
+	else
+		ret = test_runner_in_process(suite, &options, argc, argv, selected, count);
+	test_log_close();
+
+	free(selected);
+	return ret;
+}
@@ -0,0 +1,67 @@
+#ifndef __test_runner__
+#define __test_runner__
+
+#include <d3d9.h>
+
+#include "up_batcher.h"
+
+/* Test registry and runner. A suite is a list of named cases sharing one
+ * window and device per process; each case sets up the state it depends on,
+ * so any subset runs in any order.
+ *
+ * Options, handled by test_runner_main():
+ *   --list              print the selected cases and exit
+ *   --filter=a,b        cases whose name contains one of the patterns
+ *   --shard=i/n         every n-th selected case, starting at i (0-based);
+ *                       "--shard i/n" works too
+ *   --jobs[=n]          run the selection in n worker processes (default:
+ *                       one per CPU), each with its own device, and report
+ *                       the wall time of every case and the slowest ones
+ *   --slowest=n         how many slow cases to list, 10 by default
+ *   --iterations=K      K passes over the selection in this process, then
+ *                       min / median / mean / p95 / max pass time
+ *   --soak=seconds      passes until the time is up, reporting timing drift
+ *                       and process and video memory growth as it goes
+ *   --no-batch          send every UP draw to the device as it is
+ * Without --jobs, --iterations or --soak the selection runs once in this
+ * process. Closing the window ends any run early. Other "--" options are
+ * rejected unless the suite lists them in test_suite.options; those and the
+ * remaining arguments are left to the suite and passed on to the workers. */
+
+struct test_context
+{
+	HWND window;
+	IDirect3D9 *d3d;
+	IDirect3DDevice9 *device;
+	struct up_batcher *batcher;
+	D3DCAPS9 caps;
+	int argc;
+	char **argv;
+	void *data;                 /* suite resources, owned by setup / teardown */
+};
+
+struct test_case
+{
+	const char *name;
+	void (*run)(struct test_context *context, const void *param);
+	const void *param;
+};
+
+struct test_suite
+{
+	const char *name;
+	/* Once per process after the device is created; returning FALSE skips
+	 * the cases. Both are optional. */
+	BOOL (*setup)(struct test_context *context);
+	void (*teardown)(struct test_context *context);
+	const struct test_case *cases;
+	unsigned int case_count;
+	/* NULL terminated "--" options the suite reads from argv itself, may be
+	 * NULL. An entry ending in '=' takes a value, e.g. "--seed=". */
+	const char *const *options;
+};
+
+/* Returns the process exit code: 0 if every selected case passed. */
+int test_runner_main(const struct test_suite *suite, int argc, char *argv[]);
+
+#endif /* __test_runner__ */
@@ -0,0 +1,338 @@
+#include "up_batcher.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+enum
+{
+	UP_BATCHER_VB_SIZE = 1024 * 1024,   /* bytes */
+	UP_BATCHER_IB_COUNT = 64 * 1024,    /* 16-bit indices */
+	UP_BATCHER_MAX_VERTICES = 0xffff,   /* per batch, indices are 16-bit */
+};
+
+struct up_batcher
+{
+	IDirect3DDevice9 *device;
+	IDirect3DVertexBuffer9 *vb;
+	IDirect3DIndexBuffer9 *ib;
+	BOOL enabled;
+
+	UINT vb_pos;                /* first free byte */
+	UINT ib_pos;                /* first free index */
+
+	/* Pending batch, both buffers stay locked from the first append to the flush. */
+	BYTE *vertices;
+	WORD *indices;
+	D3DPRIMITIVETYPE type;      /* D3DPT_TRIANGLELIST or D3DPT_LINELIST */
+	UINT stride;
+	UINT base_vertex;           /* first vertex of the batch, vb_pos rounded up to the stride */
+	UINT vertex_count;
+	UINT index_count;
+
+	unsigned int submitted;
+	unsigned int issued;
+};
+
+static D3DPRIMITIVETYPE list_type(D3DPRIMITIVETYPE type)
+{
+	switch (type)
+	{
+		case D3DPT_TRIANGLELIST:
+		case D3DPT_TRIANGLESTRIP:
+		case D3DPT_TRIANGLEFAN:
+			return D3DPT_TRIANGLELIST;
+		case D3DPT_LINELIST:
+		case D3DPT_LINESTRIP:
+			return D3DPT_LINELIST;
+		default:
+			return (D3DPRIMITIVETYPE)0; /* points are not batched */
+	}
+}
+
+/* Vertices a non-indexed draw reads, or indices an indexed one reads. */
+static UINT sequence_length(D3DPRIMITIVETYPE type, UINT primitive_count)
+{
+	switch (type)
+	{
+		case D3DPT_TRIANGLELIST: return primitive_count * 3;
+		case D3DPT_TRIANGLESTRIP:
+		case D3DPT_TRIANGLEFAN: return primitive_count + 2;
+		case D3DPT_LINELIST: return primitive_count * 2;
+		case D3DPT_LINESTRIP: return primitive_count + 1;
+		default: return primitive_count;
+	}
+}
+
+/* Positions in the draw's vertex / index sequence of primitive p, in list
+ * order. Odd strip triangles are swapped and fan triangles rotated so the
+ * winding and the first vertex stay what the strip / fan would have used. */
+static UINT primitive_corners(D3DPRIMITIVETYPE type, UINT p, UINT *corners)
+{
+	switch (type)
+	{
+		case D3DPT_TRIANGLELIST:
+			corners[0] = p * 3; corners[1] = p * 3 + 1; corners[2] = p * 3 + 2;
+			return 3;
+		case D3DPT_TRIANGLESTRIP:
+			corners[0] = p;
+			corners[1] = (p & 1) ? p + 2 : p + 1;
+			corners[2] = (p & 1) ? p + 1 : p + 2;
+			return 3;
+		case D3DPT_TRIANGLEFAN:
+			corners[0] = p + 1; corners[1] = p + 2; corners[2] = 0;
+			return 3;
+		case D3DPT_LINELIST:
+			corners[0] = p * 2; corners[1] = p * 2 + 1;
+			return 2;
+		case D3DPT_LINESTRIP:
+			corners[0] = p; corners[1] = p + 1;
+			return 2;
+		default:
+			return 0;
+	}
+}
+
+struct up_batcher *up_batcher_create(IDirect3DDevice9 *device, BOOL enabled)
+{
+	struct up_batcher *batcher;
+
+	if (!(batcher = (struct up_batcher *)calloc(1, sizeof(*batcher))))
+		return NULL;
+	batcher->device = device;
+	batcher->enabled = enabled;
+
+	if (enabled && (FAILED(IDirect3DDevice9_CreateVertexBuffer(device, UP_BATCHER_VB_SIZE,
+			D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY, 0, D3DPOOL_DEFAULT, &batcher->vb, NULL))
+			|| FAILED(IDirect3DDevice9_CreateIndexBuffer(device, UP_BATCHER_IB_COUNT * sizeof(WORD),
+			D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY, D3DFMT_INDEX16, D3DPOOL_DEFAULT, &batcher->ib, NULL))))
+	{
+		/* Fall back to plain UP draws. */
+		if (batcher->vb)
+			IDirect3DVertexBuffer9_Release(batcher->vb);
+		batcher->vb = NULL;
+		batcher->enabled = FALSE;
+	}
+	return batcher;
+}
+
+void up_batcher_destroy(struct up_batcher *batcher)
+{
+	if (!batcher)
+		return;
+	up_batcher_flush(batcher);
+	if (batcher->vb)
+		IDirect3DVertexBuffer9_Release(batcher->vb);
+	if (batcher->ib)
+		IDirect3DIndexBuffer9_Release(batcher->ib);
+	free(batcher);
+}
+
+HRESULT up_batcher_flush(struct up_batcher *batcher)
+{
+	IDirect3DDevice9 *device = batcher->device;
+	UINT primitive_count;
+	HRESULT hr;
+
+	if (!batcher->vertices)
+		return D3D_OK;
+
+	IDirect3DVertexBuffer9_Unlock(batcher->vb);
+	IDirect3DIndexBuffer9_Unlock(batcher->ib);
+	batcher->vertices = NULL;
+	batcher->indices = NULL;
+
+	primitive_count = batcher->index_count / (batcher->type == D3DPT_TRIANGLELIST ? 3 : 2);
+	IDirect3DDevice9_SetStreamSource(device, 0, batcher->vb, 0, batcher->stride);
+	IDirect3DDevice9_SetIndices(device, batcher->ib);
+	hr = IDirect3DDevice9_DrawIndexedPrimitive(device, batcher->type, batcher->base_vertex,
+			0, batcher->vertex_count, batcher->ib_pos, primitive_count);
+	/* Leave the stream and index bindings the way a UP draw does. */
+	IDirect3DDevice9_SetStreamSource(device, 0, NULL, 0, 0);
+	IDirect3DDevice9_SetIndices(device, NULL);
+	++batcher->issued;
+
+	batcher->vb_pos = (batcher->base_vertex + batcher->vertex_count) * batcher->stride;
+	batcher->ib_pos += batcher->index_count;
+	batcher->vertex_count = 0;
+	batcher->index_count = 0;
+	return hr;
+}
+
+/* Makes room for vertex_count vertices and index_count indices in a batch of
+ * the given type and stride, flushing or starting a new batch as needed. */
+static BOOL reserve(struct up_batcher *batcher, D3DPRIMITIVETYPE type, UINT stride,
+		UINT vertex_count, UINT index_count)
+{
+	UINT base_vertex, vb_offset;
+	DWORD lock_flags = D3DLOCK_NOOVERWRITE;
+
+	if (vertex_count > UP_BATCHER_MAX_VERTICES || vertex_count * stride > UP_BATCHER_VB_SIZE
+			|| index_count > UP_BATCHER_IB_COUNT)
+		return FALSE;
+
+	if (batcher->vertices)
+	{
+		if (batcher->type == type && batcher->stride == stride
+				&& batcher->vertex_count + vertex_count <= UP_BATCHER_MAX_VERTICES
+				&& (batcher->base_vertex + batcher->vertex_count + vertex_count) * stride <= UP_BATCHER_VB_SIZE
+				&& batcher->ib_pos + batcher->index_count + index_count <= UP_BATCHER_IB_COUNT)
+			return TRUE;
+		up_batcher_flush(batcher);
+	}
+
+	base_vertex = (batcher->vb_pos + stride - 1) / stride;
+	if ((base_vertex + vertex_count) * stride > UP_BATCHER_VB_SIZE
+			|| batcher->ib_pos + index_count > UP_BATCHER_IB_COUNT)
+	{
+		/* Out of space, start over with fresh buffers. */
+		base_vertex = 0;
+		batcher->vb_pos = 0;
+		batcher->ib_pos = 0;
+		lock_flags = D3DLOCK_DISCARD;
+	}
+
+	vb_offset = base_vertex * stride;
+	if (FAILED(IDirect3DVertexBuffer9_Lock(batcher->vb, vb_offset, UP_BATCHER_VB_SIZE - vb_offset,
+			(void **)&batcher->vertices, lock_flags)))
+	{
+		batcher->vertices = NULL;
+		return FALSE;
+	}
+	if (FAILED(IDirect3DIndexBuffer9_Lock(batcher->ib, batcher->ib_pos * sizeof(WORD),
+			(UP_BATCHER_IB_COUNT - batcher->ib_pos) * sizeof(WORD), (void **)&batcher->indices, lock_flags)))
+	{
+		IDirect3DVertexBuffer9_Unlock(batcher->vb);
+		batcher->vertices = NULL;
+		batcher->indices = NULL;
+		return FALSE;
+	}
+
+	batcher->type = type;
+	batcher->stride = stride;
+	batcher->base_vertex = base_vertex;
+	return TRUE;
+}
+
+/* indices == NULL: the draw's vertex sequence is its own index list. */
+static void append(struct up_batcher *batcher, D3DPRIMITIVETYPE type, UINT primitive_count,
+		const void *indices, D3DFORMAT index_format, UINT min_index,
+		const void *data, UINT vertex_count, UINT stride)
+{
+	WORD *out = batcher->indices + batcher->index_count;
+	UINT first = batcher->vertex_count;
+	UINT corners[3], p, k, n, seq;
+
+	memcpy(batcher->vertices + first * stride, (const BYTE *)data + min_index * stride, vertex_count * stride);
+
+	for (p = 0; p < primitive_count; ++p)
+	{
+		n = primitive_corners(type, p, corners);
+		for (k = 0; k < n; ++k)
+		{
+			seq = corners[k];
+			if (indices)
+				seq = index_format == D3DFMT_INDEX32 ? ((const DWORD *)indices)[seq] : ((const WORD *)indices)[seq];
+			*out++ = (WORD)(first + seq - min_index);
+		}
+	}
+
+	batcher->vertex_count += vertex_count;
+	batcher->index_count += (UINT)(out - (batcher->indices + batcher->index_count));
+}
+
+HRESULT up_batcher_draw_primitive_up(struct up_batcher *batcher, D3DPRIMITIVETYPE type,
+		UINT primitive_count, const void *data, UINT stride)
+{
+	D3DPRIMITIVETYPE batch_type = list_type(type);
+	UINT vertex_count = sequence_length(type, primitive_count);
+	UINT index_count = primitive_count * (batch_type == D3DPT_TRIANGLELIST ? 3 : 2);
+
+	++batcher->submitted;
+	if (!batcher->enabled || !batch_type || !primitive_count
+			|| !reserve(batcher, batch_type, stride, vertex_count, index_count))
+	{
+		up_batcher_flush(batcher);
+		++batcher->issued;
+		return IDirect3DDevice9_DrawPrimitiveUP(batcher->device, type, primitive_count, data, stride);
+	}
+
+	append(batcher, type, primitive_count, NULL, D3DFMT_INDEX16, 0, data, vertex_count, stride);
+	return D3D_OK;
+}
+
+HRESULT up_batcher_draw_indexed_primitive_up(struct up_batcher *batcher, D3DPRIMITIVETYPE type,
+		UINT min_index, UINT vertex_count, UINT primitive_count, const void *indices,
+		D3DFORMAT index_format, const void *data, UINT stride)
+{
+	D3DPRIMITIVETYPE batch_type = list_type(type);
+	UINT index_count = primitive_count * (batch_type == D3DPT_TRIANGLELIST ? 3 : 2);
+
+	++batcher->submitted;
+	if (!batcher->enabled || !batch_type || !primitive_count
+			|| !reserve(batcher, batch_type, stride, vertex_count, index_count))
+	{
+		up_batcher_flush(batcher);
+		++batcher->issued;
+		return IDirect3DDevice9_DrawIndexedPrimitiveUP(batcher->device, type, min_index, vertex_count,
+				primitive_count, indices, index_format, data, stride);
+	}
+
+	append(batcher, type, primitive_count, indices, index_format, min_index, data, vertex_count, stride);
+	return D3D_OK;
+}
+
+HRESULT up_batcher_set_render_state(struct up_batcher *batcher, D3DRENDERSTATETYPE state, DWORD value)
+{
+	DWORD current;
+
+	if (batcher->vertices && (FAILED(IDirect3DDevice9_GetRenderState(batcher->device, state, &current))
+			|| current != value))
+		up_batcher_flush(batcher);
+	return IDirect3DDevice9_SetRenderState(batcher->device, state, value);
+}
+
+HRESULT up_batcher_set_fvf(struct up_batcher *batcher, DWORD fvf)
+{
+	DWORD current;
+
+	if (batcher->vertices && (FAILED(IDirect3DDevice9_GetFVF(batcher->device, &current)) || current != fvf))
+		up_batcher_flush(batcher);
+	return IDirect3DDevice9_SetFVF(batcher->device, fvf);
+}
+
+HRESULT up_batcher_set_transform(struct up_batcher *batcher, D3DTRANSFORMSTATETYPE state, const D3DMATRIX *matrix)
+{
+	up_batcher_flush(batcher);
+	return IDirect3DDevice9_SetTransform(batcher->device, state, matrix);
+}
+
+HRESULT up_batcher_set_vertex_shader(struct up_batcher *batcher, IDirect3DVertexShader9 *shader)
+{
+	up_batcher_flush(batcher);
+	return IDirect3DDevice9_SetVertexShader(batcher->device, shader);
+}
+
+HRESULT up_batcher_set_pixel_shader(struct up_batcher *batcher, IDirect3DPixelShader9 *shader)
+{
+	up_batcher_flush(batcher);
+	return IDirect3DDevice9_SetPixelShader(batcher->device, shader);
+}
+
+HRESULT up_batcher_clear(struct up_batcher *batcher, DWORD rect_count, const D3DRECT *rects,
+		DWORD flags, D3DCOLOR color, float z, DWORD stencil)
+{
+	up_batcher_flush(batcher);
+	return IDirect3DDevice9_Clear(batcher->device, rect_count, rects, flags, color, z, stencil);
+}
+
+HRESULT up_batcher_end_scene(struct up_batcher *batcher)
+{
+	up_batcher_flush(batcher);
+	return IDirect3DDevice9_EndScene(batcher->device);
+}
+
+void up_batcher_get_stats(const struct up_batcher *batcher, unsigned int *submitted, unsigned int *issued)
+{
+	*submitted = batcher->submitted;
+	*issued = batcher->issued;
+}
@@ -0,0 +1,43 @@
+#ifndef __up_batcher__
+#define __up_batcher__
+
+#include <d3d9.h>
+
+/* Coalesces DrawPrimitiveUP / DrawIndexedPrimitiveUP calls. The vertices and
+ * rebased indices of consecutive UP draws with the same FVF and stride are
+ * appended to one dynamic vertex / index buffer and drawn with a single
+ * DrawIndexedPrimitive when the batch is flushed. Strips and fans are turned
+ * into lists so they can share a batch.
+ *
+ * State changes that may affect a pending batch have to go through the
+ * up_batcher_set_* wrappers (or be preceded by up_batcher_flush()), they
+ * flush before touching the device. up_batcher_end_scene() flushes too. */
+
+struct up_batcher;
+
+/* enabled == FALSE passes every draw straight to the device, for comparison. */
+struct up_batcher *up_batcher_create(IDirect3DDevice9 *device, BOOL enabled);
+void up_batcher_destroy(struct up_batcher *batcher);
+
+HRESULT up_batcher_draw_primitive_up(struct up_batcher *batcher, D3DPRIMITIVETYPE type,
+		UINT primitive_count, const void *data, UINT stride);
+HRESULT up_batcher_draw_indexed_primitive_up(struct up_batcher *batcher, D3DPRIMITIVETYPE type,
+		UINT min_index, UINT vertex_count, UINT primitive_count, const void *indices,
+		D3DFORMAT index_format, const void *data, UINT stride);
+
+/* Issues the pending batch, if any. */
+HRESULT up_batcher_flush(struct up_batcher *batcher);
+
+HRESULT up_batcher_set_render_state(struct up_batcher *batcher, D3DRENDERSTATETYPE state, DWORD value);
+HRESULT up_batcher_set_fvf(struct up_batcher *batcher, DWORD fvf);
+HRESULT up_batcher_set_transform(struct up_batcher *batcher, D3DTRANSFORMSTATETYPE state, const D3DMATRIX *matrix);
+HRESULT up_batcher_set_vertex_shader(struct up_batcher *batcher, IDirect3DVertexShader9 *shader);
+HRESULT up_batcher_set_pixel_shader(struct up_batcher *batcher, IDirect3DPixelShader9 *shader);
+HRESULT up_batcher_clear(struct up_batcher *batcher, DWORD rect_count, const D3DRECT *rects,
+		DWORD flags, D3DCOLOR color, float z, DWORD stencil);
+HRESULT up_batcher_end_scene(struct up_batcher *batcher);
+
+/* UP draws received and draw calls actually sent to the device. */
+void up_batcher_get_stats(const struct up_batcher *batcher, unsigned int *submitted, unsigned int *issued);
+
+#endif /* __up_batcher__ */
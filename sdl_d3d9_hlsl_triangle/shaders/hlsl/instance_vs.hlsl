@@ -0,0 +1,27 @@
+// One draw per instance: the object space position is scaled and moved by
+// c4 (xyz offset, w scale) and projected with the view * projection in c0-c3.
+row_major float4x4 ViewProj : register(c0);
+float4 Instance : register(c4);
+
+struct VSInputInstance
+{
+    float4  Position    : POSITION;
+    float4  Color       : COLOR;
+};
+
+struct VS_OUTPUT
+{
+    float4 Position : POSITION;
+    float4 Color : COLOR;
+};
+
+//Vertex Shader
+VS_OUTPUT main(VSInputInstance VertexIn)
+{
+    VS_OUTPUT VertexOut;
+    float3 world = VertexIn.Position.xyz * Instance.w + Instance.xyz;
+    VertexOut.Position = mul(float4(world, 1.0f), ViewProj);
+    VertexOut.Color = VertexIn.Color;
+
+    return VertexOut;
+}
@@ -0,0 +1,28 @@
+// One draw per object: object space to world with the object's own matrix
+// in c4-c7, then the view * projection in c0-c3. c8 tints the vertex color.
+row_major float4x4 ViewProj : register(c0);
+row_major float4x4 World : register(c4);
+float4 Tint : register(c8);
+
+struct VS_INPUT
+{
+    float4 Position : POSITION;
+    float4 Color : COLOR;
+};
+
+struct VS_OUTPUT
+{
+    float4 Position : POSITION;
+    float4 Color : COLOR;
+};
+
+//Vertex Shader
+VS_OUTPUT main(VS_INPUT VertexIn)
+{
+    VS_OUTPUT VertexOut;
+    float4 world = mul(VertexIn.Position, World);
+    VertexOut.Position = mul(world, ViewProj);
+    VertexOut.Color = VertexIn.Color * Tint;
+
+    return VertexOut;
+}
@@ -0,0 +1,27 @@
+// Decodes the quantized positions written by vtx::PackVertices().
+// FLOAT16/SHORT4N/UBYTE4N/DEC3N are expanded to floats by the vertex fetch,
+// c0/c1 scale and offset them back into object space (w ends up as 1).
+float4 PosScale : register(c0);
+float4 PosBias  : register(c1);
+
+struct VSInputPacked
+{
+    float4  Position    : POSITION;
+    float4  Color       : COLOR;
+};
+
+struct VS_OUTPUT
+{
+    float4 Position : POSITION;
+    float4 Color : COLOR;
+};
+
+//Vertex Shader
+VS_OUTPUT main(VSInputPacked VertexIn)
+{
+    VS_OUTPUT VertexOut;
+    VertexOut.Position = VertexIn.Position * PosScale + PosBias;
+    VertexOut.Color = VertexIn.Color;
+
+    return VertexOut;
+}
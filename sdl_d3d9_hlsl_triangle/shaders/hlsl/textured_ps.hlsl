@@ -0,0 +1,8 @@
+// The texture in s0 modulated by the vertex color.
+sampler2D Texture : register(s0);
+
+//Pixel Shader
+float4 main(float2 TexCoord : TEXCOORD0, float4 Color : COLOR) : COLOR
+{
+    return tex2D(Texture, TexCoord) * Color;
+}
@@ -0,0 +1,26 @@
+// Same input as min_vs, with the texture coordinates and the vertex color
+// passed on to textured_ps. Positions are already in clip space.
+struct VSInputTxVc
+{
+    float4  Position    : POSITION;
+    float2  TexCoord    : TEXCOORD0;
+    float4  Color       : COLOR;
+};
+
+struct VS_OUTPUT
+{
+    float4 Position : POSITION;
+    float2 TexCoord : TEXCOORD0;
+    float4 Color : COLOR;
+};
+
+//Vertex Shader
+VS_OUTPUT main(VSInputTxVc VertexIn)
+{
+    VS_OUTPUT VertexOut;
+    VertexOut.Position = VertexIn.Position;
+    VertexOut.TexCoord = VertexIn.TexCoord;
+    VertexOut.Color = VertexIn.Color;
+
+    return VertexOut;
+}
@@ -0,0 +1,8 @@
+// Scales the interpolated color by c0, e.g. a fade set once per frame.
+float4 Scale : register(c0);
+
+//Pixel Shader
+float4 main(float4 Color : COLOR) : COLOR
+{
+    return Color * Scale;
+}
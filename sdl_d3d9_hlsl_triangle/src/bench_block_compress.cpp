@@ -0,0 +1,142 @@
+#include "benchmarks.h"
+#include "bench_util.h"
+#include "block_compress.h"
+#include "d3d_utility.h"
+#include "resource_registry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <SDL2/SDL.h>
+
+namespace
+{
+	// Something between a photo and a UI atlas: smooth gradients, hard
+	// edges, some noise and an alpha ramp with cut-out holes.
+	void GenerateImage(UINT size, std::vector<uint8_t>& pixels)
+	{
+		pixels.resize(static_cast<size_t>(size) * size * 4);
+		uint32_t seed = 12345;
+		for (UINT y = 0; y < size; y++)
+		{
+			uint8_t* row = pixels.data() + static_cast<size_t>(y) * size * 4;
+			for (UINT x = 0; x < size; x++)
+			{
+				seed = seed * 1664525u + 1013904223u;
+				const int noise = static_cast<int>(seed >> 28) - 8;
+				const float u = static_cast<float>(x) / size, v = static_cast<float>(y) / size;
+				const bool stripe = ((x / 37) ^ (y / 23)) & 1;
+				const int r = static_cast<int>(255.0f * u) + noise;
+				const int g = static_cast<int>(128.0f + 127.0f * std::sin(v * 12.0f)) + noise;
+				const int b = stripe ? 40 : static_cast<int>(255.0f * (1.0f - u * v));
+				const bool hole = ((x / 64) + (y / 64)) % 5 == 0;
+				row[x * 4 + 0] = static_cast<uint8_t>(std::clamp(b, 0, 255));
+				row[x * 4 + 1] = static_cast<uint8_t>(std::clamp(g, 0, 255));
+				row[x * 4 + 2] = static_cast<uint8_t>(std::clamp(r, 0, 255));
+				row[x * 4 + 3] = hole ? 0 : static_cast<uint8_t>(255.0f * v);
+			}
+		}
+	}
+
+	// Best of `runs`, MPixels/s.
+	template <typename Fn>
+	double Throughput(UINT size, int runs, Fn&& compress)
+	{
+		double best = 0.0;
+		for (int run = 0; run < runs; run++)
+		{
+			const double start = bench::NowMs();
+			compress();
+			const double ms = bench::NowMs() - start;
+			if (ms > 0.0)
+				best = std::max(best, static_cast<double>(size) * size / (ms * 1000.0));
+		}
+		return best;
+	}
+
+	// Round trip through a texture the way a loader would: lock level 0 of
+	// a managed DXT texture and compress straight into it.
+	bool UploadCompressed(IDirect3DDevice9* device, tex::BlockFormat format, const std::vector<uint8_t>& pixels,
+		UINT size, task::ThreadPool* pool, double* ms)
+	{
+		IDirect3DTexture9* texture = nullptr;
+		const double start = bench::NowMs();
+		if (FAILED(d3d::CreateTexture(device, size, size, 1, 0, tex::D3DFormat(format), D3DPOOL_MANAGED, &texture)))
+			return false;
+
+		D3DLOCKED_RECT locked;
+		if (FAILED(texture->LockRect(0, &locked, nullptr, 0)))
+		{
+			d3d::Release(texture);
+			return false;
+		}
+		tex::Compress(format, pixels.data(), size * 4, size, size, static_cast<uint8_t*>(locked.pBits),
+			static_cast<UINT>(locked.Pitch), pool);
+		texture->UnlockRect(0);
+		texture->PreLoad();
+		bench::WaitForGpu(device);
+		*ms = bench::NowMs() - start;
+
+		d3d::Release(texture);
+		return true;
+	}
+}
+
+bool bench::RunBlockCompress(IDirect3DDevice9* device, UINT size, int runs)
+{
+	size = std::max(4u, size & ~3u);
+	std::vector<uint8_t> pixels, decoded(static_cast<size_t>(size) * size * 4);
+	GenerateImage(size, pixels);
+
+	task::ThreadPool& pool = task::ThreadPool::Shared();
+	const size_t rgbaBytes = d3d::SurfaceBytes(D3DFMT_A8R8G8B8, size, size);
+	SDL_Log("block compress: %ux%u, %s kernel, %u workers, best of %d runs", size, size, tex::SimdName(),
+		pool.WorkerCount(), runs);
+
+	bool ok = true;
+	const tex::BlockFormat formats[] = { tex::BlockFormat::BC1, tex::BlockFormat::BC3 };
+	for (tex::BlockFormat format : formats)
+	{
+		const bool alpha = format == tex::BlockFormat::BC3;
+		const char* name = alpha ? "BC3" : "BC1";
+		const UINT blockPitch = size / 4 * tex::BlockBytes(format);
+		std::vector<uint8_t> reference(static_cast<size_t>(blockPitch) * (size / 4)), blocks(reference.size());
+
+		const double scalar = Throughput(size, runs, [&]
+		{
+			tex::Compress(format, pixels.data(), size * 4, size, size, reference.data(), blockPitch, nullptr,
+				tex::Kernel::Scalar);
+		});
+		const double simd = Throughput(size, runs, [&]
+		{
+			tex::Compress(format, pixels.data(), size * 4, size, size, blocks.data(), blockPitch);
+		});
+		const bool identical = blocks == reference;
+		const double threaded = Throughput(size, runs, [&]
+		{
+			tex::Compress(format, pixels.data(), size * 4, size, size, blocks.data(), blockPitch, &pool);
+		});
+		ok = identical && blocks == reference && ok; // the pool must not change a bit either
+
+		// BC1 carries no alpha, compare color only.
+		tex::Decompress(format, blocks.data(), blockPitch, size, size, decoded.data(), size * 4);
+		const double psnr = tex::Psnr(pixels.data(), size * 4, decoded.data(), size * 4, size, size, alpha);
+
+		SDL_Log("block compress: %s scalar %8.1f MPixels/s, %s %8.1f (x%.1f), %s threaded %8.1f (x%.1f)",
+			name, scalar, tex::SimdName(), simd, scalar > 0.0 ? simd / scalar : 0.0,
+			tex::SimdName(), threaded, scalar > 0.0 ? threaded / scalar : 0.0);
+		SDL_Log("block compress: %s PSNR %.2f dB%s, %s the scalar reference, %.2f MB vs %.2f MB A8R8G8B8 (1/%zu)",
+			name, psnr, alpha ? " with alpha" : "", identical ? "bit-identical to" : "DIFFERS from",
+			blocks.size() / (1024.0 * 1024.0), rgbaBytes / (1024.0 * 1024.0), rgbaBytes / blocks.size());
+
+		double uploadMs = 0.0;
+		if (FAILED(bench::CheckTextureFormat(device, 0, tex::D3DFormat(format))))
+			SDL_Log("block compress: %s textures not supported by the device", name);
+		else if (UploadCompressed(device, format, pixels, size, &pool, &uploadMs))
+			SDL_Log("block compress: %s texture created, compressed and uploaded in %.2f ms", name, uploadMs);
+		else
+			ok = false;
+	}
+	return ok;
+}
@@ -0,0 +1,231 @@
+#include "benchmarks.h"
+#include "bench_util.h"
+#include "buffer_pool.h"
+#include "shader_util.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <SDL2/SDL.h>
+
+namespace
+{
+	struct GridVertex
+	{
+		float x, y, z;
+		uint32_t color;
+	};
+	const DWORD GridFVF = D3DFVF_XYZ | D3DFVF_DIFFUSE;
+
+	struct GridMesh
+	{
+		std::vector<GridVertex> vertices;
+		std::vector<uint16_t> indices;
+	};
+
+	// Small n x n quad grids of different sizes scattered over the screen,
+	// the kind of many-small-meshes scene where binds add up.
+	void GenerateGrid(std::mt19937& rng, GridMesh& mesh)
+	{
+		std::uniform_int_distribution<int> cells(1, 12);
+		std::uniform_real_distribution<float> pos(-0.95f, 0.9f);
+		const int n = cells(rng);
+		const float x0 = pos(rng), y0 = pos(rng), step = 0.05f / n;
+		const uint32_t color = 0xff000000 | (rng() & 0x00ffffff);
+
+		mesh.vertices.clear();
+		mesh.indices.clear();
+		for (int y = 0; y <= n; y++)
+			for (int x = 0; x <= n; x++)
+				mesh.vertices.push_back({ x0 + x * step, y0 + y * step, 0.5f, color });
+		for (int y = 0; y < n; y++)
+			for (int x = 0; x < n; x++)
+			{
+				const uint16_t i = static_cast<uint16_t>(y * (n + 1) + x);
+				const uint16_t quad[6] = { i, static_cast<uint16_t>(i + n + 1), static_cast<uint16_t>(i + 1),
+					static_cast<uint16_t>(i + 1), static_cast<uint16_t>(i + n + 1), static_cast<uint16_t>(i + n + 2) };
+				mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+			}
+	}
+
+	void LogPoolStats(const char* when, const d3d::BufferPoolStats& s)
+	{
+		SDL_Log("buffer pool: %-12s %u slabs, %u meshes, vertices %.1f%% used, indices %.1f%% used, "
+			"%u free ranges, fragmentation %.2f",
+			when, s.slabs, s.allocations,
+			s.vertexCapacity ? 100.0 * s.vertexUsed / s.vertexCapacity : 0.0,
+			s.indexCapacity ? 100.0 * s.indexUsed / s.indexCapacity : 0.0,
+			s.freeRanges, s.fragmentation);
+	}
+
+	template<class DrawFn> void TimeFrames(IDirect3DDevice9* device, int frames, bench::FrameStats& stats, DrawFn draw)
+	{
+		stats.Reserve(frames);
+		for (int frame = -5; frame < frames; frame++) // 5 warm-up frames
+		{
+			double start = bench::NowMs();
+			device->Clear(0, 0, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER, 0xffffffff, 1.0f, 0);
+			device->BeginScene();
+			draw();
+			device->EndScene();
+			device->Present(0, 0, 0, 0);
+			bench::WaitForGpu(device);
+			if (frame >= 0)
+				stats.Add(bench::NowMs() - start);
+		}
+	}
+}
+
+bool bench::RunBufferPool(IDirect3DDevice9* device, size_t meshCount, int frames)
+{
+	if (meshCount == 0)
+		return false;
+
+	IDirect3DVertexShader9* vs = d3d::LoadVertexShader(device, "shaders/hlsl/min_vs.hlsl");
+	IDirect3DPixelShader9* ps = d3d::LoadPixelShader(device, "shaders/hlsl/min_ps.hlsl");
+	if (!vs || !ps)
+	{
+		d3d::Release(vs);
+		d3d::Release(ps);
+		return false;
+	}
+
+	std::mt19937 rng(99);
+	std::vector<GridMesh> meshes(meshCount);
+	for (GridMesh& m : meshes)
+		GenerateGrid(rng, m);
+
+	// One vertex + index buffer per mesh, like the Triangle global used to be.
+	struct OwnBuffers
+	{
+		IDirect3DVertexBuffer9* vb = nullptr;
+		IDirect3DIndexBuffer9* ib = nullptr;
+	};
+	std::vector<OwnBuffers> own(meshCount);
+	bool ok = true;
+	for (size_t i = 0; i < meshCount && ok; i++)
+	{
+		const GridMesh& m = meshes[i];
+		void* data = nullptr;
+		ok = SUCCEEDED(d3d::CreateVertexBuffer(device, static_cast<UINT>(m.vertices.size() * sizeof(GridVertex)),
+				D3DUSAGE_WRITEONLY, GridFVF, D3DPOOL_MANAGED, &own[i].vb)) &&
+			SUCCEEDED(d3d::CreateIndexBuffer(device, static_cast<UINT>(m.indices.size() * sizeof(uint16_t)),
+				D3DUSAGE_WRITEONLY, D3DFMT_INDEX16, D3DPOOL_MANAGED, &own[i].ib));
+		if (!ok)
+			break;
+		own[i].vb->Lock(0, 0, &data, 0);
+		memcpy(data, m.vertices.data(), m.vertices.size() * sizeof(GridVertex));
+		own[i].vb->Unlock();
+		own[i].ib->Lock(0, 0, &data, 0);
+		memcpy(data, m.indices.data(), m.indices.size() * sizeof(uint16_t));
+		own[i].ib->Unlock();
+	}
+
+	d3d::BufferPool pool;
+	pool.Init(device, sizeof(GridVertex), GridFVF, 0x10000, 0x30000);
+	std::vector<d3d::PoolAllocation> allocations(meshCount);
+	std::string error;
+	for (size_t i = 0; i < meshCount && ok; i++)
+	{
+		const GridMesh& m = meshes[i];
+		ok = pool.Allocate(m.vertices.data(), static_cast<UINT>(m.vertices.size()),
+			m.indices.data(), static_cast<UINT>(m.indices.size()), &allocations[i], error);
+	}
+
+	if (ok)
+	{
+		SDL_Log("buffer pool: %zu meshes, %d frames per path", meshCount, frames);
+		LogPoolStats("filled", pool.Stats());
+
+		device->SetRenderState(D3DRS_CULLMODE, D3DCULL_NONE);
+		device->SetVertexShader(vs);
+		device->SetPixelShader(ps);
+		device->SetFVF(GridFVF);
+
+		// Scene order is random with respect to slabs.
+		std::vector<size_t> order(meshCount);
+		for (size_t i = 0; i < meshCount; i++)
+			order[i] = i;
+		std::shuffle(order.begin(), order.end(), rng);
+
+		FrameStats ownStats;
+		TimeFrames(device, frames, ownStats, [&]()
+		{
+			for (size_t i : order)
+			{
+				const GridMesh& m = meshes[i];
+				device->SetStreamSource(0, own[i].vb, 0, sizeof(GridVertex));
+				device->SetIndices(own[i].ib);
+				device->DrawIndexedPrimitive(D3DPT_TRIANGLELIST, 0, 0, static_cast<UINT>(m.vertices.size()),
+					0, static_cast<UINT>(m.indices.size() / 3));
+			}
+		});
+
+		std::vector<d3d::PoolAllocation> unsorted(meshCount);
+		for (size_t i = 0; i < meshCount; i++)
+			unsorted[i] = allocations[order[i]];
+		std::vector<d3d::PoolAllocation> sorted(unsorted);
+		std::sort(sorted.begin(), sorted.end(), d3d::BufferPool::SlabOrder);
+
+		uint64_t binds = pool.Stats().binds;
+		pool.Unbind();
+		FrameStats unsortedStats;
+		TimeFrames(device, frames, unsortedStats, [&]() { for (const d3d::PoolAllocation& a : unsorted) pool.Draw(a); });
+		const uint64_t unsortedBinds = pool.Stats().binds - binds;
+
+		binds = pool.Stats().binds;
+		pool.Unbind();
+		FrameStats sortedStats;
+		TimeFrames(device, frames, sortedStats, [&]() { for (const d3d::PoolAllocation& a : sorted) pool.Draw(a); });
+		const uint64_t sortedBinds = pool.Stats().binds - binds;
+
+		const int timed = frames + 5;
+		SDL_Log("buffer pool: %-18s frame avg %7.3f ms p95 %7.3f ms  %zu binds/frame",
+			"buffer per mesh", ownStats.Average(), ownStats.Percentile(95.0), meshCount);
+		SDL_Log("buffer pool: %-18s frame avg %7.3f ms p95 %7.3f ms  %.1f binds/frame",
+			"pool, scene order", unsortedStats.Average(), unsortedStats.Percentile(95.0),
+			static_cast<double>(unsortedBinds) / timed);
+		SDL_Log("buffer pool: %-18s frame avg %7.3f ms p95 %7.3f ms  %.1f binds/frame",
+			"pool, slab order", sortedStats.Average(), sortedStats.Percentile(95.0),
+			static_cast<double>(sortedBinds) / timed);
+
+		// Streaming churn: replace random meshes with new ones of other
+		// sizes and see what that does to occupancy and fragmentation.
+		std::uniform_int_distribution<size_t> pick(0, meshCount - 1);
+		GridMesh replacement;
+		for (int round = 1; round <= 4 && ok; round++)
+		{
+			for (size_t n = 0; n < meshCount / 4 && ok; n++)
+			{
+				d3d::PoolAllocation& a = allocations[pick(rng)];
+				pool.Free(a);
+				GenerateGrid(rng, replacement);
+				ok = pool.Allocate(replacement.vertices.data(), static_cast<UINT>(replacement.vertices.size()),
+					replacement.indices.data(), static_cast<UINT>(replacement.indices.size()), &a, error);
+			}
+			char when[32];
+			snprintf(when, sizeof(when), "churn %d/4", round);
+			LogPoolStats(when, pool.Stats());
+		}
+	}
+
+	if (!ok)
+		SDL_Log("buffer pool: %s", error.empty() ? "can't create per-mesh buffers" : error.c_str());
+
+	device->SetStreamSource(0, nullptr, 0, 0);
+	device->SetIndices(nullptr);
+	device->SetVertexShader(nullptr);
+	device->SetPixelShader(nullptr);
+	for (OwnBuffers& b : own)
+	{
+		d3d::Release(b.vb);
+		d3d::Release(b.ib);
+	}
+	pool.Release();
+	d3d::Release(vs);
+	d3d::Release(ps);
+	return ok;
+}
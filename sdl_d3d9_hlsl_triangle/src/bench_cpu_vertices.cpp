@@ -0,0 +1,228 @@
+#include "benchmarks.h"
+#include "bench_util.h"
+#include "cpu_vertex_pipeline.h"
+#include "d3d_math.h"
+#include "d3d_utility.h"
+#include "indexed_mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <SDL2/SDL.h>
+
+namespace
+{
+	struct TerrainVertex
+	{
+		float x, y, z;
+		uint32_t color;
+	};
+
+	// Rolling terrain around the origin, large enough that the camera is
+	// always inside it: some triangles are rejected, some cross the near
+	// plane and get clipped.
+	void GenerateTerrain(unsigned side, vtx::VertexSoA& soa, std::vector<uint32_t>& indices)
+	{
+		soa.Resize(static_cast<size_t>(side) * side);
+		const float size = 400.0f;
+		for (unsigned y = 0; y < side; y++)
+		{
+			for (unsigned x = 0; x < side; x++)
+			{
+				const float px = -size * 0.5f + size * x / (side - 1);
+				const float pz = -size * 0.5f + size * y / (side - 1);
+				const float h = 4.0f * std::sin(px * 0.05f) * std::cos(pz * 0.07f);
+				const uint32_t g = static_cast<uint32_t>(128.0f + h * 25.0f);
+				soa.Set(y * side + x, px, h, pz, 0xff000000 | (g << 8) | ((x * 7) & 0x3f) << 16 | 0x20);
+			}
+		}
+
+		indices.clear();
+		indices.reserve(static_cast<size_t>(side - 1) * (side - 1) * 6);
+		for (unsigned y = 0; y + 1 < side; y++)
+		{
+			for (unsigned x = 0; x + 1 < side; x++)
+			{
+				uint32_t a = y * side + x, b = a + 1, c = a + side, d = c + 1;
+				indices.insert(indices.end(), { a, c, b, b, c, d });
+			}
+		}
+	}
+
+	// Camera low over the terrain, circling and looking outwards.
+	void CameraState(int frame, const D3DVIEWPORT9& viewport, vtx::PipelineState* state)
+	{
+		const float angle = frame * 0.01f;
+		D3DVECTOR eye = { 20.0f * std::cos(angle), 6.0f, 20.0f * std::sin(angle) };
+		D3DVECTOR at = { eye.x + std::cos(angle * 3.0f), 5.0f, eye.z + std::sin(angle * 3.0f) };
+		D3DVECTOR up = { 0.0f, 1.0f, 0.0f };
+
+		d3d::MatrixIdentity(&state->world);
+		d3d::MatrixLookAtLH(&state->view, &eye, &at, &up);
+		d3d::MatrixPerspectiveFovLH(&state->projection, 3.14159265f * 0.33f,
+			static_cast<float>(viewport.Width) / static_cast<float>(viewport.Height), 1.0f, 150.0f);
+		state->viewport = viewport;
+		state->fogMode = D3DFOG_LINEAR;
+		state->fogStart = 40.0f;
+		state->fogEnd = 140.0f;
+	}
+
+	DWORD FloatBits(float f)
+	{
+		DWORD d;
+		memcpy(&d, &f, sizeof(d));
+		return d;
+	}
+
+	void SetFogStates(IDirect3DDevice9* device, const vtx::PipelineState& state, bool pretransformed)
+	{
+		device->SetRenderState(D3DRS_FOGENABLE, TRUE);
+		device->SetRenderState(D3DRS_FOGCOLOR, 0xff8090a0);
+		device->SetRenderState(D3DRS_FOGTABLEMODE, D3DFOG_NONE);
+		// Pretransformed vertices bring their fog factor in the specular alpha.
+		device->SetRenderState(D3DRS_FOGVERTEXMODE, pretransformed ? D3DFOG_NONE : state.fogMode);
+		device->SetRenderState(D3DRS_FOGSTART, FloatBits(state.fogStart));
+		device->SetRenderState(D3DRS_FOGEND, FloatBits(state.fogEnd));
+		device->SetRenderState(D3DRS_RANGEFOGENABLE, FALSE);
+	}
+
+	void LogFrames(const char* path, const bench::FrameStats& frames)
+	{
+		SDL_Log("cpu vertices: %-22s frame avg %7.3f ms p95 %7.3f ms", path, frames.Average(), frames.Percentile(95.0));
+	}
+}
+
+bool bench::RunCpuVertices(IDirect3DDevice9* device, size_t vertexCount, int frames)
+{
+	D3DCAPS9 caps;
+	device->GetDeviceCaps(&caps);
+	const UINT maxPrimitives = caps.MaxPrimitiveCount ? caps.MaxPrimitiveCount : 65535;
+	const size_t maxVertices = caps.MaxVertexIndex > 0xffff ? caps.MaxVertexIndex : 0xffff;
+	const unsigned side = static_cast<unsigned>(std::sqrt(static_cast<double>(std::min(vertexCount, maxVertices))));
+	if (side < 2)
+		return false;
+
+	vtx::VertexSoA soa;
+	std::vector<uint32_t> indices;
+	GenerateTerrain(side, soa, indices);
+	const size_t triangles = indices.size() / 3;
+
+	// The device path: the same terrain as FVF vertices, transformed and
+	// fogged by whatever vertex processing the device was created with.
+	std::vector<TerrainVertex> vertices(soa.Count());
+	for (size_t i = 0; i < vertices.size(); i++)
+		vertices[i] = { soa.x[i], soa.y[i], soa.z[i], soa.color[i] };
+	mesh::IndexedMesh terrain;
+	mesh::BuildOptions options;
+	options.optimizeVertexCache = false;
+	options.optimizeVertexFetch = false;
+	if (!mesh::CreateIndexedMesh(device, vertices.data(), vertices.size(), sizeof(TerrainVertex),
+		D3DFVF_XYZ | D3DFVF_DIFFUSE, indices.data(), indices.size(), options, &terrain, nullptr))
+		return false;
+
+	// Room for every triangle plus the extra ones clipping produces.
+	vtx::CpuVertexPipeline pipeline;
+	std::string error;
+	if (!pipeline.Create(device, static_cast<UINT>(triangles * 3 + triangles / 4 * 3), error))
+	{
+		SDL_Log("cpu vertices: %s", error.c_str());
+		mesh::ReleaseIndexedMesh(terrain);
+		return false;
+	}
+
+	D3DVIEWPORT9 viewport;
+	device->GetViewport(&viewport);
+	task::ThreadPool& pool = task::ThreadPool::Shared();
+	SDL_Log("cpu vertices: %zu vertices, %zu triangles, %s vertex processing, %s kernel, %u workers",
+		soa.Count(), triangles, d3d::UsesSoftwareVertexProcessing(device) ? "software" : "hardware",
+		vtx::PipelineSimdName(), pool.WorkerCount());
+
+	device->SetVertexShader(nullptr);
+	device->SetPixelShader(nullptr);
+	device->SetRenderState(D3DRS_LIGHTING, FALSE);
+	device->SetRenderState(D3DRS_CULLMODE, D3DCULL_NONE);
+
+	// 1. Device vertex processing.
+	FrameStats deviceFrames;
+	for (int frame = -5; frame < frames; frame++) // 5 warm-up frames
+	{
+		const double start = NowMs();
+		vtx::PipelineState state;
+		CameraState(frame, viewport, &state);
+		device->SetTransform(D3DTS_WORLD, &state.world);
+		device->SetTransform(D3DTS_VIEW, &state.view);
+		device->SetTransform(D3DTS_PROJECTION, &state.projection);
+		SetFogStates(device, state, false);
+
+		device->Clear(0, 0, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER, 0xff8090a0, 1.0f, 0);
+		device->BeginScene();
+		mesh::DrawIndexedMesh(device, terrain, maxPrimitives);
+		device->EndScene();
+		device->Present(0, 0, 0, 0);
+		WaitForGpu(device);
+		if (frame >= 0)
+			deviceFrames.Add(NowMs() - start);
+	}
+	LogFrames("device", deviceFrames);
+
+	// 2. Our pipeline: scalar, SIMD, SIMD on all workers.
+	struct Variant
+	{
+		std::string name;
+		vtx::PipelineKernel kernel;
+		task::ThreadPool* pool;
+	};
+	const Variant variants[] =
+	{
+		{ "cpu scalar", vtx::PipelineKernel::Scalar, nullptr },
+		{ std::string("cpu ") + vtx::PipelineSimdName(), vtx::PipelineKernel::Simd, nullptr },
+		{ std::string("cpu ") + vtx::PipelineSimdName() + " threaded", vtx::PipelineKernel::Simd, &pool },
+	};
+
+	bool ok = true;
+	for (const Variant& variant : variants)
+	{
+		FrameStats frameStats, transformMs, assembleMs, uploadMs;
+		size_t rejected = 0, clipped = 0;
+		for (int frame = -5; frame < frames; frame++)
+		{
+			const double start = NowMs();
+			vtx::PipelineState state;
+			CameraState(frame, viewport, &state);
+			SetFogStates(device, state, true);
+			pipeline.SetState(state);
+			if (!pipeline.Process(soa, indices.data(), indices.size(), variant.pool, variant.kernel))
+				ok = false;
+
+			device->Clear(0, 0, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER, 0xff8090a0, 1.0f, 0);
+			device->BeginScene();
+			pipeline.Draw(device);
+			device->EndScene();
+			device->Present(0, 0, 0, 0);
+			WaitForGpu(device);
+			if (frame >= 0)
+			{
+				const vtx::PipelineStats& stats = pipeline.Stats();
+				frameStats.Add(NowMs() - start);
+				transformMs.Add(stats.transformMs);
+				assembleMs.Add(stats.assembleMs);
+				uploadMs.Add(stats.uploadMs);
+				rejected += stats.rejected;
+				clipped += stats.clipped;
+			}
+		}
+
+		LogFrames(variant.name.c_str(), frameStats);
+		SDL_Log("cpu vertices: %-22s transform %.3f ms, assemble %.3f ms, upload %.3f ms, %zu rejected, %zu clipped per frame",
+			"", transformMs.Average(), assembleMs.Average(), uploadMs.Average(),
+			frames > 0 ? rejected / frames : 0, frames > 0 ? clipped / frames : 0);
+	}
+
+	device->SetRenderState(D3DRS_FOGENABLE, FALSE);
+	pipeline.Release();
+	mesh::ReleaseIndexedMesh(terrain);
+	return ok;
+}
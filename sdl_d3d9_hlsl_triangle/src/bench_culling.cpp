@@ -0,0 +1,193 @@
+#include "benchmarks.h"
+#include "bench_util.h"
+#include "culling.h"
+#include "d3d_math.h"
+#include "indexed_mesh.h"
+#include "shader_util.h"
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include <SDL2/SDL.h>
+
+namespace
+{
+	struct CubeVertex
+	{
+		float x, y, z;
+		uint32_t color;
+	};
+
+	bool CreateCube(IDirect3DDevice9* device, mesh::IndexedMesh* cube)
+	{
+		std::vector<CubeVertex> vertices;
+		for (int i = 0; i < 8; i++)
+		{
+			float x = (i & 1) ? 1.0f : -1.0f, y = (i & 2) ? 1.0f : -1.0f, z = (i & 4) ? 1.0f : -1.0f;
+			uint32_t color = 0xff000000 | ((i & 1) ? 0xff0000 : 0x400000) | ((i & 2) ? 0xff00 : 0x4000) | ((i & 4) ? 0xff : 0x40);
+			vertices.push_back({ x, y, z, color });
+		}
+		const uint32_t indices[] =
+		{
+			0, 2, 1, 1, 2, 3,  4, 5, 6, 5, 7, 6,  0, 1, 4, 1, 5, 4,
+			2, 6, 3, 3, 6, 7,  0, 4, 2, 2, 4, 6,  1, 3, 5, 3, 7, 5,
+		};
+		mesh::BuildOptions options;
+		options.optimizeVertexCache = false;
+		options.optimizeVertexFetch = false;
+		return mesh::CreateIndexedMesh(device, vertices.data(), vertices.size(), sizeof(CubeVertex),
+			D3DFVF_XYZ | D3DFVF_DIFFUSE, indices, sizeof(indices) / sizeof(indices[0]), options, cube, nullptr);
+	}
+
+	// Camera at the origin turning around the y axis and slowly nodding.
+	void CameraViewProj(int frame, float aspect, D3DMATRIX* viewProj)
+	{
+		const float yaw = frame * 0.01f, pitch = 0.3f * std::sin(frame * 0.007f);
+		D3DVECTOR eye = { 0.0f, 0.0f, 0.0f };
+		D3DVECTOR at = { std::sin(yaw) * std::cos(pitch), std::sin(pitch), std::cos(yaw) * std::cos(pitch) };
+		D3DVECTOR up = { 0.0f, 1.0f, 0.0f };
+
+		D3DMATRIX view, proj;
+		d3d::MatrixLookAtLH(&view, &eye, &at, &up);
+		d3d::MatrixPerspectiveFovLH(&proj, 3.14159265f * 0.33f, aspect, 1.0f, 1500.0f);
+		d3d::MatrixMultiply(viewProj, &view, &proj);
+	}
+}
+
+bool bench::RunCulling(IDirect3DDevice9* device, SDL_Window* window, size_t instances, int frames)
+{
+	if (instances == 0)
+		return false;
+
+	IDirect3DVertexShader9* vs = d3d::LoadVertexShader(device, "shaders/hlsl/instance_vs.hlsl");
+	IDirect3DPixelShader9* ps = d3d::LoadPixelShader(device, "shaders/hlsl/min_ps.hlsl");
+	mesh::IndexedMesh cube;
+	if (!vs || !ps || !CreateCube(device, &cube))
+	{
+		d3d::Release(vs);
+		d3d::Release(ps);
+		return false;
+	}
+
+	// Instances scattered around the camera, bounds and draw constants kept
+	// in separate arrays: the culler only touches the SoA boxes.
+	cull::BoxSoA boxes;
+	boxes.Resize(instances);
+	std::vector<float> constants(instances * 4);
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> pos(-1000.0f, 1000.0f), size(0.5f, 4.0f);
+	for (size_t i = 0; i < instances; i++)
+	{
+		float center[3] = { pos(rng), pos(rng), pos(rng) };
+		float scale = size(rng);
+		float extent[3] = { scale, scale, scale };
+		boxes.Set(i, center, extent);
+		constants[i * 4 + 0] = center[0];
+		constants[i * 4 + 1] = center[1];
+		constants[i * 4 + 2] = center[2];
+		constants[i * 4 + 3] = scale;
+	}
+
+	D3DVIEWPORT9 viewport;
+	device->GetViewport(&viewport);
+	const float aspect = static_cast<float>(viewport.Width) / static_cast<float>(viewport.Height);
+
+	device->SetRenderState(D3DRS_CULLMODE, D3DCULL_NONE);
+	device->SetVertexShader(vs);
+	device->SetPixelShader(ps);
+	device->SetStreamSource(0, cube.vb, 0, cube.stride);
+	device->SetIndices(cube.ib);
+	device->SetFVF(cube.fvf);
+
+	SDL_Log("culling: %zu instances, %s kernel, %u workers", instances, cull::SimdName(),
+		task::ThreadPool::Shared().WorkerCount());
+
+	task::ThreadPool& pool = task::ThreadPool::Shared();
+	std::vector<uint32_t> visible;
+	std::vector<cull::Frustum> frustums;
+	FrameStats cullStats, frameStats;
+	size_t visibleSum = 0;
+	bool quit = false;
+
+	for (int frame = 0; frame < frames && !quit; frame++)
+	{
+		SDL_Event ev;
+		while (SDL_PollEvent(&ev))
+		{
+			if (ev.type == SDL_QUIT || (ev.type == SDL_KEYDOWN && ev.key.keysym.scancode == SDL_SCANCODE_ESCAPE))
+				quit = true;
+		}
+
+		const double start = NowMs();
+		D3DMATRIX viewProj;
+		CameraViewProj(frame, aspect, &viewProj);
+		cull::Frustum frustum;
+		cull::ExtractFrustum(viewProj, &frustum);
+		frustums.push_back(frustum);
+
+		const double cullStart = NowMs();
+		const size_t count = cull::Cull(frustum, boxes, visible, &pool);
+		const double cullMs = NowMs() - cullStart;
+
+		device->Clear(0, 0, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER, 0xff202020, 1.0f, 0);
+		device->BeginScene();
+		device->SetVertexShaderConstantF(0, &viewProj.m[0][0], 4);
+		for (uint32_t i : visible)
+		{
+			device->SetVertexShaderConstantF(4, &constants[i * 4], 1);
+			device->DrawIndexedPrimitive(D3DPT_TRIANGLELIST, 0, 0, cube.vertexCount, 0, cube.indexCount / 3);
+		}
+		device->EndScene();
+		device->Present(0, 0, 0, 0);
+		WaitForGpu(device);
+
+		const double frameMs = NowMs() - start;
+		cullStats.Add(cullMs);
+		frameStats.Add(frameMs);
+		visibleSum += count;
+
+		char title[128];
+		snprintf(title, sizeof(title), "culling: %zu visible, %zu culled, cull %.3f ms",
+			count, instances - count, cullMs);
+		if (window)
+			SDL_SetWindowTitle(window, title);
+		if (frame % 60 == 0)
+			SDL_Log("culling: frame %d: %zu visible, %zu culled, cull %.3f ms, frame %.2f ms",
+				frame, count, instances - count, cullMs, frameMs);
+	}
+
+	if (cullStats.Count())
+	{
+		SDL_Log("culling: avg %.1f visible of %zu, cull avg %.3f ms p95 %.3f ms, frame avg %.2f ms",
+			static_cast<double>(visibleSum) / cullStats.Count(), instances,
+			cullStats.Average(), cullStats.Percentile(95.0), frameStats.Average());
+
+		// Same frustums again without drawing: scalar vs SIMD vs SIMD on the pool.
+		struct Variant { const char* name; cull::Kernel kernel; task::ThreadPool* pool; };
+		const Variant variants[] =
+		{
+			{ "scalar",         cull::Kernel::Scalar, nullptr },
+			{ "simd",           cull::Kernel::Simd,   nullptr },
+			{ "simd + threads", cull::Kernel::Simd,   &pool   },
+		};
+		for (const Variant& v : variants)
+		{
+			double start = NowMs();
+			for (const cull::Frustum& f : frustums)
+				cull::Cull(f, boxes, visible, v.pool, 16384, v.kernel);
+			double ms = (NowMs() - start) / frustums.size();
+			SDL_Log("culling: %-14s %.3f ms per frame, %.1f Mboxes/s", v.name, ms, ms > 0.0 ? instances / ms / 1000.0 : 0.0);
+		}
+	}
+
+	device->SetStreamSource(0, nullptr, 0, 0);
+	device->SetIndices(nullptr);
+	device->SetVertexShader(nullptr);
+	device->SetPixelShader(nullptr);
+	mesh::ReleaseIndexedMesh(cube);
+	d3d::Release(vs);
+	d3d::Release(ps);
+	return true;
+}
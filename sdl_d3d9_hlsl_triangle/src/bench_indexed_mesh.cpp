@@ -0,0 +1,188 @@
+#include "benchmarks.h"
+#include "bench_util.h"
+#include "indexed_mesh.h"
+#include "mesh_file.h"
+#include "mesh_optimizer.h"
+#include "shader_util.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include <SDL2/SDL.h>
+
+namespace
+{
+	struct GridVertex
+	{
+		float x, y, z;
+		uint32_t color;
+	};
+
+	// mesh::GenerateGridMesh() unpacked into a vertex array the bench can shuffle.
+	void GenerateGrid(unsigned size, std::vector<GridVertex>& vertices, std::vector<uint32_t>& indices)
+	{
+		mesh::MeshData data;
+		mesh::GenerateGridMesh(size, data);
+		static_assert(sizeof(GridVertex) == 16, "GridVertex must match the generated float3 + D3DCOLOR layout");
+		vertices.resize(data.vertices.size() / sizeof(GridVertex));
+		memcpy(vertices.data(), data.vertices.data(), data.vertices.size());
+		indices.swap(data.indices);
+	}
+
+	// Random triangle order and random vertex numbering, i.e. what an
+	// exporter that doesn't care produces.
+	void Shuffle(std::vector<GridVertex>& vertices, std::vector<uint32_t>& indices)
+	{
+		std::mt19937 rng(42);
+
+		std::vector<uint32_t> order(vertices.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::shuffle(order.begin(), order.end(), rng);
+		std::vector<GridVertex> shuffled(vertices.size());
+		for (size_t v = 0; v < vertices.size(); v++)
+			shuffled[order[v]] = vertices[v];
+		vertices.swap(shuffled);
+		for (uint32_t& i : indices)
+			i = order[i];
+
+		const size_t triCount = indices.size() / 3;
+		std::vector<uint32_t> tris(triCount);
+		std::iota(tris.begin(), tris.end(), 0);
+		std::shuffle(tris.begin(), tris.end(), rng);
+		std::vector<uint32_t> reordered(indices.size());
+		for (size_t t = 0; t < triCount; t++)
+			std::copy_n(&indices[tris[t] * 3], 3, &reordered[t * 3]);
+		indices.swap(reordered);
+	}
+
+	// The FIFO model against counts worked out by hand: a strip keeps its last
+	// two vertices, so 2 entries give (n + 2) / n; a row-order grid of `size`
+	// quads transforms every vertex once with 2 * size + 1 entries.
+	bool CheckCacheModel()
+	{
+		std::vector<uint32_t> strip;
+		for (uint32_t t = 0; t < 10; t++)
+			strip.insert(strip.end(), { t, t + 1 + (t & 1), t + 2 - (t & 1) });
+		const float stripAcmr = mesh::AnalyzeVertexCache(strip.data(), strip.size(), 12, 2).acmr;
+
+		std::vector<GridVertex> vertices;
+		std::vector<uint32_t> grid;
+		GenerateGrid(4, vertices, grid);
+		const float gridAcmr = mesh::AnalyzeVertexCache(grid.data(), grid.size(), vertices.size(), 9).acmr;
+
+		if (stripAcmr == 12.0f / 10.0f && gridAcmr == 25.0f / 32.0f)
+			return true;
+		SDL_Log("indexed mesh: cache model is off, strip ACMR %.3f (expected 1.200), grid ACMR %.4f (expected 0.7812)",
+			stripAcmr, gridAcmr);
+		return false;
+	}
+
+	double MeasureFrames(IDirect3DDevice9* device, const mesh::IndexedMesh& m, UINT maxPrimitives, int frames,
+		bench::FrameStats& stats)
+	{
+		stats.Clear();
+		for (int frame = -5; frame < frames; frame++)
+		{
+			double start = bench::NowMs();
+			device->Clear(0, 0, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER, 0xffffffff, 1.0f, 0);
+			device->BeginScene();
+			mesh::DrawIndexedMesh(device, m, maxPrimitives);
+			device->EndScene();
+			device->Present(0, 0, 0, 0);
+			bench::WaitForGpu(device);
+			if (frame >= 0)
+				stats.Add(bench::NowMs() - start);
+		}
+		return stats.Average();
+	}
+}
+
+bool bench::RunIndexedMesh(IDirect3DDevice9* device, unsigned gridSize, int frames)
+{
+	if (gridSize == 0 || !CheckCacheModel())
+		return false;
+
+	D3DCAPS9 caps;
+	device->GetDeviceCaps(&caps);
+	const UINT maxPrimitives = caps.MaxPrimitiveCount ? caps.MaxPrimitiveCount : 65535;
+
+	IDirect3DVertexShader9* vs = d3d::LoadVertexShader(device, "shaders/hlsl/min_vs.hlsl");
+	IDirect3DPixelShader9* ps = d3d::LoadPixelShader(device, "shaders/hlsl/min_ps.hlsl");
+	if (!vs || !ps)
+	{
+		d3d::Release(vs);
+		d3d::Release(ps);
+		return false;
+	}
+	device->SetVertexShader(vs);
+	device->SetPixelShader(ps);
+	device->SetRenderState(D3DRS_CULLMODE, D3DCULL_NONE);
+
+	std::vector<GridVertex> gridVertices, vertices;
+	std::vector<uint32_t> gridIndices, indices;
+	GenerateGrid(gridSize, gridVertices, gridIndices);
+	vertices = gridVertices;
+	indices = gridIndices;
+	Shuffle(vertices, indices);
+
+	SDL_Log("indexed mesh: %ux%u grid, %zu vertices, %zu triangles, %s indices",
+		gridSize, gridSize, vertices.size(), indices.size() / 3,
+		vertices.size() > 0xffff ? "32-bit" : "16-bit");
+
+	struct Case
+	{
+		const char* name;
+		const std::vector<GridVertex>* vertices;
+		const std::vector<uint32_t>* indices;
+		bool optimize;
+	};
+	const Case cases[] =
+	{
+		{ "grid order", &gridVertices, &gridIndices, false },
+		{ "shuffled",   &vertices,     &indices,     false },
+		{ "optimized",  &vertices,     &indices,     true  },
+	};
+
+	const DWORD fvf = D3DFVF_XYZ | D3DFVF_DIFFUSE;
+	bool ok = true;
+	for (const Case& c : cases)
+	{
+		mesh::BuildOptions options;
+		options.optimizeVertexCache = c.optimize;
+		options.optimizeVertexFetch = c.optimize;
+
+		mesh::IndexedMesh m;
+		mesh::BuildReport report;
+		if (!mesh::CreateIndexedMesh(device, c.vertices->data(), c.vertices->size(), sizeof(GridVertex), fvf,
+			c.indices->data(), c.indices->size(), options, &m, &report))
+		{
+			SDL_Log("indexed mesh: %s - can't create buffers (MaxVertexIndex %lu)",
+				c.name, static_cast<unsigned long>(caps.MaxVertexIndex));
+			ok = false;
+			continue;
+		}
+
+		FrameStats stats;
+		double avg = MeasureFrames(device, m, maxPrimitives, frames, stats);
+
+		if (c.optimize)
+			SDL_Log("indexed mesh: %-10s ACMR %.3f -> %.3f  ATVR %.3f -> %.3f  (optimizer %.1f ms)",
+				c.name, report.acmrBefore, report.acmrAfter, report.atvrBefore, report.atvrAfter, report.optimizeMs);
+		else
+			SDL_Log("indexed mesh: %-10s ACMR %.3f  ATVR %.3f", c.name, report.acmrBefore, report.atvrBefore);
+		SDL_Log("indexed mesh: %-10s frame avg %.3f ms p95 %.3f ms", c.name, avg, stats.Percentile(95.0));
+
+		mesh::ReleaseIndexedMesh(m);
+	}
+
+	device->SetStreamSource(0, nullptr, 0, 0);
+	device->SetIndices(nullptr);
+	device->SetVertexShader(nullptr);
+	device->SetPixelShader(nullptr);
+	d3d::Release(vs);
+	d3d::Release(ps);
+	return ok;
+}
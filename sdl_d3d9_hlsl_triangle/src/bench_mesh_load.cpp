@@ -0,0 +1,100 @@
+#include "benchmarks.h"
+#include "bench_util.h"
+#include "mesh_loader.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <SDL2/SDL.h>
+
+namespace
+{
+	// Writes a generated grid next to the device cache when no file is given.
+	std::string CookBenchMesh(std::string& error)
+	{
+		char* pref = SDL_GetPrefPath("q4a", "sdl_triangle");
+		std::string path = pref ? pref : "";
+		SDL_free(pref);
+		path += "bench_grid.mesh";
+
+		mesh::MeshData data;
+		mesh::GenerateGridMesh(1024, data);
+		mesh::BuildMeshlets(data);
+		if (!mesh::WriteMeshFile(path.c_str(), data, error))
+			return std::string();
+		return path;
+	}
+
+	double GBps(uint64_t bytes, double ms)
+	{
+		return ms > 0.0 ? bytes / (ms * 1.0e6) : 0.0;
+	}
+}
+
+bool bench::RunMeshLoad(IDirect3DDevice9* device, const char* path, int iterations)
+{
+	std::string error;
+	std::string file = path && *path ? path : CookBenchMesh(error);
+	if (file.empty())
+	{
+		SDL_Log("mesh load: %s", error.c_str());
+		return false;
+	}
+
+	mesh::LoadedMesh loaded;
+	mesh::LoadStats first;
+	if (!mesh::LoadMeshFile(device, file.c_str(), &loaded, error, 0, &first))
+	{
+		SDL_Log("mesh load: %s: %s", file.c_str(), error.c_str());
+		return false;
+	}
+	SDL_Log("mesh load: %s, %u vertices x %u bytes, %u indices (%s), %zu meshlets, %.1f MB",
+		file.c_str(), loaded.buffers.vertexCount, loaded.buffers.stride, loaded.buffers.indexCount,
+		loaded.buffers.indexFormat == D3DFMT_INDEX32 ? "32-bit" : "16-bit",
+		loaded.meshlets.size(), first.bytes / (1024.0 * 1024.0));
+	SDL_Log("mesh load: first load %.2f ms (%.2f GB/s)", first.totalMs, GBps(first.bytes, first.totalMs));
+	mesh::ReleaseLoadedMesh(loaded);
+
+	// Host memcpy of the same amount as an upper bound for the copy.
+	std::vector<uint8_t> src(first.bytes, 1), dst(first.bytes);
+	FrameStats memcpyStats;
+	for (int i = 0; i < iterations; i++)
+	{
+		double start = NowMs();
+		memcpy(dst.data(), src.data(), src.size());
+		memcpyStats.Add(NowMs() - start);
+	}
+	SDL_Log("mesh load: %-14s %.2f GB/s", "memcpy", GBps(first.bytes, memcpyStats.Min()));
+
+	const size_t chunks[] = { 0, 4 << 20, 1 << 20, 64 << 10 };
+	for (size_t chunk : chunks)
+	{
+		FrameStats total, copy;
+		double mapMs = 0.0;
+		for (int i = 0; i < iterations; i++)
+		{
+			mesh::LoadStats stats;
+			if (!mesh::LoadMeshFile(device, file.c_str(), &loaded, error, chunk, &stats))
+			{
+				SDL_Log("mesh load: %s", error.c_str());
+				return false;
+			}
+			mesh::ReleaseLoadedMesh(loaded);
+			total.Add(stats.totalMs);
+			copy.Add(stats.copyMs);
+			mapMs += stats.mapMs;
+		}
+
+		char name[32];
+		if (chunk)
+			snprintf(name, sizeof(name), "%zu KB chunks", chunk >> 10);
+		else
+			snprintf(name, sizeof(name), "single lock");
+		SDL_Log("mesh load: %-14s avg %.2f ms (%.2f GB/s), best %.2f GB/s, map %.3f ms, copy %.2f GB/s",
+			name, total.Average(), GBps(first.bytes, total.Average()), GBps(first.bytes, total.Min()),
+			mapMs / iterations, GBps(first.bytes, copy.Average()));
+	}
+	return true;
+}
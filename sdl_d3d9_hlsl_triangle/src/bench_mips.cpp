@@ -0,0 +1,193 @@
+#include "benchmarks.h"
+#include "bench_util.h"
+#include "d3d_utility.h"
+#include "mip_generator.h"
+#include "resource_registry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <SDL2/SDL.h>
+
+namespace
+{
+	// Gradients, thin stripes that alias when filtered badly, some noise.
+	void GenerateImage(UINT size, uint8_t* pixels, UINT pitch)
+	{
+		uint32_t seed = 777;
+		for (UINT y = 0; y < size; y++)
+		{
+			uint8_t* row = pixels + static_cast<size_t>(y) * pitch;
+			for (UINT x = 0; x < size; x++)
+			{
+				seed = seed * 1664525u + 1013904223u;
+				const int noise = static_cast<int>(seed >> 28) - 8;
+				const bool stripe = (x / 3 + y / 5) & 1;
+				row[x * 4 + 0] = static_cast<uint8_t>(std::clamp(static_cast<int>(x * 255 / size) + noise, 0, 255));
+				row[x * 4 + 1] = stripe ? 230 : 20;
+				row[x * 4 + 2] = static_cast<uint8_t>(y * 255 / size);
+				row[x * 4 + 3] = static_cast<uint8_t>(128.0 + 127.0 * std::sin(x * 0.01 + y * 0.02));
+			}
+		}
+	}
+
+	// Every level in system memory, laid out like a locked texture.
+	struct Chain
+	{
+		std::vector<std::vector<uint8_t>> storage;
+		std::vector<tex::MipLevel> levels;
+	};
+
+	void CreateChain(UINT size, Chain& chain)
+	{
+		for (UINT width = size, height = size;; width = std::max(1u, width / 2), height = std::max(1u, height / 2))
+		{
+			chain.storage.emplace_back(static_cast<size_t>(width) * height * 4);
+			tex::MipLevel level;
+			level.bits = chain.storage.back().data();
+			level.pitch = width * 4;
+			level.width = width;
+			level.height = height;
+			chain.levels.push_back(level);
+			if (width == 1 && height == 1)
+				break;
+		}
+	}
+
+	// Best of `runs` in ms.
+	template <typename Fn>
+	double BestMs(int runs, Fn&& fn)
+	{
+		double best = 0.0;
+		for (int run = 0; run < runs; run++)
+		{
+			const double start = bench::NowMs();
+			if (!fn())
+				return -1.0;
+			const double ms = bench::NowMs() - start;
+			best = run == 0 ? ms : std::min(best, ms);
+		}
+		return best;
+	}
+
+	bool FillLevel0(IDirect3DTexture9* texture, const tex::MipLevel& source)
+	{
+		D3DLOCKED_RECT rect;
+		if (FAILED(texture->LockRect(0, &rect, nullptr, 0)))
+			return false;
+		for (UINT y = 0; y < source.height; y++)
+			memcpy(static_cast<uint8_t*>(rect.pBits) + static_cast<size_t>(y) * rect.Pitch,
+				source.bits + static_cast<size_t>(y) * source.pitch, source.width * 4);
+		texture->UnlockRect(0);
+		return true;
+	}
+
+	// Our chain written into a managed texture against the runtime's
+	// D3DUSAGE_AUTOGENMIPMAP, both up to the point the GPU has the texture.
+	void LogTextureUpload(IDirect3DDevice9* device, const tex::MipLevel& source, task::ThreadPool& pool, int runs,
+		bool& ok)
+	{
+		const UINT size = source.width;
+		std::string error;
+		const double cpuMs = BestMs(runs, [&]
+		{
+			IDirect3DTexture9* texture = nullptr;
+			if (FAILED(d3d::CreateTexture(device, size, size, 0, 0, D3DFMT_A8R8G8B8, D3DPOOL_MANAGED, &texture)))
+				return false;
+			tex::MipOptions options;
+			const bool filled = FillLevel0(texture, source) && tex::GenerateMips(texture, options, &pool, error);
+			texture->PreLoad();
+			bench::WaitForGpu(device);
+			d3d::Release(texture);
+			return filled;
+		});
+		if (cpuMs < 0.0)
+		{
+			SDL_Log("mips: texture with generated mips failed: %s", error.empty() ? "CreateTexture failed" : error.c_str());
+			ok = false;
+		}
+		else
+		{
+			SDL_Log("mips: managed texture, box mips on the CPU  %8.2f ms", cpuMs);
+		}
+
+		if (bench::CheckTextureFormat(device, D3DUSAGE_AUTOGENMIPMAP, D3DFMT_A8R8G8B8) != D3D_OK)
+		{
+			SDL_Log("mips: managed texture, D3DUSAGE_AUTOGENMIPMAP not supported");
+			return;
+		}
+		const double autoMs = BestMs(runs, [&]
+		{
+			IDirect3DTexture9* texture = nullptr;
+			if (FAILED(d3d::CreateTexture(device, size, size, 0, D3DUSAGE_AUTOGENMIPMAP, D3DFMT_A8R8G8B8,
+				D3DPOOL_MANAGED, &texture)))
+				return false;
+			const bool filled = FillLevel0(texture, source);
+			texture->GenerateMipSubLevels();
+			texture->PreLoad();
+			bench::WaitForGpu(device);
+			d3d::Release(texture);
+			return filled;
+		});
+		if (autoMs < 0.0)
+			SDL_Log("mips: managed texture, D3DUSAGE_AUTOGENMIPMAP failed");
+		else
+			SDL_Log("mips: managed texture, D3DUSAGE_AUTOGENMIPMAP %8.2f ms", autoMs);
+	}
+}
+
+bool bench::RunMips(IDirect3DDevice9* device, UINT size, int runs)
+{
+	Chain chain;
+	CreateChain(size, chain);
+	const tex::MipLevel& source = chain.levels[0];
+	GenerateImage(size, source.bits, source.pitch);
+
+	task::ThreadPool& pool = task::ThreadPool::Shared();
+	const UINT count = static_cast<UINT>(chain.levels.size());
+	SDL_Log("mips: %ux%u, %u levels, %s kernel, %u workers, best of %d runs", size, size, count, tex::SimdName(),
+		pool.WorkerCount(), runs);
+
+	struct Variant
+	{
+		tex::MipFilter filter;
+		bool srgb;
+		const char* name;
+	};
+	const Variant variants[] =
+	{
+		{ tex::MipFilter::Box, false, "box" },
+		{ tex::MipFilter::Box, true, "box sRGB" },
+		{ tex::MipFilter::Kaiser, false, "kaiser" },
+		{ tex::MipFilter::Kaiser, true, "kaiser sRGB" },
+	};
+
+	const double megapixels = static_cast<double>(size) * size / 1e6;
+	for (const Variant& variant : variants)
+	{
+		tex::MipOptions options;
+		options.filter = variant.filter;
+		options.srgb = variant.srgb;
+
+		double ms[3];
+		for (int i = 0; i < 3; i++)
+		{
+			options.kernel = i == 0 ? tex::Kernel::Scalar : tex::Kernel::Simd;
+			ms[i] = BestMs(runs, [&]
+			{
+				tex::GenerateMips(chain.levels.data(), count, options, i == 2 ? &pool : nullptr);
+				return true;
+			});
+		}
+		SDL_Log("mips: %-11s scalar %8.2f ms, %s %8.2f ms (x%.1f), %s threaded %8.2f ms (x%.1f), %.0f MPixels/s",
+			variant.name, ms[0], tex::SimdName(), ms[1], ms[1] > 0.0 ? ms[0] / ms[1] : 0.0, tex::SimdName(), ms[2],
+			ms[2] > 0.0 ? ms[0] / ms[2] : 0.0, ms[2] > 0.0 ? megapixels / ms[2] * 1000.0 : 0.0);
+	}
+
+	bool ok = true;
+	LogTextureUpload(device, source, pool, std::min(runs, 3), ok);
+	return ok;
+}
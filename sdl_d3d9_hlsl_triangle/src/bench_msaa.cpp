@@ -0,0 +1,231 @@
+#include "benchmarks.h"
+#include "bench_util.h"
+#include "device_reset.h"
+#include "shader_util.h"
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <SDL2/SDL.h>
+
+namespace
+{
+	struct SceneVertex
+	{
+		float x, y, z;
+		uint32_t color;
+	};
+	const DWORD SceneFVF = D3DFVF_XYZ | D3DFVF_DIFFUSE;
+
+	// Overlapping mid-sized triangles: lots of edges to antialias and
+	// enough fill for the sample count to matter.
+	bool CreateScene(IDirect3DDevice9* device, UINT triangles, IDirect3DVertexBuffer9** vb)
+	{
+		std::mt19937 rng(21);
+		std::uniform_real_distribution<float> pos(-1.0f, 1.0f), offset(-0.15f, 0.15f), depth(0.0f, 1.0f);
+		std::vector<SceneVertex> vertices(triangles * 3);
+		for (UINT t = 0; t < triangles; t++)
+		{
+			const float x = pos(rng), y = pos(rng), z = depth(rng);
+			const uint32_t color = 0xff000000 | (rng() & 0x00ffffff);
+			for (UINT v = 0; v < 3; v++)
+				vertices[t * 3 + v] = { x + offset(rng), y + offset(rng), z, color };
+		}
+
+		const UINT bytes = static_cast<UINT>(vertices.size() * sizeof(SceneVertex));
+		void* data = nullptr;
+		if (FAILED(d3d::CreateVertexBuffer(device, bytes, D3DUSAGE_WRITEONLY, SceneFVF, D3DPOOL_MANAGED, vb)) ||
+			FAILED((*vb)->Lock(0, 0, &data, 0)))
+			return false;
+		memcpy(data, vertices.data(), bytes);
+		(*vb)->Unlock();
+		return true;
+	}
+
+	struct Scene
+	{
+		IDirect3DVertexBuffer9* vb = nullptr;
+		IDirect3DVertexShader9* vs = nullptr;
+		IDirect3DPixelShader9* ps = nullptr;
+		UINT triangles = 0;
+
+		// Reset drops all device state, so this is set again per variant.
+		void Bind(IDirect3DDevice9* device) const
+		{
+			device->SetRenderState(D3DRS_CULLMODE, D3DCULL_NONE);
+			device->SetRenderState(D3DRS_MULTISAMPLEANTIALIAS, TRUE);
+			device->SetVertexShader(vs);
+			device->SetPixelShader(ps);
+			device->SetStreamSource(0, vb, 0, sizeof(SceneVertex));
+			device->SetFVF(SceneFVF);
+		}
+
+		void Draw(IDirect3DDevice9* device) const
+		{
+			device->Clear(0, 0, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER, 0xff303030, 1.0f, 0);
+			device->BeginScene();
+			device->DrawPrimitive(D3DPT_TRIANGLELIST, 0, triangles);
+			device->EndScene();
+		}
+	};
+
+	double Megabytes(size_t bytes)
+	{
+		return bytes / (1024.0 * 1024.0);
+	}
+}
+
+bool bench::RunMsaa(IDirect3DDevice9* device, int frames)
+{
+	D3DPRESENT_PARAMETERS original;
+	IDirect3D9* d3d9 = nullptr;
+	if (!d3d::GetPresentParameters(device, &original) || FAILED(device->GetDirect3D(&d3d9)))
+		return false;
+
+	Scene scene;
+	scene.triangles = 20000;
+	scene.vs = d3d::LoadVertexShader(device, "shaders/hlsl/min_vs.hlsl");
+	scene.ps = d3d::LoadPixelShader(device, "shaders/hlsl/min_ps.hlsl");
+	if (!scene.vs || !scene.ps || !CreateScene(device, scene.triangles, &scene.vb))
+	{
+		d3d::Release(scene.vs);
+		d3d::Release(scene.ps);
+		d3d::Release(scene.vb);
+		d3d9->Release();
+		return false;
+	}
+
+	const UINT width = original.BackBufferWidth, height = original.BackBufferHeight;
+	const D3DFORMAT colorFormat = original.BackBufferFormat;
+	const D3DFORMAT depthFormat = original.AutoDepthStencilFormat;
+	const size_t colorBytes = d3d::SurfaceBytes(colorFormat, width, height);
+	const size_t depthBytes = d3d::SurfaceBytes(depthFormat, width, height);
+
+	SDL_Log("msaa: %ux%u, %u triangles, %d frames per variant", width, height, scene.triangles, frames);
+
+	bool ok = true;
+	double baselineMs = 0.0;
+	const D3DMULTISAMPLE_TYPE levels[] =
+	{
+		D3DMULTISAMPLE_NONE, D3DMULTISAMPLE_2_SAMPLES, D3DMULTISAMPLE_4_SAMPLES, D3DMULTISAMPLE_8_SAMPLES,
+	};
+	for (D3DMULTISAMPLE_TYPE level : levels)
+	{
+		const int samples = level == D3DMULTISAMPLE_NONE ? 1 : static_cast<int>(level);
+		if (level != D3DMULTISAMPLE_NONE &&
+			d3d::BestMultiSample(d3d9, D3DDEVTYPE_HAL, colorFormat, depthFormat, original.Windowed, level) != level)
+		{
+			SDL_Log("msaa: x%d not supported", samples);
+			continue;
+		}
+
+		// 1. Multisampled back buffer, resolved by Present.
+		D3DPRESENT_PARAMETERS d3dpp = original;
+		d3dpp.MultiSampleType = level;
+		d3dpp.MultiSampleQuality = 0;
+		if (!d3d::ResetDevice(device, d3dpp))
+		{
+			ok = false;
+			break;
+		}
+		scene.Bind(device);
+
+		FrameStats backBuffer;
+		for (int frame = -5; frame < frames; frame++) // 5 warm-up frames
+		{
+			const double start = NowMs();
+			scene.Draw(device);
+			device->Present(0, 0, 0, 0);
+			WaitForGpu(device);
+			if (frame >= 0)
+				backBuffer.Add(NowMs() - start);
+		}
+
+		// Samples of color and depth, plus the single-sample surface
+		// Present resolves into.
+		const size_t backBufferBytes = (colorBytes + depthBytes) * samples + (samples > 1 ? colorBytes : 0);
+		if (level == D3DMULTISAMPLE_NONE)
+			baselineMs = backBuffer.Average();
+		SDL_Log("msaa: x%d back buffer  frame avg %7.3f ms p95 %7.3f ms (%+.3f ms)  %6.1f MB",
+			samples, backBuffer.Average(), backBuffer.Percentile(95.0), backBuffer.Average() - baselineMs,
+			Megabytes(backBufferBytes));
+
+		if (level == D3DMULTISAMPLE_NONE)
+			continue;
+
+		// 2. Single-sample back buffer, scene in a multisampled offscreen
+		// target that is resolved with StretchRect. The device may have been
+		// created with --msaa, so the back buffer is forced to one sample.
+		d3dpp = original;
+		d3dpp.MultiSampleType = D3DMULTISAMPLE_NONE;
+		d3dpp.MultiSampleQuality = 0;
+		if (!d3d::ResetDevice(device, d3dpp))
+		{
+			ok = false;
+			break;
+		}
+		scene.Bind(device);
+
+		IDirect3DSurface9* target = nullptr;
+		IDirect3DSurface9* depth = nullptr;
+		IDirect3DSurface9* backSurface = nullptr;
+		IDirect3DSurface9* backDepth = nullptr;
+		if (FAILED(d3d::CreateRenderTarget(device, width, height, colorFormat, level, 0, FALSE, &target)) ||
+			FAILED(d3d::CreateDepthStencilSurface(device, width, height, depthFormat, level, 0, TRUE, &depth)))
+		{
+			SDL_Log("msaa: x%d can't create the offscreen target", samples);
+			d3d::Release(target);
+			continue;
+		}
+		device->GetRenderTarget(0, &backSurface);
+		device->GetDepthStencilSurface(&backDepth);
+
+		FrameStats offscreen, resolve;
+		for (int frame = -5; frame < frames; frame++)
+		{
+			const double start = NowMs();
+			device->SetRenderTarget(0, target);
+			device->SetDepthStencilSurface(depth);
+			scene.Draw(device);
+			WaitForGpu(device);
+
+			const double resolveStart = NowMs();
+			device->StretchRect(target, nullptr, backSurface, nullptr, D3DTEXF_NONE);
+			WaitForGpu(device);
+			const double resolveMs = NowMs() - resolveStart;
+
+			device->SetRenderTarget(0, backSurface);
+			device->SetDepthStencilSurface(backDepth);
+			device->Present(0, 0, 0, 0);
+			WaitForGpu(device);
+			if (frame >= 0)
+			{
+				offscreen.Add(NowMs() - start);
+				resolve.Add(resolveMs);
+			}
+		}
+
+		// The single-sample back buffer and its depth stay allocated.
+		const size_t offscreenBytes = colorBytes + depthBytes + (colorBytes + depthBytes) * samples;
+		SDL_Log("msaa: x%d offscreen    frame avg %7.3f ms p95 %7.3f ms (%+.3f ms)  %6.1f MB  resolve avg %.3f ms",
+			samples, offscreen.Average(), offscreen.Percentile(95.0), offscreen.Average() - baselineMs,
+			Megabytes(offscreenBytes), resolve.Average());
+
+		backSurface->Release();
+		if (backDepth)
+			backDepth->Release();
+		d3d::Release(target);
+		d3d::Release(depth);
+	}
+
+	// Back to what the application created.
+	if (!d3d::ResetDevice(device, original))
+		ok = false;
+
+	d3d::Release(scene.vb);
+	d3d::Release(scene.vs);
+	d3d::Release(scene.ps);
+	d3d9->Release();
+	return ok;
+}
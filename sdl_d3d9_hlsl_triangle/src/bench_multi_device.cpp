@@ -0,0 +1,226 @@
+#include "benchmarks.h"
+#include "bench_util.h"
+#include "shader_util.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <SDL2/SDL.h>
+
+namespace
+{
+	const int ViewWidth = 320;
+	const int ViewHeight = 240;
+	const UINT TrianglesPerDraw = 32;
+
+	struct ViewVertex
+	{
+		float x, y, z;
+		uint32_t color;
+	};
+	const DWORD ViewFVF = D3DFVF_XYZ | D3DFVF_DIFFUSE;
+
+	// One render view: its own window, device and resources, driven by its
+	// own thread.
+	struct View
+	{
+		SDL_Window* window = nullptr;
+		IDirect3DDevice9* device = nullptr;
+		IDirect3DVertexBuffer9* vb = nullptr;
+		IDirect3DVertexShader9* vs = nullptr;
+		IDirect3DPixelShader9* ps = nullptr;
+		bench::FrameStats stats;
+		bool ok = true;
+	};
+
+	SDL_Window* CreateViewWindow(int index)
+	{
+		uint32_t flags;
+#if defined(_WIN32) || defined(USE_NINE)
+		flags = SDL_WINDOW_OPENGL;
+#else // for DXVK Native
+		flags = SDL_WINDOW_VULKAN;
+#endif
+		char title[32];
+		snprintf(title, sizeof(title), "view %d", index);
+		const int x = 20 + (index % 4) * (ViewWidth + 10), y = 40 + (index / 4 % 3) * (ViewHeight + 40);
+		return SDL_CreateWindow(title, x, y, ViewWidth, ViewHeight, flags);
+	}
+
+	bool CreateView(int index, const std::vector<char>& vsCode, const std::vector<char>& psCode,
+		const std::vector<ViewVertex>& vertices, View& view)
+	{
+		view.window = CreateViewWindow(index);
+		if (!view.window ||
+			!d3d::InitD3D(view.window, ViewWidth, ViewHeight, true, D3DDEVTYPE_HAL, &view.device))
+			return false;
+
+		const UINT bytes = static_cast<UINT>(vertices.size() * sizeof(ViewVertex));
+		void* data = nullptr;
+		if (FAILED(d3d::CreateVertexBuffer(view.device, bytes, D3DUSAGE_WRITEONLY, ViewFVF, D3DPOOL_MANAGED, &view.vb)) ||
+			FAILED(d3d::CreateVertexShader(view.device, (const DWORD*)vsCode.data(), &view.vs)) ||
+			FAILED(d3d::CreatePixelShader(view.device, (const DWORD*)psCode.data(), &view.ps)) ||
+			FAILED(view.vb->Lock(0, 0, &data, 0)))
+			return false;
+
+		memcpy(data, vertices.data(), bytes);
+		view.vb->Unlock();
+		return true;
+	}
+
+	void DestroyView(View& view)
+	{
+		d3d::Release(view.vb);
+		d3d::Release(view.vs);
+		d3d::Release(view.ps);
+		if (view.device)
+			view.device->Release();
+		if (view.window)
+			SDL_DestroyWindow(view.window);
+		view = View();
+	}
+
+	// The per-thread loop: many small draws, so the frame is bound by
+	// submission in the runtime and backend rather than by the GPU.
+	void RenderView(View& view, UINT draws, int frames, const std::atomic<bool>& go)
+	{
+		while (!go.load(std::memory_order_acquire))
+			std::this_thread::yield();
+
+		IDirect3DDevice9* device = view.device;
+		device->SetRenderState(D3DRS_CULLMODE, D3DCULL_NONE);
+		device->SetVertexShader(view.vs);
+		device->SetPixelShader(view.ps);
+		device->SetStreamSource(0, view.vb, 0, sizeof(ViewVertex));
+		device->SetFVF(ViewFVF);
+
+		view.stats.Reserve(frames);
+		for (int frame = -5; frame < frames; frame++) // 5 warm-up frames
+		{
+			const double start = bench::NowMs();
+			device->Clear(0, 0, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER, 0xff000000 | (frame * 4 & 0xff), 1.0f, 0);
+			device->BeginScene();
+			for (UINT d = 0; d < draws; d++)
+				device->DrawPrimitive(D3DPT_TRIANGLELIST, d * TrianglesPerDraw * 3, TrianglesPerDraw);
+			device->EndScene();
+			if (FAILED(device->Present(0, 0, 0, 0)))
+			{
+				view.ok = false;
+				break;
+			}
+			if (frame >= 0)
+				view.stats.Add(bench::NowMs() - start);
+		}
+		bench::WaitForGpu(device);
+		device->SetStreamSource(0, nullptr, 0, 0);
+	}
+}
+
+bool bench::RunMultiDevice(size_t maxDevices, int frames)
+{
+	const unsigned cores = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
+	if (maxDevices == 0)
+		maxDevices = cores;
+
+	std::vector<char> source, vsCode, psCode;
+	std::string error;
+	if (!d3d::LoadFile("shaders/hlsl/min_vs.hlsl", source, error) ||
+		!d3d::CompileShaderSource(source, "min_vs.hlsl", "vs_1_1", vsCode, error) ||
+		!d3d::LoadFile("shaders/hlsl/min_ps.hlsl", source, error) ||
+		!d3d::CompileShaderSource(source, "min_ps.hlsl", "ps_2_0", psCode, error))
+	{
+		SDL_Log("multi device: %s", error.c_str());
+		return false;
+	}
+
+	const UINT draws = 500;
+	std::vector<ViewVertex> vertices(draws * TrianglesPerDraw * 3);
+	std::mt19937 rng(5);
+	std::uniform_real_distribution<float> pos(-1.0f, 1.0f);
+	for (ViewVertex& v : vertices)
+		v = { pos(rng), pos(rng), 0.5f, static_cast<uint32_t>(0xff000000 | (rng() & 0x00ffffff)) };
+
+	// 1, 2, 4, ... and the maximum itself.
+	std::vector<size_t> counts;
+	for (size_t n = 1; n < maxDevices; n *= 2)
+		counts.push_back(n);
+	counts.push_back(maxDevices);
+
+	SDL_Log("multi device: up to %zu devices on %u cores, %u draws per frame, %d frames per device",
+		maxDevices, cores, draws, frames);
+
+	double singleFps = 0.0;
+	bool ok = true;
+	for (size_t n : counts)
+	{
+		std::vector<View> views(n);
+		for (size_t i = 0; i < n && ok; i++)
+		{
+			ok = CreateView(static_cast<int>(i), vsCode, psCode, vertices, views[i]);
+			if (!ok)
+				SDL_Log("multi device: can't create view %zu", i);
+		}
+
+		if (ok)
+		{
+			std::atomic<bool> go(false);
+			std::atomic<size_t> finished(0);
+			std::vector<std::thread> threads;
+			for (View& view : views)
+				threads.emplace_back([&, viewPtr = &view]()
+				{
+					RenderView(*viewPtr, draws, frames, go);
+					finished.fetch_add(1);
+				});
+
+			// The windows belong to this thread, keep pumping their events
+			// while the devices render.
+			const double start = NowMs();
+			go.store(true, std::memory_order_release);
+			while (finished.load() < n)
+			{
+				SDL_Event ev;
+				while (SDL_PollEvent(&ev))
+					;
+				SDL_Delay(1);
+			}
+			const double wallMs = NowMs() - start;
+			for (std::thread& t : threads)
+				t.join();
+
+			FrameStats all;
+			for (View& view : views)
+			{
+				ok = ok && view.ok;
+				all.Add(view.stats);
+			}
+
+			// Wall time includes the warm-up frames.
+			const double fps = wallMs > 0.0 ? n * (frames + 5) * 1000.0 / wallMs : 0.0;
+			if (n == 1)
+				singleFps = fps;
+			SDL_Log("multi device: %2zu devices  %8.1f frames/s total  %.2fx of one device  %3.0f%% scaling",
+				n, fps, singleFps > 0.0 ? fps / singleFps : 0.0,
+				singleFps > 0.0 ? 100.0 * fps / (singleFps * n) : 0.0);
+			SDL_Log("multi device:     all      frame avg %7.3f ms  p50 %7.3f  p95 %7.3f  p99 %7.3f  max %7.3f",
+				all.Average(), all.Percentile(50.0), all.Percentile(95.0), all.Percentile(99.0), all.Max());
+			for (size_t i = 0; i < n; i++)
+			{
+				const FrameStats& s = views[i].stats;
+				SDL_Log("multi device:     view %2zu  frame avg %7.3f ms  p50 %7.3f  p95 %7.3f  p99 %7.3f  max %7.3f",
+					i, s.Average(), s.Percentile(50.0), s.Percentile(95.0), s.Percentile(99.0), s.Max());
+			}
+		}
+
+		for (View& view : views)
+			DestroyView(view);
+		if (!ok)
+			break;
+	}
+
+	return ok;
+}
@@ -0,0 +1,204 @@
+#include "benchmarks.h"
+#include "bench_util.h"
+#include "d3d_math.h"
+#include "indexed_mesh.h"
+#include "shader_constants.h"
+#include "shader_util.h"
+
+#include <cmath>
+#include <vector>
+
+#include <SDL2/SDL.h>
+
+namespace
+{
+	struct CubeVertex
+	{
+		float x, y, z;
+		uint32_t color;
+	};
+
+	bool CreateCube(IDirect3DDevice9* device, mesh::IndexedMesh* cube)
+	{
+		std::vector<CubeVertex> vertices;
+		for (int i = 0; i < 8; i++)
+		{
+			float x = (i & 1) ? 0.5f : -0.5f, y = (i & 2) ? 0.5f : -0.5f, z = (i & 4) ? 0.5f : -0.5f;
+			uint32_t color = 0xff000000 | ((i & 1) ? 0xff0000 : 0x400000) | ((i & 2) ? 0xff00 : 0x4000) | ((i & 4) ? 0xff : 0x40);
+			vertices.push_back({ x, y, z, color });
+		}
+		const uint32_t indices[] =
+		{
+			0, 2, 1, 1, 2, 3,  4, 5, 6, 5, 7, 6,  0, 1, 4, 1, 5, 4,
+			2, 6, 3, 3, 6, 7,  0, 4, 2, 2, 4, 6,  1, 3, 5, 3, 7, 5,
+		};
+		mesh::BuildOptions options;
+		options.optimizeVertexCache = false;
+		options.optimizeVertexFetch = false;
+		return mesh::CreateIndexedMesh(device, vertices.data(), vertices.size(), sizeof(CubeVertex),
+			D3DFVF_XYZ | D3DFVF_DIFFUSE, indices, sizeof(indices) / sizeof(indices[0]), options, cube, nullptr);
+	}
+
+	// Objects on a square grid in the xz plane, each spinning at its own rate.
+	struct Objects
+	{
+		std::vector<D3DMATRIX> world;
+		std::vector<float> tint; // 4 per object
+		unsigned side = 0;
+	};
+
+	void InitObjects(size_t count, Objects& objects)
+	{
+		objects.side = static_cast<unsigned>(std::ceil(std::sqrt(static_cast<double>(count))));
+		objects.world.resize(count);
+		objects.tint.resize(count * 4);
+		for (size_t i = 0; i < count; i++)
+		{
+			objects.tint[i * 4 + 0] = 0.5f + 0.5f * static_cast<float>(i % 7) / 6.0f;
+			objects.tint[i * 4 + 1] = 0.5f + 0.5f * static_cast<float>(i % 5) / 4.0f;
+			objects.tint[i * 4 + 2] = 0.5f + 0.5f * static_cast<float>(i % 3) / 2.0f;
+			objects.tint[i * 4 + 3] = 1.0f;
+		}
+	}
+
+	void UpdateObjects(int frame, Objects& objects)
+	{
+		const float spacing = 1.5f, offset = (objects.side - 1) * spacing * 0.5f;
+		for (size_t i = 0; i < objects.world.size(); i++)
+		{
+			const float angle = frame * 0.02f * (1.0f + static_cast<float>(i % 11) * 0.1f);
+			const float c = std::cos(angle), s = std::sin(angle);
+			D3DMATRIX& m = objects.world[i];
+			m = {};
+			m._11 = c;  m._13 = -s;
+			m._22 = 1.0f;
+			m._31 = s;  m._33 = c;
+			m._41 = (i % objects.side) * spacing - offset;
+			m._43 = (i / objects.side) * spacing - offset;
+			m._44 = 1.0f;
+		}
+	}
+
+	void CameraViewProj(int frame, float aspect, float distance, D3DMATRIX* viewProj)
+	{
+		const float yaw = frame * 0.005f;
+		D3DVECTOR eye = { std::sin(yaw) * distance, distance * 0.6f, std::cos(yaw) * distance };
+		D3DVECTOR at = { 0.0f, 0.0f, 0.0f };
+		D3DVECTOR up = { 0.0f, 1.0f, 0.0f };
+
+		D3DMATRIX view, proj;
+		d3d::MatrixLookAtLH(&view, &eye, &at, &up);
+		d3d::MatrixPerspectiveFovLH(&proj, 3.14159265f * 0.33f, aspect, 0.5f, distance * 4.0f);
+		d3d::MatrixMultiply(viewProj, &view, &proj);
+	}
+}
+
+bool bench::RunShaderConstants(IDirect3DDevice9* device, size_t objectCount, int frames)
+{
+	if (objectCount == 0)
+		return false;
+
+	IDirect3DVertexShader9* vs = d3d::LoadVertexShader(device, "shaders/hlsl/object_vs.hlsl");
+	IDirect3DPixelShader9* ps = d3d::LoadPixelShader(device, "shaders/hlsl/tinted_ps.hlsl");
+	mesh::IndexedMesh cube;
+	if (!vs || !ps || !CreateCube(device, &cube))
+	{
+		d3d::Release(vs);
+		d3d::Release(ps);
+		return false;
+	}
+
+	Objects objects;
+	InitObjects(objectCount, objects);
+
+	D3DVIEWPORT9 viewport;
+	device->GetViewport(&viewport);
+	const float aspect = static_cast<float>(viewport.Width) / static_cast<float>(viewport.Height);
+	const float distance = objects.side * 1.2f + 4.0f;
+	const float scale[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+	device->SetRenderState(D3DRS_CULLMODE, D3DCULL_NONE);
+	device->SetVertexShader(vs);
+	device->SetPixelShader(ps);
+	device->SetStreamSource(0, cube.vb, 0, cube.stride);
+	device->SetIndices(cube.ib);
+	device->SetFVF(cube.fvf);
+
+	SDL_Log("shader constants: %zu objects, 9 vertex + 1 pixel registers per draw", objectCount);
+
+	// 1. Every value set on the device for every object, the way a naive
+	//    material / object binding does it: 4 calls and 10 registers a draw.
+	// 2. The same values through the shadow: the unchanged view * projection
+	//    and pixel scale are dropped, world and tint (c4-c8) go out as one call.
+	for (int variant = 0; variant < 2; variant++)
+	{
+		const bool shadowed = variant == 1;
+		d3d::ShaderConstants constants;
+		FrameStats frameStats, submitStats;
+		uint64_t calls = 0, registers = 0;
+
+		for (int frame = -5; frame < frames; frame++) // 5 warm-up frames
+		{
+			const double start = NowMs();
+			D3DMATRIX viewProj;
+			CameraViewProj(frame, aspect, distance, &viewProj);
+			UpdateObjects(frame, objects);
+			constants.BeginFrame();
+
+			device->Clear(0, 0, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER, 0xff203040, 1.0f, 0);
+			device->BeginScene();
+			const double submitStart = NowMs();
+			for (size_t i = 0; i < objectCount; i++)
+			{
+				if (shadowed)
+				{
+					constants.SetVertexMatrix(0, viewProj);
+					constants.SetVertexMatrix(4, objects.world[i]);
+					constants.SetVertex(8, &objects.tint[i * 4], 1);
+					constants.SetPixel(0, scale, 1);
+					constants.Flush(device);
+				}
+				else
+				{
+					device->SetVertexShaderConstantF(0, &viewProj.m[0][0], 4);
+					device->SetVertexShaderConstantF(4, &objects.world[i].m[0][0], 4);
+					device->SetVertexShaderConstantF(8, &objects.tint[i * 4], 1);
+					device->SetPixelShaderConstantF(0, scale, 1);
+				}
+				device->DrawIndexedPrimitive(D3DPT_TRIANGLELIST, 0, 0, cube.vertexCount, 0, cube.indexCount / 3);
+			}
+			const double submitMs = NowMs() - submitStart;
+			device->EndScene();
+			device->Present(0, 0, 0, 0);
+			WaitForGpu(device);
+
+			if (frame >= 0)
+			{
+				frameStats.Add(NowMs() - start);
+				submitStats.Add(submitMs);
+				calls += shadowed ? constants.Stats().frameCalls : objectCount * 4;
+				registers += shadowed ? constants.Stats().frameRegisters : objectCount * 10;
+			}
+		}
+
+		if (frames > 0)
+			SDL_Log("shader constants: %-8s frame avg %7.3f ms p95 %7.3f ms, submit avg %7.3f ms, "
+				"%llu calls and %llu registers per frame",
+				shadowed ? "shadowed" : "direct", frameStats.Average(), frameStats.Percentile(95.0),
+				submitStats.Average(), static_cast<unsigned long long>(calls / frames),
+				static_cast<unsigned long long>(registers / frames));
+		if (shadowed)
+			SDL_Log("shader constants: %llu registers skipped as unchanged, peak %llu registers in a frame",
+				static_cast<unsigned long long>(constants.Stats().unchangedRegisters),
+				static_cast<unsigned long long>(constants.Stats().peakFrameRegisters));
+	}
+
+	device->SetStreamSource(0, nullptr, 0, 0);
+	device->SetIndices(nullptr);
+	device->SetVertexShader(nullptr);
+	device->SetPixelShader(nullptr);
+	mesh::ReleaseIndexedMesh(cube);
+	d3d::Release(vs);
+	d3d::Release(ps);
+	return true;
+}
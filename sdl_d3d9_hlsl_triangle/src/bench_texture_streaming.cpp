@@ -0,0 +1,335 @@
+#include "benchmarks.h"
+#include "bench_util.h"
+#include "mip_generator.h"
+#include "shader_util.h"
+#include "texture_streamer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include <SDL2/SDL.h>
+
+namespace
+{
+	struct CellVertex
+	{
+		float x, y, z;
+		uint32_t color;
+		float u, v;
+	};
+	const DWORD CellFVF = D3DFVF_XYZ | D3DFVF_DIFFUSE | D3DFVF_TEX1;
+
+	// 8 x 8 textured quads on screen, the next 16 textures are prefetched.
+	const UINT GridSize = 8;
+	const UINT VisibleCount = GridSize * GridSize;
+	const UINT PrefetchCount = 16;
+
+	uint32_t Hash(uint32_t id)
+	{
+		return id * 2654435761u;
+	}
+
+	// 128, 256 or 512 texels square, fixed per id like a file header.
+	bool DescribeTexture(uint32_t id, d3d::StreamedTextureInfo* info)
+	{
+		info->width = info->height = 128u << (Hash(id) >> 16) % 3;
+		info->levels = 0;
+		info->format = D3DFMT_A8R8G8B8;
+		return true;
+	}
+
+	// Stands in for an image decoder: a checker tinted per id for the finest
+	// level and the mip chain generated from it, so the cost grows with the
+	// texture the way a real decode does.
+	bool DecodeTexture(uint32_t id, const d3d::StreamedTextureInfo& info, const d3d::StreamedLevel* levels)
+	{
+		const uint32_t tint = Hash(id) | 0xff000000;
+		const d3d::StreamedLevel& top = levels[0];
+		for (UINT y = 0; y < top.height; y++)
+		{
+			uint32_t* row = reinterpret_cast<uint32_t*>(top.bits + y * top.pitch);
+			for (UINT x = 0; x < top.width; x++)
+			{
+				const uint32_t shade = ((x ^ y) & 0xff) * 0x010101u;
+				row[x] = ((x >> 4 ^ y >> 4) & 1) ? tint : (tint & 0xff000000) | (shade & 0x00ffffff);
+			}
+		}
+
+		std::vector<tex::MipLevel> chain(info.levels);
+		for (UINT level = 0; level < info.levels; level++)
+		{
+			chain[level].bits = levels[level].bits;
+			chain[level].pitch = levels[level].pitch;
+			chain[level].width = levels[level].width;
+			chain[level].height = levels[level].height;
+		}
+		tex::GenerateMips(chain.data(), info.levels, tex::MipOptions());
+		return true;
+	}
+
+	bool CreateCells(IDirect3DDevice9* device, IDirect3DVertexBuffer9** vb)
+	{
+		std::vector<CellVertex> vertices(VisibleCount * 4);
+		const float cell = 2.0f / GridSize, half = cell * 0.45f;
+		for (UINT i = 0; i < VisibleCount; i++)
+		{
+			const float cx = -1.0f + (i % GridSize + 0.5f) * cell;
+			const float cy = 1.0f - (i / GridSize + 0.5f) * cell;
+			CellVertex* v = &vertices[i * 4];
+			v[0] = { cx - half, cy - half, 0.5f, 0xffffffff, 0.0f, 1.0f };
+			v[1] = { cx - half, cy + half, 0.5f, 0xffffffff, 0.0f, 0.0f };
+			v[2] = { cx + half, cy - half, 0.5f, 0xffffffff, 1.0f, 1.0f };
+			v[3] = { cx + half, cy + half, 0.5f, 0xffffffff, 1.0f, 0.0f };
+		}
+
+		const UINT bytes = static_cast<UINT>(vertices.size() * sizeof(CellVertex));
+		void* data = nullptr;
+		if (FAILED(d3d::CreateVertexBuffer(device, bytes, D3DUSAGE_WRITEONLY, CellFVF, D3DPOOL_MANAGED, vb)) ||
+			FAILED((*vb)->Lock(0, 0, &data, 0)))
+			return false;
+		memcpy(data, vertices.data(), bytes);
+		(*vb)->Unlock();
+		return true;
+	}
+
+	// The usual way without streaming: a texture is decoded and created on
+	// the render thread the first frame it is visible, least recently used
+	// ones are released over the budget.
+	class SyncTextures
+	{
+	public:
+		explicit SyncTextures(size_t budgetBytes) : _budget(budgetBytes) {}
+		~SyncTextures()
+		{
+			for (auto& item : _textures)
+				d3d::Release(item.second.texture);
+		}
+
+		IDirect3DTexture9* Get(IDirect3DDevice9* device, uint32_t id, uint64_t frame)
+		{
+			auto it = _textures.find(id);
+			if (it != _textures.end())
+			{
+				it->second.frame = frame;
+				return it->second.texture;
+			}
+
+			d3d::StreamedTextureInfo info;
+			DescribeTexture(id, &info);
+			IDirect3DTexture9* texture = nullptr;
+			if (FAILED(d3d::CreateTexture(device, info.width, info.height, 0, 0, info.format, D3DPOOL_MANAGED, &texture)))
+				return nullptr;
+			info.levels = texture->GetLevelCount();
+
+			std::vector<d3d::StreamedLevel> levels(info.levels);
+			size_t bytes = 0;
+			for (UINT level = 0; level < info.levels; level++)
+			{
+				D3DSURFACE_DESC desc;
+				D3DLOCKED_RECT rect;
+				texture->GetLevelDesc(level, &desc);
+				texture->LockRect(level, &rect, nullptr, 0);
+				levels[level] = { static_cast<uint8_t*>(rect.pBits), static_cast<UINT>(rect.Pitch), desc.Width, desc.Height };
+				bytes += d3d::SurfaceBytes(info.format, desc.Width, desc.Height);
+			}
+			DecodeTexture(id, info, levels.data());
+			for (UINT level = 0; level < info.levels; level++)
+				texture->UnlockRect(level);
+			// Managed textures upload on first use, this is when it happens.
+			texture->PreLoad();
+
+			_textures[id] = { texture, bytes, frame };
+			_resident += bytes;
+			_loads++;
+			Trim(frame);
+			return texture;
+		}
+
+		uint64_t Loads() const { return _loads; }
+
+	private:
+		struct Loaded
+		{
+			IDirect3DTexture9* texture;
+			size_t bytes;
+			uint64_t frame;
+		};
+
+		void Trim(uint64_t frame)
+		{
+			while (_resident > _budget)
+			{
+				auto oldest = _textures.end();
+				for (auto it = _textures.begin(); it != _textures.end(); ++it)
+					if (it->second.frame < frame && (oldest == _textures.end() || it->second.frame < oldest->second.frame))
+						oldest = it;
+				if (oldest == _textures.end())
+					return;
+				_resident -= oldest->second.bytes;
+				d3d::Release(oldest->second.texture);
+				_textures.erase(oldest);
+			}
+		}
+
+		std::unordered_map<uint32_t, Loaded> _textures;
+		size_t _budget;
+		size_t _resident = 0;
+		uint64_t _loads = 0;
+	};
+
+	struct FrameQuality
+	{
+		uint64_t missing = 0;   // cells drawn with the placeholder
+		uint64_t coarse = 0;    // cells drawn without their finest level
+	};
+
+	// A spike is a frame over twice the median.
+	void LogFrames(const char* name, const bench::FrameStats& stats, const FrameQuality& quality, int frames)
+	{
+		const double median = stats.Percentile(50.0);
+		const double cells = static_cast<double>(frames) * VisibleCount;
+		SDL_Log("texture streaming: %-11s frame avg %7.3f ms p50 %7.3f p99 %7.3f max %7.3f ms, %zu spikes, "
+			"placeholder %5.1f%% coarse %5.1f%% of cells", name, stats.Average(), median, stats.Percentile(99.0),
+			stats.Max(), stats.CountAbove(median * 2.0), 100.0 * quality.missing / cells, 100.0 * quality.coarse / cells);
+	}
+}
+
+bool bench::RunTextureStreaming(IDirect3DDevice9* device, size_t textureCount, int frames)
+{
+	if (textureCount < VisibleCount + PrefetchCount)
+		textureCount = VisibleCount + PrefetchCount;
+
+	IDirect3DVertexShader9* vs = d3d::LoadVertexShader(device, "shaders/hlsl/textured_vs.hlsl");
+	IDirect3DPixelShader9* ps = d3d::LoadPixelShader(device, "shaders/hlsl/textured_ps.hlsl");
+	IDirect3DVertexBuffer9* vb = nullptr;
+	IDirect3DTexture9* placeholder = nullptr;
+	D3DLOCKED_RECT rect;
+	if (!vs || !ps || !CreateCells(device, &vb) ||
+		FAILED(d3d::CreateTexture(device, 1, 1, 1, 0, D3DFMT_A8R8G8B8, D3DPOOL_MANAGED, &placeholder)) ||
+		FAILED(placeholder->LockRect(0, &rect, nullptr, 0)))
+	{
+		d3d::Release(vs);
+		d3d::Release(ps);
+		d3d::Release(vb);
+		d3d::Release(placeholder);
+		return false;
+	}
+	*static_cast<uint32_t*>(rect.pBits) = 0xff808080;
+	placeholder->UnlockRect(0);
+
+	// Enough for the visible cells and the prefetch, not for everything that
+	// went by: the scene scrolls by one texture a frame and keeps paging.
+	const size_t residentBudget = 48 << 20;
+	SDL_Log("texture streaming: %zu textures of 128-512 texels, %u visible + %u prefetched, "
+		"%.0f MB resident, %d frames per variant", textureCount, VisibleCount, PrefetchCount,
+		residentBudget / (1024.0 * 1024.0), frames);
+
+	device->SetRenderState(D3DRS_CULLMODE, D3DCULL_NONE);
+	device->SetVertexShader(vs);
+	device->SetPixelShader(ps);
+	device->SetStreamSource(0, vb, 0, sizeof(CellVertex));
+	device->SetFVF(CellFVF);
+	device->SetSamplerState(0, D3DSAMP_MINFILTER, D3DTEXF_LINEAR);
+	device->SetSamplerState(0, D3DSAMP_MAGFILTER, D3DTEXF_LINEAR);
+	device->SetSamplerState(0, D3DSAMP_MIPFILTER, D3DTEXF_LINEAR);
+
+	auto drawCell = [&](UINT cell, IDirect3DTexture9* texture, DWORD maxMipLevel)
+	{
+		device->SetTexture(0, texture ? texture : placeholder);
+		device->SetSamplerState(0, D3DSAMP_MAXMIPLEVEL, maxMipLevel);
+		device->DrawPrimitive(D3DPT_TRIANGLESTRIP, cell * 4, 2);
+	};
+
+	// 1. Decoded, created and uploaded on the render thread when it shows up.
+	{
+		SyncTextures sync(residentBudget);
+		FrameStats stats;
+		stats.Reserve(frames);
+		for (int frame = 0; frame < frames; frame++)
+		{
+			const double start = NowMs();
+			device->Clear(0, 0, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER, 0xff202020, 1.0f, 0);
+			device->BeginScene();
+			for (UINT cell = 0; cell < VisibleCount; cell++)
+			{
+				const uint32_t id = static_cast<uint32_t>((frame + cell) % textureCount);
+				drawCell(cell, sync.Get(device, id, frame), 0);
+			}
+			device->EndScene();
+			device->Present(0, 0, 0, 0);
+			WaitForGpu(device);
+			stats.Add(NowMs() - start);
+		}
+		LogFrames("synchronous", stats, FrameQuality(), frames);
+		SDL_Log("texture streaming: synchronous %llu loads", static_cast<unsigned long long>(sync.Loads()));
+	}
+
+	// 2. Streamed: decoded on a worker, uploaded coarse to fine within 1 ms
+	// a frame, the textures coming up next prefetched.
+	d3d::TextureStreamer streamer;
+	d3d::TextureStreamerDesc desc;
+	desc.uploadBudgetMs = 1.0;
+	desc.residentBudgetBytes = residentBudget;
+	desc.stagingTextures = 8;
+	desc.decodeThreads = 2;
+	std::string error;
+	bool ok = streamer.Create(device, desc, DescribeTexture, DecodeTexture, error);
+	if (!ok)
+	{
+		SDL_Log("texture streaming: %s", error.c_str());
+	}
+	else
+	{
+		FrameStats stats, update;
+		FrameQuality quality;
+		stats.Reserve(frames);
+		update.Reserve(frames);
+		for (int frame = 0; frame < frames; frame++)
+		{
+			const double start = NowMs();
+			for (UINT cell = 0; cell < VisibleCount; cell++)
+				streamer.Request(static_cast<uint32_t>((frame + cell) % textureCount), 1.0f);
+			for (UINT i = 0; i < PrefetchCount; i++)
+				streamer.Request(static_cast<uint32_t>((frame + VisibleCount + i) % textureCount), 0.5f - i * 0.01f);
+			streamer.Update();
+			update.Add(NowMs() - start);
+
+			device->Clear(0, 0, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER, 0xff202020, 1.0f, 0);
+			device->BeginScene();
+			for (UINT cell = 0; cell < VisibleCount; cell++)
+			{
+				DWORD maxMipLevel = 0;
+				IDirect3DTexture9* texture = streamer.Get(static_cast<uint32_t>((frame + cell) % textureCount), &maxMipLevel);
+				if (!texture)
+					quality.missing++;
+				else if (maxMipLevel > 0)
+					quality.coarse++;
+				drawCell(cell, texture, texture ? maxMipLevel : 0);
+			}
+			device->EndScene();
+			device->Present(0, 0, 0, 0);
+			WaitForGpu(device);
+			stats.Add(NowMs() - start);
+		}
+		LogFrames("streamed", stats, quality, frames);
+
+		const d3d::TextureStreamerStats& s = streamer.Stats();
+		SDL_Log("texture streaming: streamed    Update avg %.3f ms max %.3f ms, %llu over budget; %llu decodes, "
+			"%llu levels, %.1f MB uploaded, %llu evictions, %llu textures + %llu staging created",
+			update.Average(), s.peakUpdateMs, static_cast<unsigned long long>(s.overBudgetUpdates),
+			static_cast<unsigned long long>(s.decodes), static_cast<unsigned long long>(s.levelsUploaded),
+			s.bytesUploaded / (1024.0 * 1024.0), static_cast<unsigned long long>(s.evictions),
+			static_cast<unsigned long long>(s.texturesCreated), static_cast<unsigned long long>(s.stagingCreated));
+	}
+
+	device->SetTexture(0, nullptr);
+	device->SetSamplerState(0, D3DSAMP_MAXMIPLEVEL, 0);
+	streamer.Release();
+	d3d::Release(placeholder);
+	d3d::Release(vb);
+	d3d::Release(vs);
+	d3d::Release(ps);
+	return ok;
+}
@@ -0,0 +1,205 @@
+#include "benchmarks.h"
+#include "bench_util.h"
+#include "transform_hierarchy.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <SDL2/SDL.h>
+
+namespace
+{
+	// The usual scene graph node: everything in one struct, a pointer to
+	// the parent, nodes in creation order. A node's parent is brought up to
+	// date first, which is where the pointer chasing comes from.
+	struct PointerNode
+	{
+		float t[3], q[4], s[3];
+		PointerNode* parent;
+		D3DMATRIX world;
+		int frame;
+	};
+
+	void UpdatePointerNode(PointerNode* node, int frame)
+	{
+		if (node->frame == frame)
+			return;
+		if (node->parent)
+			UpdatePointerNode(node->parent, frame);
+
+		const float x = node->q[0], y = node->q[1], z = node->q[2], w = node->q[3];
+		const float local[4][3] =
+		{
+			{ (1.0f - 2.0f * (y * y + z * z)) * node->s[0], 2.0f * (x * y + z * w) * node->s[0], 2.0f * (x * z - y * w) * node->s[0] },
+			{ 2.0f * (x * y - z * w) * node->s[1], (1.0f - 2.0f * (x * x + z * z)) * node->s[1], 2.0f * (y * z + x * w) * node->s[1] },
+			{ 2.0f * (x * z + y * w) * node->s[2], 2.0f * (y * z - x * w) * node->s[2], (1.0f - 2.0f * (x * x + y * y)) * node->s[2] },
+			{ node->t[0], node->t[1], node->t[2] },
+		};
+		for (int r = 0; r < 4; r++)
+			for (int c = 0; c < 4; c++)
+			{
+				if (!node->parent)
+				{
+					node->world.m[r][c] = c < 3 ? local[r][c] : (r == 3 ? 1.0f : 0.0f);
+					continue;
+				}
+				const D3DMATRIX& p = node->parent->world;
+				node->world.m[r][c] = local[r][0] * p.m[0][c] + local[r][1] * p.m[1][c] + local[r][2] * p.m[2][c] +
+					(r == 3 ? p.m[3][c] : 0.0f);
+			}
+		node->frame = frame;
+	}
+
+	// A few roots, every other node hangs off a random node in the second
+	// half of the ones before it: some 50 levels for a million nodes, wider
+	// towards the leaves. Returned in shuffled order, as a scene loads.
+	std::vector<uint32_t> GenerateParents(size_t count, std::mt19937& rng)
+	{
+		std::vector<uint32_t> parents(count);
+		for (size_t i = 0; i < count; i++)
+			parents[i] = i < 16 ? scene::NoParent : static_cast<uint32_t>(i / 2 + rng() % (i - i / 2));
+
+		std::vector<uint32_t> shuffle(count), position(count);
+		for (size_t i = 0; i < count; i++)
+			shuffle[i] = static_cast<uint32_t>(i);
+		std::shuffle(shuffle.begin(), shuffle.end(), rng);
+		for (size_t i = 0; i < count; i++)
+			position[shuffle[i]] = static_cast<uint32_t>(i);
+
+		std::vector<uint32_t> shuffled(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			const uint32_t p = parents[shuffle[i]];
+			shuffled[i] = p == scene::NoParent ? p : position[p];
+		}
+		return shuffled;
+	}
+
+	// Every node spins around y at its own rate.
+	float Angle(size_t node, int frame)
+	{
+		return frame * 0.01f * (1.0f + static_cast<float>(node % 13) * 0.05f);
+	}
+
+	void LogUpdates(const char* name, const bench::FrameStats& stats, size_t count)
+	{
+		const double average = stats.Average();
+		SDL_Log("transforms: %-20s avg %8.3f ms p95 %8.3f ms, %7.1f Mnodes/s", name, average, stats.Percentile(95.0),
+			average > 0.0 ? count / average / 1000.0 : 0.0);
+	}
+}
+
+bool bench::RunTransforms(size_t nodeCount, int frames)
+{
+	if (nodeCount < 16 || nodeCount >= scene::NoParent)
+		return false;
+
+	std::mt19937 rng(11);
+	const std::vector<uint32_t> parents = GenerateParents(nodeCount, rng);
+	std::uniform_real_distribution<float> offset(-2.0f, 2.0f), scale(0.9f, 1.1f);
+	std::vector<float> translations(nodeCount * 3), scales(nodeCount);
+	for (size_t i = 0; i < nodeCount; i++)
+	{
+		translations[i * 3 + 0] = offset(rng);
+		translations[i * 3 + 1] = offset(rng);
+		translations[i * 3 + 2] = offset(rng);
+		scales[i] = scale(rng);
+	}
+
+	// 1. Pointer nodes in load order.
+	std::vector<PointerNode> nodes(nodeCount);
+	for (size_t i = 0; i < nodeCount; i++)
+	{
+		PointerNode& node = nodes[i];
+		node = {};
+		node.t[0] = translations[i * 3 + 0];
+		node.t[1] = translations[i * 3 + 1];
+		node.t[2] = translations[i * 3 + 2];
+		node.s[0] = node.s[1] = node.s[2] = scales[i];
+		node.parent = parents[i] == scene::NoParent ? nullptr : &nodes[parents[i]];
+		node.frame = -1;
+	}
+
+	// 2. The same nodes sorted into the hierarchy.
+	scene::TransformHierarchy hierarchy;
+	std::vector<uint32_t> remap;
+	const double buildStart = NowMs();
+	if (!hierarchy.Build(parents, &remap))
+		return false;
+	const double buildMs = NowMs() - buildStart;
+	for (size_t i = 0; i < nodeCount; i++)
+	{
+		const float uniform[3] = { scales[i], scales[i], scales[i] };
+		const float identity[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+		hierarchy.SetLocal(remap[i], &translations[i * 3], identity, uniform);
+	}
+
+	task::ThreadPool& pool = task::ThreadPool::Shared();
+	SDL_Log("transforms: %zu nodes, %zu levels, built in %.1f ms, %s kernel, %u workers", nodeCount,
+		hierarchy.LevelCount(), buildMs, scene::SimdName(), pool.WorkerCount());
+
+	FrameStats pointerStats;
+	for (int frame = 0; frame < frames; frame++)
+	{
+		for (size_t i = 0; i < nodeCount; i++)
+		{
+			const float angle = Angle(i, frame);
+			nodes[i].q[1] = std::sin(angle * 0.5f);
+			nodes[i].q[3] = std::cos(angle * 0.5f);
+		}
+		const double start = NowMs();
+		for (PointerNode& node : nodes)
+			UpdatePointerNode(&node, frame);
+		pointerStats.Add(NowMs() - start);
+	}
+	LogUpdates("pointer nodes", pointerStats, nodeCount);
+
+	struct Variant
+	{
+		std::string name;
+		scene::Kernel kernel;
+		task::ThreadPool* pool;
+	};
+	const Variant variants[] =
+	{
+		{ "SoA scalar", scene::Kernel::Scalar, nullptr },
+		{ std::string("SoA ") + scene::SimdName(), scene::Kernel::Simd, nullptr },
+		{ std::string("SoA ") + scene::SimdName() + " threaded", scene::Kernel::Simd, &pool },
+	};
+	// Every variant ends on the pointer nodes' last frame, the matrices have
+	// to agree with them.
+	bool ok = true;
+	for (const Variant& variant : variants)
+	{
+		FrameStats stats;
+		for (int frame = 0; frame < frames; frame++)
+		{
+			for (size_t i = 0; i < nodeCount; i++)
+			{
+				const float angle = Angle(i, frame);
+				hierarchy.ry[remap[i]] = std::sin(angle * 0.5f);
+				hierarchy.rw[remap[i]] = std::cos(angle * 0.5f);
+			}
+			const double start = NowMs();
+			hierarchy.UpdateWorld(variant.pool, 4096, variant.kernel);
+			stats.Add(NowMs() - start);
+		}
+		LogUpdates(variant.name.c_str(), stats, nodeCount);
+
+		float maxError = 0.0f;
+		for (size_t i = 0; i < nodeCount; i++)
+		{
+			const float* a = &nodes[i].world.m[0][0];
+			const float* b = &hierarchy.world[remap[i]].m[0][0];
+			for (int k = 0; k < 16; k++)
+				maxError = std::max(maxError, std::fabs(a[k] - b[k]) / std::max(1.0f, std::fabs(a[k])));
+		}
+		SDL_Log("transforms: %-20s largest relative difference to the pointer nodes %g%s", variant.name.c_str(),
+			maxError, maxError < 1e-3f ? "" : " - MISMATCH");
+		ok = ok && maxError < 1e-3f;
+	}
+	return ok;
+}
@@ -0,0 +1,237 @@
+#include "benchmarks.h"
+#include "bench_util.h"
+#include "shader_util.h"
+#include "upload_arena.h"
+
+#include <cmath>
+#include <vector>
+
+#include <SDL2/SDL.h>
+
+namespace
+{
+	struct QuadVertex
+	{
+		float x, y, z;
+		uint32_t color;
+	};
+	const DWORD QuadFVF = D3DFVF_XYZ | D3DFVF_DIFFUSE;
+
+	// 16-bit indices: at most 16384 quads (65536 vertices) per draw.
+	const UINT QuadsPerBatch = 16384;
+
+	// A grid of small quads wobbling around their cells, regenerated every
+	// frame like particles or UI would be.
+	void WriteQuads(QuadVertex* vertices, UINT first, UINT count, UINT columns, int frame)
+	{
+		const float cell = 2.0f / columns, half = cell * 0.3f;
+		for (UINT q = 0; q < count; q++)
+		{
+			const UINT i = first + q;
+			const float phase = frame * 0.05f + i * 0.37f;
+			const float cx = -1.0f + (i % columns + 0.5f) * cell + std::sin(phase) * cell * 0.15f;
+			const float cy = -1.0f + (i / columns % columns + 0.5f) * cell + std::cos(phase) * cell * 0.15f;
+			const uint32_t color = 0xff000000 | (i * 2654435761u >> 8);
+			QuadVertex* v = vertices + q * 4;
+			v[0] = { cx - half, cy - half, 0.5f, color };
+			v[1] = { cx - half, cy + half, 0.5f, color };
+			v[2] = { cx + half, cy + half, 0.5f, color };
+			v[3] = { cx + half, cy - half, 0.5f, color };
+		}
+	}
+
+	void WriteIndices(uint16_t* indices, UINT count)
+	{
+		for (UINT q = 0; q < count; q++)
+		{
+			const uint16_t v = static_cast<uint16_t>(q * 4);
+			uint16_t* i = indices + q * 6;
+			i[0] = v; i[1] = v + 1; i[2] = v + 2;
+			i[3] = v; i[4] = v + 2; i[5] = v + 3;
+		}
+	}
+
+	enum class Path
+	{
+		UserPointer,   // DrawIndexedPrimitiveUP from a reused scratch array
+		CreatePerFrame,// fresh buffers every frame
+		Arena,
+	};
+
+	const char* PathName(Path path)
+	{
+		switch (path)
+		{
+		case Path::UserPointer: return "DrawIndexedPrimitiveUP";
+		case Path::CreatePerFrame: return "CreateVertexBuffer";
+		default: return "upload arena";
+		}
+	}
+}
+
+bool bench::RunUploadArena(IDirect3DDevice9* device, size_t quads, int frames)
+{
+	if (quads == 0)
+		return false;
+
+	IDirect3DVertexShader9* vs = d3d::LoadVertexShader(device, "shaders/hlsl/min_vs.hlsl");
+	IDirect3DPixelShader9* ps = d3d::LoadPixelShader(device, "shaders/hlsl/min_ps.hlsl");
+	if (!vs || !ps)
+	{
+		d3d::Release(vs);
+		d3d::Release(ps);
+		return false;
+	}
+
+	const UINT quadCount = static_cast<UINT>(quads);
+	const UINT columns = static_cast<UINT>(std::ceil(std::sqrt(static_cast<double>(quadCount))));
+	const UINT vertexBytes = quadCount * 4 * sizeof(QuadVertex);
+	const UINT indexBytes = quadCount * 6 * sizeof(uint16_t);
+
+	d3d::UploadArena arena;
+	std::string error;
+	if (!arena.Create(device, vertexBytes, indexBytes, 3, error))
+	{
+		SDL_Log("upload arena: %s", error.c_str());
+		d3d::Release(vs);
+		d3d::Release(ps);
+		return false;
+	}
+
+	std::vector<QuadVertex> scratchVertices(QuadsPerBatch * 4);
+	std::vector<uint16_t> scratchIndices(QuadsPerBatch * 6);
+	WriteIndices(scratchIndices.data(), QuadsPerBatch);
+
+	SDL_Log("upload arena: %u quads (%.1f MB per frame), %d frames per path, %u frames in flight",
+		quadCount, (vertexBytes + indexBytes) / (1024.0 * 1024.0), frames, arena.FramesInFlight());
+
+	device->SetRenderState(D3DRS_CULLMODE, D3DCULL_NONE);
+	device->SetVertexShader(vs);
+	device->SetPixelShader(ps);
+	device->SetFVF(QuadFVF);
+
+	bool ok = true;
+	for (Path path : { Path::UserPointer, Path::CreatePerFrame, Path::Arena })
+	{
+		FrameStats stats;
+		stats.Reserve(frames);
+		uint64_t creates = 0;
+		const d3d::UploadArenaStats before = arena.Stats();
+		double wallStart = 0.0;
+
+		// No wait per frame: the point is how the paths behave with the GPU
+		// running behind. Frame time is CPU time up to Present.
+		for (int frame = -5; frame < frames && ok; frame++) // 5 warm-up frames
+		{
+			if (frame == 0)
+			{
+				WaitForGpu(device);
+				wallStart = NowMs();
+			}
+
+			const double start = NowMs();
+			device->Clear(0, 0, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER, 0xff202020, 1.0f, 0);
+			device->BeginScene();
+
+			IDirect3DVertexBuffer9* vb = nullptr;
+			IDirect3DIndexBuffer9* ib = nullptr;
+			if (path == Path::CreatePerFrame)
+			{
+				if (FAILED(d3d::CreateVertexBuffer(device, vertexBytes, D3DUSAGE_WRITEONLY, 0, D3DPOOL_DEFAULT, &vb)) ||
+					FAILED(d3d::CreateIndexBuffer(device, indexBytes, D3DUSAGE_WRITEONLY, D3DFMT_INDEX16, D3DPOOL_DEFAULT, &ib)))
+				{
+					SDL_Log("upload arena: %s can't create buffers", PathName(path));
+					ok = false;
+				}
+				creates += 2;
+			}
+			else if (path == Path::Arena)
+				arena.BeginFrame();
+
+			for (UINT first = 0; first < quadCount && ok; first += QuadsPerBatch)
+			{
+				const UINT count = quadCount - first < QuadsPerBatch ? quadCount - first : QuadsPerBatch;
+				if (path == Path::UserPointer)
+				{
+					WriteQuads(scratchVertices.data(), first, count, columns, frame);
+					device->DrawIndexedPrimitiveUP(D3DPT_TRIANGLELIST, 0, count * 4, count * 2,
+						scratchIndices.data(), D3DFMT_INDEX16, scratchVertices.data(), sizeof(QuadVertex));
+				}
+				else if (path == Path::CreatePerFrame)
+				{
+					void* vertices = nullptr;
+					void* indices = nullptr;
+					vb->Lock(first * 4 * sizeof(QuadVertex), count * 4 * sizeof(QuadVertex), &vertices, 0);
+					WriteQuads(static_cast<QuadVertex*>(vertices), first, count, columns, frame);
+					vb->Unlock();
+					ib->Lock(first * 6 * sizeof(uint16_t), count * 6 * sizeof(uint16_t), &indices, 0);
+					WriteIndices(static_cast<uint16_t*>(indices), count);
+					ib->Unlock();
+
+					device->SetStreamSource(0, vb, 0, sizeof(QuadVertex));
+					device->SetIndices(ib);
+					device->DrawIndexedPrimitive(D3DPT_TRIANGLELIST, first * 4, 0, count * 4, first * 6, count * 2);
+				}
+				else
+				{
+					d3d::VertexUpload vertices;
+					d3d::IndexUpload indices;
+					if (!arena.AllocVertices(count * 4, sizeof(QuadVertex), &vertices) ||
+						!arena.AllocIndices(count * 6, &indices))
+					{
+						SDL_Log("upload arena: out of space at quad %u", first);
+						ok = false;
+						break;
+					}
+					WriteQuads(static_cast<QuadVertex*>(vertices.data), first, count, columns, frame);
+					WriteIndices(indices.data, count);
+					arena.Unlock();
+
+					device->SetStreamSource(0, vertices.vb, 0, sizeof(QuadVertex));
+					device->SetIndices(indices.ib);
+					device->DrawIndexedPrimitive(D3DPT_TRIANGLELIST, vertices.startVertex, 0, count * 4,
+						indices.startIndex, count * 2);
+				}
+			}
+
+			if (path == Path::Arena)
+				arena.EndFrame();
+			device->EndScene();
+			device->Present(0, 0, 0, 0);
+
+			device->SetStreamSource(0, nullptr, 0, 0);
+			device->SetIndices(nullptr);
+			d3d::Release(vb);
+			d3d::Release(ib);
+
+			if (frame >= 0)
+				stats.Add(NowMs() - start);
+		}
+		WaitForGpu(device);
+		const double wallMs = NowMs() - wallStart;
+
+		if (!ok)
+			break;
+
+		SDL_Log("upload arena: %-22s cpu avg %7.3f ms p95 %7.3f ms  %7.1f fps  %llu buffers created",
+			PathName(path), stats.Average(), stats.Percentile(95.0),
+			wallMs > 0.0 ? stats.Count() * 1000.0 / wallMs : 0.0,
+			static_cast<unsigned long long>(creates));
+		if (path == Path::Arena)
+		{
+			const d3d::UploadArenaStats& after = arena.Stats();
+			SDL_Log("upload arena: %llu locks, %llu fence waits (%.2f ms), peak %u + %u bytes, %llu overflows",
+				static_cast<unsigned long long>(after.locks - before.locks),
+				static_cast<unsigned long long>(after.waits - before.waits), after.waitMs - before.waitMs,
+				after.peakVertexBytes, after.peakIndexBytes,
+				static_cast<unsigned long long>(after.overflows - before.overflows));
+		}
+	}
+
+	device->SetVertexShader(nullptr);
+	device->SetPixelShader(nullptr);
+	arena.Release();
+	d3d::Release(vs);
+	d3d::Release(ps);
+	return ok;
+}
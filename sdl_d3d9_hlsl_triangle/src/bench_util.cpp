@@ -0,0 +1,72 @@
+#include "bench_util.h"
+#include "d3d_utility.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+double bench::NowMs()
+{
+	using namespace std::chrono;
+	return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+bool bench::WaitForGpu(IDirect3DDevice9* device)
+{
+	IDirect3DQuery9* query = nullptr;
+	if (FAILED(d3d::CreateQuery(device, D3DQUERYTYPE_EVENT, &query)))
+		return false;
+
+	query->Issue(D3DISSUE_END);
+	while (query->GetData(nullptr, 0, D3DGETDATA_FLUSH) == S_FALSE)
+		std::this_thread::yield();
+
+	d3d::Release(query);
+	return true;
+}
+
+HRESULT bench::CheckTextureFormat(IDirect3DDevice9* device, DWORD usage, D3DFORMAT format)
+{
+	IDirect3D9* d3d9 = nullptr;
+	D3DDEVICE_CREATION_PARAMETERS creation;
+	D3DDISPLAYMODE mode;
+	HRESULT hr = device->GetDirect3D(&d3d9);
+	if (FAILED(hr))
+		return hr;
+
+	hr = device->GetCreationParameters(&creation);
+	if (SUCCEEDED(hr))
+		hr = device->GetDisplayMode(0, &mode);
+	if (SUCCEEDED(hr))
+		hr = d3d9->CheckDeviceFormat(creation.AdapterOrdinal, creation.DeviceType, mode.Format, usage,
+			D3DRTYPE_TEXTURE, format);
+	d3d9->Release();
+	return hr;
+}
+
+double bench::FrameStats::Average() const
+{
+	if (_samples.empty())
+		return 0.0;
+
+	double sum = 0.0;
+	for (double s : _samples)
+		sum += s;
+	return sum / _samples.size();
+}
+
+double bench::FrameStats::Percentile(double p) const
+{
+	if (_samples.empty())
+		return 0.0;
+
+	std::vector<double> sorted(_samples);
+	std::sort(sorted.begin(), sorted.end());
+	size_t index = static_cast<size_t>(p / 100.0 * (sorted.size() - 1) + 0.5);
+	return sorted[std::min(index, sorted.size() - 1)];
+}
+
+size_t bench::FrameStats::CountAbove(double ms) const
+{
+	return static_cast<size_t>(std::count_if(_samples.begin(), _samples.end(), [ms](double s) { return s > ms; }));
+}
@@ -0,0 +1,42 @@
+#ifndef __bench_util__
+#define __bench_util__
+
+#include <d3d9.h>
+#include <vector>
+
+namespace bench
+{
+	// Milliseconds since an arbitrary fixed point, high resolution.
+	double NowMs();
+
+	// Blocks until the GPU has finished everything submitted so far, so that
+	// CPU-side timings include the GPU work. Returns false if event queries
+	// are not supported (the wait is skipped).
+	bool WaitForGpu(IDirect3DDevice9* device);
+
+	// CheckDeviceFormat for a texture on the device's adapter and display
+	// format. D3DOK_NOAUTOGEN counts as success, compare when it matters.
+	HRESULT CheckTextureFormat(IDirect3DDevice9* device, DWORD usage, D3DFORMAT format);
+
+	// Frame time samples and the usual summary values.
+	class FrameStats
+	{
+	public:
+		void Reserve(size_t count) { _samples.reserve(count); }
+		void Add(double ms) { _samples.push_back(ms); }
+		void Add(const FrameStats& other) { _samples.insert(_samples.end(), other._samples.begin(), other._samples.end()); }
+		void Clear() { _samples.clear(); }
+
+		size_t Count() const { return _samples.size(); }
+		double Average() const;
+		double Percentile(double p) const; // p in [0, 100]
+		double Min() const { return Percentile(0.0); }
+		double Max() const { return Percentile(100.0); }
+		size_t CountAbove(double ms) const;
+
+	private:
+		std::vector<double> _samples;
+	};
+}
+
+#endif // __bench_util__
@@ -0,0 +1,158 @@
+#include "benchmarks.h"
+#include "bench_util.h"
+#include "shader_util.h"
+#include "vertex_formats.h"
+
+#include <random>
+#include <vector>
+
+#include <SDL2/SDL.h>
+
+namespace
+{
+	// Lots of tiny triangles, so the frame is bound by vertex fetch and not
+	// by rasterization.
+	void GenerateTriangles(size_t vertexCount, std::vector<float>& xyz, std::vector<uint32_t>& colors)
+	{
+		std::mt19937 rng(1234);
+		std::uniform_real_distribution<float> pos(-0.95f, 0.95f);
+		std::uniform_real_distribution<float> jitter(-0.004f, 0.004f);
+		std::uniform_real_distribution<float> depth(0.0f, 1.0f);
+
+		xyz.resize(vertexCount * 3);
+		colors.resize(vertexCount);
+		for (size_t i = 0; i < vertexCount; i += 3)
+		{
+			float x = pos(rng), y = pos(rng), z = depth(rng);
+			uint32_t color = 0xff000000 | (rng() & 0x00ffffff);
+			for (size_t v = i; v < i + 3 && v < vertexCount; v++)
+			{
+				xyz[v * 3 + 0] = x + jitter(rng);
+				xyz[v * 3 + 1] = y + jitter(rng);
+				xyz[v * 3 + 2] = z;
+				colors[v] = color;
+			}
+		}
+	}
+
+	void DrawAll(IDirect3DDevice9* device, UINT vertexCount, UINT maxPrimitives)
+	{
+		UINT primitives = vertexCount / 3;
+		for (UINT first = 0; first < primitives; first += maxPrimitives)
+		{
+			UINT count = primitives - first < maxPrimitives ? primitives - first : maxPrimitives;
+			device->DrawPrimitive(D3DPT_TRIANGLELIST, first * 3, count);
+		}
+	}
+}
+
+bool bench::RunVertexFormats(IDirect3DDevice9* device, size_t vertexCount, int frames)
+{
+	vertexCount -= vertexCount % 3;
+	if (vertexCount == 0)
+		return false;
+
+	D3DCAPS9 caps;
+	device->GetDeviceCaps(&caps);
+	const UINT maxPrimitives = caps.MaxPrimitiveCount ? caps.MaxPrimitiveCount : 65535;
+
+	IDirect3DVertexShader9* vs = d3d::LoadVertexShader(device, "shaders/hlsl/packed_vs.hlsl");
+	IDirect3DPixelShader9* ps = d3d::LoadPixelShader(device, "shaders/hlsl/min_ps.hlsl");
+	if (!vs || !ps)
+	{
+		d3d::Release(vs);
+		d3d::Release(ps);
+		return false;
+	}
+
+	std::vector<float> xyz;
+	std::vector<uint32_t> colors;
+	GenerateTriangles(vertexCount, xyz, colors);
+	const vtx::QuantizeBounds bounds = vtx::ComputeBounds(xyz.data(), vertexCount);
+
+	SDL_Log("vertex formats: %zu vertices, %d frames per format", vertexCount, frames);
+
+	device->SetRenderState(D3DRS_CULLMODE, D3DCULL_NONE);
+	device->SetVertexShader(vs);
+	device->SetPixelShader(ps);
+
+	double baselineMs = 0.0;
+	for (int f = 0; f < vtx::POS_FORMAT_COUNT; f++)
+	{
+		const vtx::PositionFormat format = static_cast<vtx::PositionFormat>(f);
+		const vtx::FormatInfo& info = vtx::Info(format);
+		if (!vtx::IsSupported(format, caps))
+		{
+			SDL_Log("vertex formats: %-8s not supported by the device (DeclTypes 0x%lx)",
+				info.name, static_cast<unsigned long>(caps.DeclTypes));
+			continue;
+		}
+
+		IDirect3DVertexBuffer9* vb = nullptr;
+		IDirect3DVertexDeclaration9* decl = nullptr;
+		D3DVERTEXELEMENT9 elements[3];
+		vtx::BuildDeclaration(format, elements);
+
+		if (FAILED(d3d::CreateVertexBuffer(device, static_cast<UINT>(vertexCount * info.stride),
+				D3DUSAGE_WRITEONLY, 0, D3DPOOL_MANAGED, &vb)) ||
+			FAILED(d3d::CreateVertexDeclaration(device, elements, &decl)))
+		{
+			SDL_Log("vertex formats: %-8s can't create vertex buffer or declaration", info.name);
+			d3d::Release(vb);
+			continue;
+		}
+
+		void* data = nullptr;
+		vb->Lock(0, 0, &data, 0);
+		double packStart = NowMs();
+		vtx::PackVertices(format, xyz.data(), colors.data(), vertexCount, bounds, data);
+		double packMs = NowMs() - packStart;
+		vb->Unlock();
+
+		float scale[4], bias[4];
+		vtx::DecodeConstants(format, bounds, scale, bias);
+		device->SetVertexShaderConstantF(0, scale, 1);
+		device->SetVertexShaderConstantF(1, bias, 1);
+		device->SetVertexDeclaration(decl);
+		device->SetStreamSource(0, vb, 0, info.stride);
+
+		FrameStats stats;
+		stats.Reserve(frames);
+		for (int frame = -5; frame < frames; frame++) // 5 warm-up frames
+		{
+			double start = NowMs();
+			device->Clear(0, 0, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER, 0xffffffff, 1.0f, 0);
+			device->BeginScene();
+			DrawAll(device, static_cast<UINT>(vertexCount), maxPrimitives);
+			device->EndScene();
+			device->Present(0, 0, 0, 0);
+			WaitForGpu(device);
+			if (frame >= 0)
+				stats.Add(NowMs() - start);
+		}
+
+		const double avg = stats.Average();
+		if (format == vtx::POS_FLOAT3)
+			baselineMs = avg;
+
+		SDL_Log("vertex formats: %-8s %2u B/vertex %7.1f MB  pack %7.2f ms (%6.1f Mvert/s)  "
+			"frame avg %7.3f ms p95 %7.3f ms  %7.1f Mvert/s%s",
+			info.name, info.stride, vertexCount * info.stride / (1024.0 * 1024.0),
+			packMs, packMs > 0.0 ? vertexCount / packMs / 1000.0 : 0.0,
+			avg, stats.Percentile(95.0), avg > 0.0 ? vertexCount / avg / 1000.0 : 0.0,
+			format == vtx::POS_FLOAT3 ? " (baseline)" : "");
+		if (baselineMs > 0.0 && format != vtx::POS_FLOAT3)
+			SDL_Log("vertex formats: %-8s %.2fx bandwidth, %.2fx frame time vs float3",
+				info.name, info.stride / 16.0, avg / baselineMs);
+
+		device->SetStreamSource(0, nullptr, 0, 0);
+		d3d::Release(decl);
+		d3d::Release(vb);
+	}
+
+	device->SetVertexShader(nullptr);
+	device->SetPixelShader(nullptr);
+	d3d::Release(vs);
+	d3d::Release(ps);
+	return true;
+}
@@ -0,0 +1,94 @@
+#ifndef __benchmarks__
+#define __benchmarks__
+
+#include <d3d9.h>
+#include <cstddef>
+
+struct SDL_Window;
+
+// Benchmark modes selected from the command line. Each one runs on the
+// already created device, reports through SDL_Log and returns false if it
+// could not run.
+
+namespace bench
+{
+	// --bench-vertex-formats[=vertices]: bytes per vertex and frame time of
+	// every packed position format supported by the device.
+	bool RunVertexFormats(IDirect3DDevice9* device, size_t vertexCount, int frames);
+
+	// --bench-indexed-mesh[=grid]: ACMR/ATVR and frame time of a generated
+	// grid in natural, shuffled and optimized triangle order.
+	bool RunIndexedMesh(IDirect3DDevice9* device, unsigned gridSize, int frames);
+
+	// --bench-mesh-load[=file.mesh]: map + copy throughput of the cooked mesh
+	// loader in GB/s, single lock and chunked. Without a file a generated
+	// grid is cooked first.
+	bool RunMeshLoad(IDirect3DDevice9* device, const char* path, int iterations);
+
+	// --bench-culling[=instances]: draws only the frustum-visible instances
+	// of a large scene while the camera turns, culled count and cull time go
+	// to the window title every frame. Ends with scalar / SIMD / threaded
+	// cull timings over the same frustums.
+	bool RunCulling(IDirect3DDevice9* device, SDL_Window* window, size_t instances, int frames);
+
+	// --bench-upload-arena[=quads]: CPU frame time of per-frame quads
+	// written through DrawIndexedPrimitiveUP, freshly created buffers and
+	// the upload arena, plus the arena's lock and fence wait counts.
+	bool RunUploadArena(IDirect3DDevice9* device, size_t quads, int frames);
+
+	// --bench-buffer-pool[=meshes]: frame time and binds per frame of many
+	// small meshes with their own buffers vs sub-allocated from slabs, in
+	// scene and in slab order. Ends with occupancy and fragmentation after
+	// rounds of freeing and reallocating meshes.
+	bool RunBufferPool(IDirect3DDevice9* device, size_t meshCount, int frames);
+
+	// --bench-multi-device[=max]: 1, 2, 4, ... max windows, each with its own
+	// device rendering on its own thread. Aggregate frames/s, scaling against
+	// one device and the frame time distribution of every device. Does not
+	// use the main device; max defaults to the core count.
+	bool RunMultiDevice(size_t maxDevices, int frames);
+
+	// --bench-msaa: frame time and memory at 1, 2, 4 and 8 samples, once with
+	// a multisampled back buffer (resolved by Present, set through Reset)
+	// and once with a multisampled offscreen target resolved by StretchRect,
+	// whose cost is timed on its own. Restores the present parameters.
+	bool RunMsaa(IDirect3DDevice9* device, int frames);
+
+	// --bench-cpu-vertices[=vertices]: frame time of a fogged terrain with
+	// the device's own vertex processing against the CPU vertex pipeline,
+	// scalar, SIMD and SIMD across the workers, with the pipeline's stage
+	// timings and rejected / clipped triangle counts.
+	bool RunCpuVertices(IDirect3DDevice9* device, size_t vertexCount, int frames);
+
+	// --bench-texture-streaming[=textures]: a grid of textures scrolling by
+	// one texture a frame under a fixed memory budget. Frame time, spikes
+	// and how often a cell had no texture or only its coarse levels, once
+	// loading on the render thread and once through the texture streamer.
+	bool RunTextureStreaming(IDirect3DDevice9* device, size_t textureCount, int frames);
+
+	// --bench-block-compress[=size]: BC1 and BC3 compression of a generated
+	// size x size image in MPixels/s, scalar, SIMD and SIMD across the
+	// workers, with PSNR, whether SIMD matches the scalar reference bit for
+	// bit and the memory saved, then the same into a locked DXT texture.
+	bool RunBlockCompress(IDirect3DDevice9* device, UINT size, int runs);
+
+	// --bench-mips[=size]: full mip chain of a size x size image, box and
+	// Kaiser, linear and sRGB, scalar, SIMD and SIMD across the workers.
+	// Then a managed texture filled by the generator against the runtime's
+	// D3DUSAGE_AUTOGENMIPMAP, until the GPU has it.
+	bool RunMips(IDirect3DDevice9* device, UINT size, int runs);
+
+	// --bench-shader-constants[=objects]: one draw per object with its own
+	// world matrix and tint, constants set straight on the device against
+	// the shadowed register file. Frame and submit time, calls and
+	// registers uploaded per frame.
+	bool RunShaderConstants(IDirect3DDevice9* device, size_t objectCount, int frames);
+
+	// --bench-transforms[=nodes]: world matrices of an animated hierarchy,
+	// pointer-linked nodes in load order against the sorted SoA hierarchy,
+	// scalar, SIMD and SIMD across the workers level by level. Does not use
+	// the device.
+	bool RunTransforms(size_t nodeCount, int frames);
+}
+
+#endif // __benchmarks__
@@ -0,0 +1,528 @@
+#include "block_compress.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEX_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define TEX_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+	// One block's pixels, 16 x BGRA in row order.
+	struct BlockPixels
+	{
+		alignas(16) uint8_t bgra[64];
+	};
+
+	// What both kernels derive from the block's extremes.
+	struct ColorPalette
+	{
+		uint16_t c0, c1;
+		int bgr[4][3];
+	};
+
+	struct AlphaPalette
+	{
+		uint8_t a0, a1;
+		int values[8];
+	};
+
+	void LoadBlock(const uint8_t* pixels, UINT pitch, UINT width, UINT height, UINT bx, UINT by, BlockPixels* block)
+	{
+		const UINT x0 = bx * 4, y0 = by * 4;
+		if (x0 + 4 <= width && y0 + 4 <= height)
+		{
+			for (UINT y = 0; y < 4; y++)
+				memcpy(block->bgra + y * 16, pixels + static_cast<size_t>(y0 + y) * pitch + x0 * 4, 16);
+			return;
+		}
+
+		for (UINT y = 0; y < 4; y++)
+		{
+			const uint8_t* row = pixels + static_cast<size_t>(std::min(y0 + y, height - 1)) * pitch;
+			for (UINT x = 0; x < 4; x++)
+				memcpy(block->bgra + (y * 4 + x) * 4, row + std::min(x0 + x, width - 1) * 4, 4);
+		}
+	}
+
+	uint16_t To565(int b, int g, int r)
+	{
+		return static_cast<uint16_t>((r >> 3) << 11 | (g >> 2) << 5 | b >> 3);
+	}
+
+	void From565(uint16_t c, int bgr[3])
+	{
+		const int r = c >> 11, g = c >> 5 & 63, b = c & 31;
+		bgr[0] = b << 3 | b >> 2;
+		bgr[1] = g << 2 | g >> 4;
+		bgr[2] = r << 3 | r >> 2;
+	}
+
+	// Endpoints from the per-channel min / max, pulled in by 1/16 of the
+	// range so outliers don't stretch the palette. c0 > c1 selects the
+	// 4-color mode; c0 == c1 is a flat block, every index 0.
+	ColorPalette MakeColorPalette(const uint8_t mn[3], const uint8_t mx[3])
+	{
+		int lo[3], hi[3];
+		for (int c = 0; c < 3; c++)
+		{
+			const int inset = (mx[c] - mn[c]) >> 4;
+			lo[c] = mn[c] + inset;
+			hi[c] = mx[c] - inset;
+		}
+
+		ColorPalette p;
+		p.c0 = To565(hi[0], hi[1], hi[2]);
+		p.c1 = To565(lo[0], lo[1], lo[2]);
+		if (p.c0 < p.c1)
+			std::swap(p.c0, p.c1);
+
+		From565(p.c0, p.bgr[0]);
+		From565(p.c1, p.bgr[1]);
+		for (int c = 0; c < 3; c++)
+		{
+			p.bgr[2][c] = (2 * p.bgr[0][c] + p.bgr[1][c]) / 3;
+			p.bgr[3][c] = (p.bgr[0][c] + 2 * p.bgr[1][c]) / 3;
+		}
+		return p;
+	}
+
+	// 8-value mode (a0 > a1) between the extremes; a0 == a1 is a flat block.
+	AlphaPalette MakeAlphaPalette(uint8_t mn, uint8_t mx)
+	{
+		AlphaPalette p;
+		p.a0 = mx;
+		p.a1 = mn;
+		p.values[0] = mx;
+		p.values[1] = mn;
+		for (int k = 2; k < 8; k++)
+			p.values[k] = ((8 - k) * mx + (k - 1) * mn) / 7;
+		return p;
+	}
+
+	void WriteColorBlock(const ColorPalette& p, const int indices[16], uint8_t* out)
+	{
+		uint32_t bits = 0;
+		if (p.c0 != p.c1)
+			for (int i = 0; i < 16; i++)
+				bits |= static_cast<uint32_t>(indices[i]) << (i * 2);
+
+		out[0] = static_cast<uint8_t>(p.c0);
+		out[1] = static_cast<uint8_t>(p.c0 >> 8);
+		out[2] = static_cast<uint8_t>(p.c1);
+		out[3] = static_cast<uint8_t>(p.c1 >> 8);
+		for (int i = 0; i < 4; i++)
+			out[4 + i] = static_cast<uint8_t>(bits >> (i * 8));
+	}
+
+	void WriteAlphaBlock(const AlphaPalette& p, const int indices[16], uint8_t* out)
+	{
+		uint64_t bits = 0;
+		if (p.a0 != p.a1)
+			for (int i = 0; i < 16; i++)
+				bits |= static_cast<uint64_t>(indices[i]) << (i * 3);
+
+		out[0] = p.a0;
+		out[1] = p.a1;
+		for (int i = 0; i < 6; i++)
+			out[2 + i] = static_cast<uint8_t>(bits >> (i * 8));
+	}
+
+	// Scalar kernel, the reference the SIMD one has to match bit for bit.
+	// Nearest palette entry by squared distance, ties go to the lower index.
+
+	void EncodeBlockScalar(const BlockPixels& block, bool alpha, uint8_t* out)
+	{
+		uint8_t mn[4] = { 255, 255, 255, 255 }, mx[4] = { 0, 0, 0, 0 };
+		for (int i = 0; i < 16; i++)
+			for (int c = 0; c < 4; c++)
+			{
+				mn[c] = std::min(mn[c], block.bgra[i * 4 + c]);
+				mx[c] = std::max(mx[c], block.bgra[i * 4 + c]);
+			}
+
+		int indices[16];
+		if (alpha)
+		{
+			const AlphaPalette p = MakeAlphaPalette(mn[3], mx[3]);
+			for (int i = 0; i < 16; i++)
+			{
+				const int a = block.bgra[i * 4 + 3];
+				int best = std::abs(a - p.values[0]), index = 0;
+				for (int k = 1; k < 8; k++)
+				{
+					const int d = std::abs(a - p.values[k]);
+					if (d < best)
+					{
+						best = d;
+						index = k;
+					}
+				}
+				indices[i] = index;
+			}
+			WriteAlphaBlock(p, indices, out);
+			out += 8;
+		}
+
+		const ColorPalette p = MakeColorPalette(mn, mx);
+		for (int i = 0; i < 16; i++)
+		{
+			const uint8_t* px = block.bgra + i * 4;
+			int best = 0, index = 0;
+			for (int k = 0; k < 4; k++)
+			{
+				const int db = px[0] - p.bgr[k][0], dg = px[1] - p.bgr[k][1], dr = px[2] - p.bgr[k][2];
+				const int d = db * db + dg * dg + dr * dr;
+				if (k == 0 || d < best)
+				{
+					best = d;
+					index = k;
+				}
+			}
+			indices[i] = index;
+		}
+		WriteColorBlock(p, indices, out);
+	}
+
+#if TEX_SSE2
+
+	// Best so far and its index, replaced where `d` is strictly smaller.
+	inline void SelectLess32(__m128i d, __m128i k, __m128i& best, __m128i& index)
+	{
+		const __m128i less = _mm_cmplt_epi32(d, best);
+		best = _mm_or_si128(_mm_and_si128(less, d), _mm_andnot_si128(less, best));
+		index = _mm_or_si128(_mm_and_si128(less, k), _mm_andnot_si128(less, index));
+	}
+
+	inline void SelectLess16(__m128i d, __m128i k, __m128i& best, __m128i& index)
+	{
+		const __m128i less = _mm_cmplt_epi16(d, best);
+		best = _mm_or_si128(_mm_and_si128(less, d), _mm_andnot_si128(less, best));
+		index = _mm_or_si128(_mm_and_si128(less, k), _mm_andnot_si128(less, index));
+	}
+
+	void EncodeBlockSimd(const BlockPixels& block, bool alpha, uint8_t* out)
+	{
+		__m128i px[4];
+		for (int r = 0; r < 4; r++)
+			px[r] = _mm_load_si128(reinterpret_cast<const __m128i*>(block.bgra) + r);
+
+		// Per-channel extremes: across the 4 registers, then the 4 pixels of one.
+		__m128i mn = _mm_min_epu8(_mm_min_epu8(px[0], px[1]), _mm_min_epu8(px[2], px[3]));
+		__m128i mx = _mm_max_epu8(_mm_max_epu8(px[0], px[1]), _mm_max_epu8(px[2], px[3]));
+		mn = _mm_min_epu8(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(1, 0, 3, 2)));
+		mx = _mm_max_epu8(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(1, 0, 3, 2)));
+		mn = _mm_min_epu8(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(2, 3, 0, 1)));
+		mx = _mm_max_epu8(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(2, 3, 0, 1)));
+		const uint32_t mnBits = static_cast<uint32_t>(_mm_cvtsi128_si32(mn));
+		const uint32_t mxBits = static_cast<uint32_t>(_mm_cvtsi128_si32(mx));
+		const uint8_t mnBgra[4] = { uint8_t(mnBits), uint8_t(mnBits >> 8), uint8_t(mnBits >> 16), uint8_t(mnBits >> 24) };
+		const uint8_t mxBgra[4] = { uint8_t(mxBits), uint8_t(mxBits >> 8), uint8_t(mxBits >> 16), uint8_t(mxBits >> 24) };
+
+		alignas(16) int32_t colorIndices[16];
+		alignas(16) int16_t alphaIndices[16];
+		int indices[16];
+		const __m128i zero = _mm_setzero_si128();
+
+		if (alpha)
+		{
+			const AlphaPalette p = MakeAlphaPalette(mnBgra[3], mxBgra[3]);
+			const __m128i a01 = _mm_packs_epi32(_mm_srli_epi32(px[0], 24), _mm_srli_epi32(px[1], 24));
+			const __m128i a23 = _mm_packs_epi32(_mm_srli_epi32(px[2], 24), _mm_srli_epi32(px[3], 24));
+			__m128i best01 = _mm_set1_epi16(0x7fff), best23 = best01, index01 = zero, index23 = zero;
+			for (int k = 0; k < 8; k++)
+			{
+				const __m128i value = _mm_set1_epi16(static_cast<short>(p.values[k]));
+				const __m128i key = _mm_set1_epi16(static_cast<short>(k));
+				const __m128i d01 = _mm_max_epi16(_mm_sub_epi16(a01, value), _mm_sub_epi16(value, a01));
+				const __m128i d23 = _mm_max_epi16(_mm_sub_epi16(a23, value), _mm_sub_epi16(value, a23));
+				SelectLess16(d01, key, best01, index01);
+				SelectLess16(d23, key, best23, index23);
+			}
+			_mm_store_si128(reinterpret_cast<__m128i*>(alphaIndices), index01);
+			_mm_store_si128(reinterpret_cast<__m128i*>(alphaIndices) + 1, index23);
+			for (int i = 0; i < 16; i++)
+				indices[i] = alphaIndices[i];
+			WriteAlphaBlock(p, indices, out);
+			out += 8;
+		}
+
+		const ColorPalette p = MakeColorPalette(mnBgra, mxBgra);
+		__m128i palette[4];
+		for (int k = 0; k < 4; k++)
+			palette[k] = _mm_set_epi16(0, static_cast<short>(p.bgr[k][2]), static_cast<short>(p.bgr[k][1]),
+				static_cast<short>(p.bgr[k][0]), 0, static_cast<short>(p.bgr[k][2]), static_cast<short>(p.bgr[k][1]),
+				static_cast<short>(p.bgr[k][0]));
+
+		const __m128i rgb = _mm_set1_epi32(0x00ffffff);
+		for (int r = 0; r < 4; r++)
+		{
+			// Two pixels per register as 16-bit BGR0, madd sums b*b + g*g and
+			// r*r + 0, the shuffles add those pairs up per pixel.
+			const __m128i color = _mm_and_si128(px[r], rgb);
+			const __m128i lo = _mm_unpacklo_epi8(color, zero), hi = _mm_unpackhi_epi8(color, zero);
+			__m128i best = zero, index = zero;
+			for (int k = 0; k < 4; k++)
+			{
+				const __m128i dlo = _mm_sub_epi16(lo, palette[k]), dhi = _mm_sub_epi16(hi, palette[k]);
+				const __m128 slo = _mm_castsi128_ps(_mm_madd_epi16(dlo, dlo));
+				const __m128 shi = _mm_castsi128_ps(_mm_madd_epi16(dhi, dhi));
+				const __m128i d = _mm_add_epi32(
+					_mm_castps_si128(_mm_shuffle_ps(slo, shi, _MM_SHUFFLE(2, 0, 2, 0))),
+					_mm_castps_si128(_mm_shuffle_ps(slo, shi, _MM_SHUFFLE(3, 1, 3, 1))));
+				if (k == 0)
+					best = d;
+				else
+					SelectLess32(d, _mm_set1_epi32(k), best, index);
+			}
+			_mm_store_si128(reinterpret_cast<__m128i*>(colorIndices) + r, index);
+		}
+		for (int i = 0; i < 16; i++)
+			indices[i] = colorIndices[i];
+		WriteColorBlock(p, indices, out);
+	}
+
+#elif TEX_NEON
+
+	void EncodeBlockSimd(const BlockPixels& block, bool alpha, uint8_t* out)
+	{
+		// B, G, R and A of all 16 pixels, one register each.
+		const uint8x16x4_t px = vld4q_u8(block.bgra);
+		const uint8_t mn[4] = { vminvq_u8(px.val[0]), vminvq_u8(px.val[1]), vminvq_u8(px.val[2]), vminvq_u8(px.val[3]) };
+		const uint8_t mx[4] = { vmaxvq_u8(px.val[0]), vmaxvq_u8(px.val[1]), vmaxvq_u8(px.val[2]), vmaxvq_u8(px.val[3]) };
+
+		uint8_t bytes[16];
+		uint32_t words[16];
+		int indices[16];
+
+		if (alpha)
+		{
+			const AlphaPalette p = MakeAlphaPalette(mn[3], mx[3]);
+			uint8x16_t best = vdupq_n_u8(255), index = vdupq_n_u8(0);
+			for (int k = 0; k < 8; k++)
+			{
+				const uint8x16_t d = vabdq_u8(px.val[3], vdupq_n_u8(static_cast<uint8_t>(p.values[k])));
+				const uint8x16_t less = k == 0 ? vdupq_n_u8(255) : vcltq_u8(d, best);
+				best = vbslq_u8(less, d, best);
+				index = vbslq_u8(less, vdupq_n_u8(static_cast<uint8_t>(k)), index);
+			}
+			vst1q_u8(bytes, index);
+			for (int i = 0; i < 16; i++)
+				indices[i] = bytes[i];
+			WriteAlphaBlock(p, indices, out);
+			out += 8;
+		}
+
+		const ColorPalette p = MakeColorPalette(mn, mx);
+		uint32x4_t best[4], index[4];
+		for (int k = 0; k < 4; k++)
+		{
+			const uint8x16_t db = vabdq_u8(px.val[0], vdupq_n_u8(static_cast<uint8_t>(p.bgr[k][0])));
+			const uint8x16_t dg = vabdq_u8(px.val[1], vdupq_n_u8(static_cast<uint8_t>(p.bgr[k][1])));
+			const uint8x16_t dr = vabdq_u8(px.val[2], vdupq_n_u8(static_cast<uint8_t>(p.bgr[k][2])));
+			// Squares fit 16 bits, their sum needs 32.
+			const uint16x8_t bb[2] = { vmull_u8(vget_low_u8(db), vget_low_u8(db)), vmull_high_u8(db, db) };
+			const uint16x8_t gg[2] = { vmull_u8(vget_low_u8(dg), vget_low_u8(dg)), vmull_high_u8(dg, dg) };
+			const uint16x8_t rr[2] = { vmull_u8(vget_low_u8(dr), vget_low_u8(dr)), vmull_high_u8(dr, dr) };
+			for (int q = 0; q < 4; q++)
+			{
+				const int h = q / 2;
+				const uint32x4_t d = q % 2 == 0
+					? vaddw_u16(vaddl_u16(vget_low_u16(bb[h]), vget_low_u16(gg[h])), vget_low_u16(rr[h]))
+					: vaddw_u16(vaddl_u16(vget_high_u16(bb[h]), vget_high_u16(gg[h])), vget_high_u16(rr[h]));
+				if (k == 0)
+				{
+					best[q] = d;
+					index[q] = vdupq_n_u32(0);
+					continue;
+				}
+				const uint32x4_t less = vcltq_u32(d, best[q]);
+				best[q] = vbslq_u32(less, d, best[q]);
+				index[q] = vbslq_u32(less, vdupq_n_u32(static_cast<uint32_t>(k)), index[q]);
+			}
+		}
+		for (int q = 0; q < 4; q++)
+			vst1q_u32(words + q * 4, index[q]);
+		for (int i = 0; i < 16; i++)
+			indices[i] = static_cast<int>(words[i]);
+		WriteColorBlock(p, indices, out);
+	}
+
+#endif
+
+	void DecodeColorBlock(const uint8_t* in, uint8_t out[64])
+	{
+		const uint16_t c0 = static_cast<uint16_t>(in[0] | in[1] << 8);
+		const uint16_t c1 = static_cast<uint16_t>(in[2] | in[3] << 8);
+		const uint32_t bits = in[4] | in[5] << 8 | in[6] << 16 | static_cast<uint32_t>(in[7]) << 24;
+
+		int palette[4][4];
+		From565(c0, palette[0]);
+		From565(c1, palette[1]);
+		palette[0][3] = palette[1][3] = palette[2][3] = 255;
+		for (int c = 0; c < 3; c++)
+		{
+			if (c0 > c1)
+			{
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+			else
+			{
+				palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+				palette[3][c] = 0;
+			}
+		}
+		palette[3][3] = c0 > c1 ? 255 : 0;
+
+		for (int i = 0; i < 16; i++)
+			for (int c = 0; c < 4; c++)
+				out[i * 4 + c] = static_cast<uint8_t>(palette[bits >> (i * 2) & 3][c]);
+	}
+
+	void DecodeAlphaBlock(const uint8_t* in, uint8_t out[64])
+	{
+		const int a0 = in[0], a1 = in[1];
+		int values[8] = { a0, a1 };
+		if (a0 > a1)
+		{
+			for (int k = 2; k < 8; k++)
+				values[k] = ((8 - k) * a0 + (k - 1) * a1) / 7;
+		}
+		else
+		{
+			for (int k = 2; k < 6; k++)
+				values[k] = ((6 - k) * a0 + (k - 1) * a1) / 5;
+			values[6] = 0;
+			values[7] = 255;
+		}
+
+		uint64_t bits = 0;
+		for (int i = 0; i < 6; i++)
+			bits |= static_cast<uint64_t>(in[2 + i]) << (i * 8);
+		for (int i = 0; i < 16; i++)
+			out[i * 4 + 3] = static_cast<uint8_t>(values[bits >> (i * 3) & 7]);
+	}
+}
+
+const char* tex::SimdName()
+{
+#if TEX_SSE2
+	return "SSE2";
+#elif TEX_NEON
+	return "NEON";
+#else
+	return "scalar";
+#endif
+}
+
+D3DFORMAT tex::D3DFormat(BlockFormat format)
+{
+	return format == BlockFormat::BC1 ? D3DFMT_DXT1 : D3DFMT_DXT5;
+}
+
+UINT tex::BlockBytes(BlockFormat format)
+{
+	return format == BlockFormat::BC1 ? 8 : 16;
+}
+
+void tex::CompressRows(BlockFormat format, const uint8_t* pixels, UINT pitch, UINT width, UINT height,
+	uint8_t* blocks, UINT blockPitch, UINT firstRow, UINT rowCount, Kernel kernel)
+{
+	const bool alpha = format == BlockFormat::BC3;
+	const UINT blockBytes = BlockBytes(format);
+	const UINT columns = (width + 3) / 4;
+	BlockPixels block;
+
+	for (UINT by = firstRow; by < firstRow + rowCount; by++)
+	{
+		uint8_t* out = blocks + static_cast<size_t>(by) * blockPitch;
+		for (UINT bx = 0; bx < columns; bx++, out += blockBytes)
+		{
+			LoadBlock(pixels, pitch, width, height, bx, by, &block);
+#if TEX_SSE2 || TEX_NEON
+			if (kernel == Kernel::Simd)
+			{
+				EncodeBlockSimd(block, alpha, out);
+				continue;
+			}
+#endif
+			EncodeBlockScalar(block, alpha, out);
+		}
+	}
+}
+
+void tex::Compress(BlockFormat format, const uint8_t* pixels, UINT pitch, UINT width, UINT height,
+	uint8_t* blocks, UINT blockPitch, task::ThreadPool* pool, Kernel kernel)
+{
+	const UINT rows = (height + 3) / 4;
+	if (!pool)
+	{
+		CompressRows(format, pixels, pitch, width, height, blocks, blockPitch, 0, rows, kernel);
+		return;
+	}
+
+	pool->ParallelFor(rows, 4, [&](size_t begin, size_t end)
+	{
+		CompressRows(format, pixels, pitch, width, height, blocks, blockPitch,
+			static_cast<UINT>(begin), static_cast<UINT>(end - begin), kernel);
+	});
+}
+
+void tex::Decompress(BlockFormat format, const uint8_t* blocks, UINT blockPitch, UINT width, UINT height,
+	uint8_t* pixels, UINT pitch)
+{
+	const UINT blockBytes = BlockBytes(format);
+	uint8_t decoded[64];
+	for (UINT by = 0; by < (height + 3) / 4; by++)
+	{
+		const uint8_t* in = blocks + static_cast<size_t>(by) * blockPitch;
+		for (UINT bx = 0; bx < (width + 3) / 4; bx++, in += blockBytes)
+		{
+			if (format == BlockFormat::BC3)
+			{
+				DecodeColorBlock(in + 8, decoded);
+				DecodeAlphaBlock(in, decoded);
+			}
+			else
+			{
+				DecodeColorBlock(in, decoded);
+			}
+
+			for (UINT y = 0; y < 4 && by * 4 + y < height; y++)
+			{
+				const UINT columns = std::min(4u, width - bx * 4);
+				memcpy(pixels + static_cast<size_t>(by * 4 + y) * pitch + bx * 16, decoded + y * 16, columns * 4);
+			}
+		}
+	}
+}
+
+double tex::Psnr(const uint8_t* a, UINT pitchA, const uint8_t* b, UINT pitchB, UINT width, UINT height, bool alpha)
+{
+	const int channels = alpha ? 4 : 3;
+	double sum = 0.0;
+	for (UINT y = 0; y < height; y++)
+	{
+		const uint8_t* rowA = a + static_cast<size_t>(y) * pitchA;
+		const uint8_t* rowB = b + static_cast<size_t>(y) * pitchB;
+		for (UINT x = 0; x < width; x++)
+			for (int c = 0; c < channels; c++)
+			{
+				const double d = static_cast<double>(rowA[x * 4 + c]) - rowB[x * 4 + c];
+				sum += d * d;
+			}
+	}
+
+	const double mse = sum / (static_cast<double>(width) * height * channels);
+	if (mse == 0.0)
+		return std::numeric_limits<double>::infinity();
+	return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
@@ -0,0 +1,60 @@
+#ifndef __block_compress__
+#define __block_compress__
+
+#include "task_graph.h"
+
+#include <d3d9.h>
+#include <cstddef>
+#include <cstdint>
+
+// CPU encoder for D3DFMT_DXT1 (BC1) and D3DFMT_DXT5 (BC3). Every 4x4 block
+// gets the bounding box of its colors, inset by 1/16 of the range, as
+// endpoints and each pixel the nearest of the four palette colors; BC3 adds
+// an 8-value alpha ramp between the block's alpha extremes. The SIMD kernel
+// (SSE2, NEON) produces the same bits as the scalar one, blocks are split
+// across the thread pool by rows.
+//
+// Pixels are 32-bit in D3DFMT_A8R8G8B8 memory order (B, G, R, A). Edge
+// blocks of images that aren't a multiple of 4 repeat the last row and
+// column. BC1 is always the opaque 4-color mode.
+
+namespace tex
+{
+	enum class BlockFormat
+	{
+		BC1, // D3DFMT_DXT1, 8 bytes per block
+		BC3, // D3DFMT_DXT5, 16 bytes per block
+	};
+
+	enum class Kernel
+	{
+		Scalar,
+		Simd,
+	};
+
+	// "SSE2", "NEON" or "scalar" - what Kernel::Simd compiles to.
+	const char* SimdName();
+
+	D3DFORMAT D3DFormat(BlockFormat format);
+	UINT BlockBytes(BlockFormat format);
+
+	// Encodes block rows [firstRow, firstRow + rowCount). `blockPitch` is the
+	// distance between block rows, as D3DLOCKED_RECT::Pitch for DXT surfaces.
+	void CompressRows(BlockFormat format, const uint8_t* pixels, UINT pitch, UINT width, UINT height,
+		uint8_t* blocks, UINT blockPitch, UINT firstRow, UINT rowCount, Kernel kernel = Kernel::Simd);
+
+	// The whole image, on the pool when given.
+	void Compress(BlockFormat format, const uint8_t* pixels, UINT pitch, UINT width, UINT height,
+		uint8_t* blocks, UINT blockPitch, task::ThreadPool* pool = nullptr, Kernel kernel = Kernel::Simd);
+
+	// Reference decoder, both BC1 modes and both BC3 alpha modes.
+	void Decompress(BlockFormat format, const uint8_t* blocks, UINT blockPitch, UINT width, UINT height,
+		uint8_t* pixels, UINT pitch);
+
+	// Peak signal to noise ratio in dB over color, and alpha when asked.
+	// Infinite for identical images.
+	double Psnr(const uint8_t* a, UINT pitchA, const uint8_t* b, UINT pitchB, UINT width, UINT height,
+		bool alpha);
+}
+
+#endif // __block_compress__
@@ -0,0 +1,269 @@
+#include "buffer_pool.h"
+#include "d3d_utility.h"
+
+#include <algorithm>
+#include <cstring>
+
+void d3d::RangeAllocator::Reset(UINT capacity)
+{
+	_capacity = capacity;
+	_used = 0;
+	_free.clear();
+	if (capacity)
+		_free.push_back({ 0, capacity });
+}
+
+bool d3d::RangeAllocator::Allocate(UINT size, UINT* offset)
+{
+	if (size == 0)
+	{
+		*offset = 0;
+		return true;
+	}
+
+	for (size_t i = 0; i < _free.size(); i++)
+	{
+		Range& range = _free[i];
+		if (range.size < size)
+			continue;
+
+		*offset = range.offset;
+		range.offset += size;
+		range.size -= size;
+		if (range.size == 0)
+			_free.erase(_free.begin() + i);
+		_used += size;
+		return true;
+	}
+	return false;
+}
+
+void d3d::RangeAllocator::Free(UINT offset, UINT size)
+{
+	if (size == 0)
+		return;
+
+	auto next = std::lower_bound(_free.begin(), _free.end(), offset,
+		[](const Range& r, UINT o) { return r.offset < o; });
+	size_t i = next - _free.begin();
+
+	// Merge with the free ranges right before and after, if they touch.
+	bool mergedPrev = false;
+	if (i > 0 && _free[i - 1].offset + _free[i - 1].size == offset)
+	{
+		_free[i - 1].size += size;
+		mergedPrev = true;
+	}
+	if (i < _free.size() && offset + size == _free[i].offset)
+	{
+		if (mergedPrev)
+		{
+			_free[i - 1].size += _free[i].size;
+			_free.erase(_free.begin() + i);
+		}
+		else
+		{
+			_free[i].offset = offset;
+			_free[i].size += size;
+		}
+	}
+	else if (!mergedPrev)
+		_free.insert(_free.begin() + i, { offset, size });
+
+	_used -= size;
+}
+
+UINT d3d::RangeAllocator::LargestFree() const
+{
+	UINT largest = 0;
+	for (const Range& r : _free)
+		largest = std::max(largest, r.size);
+	return largest;
+}
+
+void d3d::BufferPool::Init(IDirect3DDevice9* device, UINT stride, DWORD fvf, UINT slabVertices, UINT slabIndices)
+{
+	Release();
+	_device = device;
+	_stride = stride;
+	_fvf = fvf;
+	_slabVertices = slabVertices;
+	_slabIndices = slabIndices;
+}
+
+void d3d::BufferPool::Release()
+{
+	for (Slab& slab : _slabs)
+	{
+		d3d::Release(slab.vb);
+		d3d::Release(slab.ib);
+	}
+	_slabs.clear();
+	_bound = -1;
+}
+
+int d3d::BufferPool::CreateSlab(UINT vertexCount, UINT indexCount)
+{
+	Slab slab;
+	if (FAILED(d3d::CreateVertexBuffer(_device, vertexCount * _stride, D3DUSAGE_WRITEONLY, _fvf,
+			D3DPOOL_MANAGED, &slab.vb)))
+		return -1;
+
+	if (indexCount && FAILED(d3d::CreateIndexBuffer(_device, indexCount * sizeof(uint16_t), D3DUSAGE_WRITEONLY,
+			D3DFMT_INDEX16, D3DPOOL_MANAGED, &slab.ib)))
+	{
+		d3d::Release(slab.vb);
+		return -1;
+	}
+
+	slab.vertices.Reset(vertexCount);
+	slab.indices.Reset(indexCount);
+	_slabs.push_back(slab);
+	return static_cast<int>(_slabs.size() - 1);
+}
+
+bool d3d::BufferPool::Allocate(const void* vertices, UINT vertexCount, const uint16_t* indices, UINT indexCount,
+	PoolAllocation* allocation, std::string& error)
+{
+	if (!_device || vertexCount == 0)
+	{
+		error = "empty mesh or pool not initialized";
+		return false;
+	}
+	if (indexCount && vertexCount > 0x10000)
+	{
+		error = "indexed mesh with more than 65536 vertices";
+		return false;
+	}
+	if (indexCount && !_slabIndices)
+	{
+		error = "pool has no index buffers";
+		return false;
+	}
+
+	PoolAllocation a;
+	for (size_t i = 0; i < _slabs.size() && a.slab < 0; i++)
+	{
+		Slab& slab = _slabs[i];
+		if (!slab.vertices.Allocate(vertexCount, &a.firstVertex))
+			continue;
+		if (!slab.indices.Allocate(indexCount, &a.firstIndex))
+		{
+			slab.vertices.Free(a.firstVertex, vertexCount);
+			continue;
+		}
+		a.slab = static_cast<int>(i);
+	}
+
+	if (a.slab < 0)
+	{
+		const UINT slabIndices = indexCount ? std::max(indexCount, _slabIndices) : _slabIndices;
+		int slab = CreateSlab(std::max(vertexCount, _slabVertices), slabIndices);
+		if (slab < 0)
+		{
+			error = "can't create slab buffers";
+			return false;
+		}
+		_slabs[slab].vertices.Allocate(vertexCount, &a.firstVertex);
+		_slabs[slab].indices.Allocate(indexCount, &a.firstIndex);
+		a.slab = slab;
+	}
+
+	a.vertexCount = vertexCount;
+	a.indexCount = indexCount;
+
+	Slab& slab = _slabs[a.slab];
+	void* data = nullptr;
+	if (FAILED(slab.vb->Lock(a.firstVertex * _stride, vertexCount * _stride, &data, 0)))
+	{
+		// Not counted in slab.allocations yet, so not Free().
+		slab.vertices.Free(a.firstVertex, vertexCount);
+		slab.indices.Free(a.firstIndex, indexCount);
+		error = "can't lock the slab vertex buffer";
+		return false;
+	}
+	memcpy(data, vertices, vertexCount * _stride);
+	slab.vb->Unlock();
+
+	if (indexCount)
+	{
+		if (FAILED(slab.ib->Lock(a.firstIndex * sizeof(uint16_t), indexCount * sizeof(uint16_t), &data, 0)))
+		{
+			slab.vertices.Free(a.firstVertex, vertexCount);
+			slab.indices.Free(a.firstIndex, indexCount);
+			error = "can't lock the slab index buffer";
+			return false;
+		}
+		memcpy(data, indices, indexCount * sizeof(uint16_t));
+		slab.ib->Unlock();
+	}
+
+	slab.allocations++;
+	*allocation = a;
+	return true;
+}
+
+void d3d::BufferPool::Free(PoolAllocation& allocation)
+{
+	if (allocation.slab < 0 || allocation.slab >= static_cast<int>(_slabs.size()))
+		return;
+
+	Slab& slab = _slabs[allocation.slab];
+	slab.vertices.Free(allocation.firstVertex, allocation.vertexCount);
+	slab.indices.Free(allocation.firstIndex, allocation.indexCount);
+	if (slab.allocations)
+		slab.allocations--;
+	allocation = PoolAllocation();
+}
+
+bool d3d::BufferPool::Bind(int slab)
+{
+	if (slab == _bound)
+		return false;
+
+	_device->SetStreamSource(0, _slabs[slab].vb, 0, _stride);
+	if (_slabs[slab].ib)
+		_device->SetIndices(_slabs[slab].ib);
+	if (_fvf)
+		_device->SetFVF(_fvf);
+	_bound = slab;
+	_binds++;
+	return true;
+}
+
+void d3d::BufferPool::Draw(const PoolAllocation& allocation)
+{
+	if (allocation.slab < 0)
+		return;
+
+	Bind(allocation.slab);
+	if (allocation.indexCount)
+		_device->DrawIndexedPrimitive(D3DPT_TRIANGLELIST, allocation.firstVertex, 0, allocation.vertexCount,
+			allocation.firstIndex, allocation.indexCount / 3);
+	else
+		_device->DrawPrimitive(D3DPT_TRIANGLELIST, allocation.firstVertex, allocation.vertexCount / 3);
+}
+
+d3d::BufferPoolStats d3d::BufferPool::Stats() const
+{
+	BufferPoolStats stats;
+	stats.slabs = static_cast<UINT>(_slabs.size());
+	stats.binds = _binds;
+	for (const Slab& slab : _slabs)
+	{
+		stats.allocations += slab.allocations;
+		stats.vertexCapacity += slab.vertices.Capacity();
+		stats.vertexUsed += slab.vertices.Used();
+		stats.indexCapacity += slab.indices.Capacity();
+		stats.indexUsed += slab.indices.Used();
+		stats.freeRanges += slab.vertices.FreeRanges() + slab.indices.FreeRanges();
+
+		const UINT free = slab.vertices.Capacity() - slab.vertices.Used();
+		if (free)
+		{
+			float f = 1.0f - static_cast<float>(slab.vertices.LargestFree()) / free;
+			stats.fragmentation = std::max(stats.fragmentation, f);
+		}
+	}
+	return stats;
+}
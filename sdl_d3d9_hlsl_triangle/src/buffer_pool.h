@@ -0,0 +1,122 @@
+#ifndef __buffer_pool__
+#define __buffer_pool__
+
+#include <d3d9.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Static geometry sub-allocated from a few large managed buffers ("slabs")
+// instead of one vertex buffer per mesh. A mesh is a base vertex and a
+// first index inside a slab, meshes drawn in slab order share one
+// SetStreamSource / SetIndices.
+
+namespace d3d
+{
+	// First-fit free list over [0, capacity), neighbours merge on free.
+	class RangeAllocator
+	{
+	public:
+		void Reset(UINT capacity);
+		bool Allocate(UINT size, UINT* offset);
+		void Free(UINT offset, UINT size);
+
+		UINT Capacity() const { return _capacity; }
+		UINT Used() const { return _used; }
+		UINT FreeRanges() const { return static_cast<UINT>(_free.size()); }
+		UINT LargestFree() const;
+
+	private:
+		struct Range
+		{
+			UINT offset, size;
+		};
+
+		std::vector<Range> _free; // sorted by offset
+		UINT _capacity = 0;
+		UINT _used = 0;
+	};
+
+	struct PoolAllocation
+	{
+		int slab = -1;
+		UINT firstVertex = 0, vertexCount = 0;
+		UINT firstIndex = 0, indexCount = 0; // 16-bit, relative to firstVertex
+	};
+
+	struct BufferPoolStats
+	{
+		UINT slabs = 0;
+		UINT allocations = 0;
+		UINT vertexCapacity = 0, vertexUsed = 0;
+		UINT indexCapacity = 0, indexUsed = 0;
+		UINT freeRanges = 0;
+		// 1 - largest free block / all free space, worst slab. 0 - free
+		// space is contiguous.
+		float fragmentation = 0.0f;
+		uint64_t binds = 0; // slab changes in Bind()
+	};
+
+	class BufferPool
+	{
+	public:
+		BufferPool() = default;
+		~BufferPool() { Release(); }
+
+		BufferPool(const BufferPool&) = delete;
+		BufferPool& operator=(const BufferPool&) = delete;
+
+		// Slabs hold `slabVertices` vertices of `stride` bytes and
+		// `slabIndices` 16-bit indices (0 - no index buffer). They are
+		// created on demand; a mesh bigger than a slab gets its own.
+		void Init(IDirect3DDevice9* device, UINT stride, DWORD fvf, UINT slabVertices, UINT slabIndices);
+		void Release();
+
+		// Copies the mesh into the first slab with room for it. Indices are
+		// relative to the mesh's first vertex, so a mesh has at most 65536
+		// vertices when it is indexed.
+		bool Allocate(const void* vertices, UINT vertexCount, const uint16_t* indices, UINT indexCount,
+			PoolAllocation* allocation, std::string& error);
+		void Free(PoolAllocation& allocation);
+
+		// Binds the slab's buffers (and the FVF, if any) unless they are
+		// bound already. Returns true if it had to.
+		bool Bind(int slab);
+		// Call when something else was bound to stream 0 or the indices.
+		void Unbind() { _bound = -1; }
+
+		// Bind + DrawIndexedPrimitive, or DrawPrimitive for meshes without
+		// indices. Triangle lists.
+		void Draw(const PoolAllocation& allocation);
+
+		// Draw order that keeps rebinds to one per slab.
+		static bool SlabOrder(const PoolAllocation& a, const PoolAllocation& b)
+		{
+			return a.slab != b.slab ? a.slab < b.slab : a.firstVertex < b.firstVertex;
+		}
+
+		BufferPoolStats Stats() const;
+		UINT Stride() const { return _stride; }
+
+	private:
+		struct Slab
+		{
+			IDirect3DVertexBuffer9* vb = nullptr;
+			IDirect3DIndexBuffer9* ib = nullptr;
+			RangeAllocator vertices, indices;
+			UINT allocations = 0;
+		};
+
+		int CreateSlab(UINT vertexCount, UINT indexCount);
+
+		IDirect3DDevice9* _device = nullptr;
+		UINT _stride = 0;
+		DWORD _fvf = 0;
+		UINT _slabVertices = 0, _slabIndices = 0;
+		std::vector<Slab> _slabs;
+		int _bound = -1;
+		uint64_t _binds = 0;
+	};
+}
+
+#endif // __buffer_pool__
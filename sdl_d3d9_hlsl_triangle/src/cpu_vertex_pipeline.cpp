@@ -0,0 +1,541 @@
+#include "cpu_vertex_pipeline.h"
+#include "bench_util.h"
+#include "d3d_math.h"
+#include "d3d_utility.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX__)
+#define PIPE_AVX 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PIPE_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define PIPE_NEON 1
+#include <arm_neon.h>
+#endif
+
+void vtx::VertexSoA::Resize(size_t count)
+{
+	x.resize(count);
+	y.resize(count);
+	z.resize(count);
+	color.resize(count);
+}
+
+void vtx::VertexSoA::Set(size_t i, float px, float py, float pz, uint32_t c)
+{
+	x[i] = px; y[i] = py; z[i] = pz; color[i] = c;
+}
+
+const char* vtx::PipelineSimdName()
+{
+#if PIPE_AVX
+	return "AVX";
+#elif PIPE_SSE2
+	return "SSE2";
+#elif PIPE_NEON
+	return "NEON";
+#else
+	return "scalar";
+#endif
+}
+
+namespace
+{
+	// Outcode bits, set when the vertex is outside that plane.
+	const uint32_t OutLeft = 1, OutRight = 2, OutBottom = 4, OutTop = 8, OutNear = 16, OutFar = 32;
+
+	const size_t VertexGrain = 16384;
+	const size_t TriangleGrain = 8192;
+
+	// Everything the per-vertex work needs, folded from PipelineState.
+	struct Constants
+	{
+		float m[4][4];      // world * view * projection
+		float depth[4];     // view space z: column 2 of world * view
+		float sxScale, sxBias, syScale, syBias, szScale, szBias;
+		D3DFOGMODE fogMode;
+		float fogScale, fogBias; // linear: (end - d) / (end - start)
+		float fogDensity;
+	};
+
+	Constants MakeConstants(const vtx::PipelineState& s)
+	{
+		Constants k;
+		D3DMATRIX worldView, wvp;
+		d3d::MatrixMultiply(&worldView, &s.world, &s.view);
+		d3d::MatrixMultiply(&wvp, &worldView, &s.projection);
+		memcpy(k.m, wvp.m, sizeof(k.m));
+		for (int r = 0; r < 4; r++)
+			k.depth[r] = worldView.m[r][2];
+
+		// Pretransformed vertices address pixel centers, the hardware
+		// viewport transform maps -1 to the pixel edge: half a pixel off.
+		const D3DVIEWPORT9& vp = s.viewport;
+		k.sxScale = vp.Width * 0.5f;
+		k.sxBias = vp.X + vp.Width * 0.5f - 0.5f;
+		k.syScale = vp.Height * -0.5f;
+		k.syBias = vp.Y + vp.Height * 0.5f - 0.5f;
+		k.szScale = vp.MaxZ - vp.MinZ;
+		k.szBias = vp.MinZ;
+
+		k.fogMode = s.fogMode;
+		const float range = s.fogEnd - s.fogStart;
+		k.fogScale = range != 0.0f ? -1.0f / range : 0.0f;
+		k.fogBias = range != 0.0f ? s.fogEnd / range : 1.0f;
+		k.fogDensity = s.fogDensity;
+		return k;
+	}
+
+	// Destination arrays of the transform pass.
+	struct Outputs
+	{
+		float* clipX; float* clipY; float* clipZ; float* clipW;
+		float* screenX; float* screenY; float* screenZ; float* rhw;
+		float* fog;
+		uint32_t* outcode;
+	};
+
+	void TransformScalar(const Constants& k, const vtx::VertexSoA& in, const Outputs& out, size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			const float x = in.x[i], y = in.y[i], z = in.z[i];
+			const float cx = x * k.m[0][0] + y * k.m[1][0] + z * k.m[2][0] + k.m[3][0];
+			const float cy = x * k.m[0][1] + y * k.m[1][1] + z * k.m[2][1] + k.m[3][1];
+			const float cz = x * k.m[0][2] + y * k.m[1][2] + z * k.m[2][2] + k.m[3][2];
+			const float cw = x * k.m[0][3] + y * k.m[1][3] + z * k.m[2][3] + k.m[3][3];
+			out.clipX[i] = cx; out.clipY[i] = cy; out.clipZ[i] = cz; out.clipW[i] = cw;
+
+			// Garbage for w <= 0, those vertices are always behind the near
+			// plane and go through the clipper.
+			const float rhw = 1.0f / cw;
+			out.screenX[i] = cx * rhw * k.sxScale + k.sxBias;
+			out.screenY[i] = cy * rhw * k.syScale + k.syBias;
+			out.screenZ[i] = cz * rhw * k.szScale + k.szBias;
+			out.rhw[i] = rhw;
+
+			const float d = x * k.depth[0] + y * k.depth[1] + z * k.depth[2] + k.depth[3];
+			out.fog[i] = k.fogMode == D3DFOG_LINEAR ? std::clamp(d * k.fogScale + k.fogBias, 0.0f, 1.0f) : d;
+
+			out.outcode[i] =
+				(cx < -cw ? OutLeft : 0) | (cx > cw ? OutRight : 0) |
+				(cy < -cw ? OutBottom : 0) | (cy > cw ? OutTop : 0) |
+				(cz < 0.0f ? OutNear : 0) | (cz > cw ? OutFar : 0);
+		}
+	}
+
+	// One set of lane operations per instruction set, the kernel below is
+	// written once against them.
+#if PIPE_AVX
+	typedef __m256 Lanes;
+	const size_t LaneCount = 8;
+	inline Lanes Set1(float v) { return _mm256_set1_ps(v); }
+	inline Lanes Bits(uint32_t v) { return _mm256_castsi256_ps(_mm256_set1_epi32(static_cast<int>(v))); }
+	inline Lanes Load(const float* p) { return _mm256_loadu_ps(p); }
+	inline void Store(float* p, Lanes v) { _mm256_storeu_ps(p, v); }
+	inline void StoreBits(uint32_t* p, Lanes v) { _mm256_storeu_ps(reinterpret_cast<float*>(p), v); }
+	inline Lanes Add(Lanes a, Lanes b) { return _mm256_add_ps(a, b); }
+	inline Lanes Mul(Lanes a, Lanes b) { return _mm256_mul_ps(a, b); }
+	inline Lanes Div(Lanes a, Lanes b) { return _mm256_div_ps(a, b); }
+	inline Lanes Min(Lanes a, Lanes b) { return _mm256_min_ps(a, b); }
+	inline Lanes Max(Lanes a, Lanes b) { return _mm256_max_ps(a, b); }
+	inline Lanes Negate(Lanes a) { return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f)); }
+	inline Lanes Less(Lanes a, Lanes b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	inline Lanes And(Lanes a, Lanes b) { return _mm256_and_ps(a, b); }
+	inline Lanes Or(Lanes a, Lanes b) { return _mm256_or_ps(a, b); }
+#elif PIPE_SSE2
+	typedef __m128 Lanes;
+	const size_t LaneCount = 4;
+	inline Lanes Set1(float v) { return _mm_set1_ps(v); }
+	inline Lanes Bits(uint32_t v) { return _mm_castsi128_ps(_mm_set1_epi32(static_cast<int>(v))); }
+	inline Lanes Load(const float* p) { return _mm_loadu_ps(p); }
+	inline void Store(float* p, Lanes v) { _mm_storeu_ps(p, v); }
+	inline void StoreBits(uint32_t* p, Lanes v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_castps_si128(v)); }
+	inline Lanes Add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+	inline Lanes Mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+	inline Lanes Div(Lanes a, Lanes b) { return _mm_div_ps(a, b); }
+	inline Lanes Min(Lanes a, Lanes b) { return _mm_min_ps(a, b); }
+	inline Lanes Max(Lanes a, Lanes b) { return _mm_max_ps(a, b); }
+	inline Lanes Negate(Lanes a) { return _mm_xor_ps(a, _mm_set1_ps(-0.0f)); }
+	inline Lanes Less(Lanes a, Lanes b) { return _mm_cmplt_ps(a, b); }
+	inline Lanes And(Lanes a, Lanes b) { return _mm_and_ps(a, b); }
+	inline Lanes Or(Lanes a, Lanes b) { return _mm_or_ps(a, b); }
+#elif PIPE_NEON
+	typedef float32x4_t Lanes;
+	const size_t LaneCount = 4;
+	inline Lanes Set1(float v) { return vdupq_n_f32(v); }
+	inline Lanes Bits(uint32_t v) { return vreinterpretq_f32_u32(vdupq_n_u32(v)); }
+	inline Lanes Load(const float* p) { return vld1q_f32(p); }
+	inline void Store(float* p, Lanes v) { vst1q_f32(p, v); }
+	inline void StoreBits(uint32_t* p, Lanes v) { vst1q_u32(p, vreinterpretq_u32_f32(v)); }
+	inline Lanes Add(Lanes a, Lanes b) { return vaddq_f32(a, b); }
+	inline Lanes Mul(Lanes a, Lanes b) { return vmulq_f32(a, b); }
+	inline Lanes Div(Lanes a, Lanes b) { return vdivq_f32(a, b); }
+	inline Lanes Min(Lanes a, Lanes b) { return vminq_f32(a, b); }
+	inline Lanes Max(Lanes a, Lanes b) { return vmaxq_f32(a, b); }
+	inline Lanes Negate(Lanes a) { return vnegq_f32(a); }
+	inline Lanes Less(Lanes a, Lanes b) { return vreinterpretq_f32_u32(vcltq_f32(a, b)); }
+	inline Lanes And(Lanes a, Lanes b)
+	{
+		return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+	}
+	inline Lanes Or(Lanes a, Lanes b)
+	{
+		return vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+	}
+#endif
+
+#if PIPE_AVX || PIPE_SSE2 || PIPE_NEON
+	// a * x + b * y + c * z + d
+	inline Lanes Dot(Lanes x, Lanes y, Lanes z, Lanes a, Lanes b, Lanes c, Lanes d)
+	{
+		return Add(Add(Mul(x, a), Mul(y, b)), Add(Mul(z, c), d));
+	}
+
+	void TransformSimd(const Constants& k, const vtx::VertexSoA& in, const Outputs& out, size_t begin, size_t end)
+	{
+		Lanes m[4][4];
+		for (int r = 0; r < 4; r++)
+			for (int c = 0; c < 4; c++)
+				m[r][c] = Set1(k.m[r][c]);
+		const Lanes d0 = Set1(k.depth[0]), d1 = Set1(k.depth[1]), d2 = Set1(k.depth[2]), d3 = Set1(k.depth[3]);
+		const Lanes sxScale = Set1(k.sxScale), sxBias = Set1(k.sxBias);
+		const Lanes syScale = Set1(k.syScale), syBias = Set1(k.syBias);
+		const Lanes szScale = Set1(k.szScale), szBias = Set1(k.szBias);
+		const Lanes fogScale = Set1(k.fogScale), fogBias = Set1(k.fogBias);
+		const Lanes zero = Set1(0.0f), one = Set1(1.0f);
+		const bool linearFog = k.fogMode == D3DFOG_LINEAR;
+
+		size_t i = begin;
+		for (; i + LaneCount <= end; i += LaneCount)
+		{
+			const Lanes x = Load(&in.x[i]), y = Load(&in.y[i]), z = Load(&in.z[i]);
+			const Lanes cx = Dot(x, y, z, m[0][0], m[1][0], m[2][0], m[3][0]);
+			const Lanes cy = Dot(x, y, z, m[0][1], m[1][1], m[2][1], m[3][1]);
+			const Lanes cz = Dot(x, y, z, m[0][2], m[1][2], m[2][2], m[3][2]);
+			const Lanes cw = Dot(x, y, z, m[0][3], m[1][3], m[2][3], m[3][3]);
+			Store(out.clipX + i, cx); Store(out.clipY + i, cy); Store(out.clipZ + i, cz); Store(out.clipW + i, cw);
+
+			const Lanes rhw = Div(one, cw);
+			Store(out.screenX + i, Add(Mul(Mul(cx, rhw), sxScale), sxBias));
+			Store(out.screenY + i, Add(Mul(Mul(cy, rhw), syScale), syBias));
+			Store(out.screenZ + i, Add(Mul(Mul(cz, rhw), szScale), szBias));
+			Store(out.rhw + i, rhw);
+
+			Lanes fog = Dot(x, y, z, d0, d1, d2, d3);
+			if (linearFog)
+				fog = Min(Max(Add(Mul(fog, fogScale), fogBias), zero), one);
+			Store(out.fog + i, fog);
+
+			const Lanes negW = Negate(cw);
+			Lanes code = And(Less(cx, negW), Bits(OutLeft));
+			code = Or(code, And(Less(cw, cx), Bits(OutRight)));
+			code = Or(code, And(Less(cy, negW), Bits(OutBottom)));
+			code = Or(code, And(Less(cw, cy), Bits(OutTop)));
+			code = Or(code, And(Less(cz, zero), Bits(OutNear)));
+			code = Or(code, And(Less(cw, cz), Bits(OutFar)));
+			StoreBits(out.outcode + i, code);
+		}
+		TransformScalar(k, in, out, i, end);
+	}
+#else
+	void TransformSimd(const Constants& k, const vtx::VertexSoA& in, const Outputs& out, size_t begin, size_t end)
+	{
+		TransformScalar(k, in, out, begin, end);
+	}
+#endif
+
+	// The fog pass left the view space depth for the exponential modes.
+	void ExponentialFog(const Constants& k, float* fog, size_t begin, size_t end)
+	{
+		if (k.fogMode == D3DFOG_EXP)
+		{
+			for (size_t i = begin; i < end; i++)
+				fog[i] = std::exp(-k.fogDensity * fog[i]);
+		}
+		else if (k.fogMode == D3DFOG_EXP2)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				const float t = k.fogDensity * fog[i];
+				fog[i] = std::exp(-t * t);
+			}
+		}
+		else if (k.fogMode != D3DFOG_LINEAR)
+		{
+			std::fill(fog + begin, fog + end, 1.0f);
+		}
+	}
+
+	D3DCOLOR FogSpecular(float fog)
+	{
+		return static_cast<D3DCOLOR>(std::clamp(fog, 0.0f, 1.0f) * 255.0f + 0.5f) << 24;
+	}
+
+	// Clip space vertex with its attributes, for the clipper.
+	struct ClipVertex
+	{
+		float x, y, z, w;
+		float fog;
+		float color[4]; // b, g, r, a as in the D3DCOLOR bytes
+	};
+
+	ClipVertex MakeClipVertex(const Outputs& v, const vtx::VertexSoA& in, uint32_t i)
+	{
+		ClipVertex c = { v.clipX[i], v.clipY[i], v.clipZ[i], v.clipW[i], v.fog[i], {} };
+		for (int ch = 0; ch < 4; ch++)
+			c.color[ch] = static_cast<float>((in.color[i] >> (ch * 8)) & 0xff);
+		return c;
+	}
+
+	ClipVertex Lerp(const ClipVertex& a, const ClipVertex& b, float t)
+	{
+		ClipVertex r;
+		r.x = a.x + (b.x - a.x) * t;
+		r.y = a.y + (b.y - a.y) * t;
+		r.z = a.z + (b.z - a.z) * t;
+		r.w = a.w + (b.w - a.w) * t;
+		r.fog = a.fog + (b.fog - a.fog) * t;
+		for (int ch = 0; ch < 4; ch++)
+			r.color[ch] = a.color[ch] + (b.color[ch] - a.color[ch]) * t;
+		return r;
+	}
+
+	// Sutherland-Hodgman against one plane, `distance` >= 0 inside.
+	template <class Distance>
+	int ClipPolygon(const ClipVertex* in, int count, ClipVertex* out, Distance distance)
+	{
+		int n = 0;
+		for (int i = 0; i < count; i++)
+		{
+			const ClipVertex& a = in[i];
+			const ClipVertex& b = in[(i + 1) % count];
+			const float da = distance(a), db = distance(b);
+			if (da >= 0.0f)
+				out[n++] = a;
+			if ((da >= 0.0f) != (db >= 0.0f))
+				out[n++] = Lerp(a, b, da / (da - db));
+		}
+		return n;
+	}
+
+	vtx::ScreenVertex Project(const Constants& k, const ClipVertex& c)
+	{
+		const float rhw = 1.0f / c.w;
+		D3DCOLOR color = 0;
+		for (int ch = 0; ch < 4; ch++)
+			color |= static_cast<D3DCOLOR>(std::clamp(c.color[ch] + 0.5f, 0.0f, 255.0f)) << (ch * 8);
+		return { c.x * rhw * k.sxScale + k.sxBias, c.y * rhw * k.syScale + k.syBias,
+			c.z * rhw * k.szScale + k.szBias, rhw, color, FogSpecular(c.fog) };
+	}
+
+	struct ChunkCounts
+	{
+		size_t rejected = 0;
+		size_t clipped = 0;
+	};
+
+	void AssembleRange(const Constants& k, const vtx::VertexSoA& in, const Outputs& v, const uint32_t* indices,
+		size_t begin, size_t end, std::vector<vtx::ScreenVertex>& out, ChunkCounts& counts)
+	{
+		out.clear();
+		out.reserve((end - begin) * 3);
+		counts = ChunkCounts();
+		for (size_t t = begin; t < end; t++)
+		{
+			const uint32_t idx[3] = { indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2] };
+			const uint32_t c0 = v.outcode[idx[0]], c1 = v.outcode[idx[1]], c2 = v.outcode[idx[2]];
+			if (c0 & c1 & c2)
+			{
+				counts.rejected++;
+				continue;
+			}
+
+			// Left, right, top and bottom are left to the rasterizer's guard
+			// band, only depth needs real clipping: rhw breaks down behind
+			// the eye and z must stay in [0, 1].
+			if (!((c0 | c1 | c2) & (OutNear | OutFar)))
+			{
+				for (uint32_t i : idx)
+					out.push_back({ v.screenX[i], v.screenY[i], v.screenZ[i], v.rhw[i], in.color[i], FogSpecular(v.fog[i]) });
+				continue;
+			}
+
+			counts.clipped++;
+			ClipVertex polygon[5], clipped[5];
+			for (int i = 0; i < 3; i++)
+				polygon[i] = MakeClipVertex(v, in, idx[i]);
+			int n = ClipPolygon(polygon, 3, clipped, [](const ClipVertex& c) { return c.z; });
+			n = ClipPolygon(clipped, n, polygon, [](const ClipVertex& c) { return c.w - c.z; });
+			for (int i = 1; i + 1 < n; i++)
+			{
+				out.push_back(Project(k, polygon[0]));
+				out.push_back(Project(k, polygon[i]));
+				out.push_back(Project(k, polygon[i + 1]));
+			}
+		}
+	}
+}
+
+bool vtx::CpuVertexPipeline::Create(IDirect3DDevice9* device, UINT maxVertices, std::string& error)
+{
+	Release();
+
+	if (FAILED(d3d::CreateVertexBuffer(device, maxVertices * sizeof(ScreenVertex),
+		D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY, ScreenVertex::FVF, D3DPOOL_DEFAULT, &_vb)))
+	{
+		error = "can't create the output vertex buffer";
+		return false;
+	}
+
+	D3DCAPS9 caps;
+	device->GetDeviceCaps(&caps);
+	_maxPrimitives = caps.MaxPrimitiveCount ? caps.MaxPrimitiveCount : 65535;
+	_capacity = maxVertices / 3 * 3;
+	_cursor = _drawStart = _drawCount = 0;
+	return true;
+}
+
+void vtx::CpuVertexPipeline::Release()
+{
+	d3d::Release(_vb);
+	_capacity = _cursor = _drawStart = _drawCount = 0;
+}
+
+bool vtx::CpuVertexPipeline::Process(const VertexSoA& vertices, const uint32_t* indices, size_t indexCount,
+	task::ThreadPool* pool, PipelineKernel kernel)
+{
+	_stats = PipelineStats();
+	_drawCount = 0;
+	if (!_vb)
+		return false;
+
+	const double start = bench::NowMs();
+	const size_t count = vertices.Count();
+	for (std::vector<float>* a : { &_clipX, &_clipY, &_clipZ, &_clipW, &_screenX, &_screenY, &_screenZ, &_rhw, &_fog })
+		a->resize(count);
+	_outcode.resize(count);
+
+	const Constants k = MakeConstants(_state);
+	const Outputs out = { _clipX.data(), _clipY.data(), _clipZ.data(), _clipW.data(),
+		_screenX.data(), _screenY.data(), _screenZ.data(), _rhw.data(), _fog.data(), _outcode.data() };
+	auto transform = [&](size_t begin, size_t end)
+	{
+		if (kernel == PipelineKernel::Simd)
+			TransformSimd(k, vertices, out, begin, end);
+		else
+			TransformScalar(k, vertices, out, begin, end);
+		ExponentialFog(k, out.fog, begin, end);
+	};
+	if (pool && count > VertexGrain)
+		pool->ParallelFor(count, VertexGrain, transform);
+	else
+		transform(0, count);
+
+	const double transformed = bench::NowMs();
+
+	// Chunks of triangles are assembled into their own arrays and copied
+	// into the vertex buffer one after the other.
+	const size_t triangles = indexCount / 3;
+	const size_t chunks = (triangles + TriangleGrain - 1) / TriangleGrain;
+	_chunks.resize(chunks);
+	std::vector<ChunkCounts> counts(chunks);
+	auto assemble = [&](size_t first, size_t last)
+	{
+		for (size_t c = first; c < last; c++)
+		{
+			const size_t begin = c * TriangleGrain;
+			const size_t end = std::min(begin + TriangleGrain, triangles);
+			AssembleRange(k, vertices, out, indices, begin, end, _chunks[c], counts[c]);
+		}
+	};
+	if (pool && chunks > 1)
+		pool->ParallelFor(chunks, 1, assemble);
+	else
+		assemble(0, chunks);
+
+	size_t total = 0;
+	for (size_t c = 0; c < chunks; c++)
+	{
+		total += _chunks[c].size();
+		_stats.rejected += counts[c].rejected;
+		_stats.clipped += counts[c].clipped;
+	}
+
+	const double assembled = bench::NowMs();
+
+	// Appends with NOOVERWRITE while there is room, so several batches per
+	// frame don't stall, and starts over with DISCARD when full.
+	const UINT fit = static_cast<UINT>(std::min<size_t>(total, _capacity));
+	bool ok = fit == total;
+	if (fit)
+	{
+		DWORD flags = D3DLOCK_NOOVERWRITE;
+		if (_cursor == 0 || fit > _capacity - _cursor)
+		{
+			flags = D3DLOCK_DISCARD;
+			_cursor = 0;
+		}
+
+		void* data = nullptr;
+		if (SUCCEEDED(_vb->Lock(_cursor * sizeof(ScreenVertex), fit * sizeof(ScreenVertex), &data, flags)))
+		{
+			std::vector<size_t> offsets(chunks + 1, 0);
+			for (size_t c = 0; c < chunks; c++)
+				offsets[c + 1] = offsets[c] + _chunks[c].size();
+
+			ScreenVertex* dst = static_cast<ScreenVertex*>(data);
+			auto copy = [&](size_t first, size_t last)
+			{
+				for (size_t c = first; c < last; c++)
+				{
+					if (offsets[c] >= fit)
+						continue;
+					const size_t n = std::min(offsets[c + 1], static_cast<size_t>(fit)) - offsets[c];
+					memcpy(dst + offsets[c], _chunks[c].data(), n * sizeof(ScreenVertex));
+				}
+			};
+			if (pool && chunks > 1)
+				pool->ParallelFor(chunks, 1, copy);
+			else
+				copy(0, chunks);
+
+			_vb->Unlock();
+			_drawStart = _cursor;
+			_drawCount = fit;
+			_cursor += fit;
+		}
+		else
+		{
+			ok = false;
+		}
+	}
+
+	_stats.vertices = count;
+	_stats.triangles = triangles;
+	_stats.outputVertices = _drawCount;
+	_stats.transformMs = transformed - start;
+	_stats.assembleMs = assembled - transformed;
+	_stats.uploadMs = bench::NowMs() - assembled;
+	return ok;
+}
+
+void vtx::CpuVertexPipeline::Draw(IDirect3DDevice9* device) const
+{
+	if (!_drawCount)
+		return;
+
+	device->SetVertexShader(nullptr);
+	device->SetFVF(ScreenVertex::FVF);
+	device->SetStreamSource(0, _vb, 0, sizeof(ScreenVertex));
+	for (UINT first = 0; first < _drawCount / 3; first += _maxPrimitives)
+	{
+		const UINT primitives = std::min(_drawCount / 3 - first, _maxPrimitives);
+		device->DrawPrimitive(D3DPT_TRIANGLELIST, _drawStart + first * 3, primitives);
+	}
+}
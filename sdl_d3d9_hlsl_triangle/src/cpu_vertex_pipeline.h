@@ -0,0 +1,121 @@
+#ifndef __cpu_vertex_pipeline__
+#define __cpu_vertex_pipeline__
+
+#include "task_graph.h"
+
+#include <d3d9.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Our own vertex processing for devices without hardware T&L, instead of
+// leaving it to D3DCREATE_SOFTWARE_VERTEXPROCESSING. Positions are stored
+// as SoA arrays and transformed 4 (SSE2, NEON) or 8 (AVX, built with
+// -DENABLE_AVX=ON) at a time, the fixed-function vertex fog factor is
+// computed alongside, triangles are trivially rejected or clipped against the
+// near and far planes, and the result is written as pretransformed
+// D3DFVF_XYZRHW vertices to a dynamic vertex buffer. Large batches are split
+// across the thread pool.
+
+namespace vtx
+{
+	struct ScreenVertex
+	{
+		float x, y, z, rhw;
+		D3DCOLOR diffuse;
+		D3DCOLOR specular; // alpha carries the vertex fog factor
+
+		static const DWORD FVF = D3DFVF_XYZRHW | D3DFVF_DIFFUSE | D3DFVF_SPECULAR;
+	};
+
+	// Object space positions, one array per component, and D3DCOLORs.
+	struct VertexSoA
+	{
+		std::vector<float> x, y, z;
+		std::vector<uint32_t> color;
+
+		size_t Count() const { return x.size(); }
+		void Resize(size_t count);
+		void Set(size_t i, float px, float py, float pz, uint32_t c);
+	};
+
+	// The fixed-function state the pipeline replaces. Fog is vertex fog on
+	// the view space depth, as with D3DRS_RANGEFOGENABLE off.
+	struct PipelineState
+	{
+		D3DMATRIX world, view, projection;
+		D3DVIEWPORT9 viewport;
+		D3DFOGMODE fogMode = D3DFOG_NONE;
+		float fogStart = 0.0f, fogEnd = 1.0f, fogDensity = 1.0f;
+	};
+
+	enum class PipelineKernel
+	{
+		Scalar,
+		Simd,
+	};
+
+	// "AVX", "SSE2", "NEON" or "scalar" - what PipelineKernel::Simd compiles to.
+	const char* PipelineSimdName();
+
+	struct PipelineStats
+	{
+		size_t vertices = 0;
+		size_t triangles = 0;
+		size_t rejected = 0;       // outside one of the frustum planes
+		size_t clipped = 0;        // crossed the near or far plane
+		size_t outputVertices = 0;
+		double transformMs = 0.0;
+		double assembleMs = 0.0;   // reject, clip and project
+		double uploadMs = 0.0;     // lock and copy into the vertex buffer
+	};
+
+	class CpuVertexPipeline
+	{
+	public:
+		CpuVertexPipeline() = default;
+		~CpuVertexPipeline() { Release(); }
+
+		CpuVertexPipeline(const CpuVertexPipeline&) = delete;
+		CpuVertexPipeline& operator=(const CpuVertexPipeline&) = delete;
+
+		// Dynamic buffer for up to `maxVertices` output vertices per frame.
+		// It lives in D3DPOOL_DEFAULT: Release before a Reset, Create after.
+		bool Create(IDirect3DDevice9* device, UINT maxVertices, std::string& error);
+		void Release();
+
+		void SetState(const PipelineState& state) { _state = state; }
+
+		// Transforms `vertices`, assembles the indexed triangle list and
+		// writes what is visible to the vertex buffer. Returns false if the
+		// lock failed or the output did not fit (it is cut short then).
+		bool Process(const VertexSoA& vertices, const uint32_t* indices, size_t indexCount,
+			task::ThreadPool* pool = nullptr, PipelineKernel kernel = PipelineKernel::Simd);
+
+		// Draws the output of the last Process with the vertex shader
+		// unbound. Fog and the pixel pipeline are left to the caller.
+		void Draw(IDirect3DDevice9* device) const;
+
+		const PipelineStats& Stats() const { return _stats; }
+
+	private:
+		IDirect3DVertexBuffer9* _vb = nullptr;
+		UINT _capacity = 0;
+		UINT _cursor = 0;       // next free vertex, NOOVERWRITE until full
+		UINT _drawStart = 0, _drawCount = 0;
+		UINT _maxPrimitives = 65535;
+		PipelineState _state = {};
+		PipelineStats _stats;
+
+		// Per-vertex results: clip space position, screen position, fog
+		// factor and outcode.
+		std::vector<float> _clipX, _clipY, _clipZ, _clipW;
+		std::vector<float> _screenX, _screenY, _screenZ, _rhw;
+		std::vector<float> _fog;
+		std::vector<uint32_t> _outcode;
+		std::vector<std::vector<ScreenVertex>> _chunks; // per chunk of triangles
+	};
+}
+
+#endif // __cpu_vertex_pipeline__
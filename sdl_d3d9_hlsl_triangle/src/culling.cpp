@@ -0,0 +1,282 @@
+#include "culling.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX__)
+#define CULL_AVX 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CULL_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define CULL_NEON 1
+#include <arm_neon.h>
+#endif
+
+void cull::ExtractFrustum(const D3DMATRIX& m, Frustum* frustum)
+{
+	// column j of the matrix is (m[0][j], m[1][j], m[2][j], m[3][j])
+	auto column = [&](int j) { return Plane{ m.m[0][j], m.m[1][j], m.m[2][j], m.m[3][j] }; };
+	auto combine = [](const Plane& a, const Plane& b, float sign)
+	{
+		return Plane{ a.nx + sign * b.nx, a.ny + sign * b.ny, a.nz + sign * b.nz, a.d + sign * b.d };
+	};
+
+	const Plane w = column(3);
+	Plane* planes = frustum->planes;
+	planes[0] = combine(w, column(0), +1.0f); // left:   w + x >= 0
+	planes[1] = combine(w, column(0), -1.0f); // right:  w - x >= 0
+	planes[2] = combine(w, column(1), +1.0f); // bottom: w + y >= 0
+	planes[3] = combine(w, column(1), -1.0f); // top:    w - y >= 0
+	planes[4] = column(2);                    // near:   z >= 0
+	planes[5] = combine(w, column(2), -1.0f); // far:    w - z >= 0
+
+	for (int i = 0; i < 6; i++)
+	{
+		Plane& p = planes[i];
+		float len = std::sqrt(p.nx * p.nx + p.ny * p.ny + p.nz * p.nz);
+		if (len > 0.0f)
+		{
+			float inv = 1.0f / len;
+			p.nx *= inv; p.ny *= inv; p.nz *= inv; p.d *= inv;
+		}
+	}
+}
+
+void cull::BoxSoA::Resize(size_t count)
+{
+	for (std::vector<float>* v : { &centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ })
+		v->resize(count);
+}
+
+void cull::BoxSoA::Set(size_t i, const float center[3], const float extent[3])
+{
+	centerX[i] = center[0]; centerY[i] = center[1]; centerZ[i] = center[2];
+	extentX[i] = extent[0]; extentY[i] = extent[1]; extentZ[i] = extent[2];
+}
+
+const char* cull::SimdName()
+{
+#if CULL_AVX
+	return "AVX";
+#elif CULL_SSE2
+	return "SSE2";
+#elif CULL_NEON
+	return "NEON";
+#else
+	return "scalar";
+#endif
+}
+
+namespace
+{
+	// A box is outside when even its corner furthest along the plane normal
+	// is behind the plane: n . c + |n| . e + d < 0.
+	size_t CullScalar(const cull::Frustum& f, const cull::BoxSoA& b, size_t begin, size_t end, uint32_t* out)
+	{
+		size_t n = 0;
+		for (size_t i = begin; i < end; i++)
+		{
+			bool inside = true;
+			for (const cull::Plane& p : f.planes)
+			{
+				float dist = p.nx * b.centerX[i] + p.ny * b.centerY[i] + p.nz * b.centerZ[i] + p.d +
+					std::fabs(p.nx) * b.extentX[i] + std::fabs(p.ny) * b.extentY[i] + std::fabs(p.nz) * b.extentZ[i];
+				inside = inside && dist >= 0.0f;
+			}
+			out[n] = static_cast<uint32_t>(i);
+			n += inside;
+		}
+		return n;
+	}
+
+	// Appends base + k for every set bit k of `mask`, without branches. Also
+	// writes past the last visible entry, which stays inside the range.
+	inline size_t Emit(uint32_t* out, size_t n, size_t base, unsigned mask, int width)
+	{
+		for (int k = 0; k < width; k++)
+		{
+			out[n] = static_cast<uint32_t>(base + k);
+			n += (mask >> k) & 1;
+		}
+		return n;
+	}
+
+#if CULL_AVX
+
+	const int SimdWidth = 8;
+
+	size_t CullSimd(const cull::Frustum& f, const cull::BoxSoA& b, size_t begin, size_t end, uint32_t* out)
+	{
+		__m256 nx[6], ny[6], nz[6], ax[6], ay[6], az[6], d[6];
+		const __m256 signMask = _mm256_set1_ps(-0.0f);
+		for (int p = 0; p < 6; p++)
+		{
+			nx[p] = _mm256_set1_ps(f.planes[p].nx);
+			ny[p] = _mm256_set1_ps(f.planes[p].ny);
+			nz[p] = _mm256_set1_ps(f.planes[p].nz);
+			d[p] = _mm256_set1_ps(f.planes[p].d);
+			ax[p] = _mm256_andnot_ps(signMask, nx[p]);
+			ay[p] = _mm256_andnot_ps(signMask, ny[p]);
+			az[p] = _mm256_andnot_ps(signMask, nz[p]);
+		}
+
+		const __m256 zero = _mm256_setzero_ps();
+		size_t n = 0, i = begin;
+		for (; i + SimdWidth <= end; i += SimdWidth)
+		{
+			__m256 cx = _mm256_loadu_ps(&b.centerX[i]), cy = _mm256_loadu_ps(&b.centerY[i]), cz = _mm256_loadu_ps(&b.centerZ[i]);
+			__m256 ex = _mm256_loadu_ps(&b.extentX[i]), ey = _mm256_loadu_ps(&b.extentY[i]), ez = _mm256_loadu_ps(&b.extentZ[i]);
+			__m256 outside = zero;
+			for (int p = 0; p < 6; p++)
+			{
+				__m256 dist = _mm256_add_ps(
+					_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx[p], cx), _mm256_mul_ps(ny[p], cy)),
+						_mm256_add_ps(_mm256_mul_ps(nz[p], cz), d[p])),
+					_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax[p], ex), _mm256_mul_ps(ay[p], ey)),
+						_mm256_mul_ps(az[p], ez)));
+				outside = _mm256_or_ps(outside, _mm256_cmp_ps(dist, zero, _CMP_LT_OQ));
+			}
+			unsigned visible = ~static_cast<unsigned>(_mm256_movemask_ps(outside)) & 0xff;
+			n = Emit(out, n, i, visible, SimdWidth);
+		}
+		return n + CullScalar(f, b, i, end, out + n);
+	}
+
+#elif CULL_SSE2
+
+	const int SimdWidth = 4;
+
+	size_t CullSimd(const cull::Frustum& f, const cull::BoxSoA& b, size_t begin, size_t end, uint32_t* out)
+	{
+		__m128 nx[6], ny[6], nz[6], ax[6], ay[6], az[6], d[6];
+		const __m128 signMask = _mm_set1_ps(-0.0f);
+		for (int p = 0; p < 6; p++)
+		{
+			nx[p] = _mm_set1_ps(f.planes[p].nx);
+			ny[p] = _mm_set1_ps(f.planes[p].ny);
+			nz[p] = _mm_set1_ps(f.planes[p].nz);
+			d[p] = _mm_set1_ps(f.planes[p].d);
+			ax[p] = _mm_andnot_ps(signMask, nx[p]);
+			ay[p] = _mm_andnot_ps(signMask, ny[p]);
+			az[p] = _mm_andnot_ps(signMask, nz[p]);
+		}
+
+		const __m128 zero = _mm_setzero_ps();
+		size_t n = 0, i = begin;
+		for (; i + SimdWidth <= end; i += SimdWidth)
+		{
+			__m128 cx = _mm_loadu_ps(&b.centerX[i]), cy = _mm_loadu_ps(&b.centerY[i]), cz = _mm_loadu_ps(&b.centerZ[i]);
+			__m128 ex = _mm_loadu_ps(&b.extentX[i]), ey = _mm_loadu_ps(&b.extentY[i]), ez = _mm_loadu_ps(&b.extentZ[i]);
+			__m128 outside = zero;
+			for (int p = 0; p < 6; p++)
+			{
+				__m128 dist = _mm_add_ps(
+					_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], cx), _mm_mul_ps(ny[p], cy)),
+						_mm_add_ps(_mm_mul_ps(nz[p], cz), d[p])),
+					_mm_add_ps(_mm_add_ps(_mm_mul_ps(ax[p], ex), _mm_mul_ps(ay[p], ey)),
+						_mm_mul_ps(az[p], ez)));
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, zero));
+			}
+			unsigned visible = ~static_cast<unsigned>(_mm_movemask_ps(outside)) & 0xf;
+			n = Emit(out, n, i, visible, SimdWidth);
+		}
+		return n + CullScalar(f, b, i, end, out + n);
+	}
+
+#elif CULL_NEON
+
+	const int SimdWidth = 4;
+
+	size_t CullSimd(const cull::Frustum& f, const cull::BoxSoA& b, size_t begin, size_t end, uint32_t* out)
+	{
+		float32x4_t nx[6], ny[6], nz[6], ax[6], ay[6], az[6], d[6];
+		for (int p = 0; p < 6; p++)
+		{
+			nx[p] = vdupq_n_f32(f.planes[p].nx);
+			ny[p] = vdupq_n_f32(f.planes[p].ny);
+			nz[p] = vdupq_n_f32(f.planes[p].nz);
+			d[p] = vdupq_n_f32(f.planes[p].d);
+			ax[p] = vabsq_f32(nx[p]);
+			ay[p] = vabsq_f32(ny[p]);
+			az[p] = vabsq_f32(nz[p]);
+		}
+
+		const float32x4_t zero = vdupq_n_f32(0.0f);
+		const uint32_t bitValues[4] = { 1, 2, 4, 8 };
+		const uint32x4_t bits = vld1q_u32(bitValues);
+		size_t n = 0, i = begin;
+		for (; i + SimdWidth <= end; i += SimdWidth)
+		{
+			float32x4_t cx = vld1q_f32(&b.centerX[i]), cy = vld1q_f32(&b.centerY[i]), cz = vld1q_f32(&b.centerZ[i]);
+			float32x4_t ex = vld1q_f32(&b.extentX[i]), ey = vld1q_f32(&b.extentY[i]), ez = vld1q_f32(&b.extentZ[i]);
+			uint32x4_t outside = vdupq_n_u32(0);
+			for (int p = 0; p < 6; p++)
+			{
+				float32x4_t dist = vaddq_f32(
+					vaddq_f32(vaddq_f32(vmulq_f32(nx[p], cx), vmulq_f32(ny[p], cy)),
+						vaddq_f32(vmulq_f32(nz[p], cz), d[p])),
+					vaddq_f32(vaddq_f32(vmulq_f32(ax[p], ex), vmulq_f32(ay[p], ey)),
+						vmulq_f32(az[p], ez)));
+				outside = vorrq_u32(outside, vcltq_f32(dist, zero));
+			}
+			unsigned visible = ~vaddvq_u32(vandq_u32(outside, bits)) & 0xf;
+			n = Emit(out, n, i, visible, SimdWidth);
+		}
+		return n + CullScalar(f, b, i, end, out + n);
+	}
+
+#else
+
+	size_t CullSimd(const cull::Frustum& f, const cull::BoxSoA& b, size_t begin, size_t end, uint32_t* out)
+	{
+		return CullScalar(f, b, begin, end, out);
+	}
+
+#endif
+}
+
+size_t cull::CullRange(const Frustum& frustum, const BoxSoA& boxes, size_t begin, size_t end,
+	uint32_t* visible, Kernel kernel)
+{
+	if (kernel == Kernel::Simd)
+		return CullSimd(frustum, boxes, begin, end, visible);
+	return CullScalar(frustum, boxes, begin, end, visible);
+}
+
+size_t cull::Cull(const Frustum& frustum, const BoxSoA& boxes, std::vector<uint32_t>& visible,
+	task::ThreadPool* pool, size_t grain, Kernel kernel)
+{
+	const size_t count = boxes.Count();
+	visible.resize(count);
+	if (!pool || count <= grain)
+	{
+		size_t n = CullRange(frustum, boxes, 0, count, visible.data(), kernel);
+		visible.resize(n);
+		return n;
+	}
+
+	// Every chunk writes into its own slice of `visible`, the slices are
+	// packed together afterwards.
+	const size_t chunks = (count + grain - 1) / grain;
+	std::vector<size_t> counts(chunks);
+	pool->ParallelFor(chunks, 1, [&](size_t first, size_t last)
+	{
+		for (size_t c = first; c < last; c++)
+		{
+			size_t begin = c * grain;
+			size_t end = begin + grain < count ? begin + grain : count;
+			counts[c] = CullRange(frustum, boxes, begin, end, visible.data() + begin, kernel);
+		}
+	});
+
+	size_t n = counts[0];
+	for (size_t c = 1; c < chunks; c++)
+	{
+		memmove(visible.data() + n, visible.data() + c * grain, counts[c] * sizeof(uint32_t));
+		n += counts[c];
+	}
+	visible.resize(n);
+	return n;
+}
@@ -0,0 +1,63 @@
+#ifndef __culling__
+#define __culling__
+
+#include "task_graph.h"
+
+#include <d3d9.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Frustum culling of instance bounds stored as flat SoA arrays. The SIMD
+// kernel tests 4 (SSE2, NEON) or 8 (AVX, built with -DENABLE_AVX=ON) boxes
+// per instruction, large counts are split across the thread pool.
+
+namespace cull
+{
+	struct Plane
+	{
+		float nx, ny, nz, d; // inside: n . p + d >= 0
+	};
+
+	struct Frustum
+	{
+		Plane planes[6]; // left, right, bottom, top, near, far
+	};
+
+	// Gribb/Hartmann plane extraction from a row-vector view * projection
+	// matrix (D3D clip space, z in [0, w]). Planes are normalized.
+	void ExtractFrustum(const D3DMATRIX& viewProj, Frustum* frustum);
+
+	// Axis-aligned boxes as center / half extent, one array per component.
+	struct BoxSoA
+	{
+		std::vector<float> centerX, centerY, centerZ;
+		std::vector<float> extentX, extentY, extentZ;
+
+		size_t Count() const { return centerX.size(); }
+		void Resize(size_t count);
+		void Set(size_t i, const float center[3], const float extent[3]);
+	};
+
+	enum class Kernel
+	{
+		Scalar,
+		Simd,
+	};
+
+	// "AVX", "SSE2", "NEON" or "scalar" - what Kernel::Simd compiles to.
+	const char* SimdName();
+
+	// Writes the indices of the boxes in [begin, end) that intersect the
+	// frustum to `visible` (room for end - begin entries) and returns how
+	// many there are, in increasing order.
+	size_t CullRange(const Frustum& frustum, const BoxSoA& boxes, size_t begin, size_t end,
+		uint32_t* visible, Kernel kernel = Kernel::Simd);
+
+	// Culls all boxes, on the pool when given and the count is above `grain`.
+	// `visible` is resized to the number of visible boxes.
+	size_t Cull(const Frustum& frustum, const BoxSoA& boxes, std::vector<uint32_t>& visible,
+		task::ThreadPool* pool = nullptr, size_t grain = 16384, Kernel kernel = Kernel::Simd);
+}
+
+#endif // __culling__
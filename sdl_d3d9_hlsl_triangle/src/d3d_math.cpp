@@ -0,0 +1,76 @@
+#include "d3d_math.h"
+
+#include <cmath>
+
+namespace
+{
+	D3DVECTOR Sub(const D3DVECTOR& a, const D3DVECTOR& b)
+	{
+		return { a.x - b.x, a.y - b.y, a.z - b.z };
+	}
+
+	D3DVECTOR Cross(const D3DVECTOR& a, const D3DVECTOR& b)
+	{
+		return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+	}
+
+	float Dot(const D3DVECTOR& a, const D3DVECTOR& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	D3DVECTOR Normalize(const D3DVECTOR& v)
+	{
+		float len = std::sqrt(Dot(v, v));
+		float inv = len > 0.0f ? 1.0f / len : 0.0f;
+		return { v.x * inv, v.y * inv, v.z * inv };
+	}
+}
+
+D3DMATRIX* d3d::MatrixIdentity(D3DMATRIX* pout)
+{
+	if (!pout) return nullptr;
+	for (int r = 0; r < 4; r++)
+		for (int c = 0; c < 4; c++)
+			pout->m[r][c] = r == c ? 1.0f : 0.0f;
+	return pout;
+}
+
+D3DMATRIX* d3d::MatrixMultiply(D3DMATRIX* pout, const D3DMATRIX* a, const D3DMATRIX* b)
+{
+	D3DMATRIX result;
+	for (int r = 0; r < 4; r++)
+		for (int c = 0; c < 4; c++)
+			result.m[r][c] = a->m[r][0] * b->m[0][c] + a->m[r][1] * b->m[1][c] +
+				a->m[r][2] * b->m[2][c] + a->m[r][3] * b->m[3][c];
+	*pout = result;
+	return pout;
+}
+
+D3DMATRIX* d3d::MatrixPerspectiveFovLH(D3DMATRIX* pout, float fovy, float aspect, float zn, float zf)
+{
+	MatrixIdentity(pout);
+	pout->m[0][0] = 1.0f / (aspect * tanf(fovy / 2.0f));
+	pout->m[1][1] = 1.0f / tanf(fovy / 2.0f);
+	pout->m[2][2] = zf / (zf - zn);
+	pout->m[2][3] = 1.0f;
+	pout->m[3][2] = (zf * zn) / (zn - zf);
+	pout->m[3][3] = 0.0f;
+	return pout;
+}
+
+D3DMATRIX* d3d::MatrixLookAtLH(D3DMATRIX* pout, const D3DVECTOR* eye, const D3DVECTOR* at, const D3DVECTOR* up)
+{
+	D3DVECTOR zaxis = Normalize(Sub(*at, *eye));
+	D3DVECTOR xaxis = Normalize(Cross(*up, zaxis));
+	D3DVECTOR yaxis = Cross(zaxis, xaxis);
+
+	MatrixIdentity(pout);
+	pout->m[0][0] = xaxis.x; pout->m[0][1] = yaxis.x; pout->m[0][2] = zaxis.x;
+	pout->m[1][0] = xaxis.y; pout->m[1][1] = yaxis.y; pout->m[1][2] = zaxis.y;
+	pout->m[2][0] = xaxis.z; pout->m[2][1] = yaxis.z; pout->m[2][2] = zaxis.z;
+	pout->m[3][0] = -Dot(xaxis, *eye);
+	pout->m[3][1] = -Dot(yaxis, *eye);
+	pout->m[3][2] = -Dot(zaxis, *eye);
+	return pout;
+}
@@ -0,0 +1,17 @@
+#ifndef __d3d_math__
+#define __d3d_math__
+
+#include <d3d9.h>
+
+// The few D3DX matrix helpers the samples need, same conventions as D3DX:
+// row vectors, left-handed, clip space z in [0, w].
+
+namespace d3d
+{
+	D3DMATRIX* MatrixIdentity(D3DMATRIX* pout);
+	D3DMATRIX* MatrixMultiply(D3DMATRIX* pout, const D3DMATRIX* a, const D3DMATRIX* b); // a * b
+	D3DMATRIX* MatrixPerspectiveFovLH(D3DMATRIX* pout, float fovy, float aspect, float zn, float zf);
+	D3DMATRIX* MatrixLookAtLH(D3DMATRIX* pout, const D3DVECTOR* eye, const D3DVECTOR* at, const D3DVECTOR* up);
+}
+
+#endif // __d3d_math__
@@ -11,6 +11,7 @@
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
 #include "d3d_utility.h"
+#include "device_cache.h"
 
 #include <SDL2/SDL_syswm.h>
 
@@ -35,7 +36,8 @@ bool d3d::InitD3D(
 	int width, int height,
 	bool windowed,
 	D3DDEVTYPE deviceType,
-	IDirect3DDevice9** device)
+	IDirect3DDevice9** device,
+	D3DMULTISAMPLE_TYPE multiSample)
 {
 	// Init D3D:
 
@@ -62,7 +64,10 @@ bool d3d::InitD3D(
 	if( caps.DevCaps & D3DDEVCAPS_HWTRANSFORMANDLIGHT )
 		vp = D3DCREATE_HARDWARE_VERTEXPROCESSING;
 	else
+	{
 		vp = D3DCREATE_SOFTWARE_VERTEXPROCESSING;
+		SDL_Log("InitD3D: no hardware T&L, using software vertex processing");
+	}
 
 	// Step 3: Fill out the D3DPRESENT_PARAMETERS structure.
 
@@ -82,7 +87,54 @@ bool d3d::InitD3D(
 	d3dpp.FullScreen_RefreshRateInHz = D3DPRESENT_RATE_DEFAULT;
 	d3dpp.PresentationInterval       = D3DPRESENT_INTERVAL_IMMEDIATE;
 
-	// Step 4: Create the device.
+	// The sample count has to suit the depth format of each attempt below:
+	// the cached one, D24S8 or the D16 fallback.
+	auto chooseMultiSample = [&]()
+	{
+		if( multiSample >= D3DMULTISAMPLE_2_SAMPLES )
+			d3dpp.MultiSampleType = d3d::BestMultiSample(d3d9, deviceType, d3dpp.BackBufferFormat,
+				d3dpp.AutoDepthStencilFormat, windowed, multiSample);
+	};
+	auto logMultiSample = [&]()
+	{
+		if( multiSample >= D3DMULTISAMPLE_2_SAMPLES )
+			SDL_Log("MSAA: %d samples requested, using %d with depth format %d", static_cast<int>(multiSample),
+				static_cast<int>(d3dpp.MultiSampleType), static_cast<int>(d3dpp.AutoDepthStencilFormat));
+	};
+
+	// Step 4: Create the device, starting with the configuration that worked
+	// last time on this adapter and driver.
+
+	const std::string adapterKey = d3d::AdapterKey(d3d9, D3DADAPTER_DEFAULT, deviceType);
+	const uint64_t capsHash = d3d::CapsFingerprint(caps);
+
+	d3d::DeviceConfig cached;
+	if( d3d::LoadDeviceConfig(adapterKey, capsHash, &cached) )
+	{
+		d3dpp.AutoDepthStencilFormat = cached.depthFormat;
+		chooseMultiSample();
+
+		hr = d3d9->CreateDevice(
+			D3DADAPTER_DEFAULT,
+			deviceType,
+			hwnd,
+			cached.behaviorFlags,
+			&d3dpp,
+			device);
+
+		if( SUCCEEDED(hr) )
+		{
+			SDL_Log("device cache: hit for %s", adapterKey.c_str());
+			logMultiSample();
+			d3d9->Release(); // done with d3d9 object
+			return true;
+		}
+
+		SDL_Log("device cache: cached configuration failed, probing again");
+		d3d::ForgetDeviceConfig(adapterKey);
+		d3dpp.AutoDepthStencilFormat = D3DFMT_D24S8;
+	}
+	chooseMultiSample();
 
 	hr = d3d9->CreateDevice(
 		D3DADAPTER_DEFAULT, // primary adapter
@@ -96,7 +148,8 @@ bool d3d::InitD3D(
 	{
 		// try again using a 16-bit depth buffer
 		d3dpp.AutoDepthStencilFormat = D3DFMT_D16;
-		
+		chooseMultiSample();
+
 		hr = d3d9->CreateDevice(
 			D3DADAPTER_DEFAULT,
 			deviceType,
@@ -113,7 +166,48 @@ bool d3d::InitD3D(
 		}
 	}
 
+	d3d::DeviceConfig config;
+	config.behaviorFlags = vp;
+	config.depthFormat = d3dpp.AutoDepthStencilFormat;
+	config.capsHash = capsHash;
+	d3d::StoreDeviceConfig(adapterKey, config);
+	SDL_Log("device cache: stored configuration for %s", adapterKey.c_str());
+	logMultiSample();
+
 	d3d9->Release(); // done with d3d9 object
 	
 	return true;
 }
+
+D3DMULTISAMPLE_TYPE d3d::BestMultiSample(
+	IDirect3D9* d3d9, D3DDEVTYPE deviceType,
+	D3DFORMAT colorFormat, D3DFORMAT depthFormat, BOOL windowed,
+	D3DMULTISAMPLE_TYPE wanted, DWORD* qualityLevels)
+{
+	for( int samples = wanted; samples >= D3DMULTISAMPLE_2_SAMPLES; samples-- )
+	{
+		D3DMULTISAMPLE_TYPE type = static_cast<D3DMULTISAMPLE_TYPE>(samples);
+		DWORD levels = 0;
+		if( SUCCEEDED(d3d9->CheckDeviceMultiSampleType(D3DADAPTER_DEFAULT, deviceType,
+				colorFormat, windowed, type, &levels)) &&
+			SUCCEEDED(d3d9->CheckDeviceMultiSampleType(D3DADAPTER_DEFAULT, deviceType,
+				depthFormat, windowed, type, nullptr)) )
+		{
+			if( qualityLevels )
+				*qualityLevels = levels;
+			return type;
+		}
+	}
+
+	if( qualityLevels )
+		*qualityLevels = 0;
+	return D3DMULTISAMPLE_NONE;
+}
+
+bool d3d::UsesSoftwareVertexProcessing(IDirect3DDevice9* device)
+{
+	D3DDEVICE_CREATION_PARAMETERS params;
+	if( FAILED(device->GetCreationParameters(&params)) )
+		return false;
+	return (params.BehaviorFlags & D3DCREATE_SOFTWARE_VERTEXPROCESSING) != 0;
+}
@@ -21,6 +21,7 @@
 #include <vkd3d_utils.h>
 #endif
 #include <d3d9.h>
+#include "resource_registry.h"
 #include <SDL2/SDL.h>
 #include <string>
 
@@ -32,13 +33,28 @@ namespace d3d
 		int width, int height,     // [in] Backbuffer dimensions.
 		bool windowed,             // [in] Windowed (true)or full screen (false).
 		D3DDEVTYPE deviceType,     // [in] HAL or REF
-		IDirect3DDevice9** device);// [out]The created device.
+		IDirect3DDevice9** device, // [out]The created device.
+		D3DMULTISAMPLE_TYPE multiSample = D3DMULTISAMPLE_NONE); // [in] lowered to what the device supports
 
-	template<class T> void Release(T t)
+	// Highest sample count up to `wanted` that both formats support, and the
+	// number of quality levels for it. D3DMULTISAMPLE_NONE if there is none.
+	D3DMULTISAMPLE_TYPE BestMultiSample(
+		IDirect3D9* d3d9, D3DDEVTYPE deviceType,
+		D3DFORMAT colorFormat, D3DFORMAT depthFormat, BOOL windowed,
+		D3DMULTISAMPLE_TYPE wanted, DWORD* qualityLevels = nullptr);
+
+	// True if the device was created with software vertex processing, i.e.
+	// without hardware T&L.
+	bool UsesSoftwareVertexProcessing(IDirect3DDevice9* device);
+
+	// Releases and nulls the caller's pointer. Dropping the last reference
+	// also removes the object from the resource registry.
+	template<class T> void Release(T& t)
 	{
 		if( t )
 		{
-			t->Release();
+			if (t->Release() == 0)
+				UntrackResource(t);
 			t = 0;
 		}
 	}
@@ -0,0 +1,162 @@
+#include "device_cache.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+
+#include <SDL2/SDL.h>
+
+namespace
+{
+#if defined(_WIN32)
+	const char* Backend = "d3d9";
+#elif defined(USE_NINE)
+	const char* Backend = "nine";
+#else
+	const char* Backend = "dxvk";
+#endif
+
+	const char* CacheHeader = "# sdl_triangle device cache v1";
+
+	typedef std::map<std::string, d3d::DeviceConfig> CacheMap;
+
+	uint64_t Fnv1a(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	std::string CachePath()
+	{
+		char* prefPath = SDL_GetPrefPath("q4a", "sdl_triangle");
+		if (!prefPath)
+			return std::string();
+
+		std::string path = std::string(prefPath) + "device_cache.txt";
+		SDL_free(prefPath);
+		return path;
+	}
+
+	// One entry per line: key<TAB>behaviorFlags<TAB>depthFormat<TAB>capsHash
+	CacheMap ReadCache()
+	{
+		CacheMap entries;
+		std::string path = CachePath();
+		if (path.empty())
+			return entries;
+
+		std::ifstream file(path);
+		std::string line;
+		if (!std::getline(file, line) || line != CacheHeader)
+			return entries; // missing or written by another version
+
+		while (std::getline(file, line))
+		{
+			size_t tab = line.find('\t');
+			if (tab == std::string::npos)
+				continue;
+
+			d3d::DeviceConfig config;
+			unsigned long flags = 0, format = 0;
+			unsigned long long caps = 0;
+			if (sscanf(line.c_str() + tab + 1, "%lx\t%lu\t%llx", &flags, &format, &caps) != 3)
+				continue;
+
+			config.behaviorFlags = static_cast<DWORD>(flags);
+			config.depthFormat = static_cast<D3DFORMAT>(format);
+			config.capsHash = caps;
+			entries[line.substr(0, tab)] = config;
+		}
+		return entries;
+	}
+
+	void WriteCache(const CacheMap& entries)
+	{
+		std::string path = CachePath();
+		if (path.empty())
+			return;
+
+		std::ofstream file(path, std::ios::trunc);
+		file << CacheHeader << '\n';
+		for (const auto& entry : entries)
+		{
+			char values[64];
+			snprintf(values, sizeof(values), "%lx\t%lu\t%llx",
+				static_cast<unsigned long>(entry.second.behaviorFlags),
+				static_cast<unsigned long>(entry.second.depthFormat),
+				static_cast<unsigned long long>(entry.second.capsHash));
+			file << entry.first << '\t' << values << '\n';
+		}
+	}
+}
+
+std::string d3d::AdapterKey(IDirect3D9* d3d9, UINT adapter, D3DDEVTYPE deviceType)
+{
+	D3DADAPTER_IDENTIFIER9 id;
+	memset(&id, 0, sizeof(id));
+	d3d9->GetAdapterIdentifier(adapter, 0, &id);
+
+	// Tabs and newlines would break the cache file.
+	std::string description = id.Description;
+	for (char& c : description)
+	{
+		if (c == '\t' || c == '\n' || c == '\r')
+			c = ' ';
+	}
+
+	// DriverVersion is declared differently across the Windows and native
+	// headers, so the whole identifier (driver name and version, ids and the
+	// device GUID) goes into one hash.
+	char ids[96];
+	snprintf(ids, sizeof(ids), "%04x:%04x|%016" PRIx64 "|%d",
+		static_cast<unsigned>(id.VendorId), static_cast<unsigned>(id.DeviceId),
+		Fnv1a(&id, sizeof(id)),
+		static_cast<int>(deviceType));
+
+	return std::string(Backend) + "|" + ids + "|" + description;
+}
+
+uint64_t d3d::CapsFingerprint(const D3DCAPS9& caps)
+{
+	// DeviceType and AdapterOrdinal are already part of the key, the rest of
+	// the structure is plain data.
+	return Fnv1a(&caps, sizeof(caps));
+}
+
+bool d3d::LoadDeviceConfig(const std::string& key, uint64_t capsHash, DeviceConfig* config)
+{
+	CacheMap entries = ReadCache();
+	auto it = entries.find(key);
+	if (it == entries.end())
+		return false;
+
+	if (it->second.capsHash != capsHash)
+	{
+		SDL_Log("device cache: caps changed for %s, probing again", key.c_str());
+		return false;
+	}
+
+	*config = it->second;
+	return true;
+}
+
+void d3d::StoreDeviceConfig(const std::string& key, const DeviceConfig& config)
+{
+	CacheMap entries = ReadCache();
+	entries[key] = config;
+	WriteCache(entries);
+}
+
+void d3d::ForgetDeviceConfig(const std::string& key)
+{
+	CacheMap entries = ReadCache();
+	if (entries.erase(key))
+		WriteCache(entries);
+}
@@ -0,0 +1,99 @@
+#include "device_reset.h"
+#include "bench_util.h"
+
+#include <vector>
+
+#include <SDL2/SDL.h>
+
+namespace
+{
+	struct Callbacks
+	{
+		int id;
+		d3d::LostCallback onLost;
+		d3d::ResetCallback onReset;
+	};
+
+	std::vector<Callbacks>& Registered()
+	{
+		static std::vector<Callbacks> callbacks;
+		return callbacks;
+	}
+}
+
+int d3d::AddResetCallbacks(LostCallback onLost, ResetCallback onReset)
+{
+	static int nextId = 1;
+	Registered().push_back({ nextId, std::move(onLost), std::move(onReset) });
+	return nextId++;
+}
+
+void d3d::RemoveResetCallbacks(int id)
+{
+	std::vector<Callbacks>& callbacks = Registered();
+	for (auto it = callbacks.begin(); it != callbacks.end(); ++it)
+	{
+		if (it->id == id)
+		{
+			callbacks.erase(it);
+			return;
+		}
+	}
+}
+
+bool d3d::GetPresentParameters(IDirect3DDevice9* device, D3DPRESENT_PARAMETERS* d3dpp)
+{
+	IDirect3DSwapChain9* swapChain = nullptr;
+	if (FAILED(device->GetSwapChain(0, &swapChain)))
+		return false;
+	HRESULT hr = swapChain->GetPresentParameters(d3dpp);
+	swapChain->Release();
+	return SUCCEEDED(hr);
+}
+
+bool d3d::ResetDevice(IDirect3DDevice9* device, UINT width, UINT height, ResetTimings* timings)
+{
+	D3DPRESENT_PARAMETERS d3dpp;
+	if (!GetPresentParameters(device, &d3dpp))
+		return false;
+
+	d3dpp.BackBufferWidth = width;
+	d3dpp.BackBufferHeight = height;
+	return ResetDevice(device, d3dpp, timings);
+}
+
+bool d3d::ResetDevice(IDirect3DDevice9* device, D3DPRESENT_PARAMETERS& d3dpp, ResetTimings* timings)
+{
+	const UINT width = d3dpp.BackBufferWidth, height = d3dpp.BackBufferHeight;
+	std::vector<Callbacks>& callbacks = Registered();
+	const double start = bench::NowMs();
+	for (auto it = callbacks.rbegin(); it != callbacks.rend(); ++it)
+	{
+		if (it->onLost)
+			it->onLost();
+	}
+
+	const double lost = bench::NowMs();
+	HRESULT hr = device->Reset(&d3dpp);
+	const double reset = bench::NowMs();
+	if (FAILED(hr))
+	{
+		SDL_Log("Reset(%ux%u) - FAILED: 0x%08lx", width, height, static_cast<unsigned long>(hr));
+		return false;
+	}
+
+	bool ok = true;
+	for (Callbacks& c : callbacks)
+	{
+		if (c.onReset && !c.onReset(device, width, height))
+			ok = false;
+	}
+
+	if (timings)
+	{
+		timings->lostMs = lost - start;
+		timings->resetMs = reset - lost;
+		timings->restoreMs = bench::NowMs() - reset;
+	}
+	return ok;
+}
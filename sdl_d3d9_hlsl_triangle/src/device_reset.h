@@ -0,0 +1,42 @@
+#ifndef __device_reset__
+#define __device_reset__
+
+#include <d3d9.h>
+#include <functional>
+
+// Back buffer resize and lost device recovery through
+// IDirect3DDevice9::Reset. Managed resources and shaders survive a Reset,
+// D3DPOOL_DEFAULT objects do not: their owners register a pair of
+// callbacks that release them before the Reset and recreate them after.
+
+namespace d3d
+{
+	typedef std::function<void()> LostCallback;
+	// Gets the new back buffer size, false if the object could not be
+	// recreated.
+	typedef std::function<bool(IDirect3DDevice9* device, UINT width, UINT height)> ResetCallback;
+
+	// Returns an id for RemoveResetCallbacks. Either callback may be empty.
+	int AddResetCallbacks(LostCallback onLost, ResetCallback onReset);
+	void RemoveResetCallbacks(int id);
+
+	struct ResetTimings
+	{
+		double lostMs = 0.0;    // release callbacks
+		double resetMs = 0.0;   // IDirect3DDevice9::Reset
+		double restoreMs = 0.0; // recreate callbacks
+	};
+
+	// Calls the lost callbacks (newest first), resets the device with the
+	// current present parameters and the new back buffer size, then calls
+	// the reset callbacks (oldest first).
+	bool ResetDevice(IDirect3DDevice9* device, UINT width, UINT height, ResetTimings* timings = nullptr);
+
+	// Same with complete present parameters, e.g. another MultiSampleType.
+	bool ResetDevice(IDirect3DDevice9* device, D3DPRESENT_PARAMETERS& d3dpp, ResetTimings* timings = nullptr);
+
+	// The current present parameters of the implicit swap chain.
+	bool GetPresentParameters(IDirect3DDevice9* device, D3DPRESENT_PARAMETERS* d3dpp);
+}
+
+#endif // __device_reset__
@@ -0,0 +1,102 @@
+#include "dynamic_resolution.h"
+#include "d3d_utility.h"
+
+#include <algorithm>
+
+d3d::ResolutionController::ResolutionController(double budgetMs, float minScale, float maxScale)
+	: _budgetMs(budgetMs), _minScale(minScale), _maxScale(maxScale), _integral(maxScale), _scale(maxScale)
+{
+}
+
+float d3d::ResolutionController::Update(double frameMs)
+{
+	// Light smoothing so one hitch does not drop the resolution by itself.
+	_filteredMs = _filteredMs > 0.0 ? _filteredMs + 0.3 * (frameMs - _filteredMs) : frameMs;
+
+	// Positive error: there is headroom, go up. The cost is roughly
+	// proportional to the pixel count, i.e. to scale^2, so the relative
+	// error is halved to act on the linear scale.
+	const float error = static_cast<float>((_budgetMs - _filteredMs) / _budgetMs) * 0.5f;
+	_integral = std::clamp(_integral + _ki * error, _minScale, _maxScale);
+	_scale = std::clamp(_integral + _kp * error, _minScale, _maxScale);
+	return _scale;
+}
+
+bool d3d::DynamicResolution::Create(IDirect3DDevice9* device, UINT width, UINT height, std::string& error)
+{
+	Release();
+
+	// Same depth format as the back buffer's.
+	D3DFORMAT depthFormat = D3DFMT_D24S8;
+	IDirect3DSurface9* depth = nullptr;
+	if (SUCCEEDED(device->GetDepthStencilSurface(&depth)))
+	{
+		D3DSURFACE_DESC desc;
+		depth->GetDesc(&desc);
+		depthFormat = desc.Format;
+		depth->Release();
+	}
+
+	if (FAILED(d3d::CreateRenderTarget(device, width, height, D3DFMT_X8R8G8B8, D3DMULTISAMPLE_NONE, 0,
+			FALSE, &_target)) ||
+		FAILED(d3d::CreateDepthStencilSurface(device, width, height, depthFormat, D3DMULTISAMPLE_NONE, 0,
+			TRUE, &_depth)))
+	{
+		error = "can't create the offscreen render target";
+		Release();
+		return false;
+	}
+
+	_width = _viewWidth = width;
+	_height = _viewHeight = height;
+	return true;
+}
+
+void d3d::DynamicResolution::Release()
+{
+	d3d::Release(_savedTarget);
+	d3d::Release(_savedDepth);
+	d3d::Release(_target);
+	d3d::Release(_depth);
+}
+
+void d3d::DynamicResolution::Begin(IDirect3DDevice9* device, float scale)
+{
+	if (!_target)
+		return;
+
+	// Whole multiples of 8 pixels, so small controller moves don't change
+	// the size every frame.
+	_viewWidth = std::clamp<UINT>(static_cast<UINT>(_width * scale) & ~7u, 8, _width);
+	_viewHeight = std::clamp<UINT>(static_cast<UINT>(_height * scale) & ~7u, 8, _height);
+
+	device->GetRenderTarget(0, &_savedTarget);
+	device->GetDepthStencilSurface(&_savedDepth);
+	device->SetRenderTarget(0, _target);
+	device->SetDepthStencilSurface(_depth);
+
+	D3DVIEWPORT9 viewport = { 0, 0, _viewWidth, _viewHeight, 0.0f, 1.0f };
+	device->SetViewport(&viewport);
+}
+
+void d3d::DynamicResolution::End(IDirect3DDevice9* device)
+{
+	if (!_savedTarget)
+		return;
+
+	// SetRenderTarget resets the viewport to the full back buffer.
+	device->SetRenderTarget(0, _savedTarget);
+	device->SetDepthStencilSurface(_savedDepth);
+
+	const RECT source = { 0, 0, static_cast<LONG>(_viewWidth), static_cast<LONG>(_viewHeight) };
+	device->StretchRect(_target, &source, _savedTarget, nullptr, D3DTEXF_LINEAR);
+
+	// Get* added references, these are not tracked objects.
+	_savedTarget->Release();
+	_savedTarget = nullptr;
+	if (_savedDepth)
+	{
+		_savedDepth->Release();
+		_savedDepth = nullptr;
+	}
+}
@@ -0,0 +1,70 @@
+#ifndef __dynamic_resolution__
+#define __dynamic_resolution__
+
+#include <d3d9.h>
+#include <string>
+
+// Dynamic resolution: the scene is drawn into the top-left part of an
+// offscreen render target and StretchRect'ed to the back buffer. The size
+// of that part follows a PI controller that holds the frame time at a
+// budget.
+
+namespace d3d
+{
+	class ResolutionController
+	{
+	public:
+		ResolutionController(double budgetMs = 16.6, float minScale = 0.25f, float maxScale = 1.0f);
+
+		// Feeds the last frame time, returns the linear scale for the next
+		// frame.
+		float Update(double frameMs);
+
+		float Scale() const { return _scale; }
+		double FilteredMs() const { return _filteredMs; }
+		double BudgetMs() const { return _budgetMs; }
+
+	private:
+		double _budgetMs;
+		float _minScale, _maxScale;
+		float _kp = 0.15f;     // per unit of relative error
+		float _ki = 0.05f;     // per frame and unit of relative error
+		float _integral;       // carries the steady-state scale
+		float _scale;
+		double _filteredMs = 0.0;
+	};
+
+	class DynamicResolution
+	{
+	public:
+		DynamicResolution() = default;
+		~DynamicResolution() { Release(); }
+
+		DynamicResolution(const DynamicResolution&) = delete;
+		DynamicResolution& operator=(const DynamicResolution&) = delete;
+
+		// Render target and depth buffer at full back buffer size, the
+		// scaled frame uses a viewport inside them.
+		bool Create(IDirect3DDevice9* device, UINT width, UINT height, std::string& error);
+		void Release();
+
+		// Binds the offscreen target with a viewport of scale * size.
+		void Begin(IDirect3DDevice9* device, float scale);
+		// Restores the back buffer and upscales into it. Call after
+		// EndScene, before Present.
+		void End(IDirect3DDevice9* device);
+
+		UINT Width() const { return _viewWidth; }   // current scaled size
+		UINT Height() const { return _viewHeight; }
+
+	private:
+		IDirect3DSurface9* _target = nullptr;
+		IDirect3DSurface9* _depth = nullptr;
+		IDirect3DSurface9* _savedTarget = nullptr;
+		IDirect3DSurface9* _savedDepth = nullptr;
+		UINT _width = 0, _height = 0;
+		UINT _viewWidth = 0, _viewHeight = 0;
+	};
+}
+
+#endif // __dynamic_resolution__
@@ -0,0 +1,115 @@
+#include "indexed_mesh.h"
+#include "bench_util.h"
+#include "d3d_utility.h"
+#include "mesh_optimizer.h"
+
+#include <cstring>
+
+bool mesh::CreateIndexedMesh(
+	IDirect3DDevice9* device,
+	const void* vertices, size_t vertexCount, UINT stride, DWORD fvf,
+	const uint32_t* indices, size_t indexCount,
+	const BuildOptions& options,
+	IndexedMesh* mesh,
+	BuildReport* report)
+{
+	D3DCAPS9 caps;
+	device->GetDeviceCaps(&caps);
+
+	// Indices above MaxVertexIndex fail at draw time, 32-bit support alone
+	// doesn't mean every vertex can be reached.
+	if (vertexCount == 0 || vertexCount - 1 > caps.MaxVertexIndex)
+		return false;
+	const bool use32 = vertexCount > 0xffff;
+
+	// Work on copies, the caller's data stays untouched.
+	std::vector<uint32_t> finalIndices(indices, indices + indexCount);
+	std::vector<uint8_t> finalVertices;
+
+	CacheStats before = AnalyzeVertexCache(finalIndices.data(), indexCount, vertexCount);
+	double start = bench::NowMs();
+
+	if (options.optimizeVertexCache)
+		OptimizeVertexCache(finalIndices.data(), indexCount, vertexCount);
+
+	if (options.optimizeVertexFetch)
+	{
+		std::vector<uint32_t> remap;
+		OptimizeVertexFetch(finalIndices.data(), indexCount, vertexCount, remap);
+		finalVertices.resize(vertexCount * stride);
+		RemapVertices(finalVertices.data(), vertices, vertexCount, stride, remap);
+		vertices = finalVertices.data();
+	}
+
+	double optimizeMs = bench::NowMs() - start;
+
+	if (report)
+	{
+		CacheStats after = AnalyzeVertexCache(finalIndices.data(), indexCount, vertexCount);
+		report->acmrBefore = before.acmr;
+		report->atvrBefore = before.atvr;
+		report->acmrAfter = after.acmr;
+		report->atvrAfter = after.atvr;
+		report->optimizeMs = optimizeMs;
+	}
+
+	IndexedMesh result;
+	result.vertexCount = static_cast<UINT>(vertexCount);
+	result.indexCount = static_cast<UINT>(indexCount);
+	result.stride = stride;
+	result.fvf = fvf;
+	result.indexFormat = use32 ? D3DFMT_INDEX32 : D3DFMT_INDEX16;
+
+	const UINT indexSize = use32 ? 4 : 2;
+	if (FAILED(d3d::CreateVertexBuffer(device, static_cast<UINT>(vertexCount * stride),
+			D3DUSAGE_WRITEONLY, fvf, D3DPOOL_MANAGED, &result.vb)) ||
+		FAILED(d3d::CreateIndexBuffer(device, static_cast<UINT>(indexCount * indexSize),
+			D3DUSAGE_WRITEONLY, result.indexFormat, D3DPOOL_MANAGED, &result.ib)))
+	{
+		ReleaseIndexedMesh(result);
+		return false;
+	}
+
+	void* data = nullptr;
+	result.vb->Lock(0, 0, &data, 0);
+	memcpy(data, vertices, vertexCount * stride);
+	result.vb->Unlock();
+
+	result.ib->Lock(0, 0, &data, 0);
+	if (use32)
+	{
+		memcpy(data, finalIndices.data(), indexCount * 4);
+	}
+	else
+	{
+		uint16_t* out = static_cast<uint16_t*>(data);
+		for (size_t i = 0; i < indexCount; i++)
+			out[i] = static_cast<uint16_t>(finalIndices[i]);
+	}
+	result.ib->Unlock();
+
+	*mesh = result;
+	return true;
+}
+
+void mesh::DrawIndexedMesh(IDirect3DDevice9* device, const IndexedMesh& mesh, UINT maxPrimitives)
+{
+	device->SetStreamSource(0, mesh.vb, 0, mesh.stride);
+	device->SetIndices(mesh.ib);
+	if (mesh.fvf)
+		device->SetFVF(mesh.fvf);
+
+	const UINT primitives = mesh.indexCount / 3;
+	for (UINT first = 0; first < primitives; first += maxPrimitives)
+	{
+		UINT count = primitives - first < maxPrimitives ? primitives - first : maxPrimitives;
+		device->DrawIndexedPrimitive(D3DPT_TRIANGLELIST, 0, 0, mesh.vertexCount, first * 3, count);
+	}
+}
+
+void mesh::ReleaseIndexedMesh(IndexedMesh& mesh)
+{
+	d3d::Release(mesh.vb);
+	d3d::Release(mesh.ib);
+	mesh = IndexedMesh();
+}
@@ -0,0 +1,57 @@
+#ifndef __indexed_mesh__
+#define __indexed_mesh__
+
+#include <d3d9.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Vertex + index buffer pair drawn with DrawIndexedPrimitive. Index buffers
+// are 16-bit whenever the vertex count fits and 32-bit otherwise (if the
+// device allows it).
+
+namespace mesh
+{
+	struct IndexedMesh
+	{
+		IDirect3DVertexBuffer9* vb = nullptr;
+		IDirect3DIndexBuffer9* ib = nullptr;
+		UINT vertexCount = 0;
+		UINT indexCount = 0;
+		UINT stride = 0;
+		DWORD fvf = 0;
+		D3DFORMAT indexFormat = D3DFMT_INDEX16;
+	};
+
+	struct BuildOptions
+	{
+		bool optimizeVertexCache = true;
+		bool optimizeVertexFetch = true;
+	};
+
+	struct BuildReport
+	{
+		float acmrBefore, atvrBefore;
+		float acmrAfter, atvrAfter;
+		double optimizeMs;
+	};
+
+	// Optimizes (copies of) the vertex and index data as requested, creates
+	// managed buffers and fills them. Returns false if the buffers can't be
+	// created or the index range is not supported by the device.
+	bool CreateIndexedMesh(
+		IDirect3DDevice9* device,
+		const void* vertices, size_t vertexCount, UINT stride, DWORD fvf,
+		const uint32_t* indices, size_t indexCount,
+		const BuildOptions& options,
+		IndexedMesh* mesh,          // [out]
+		BuildReport* report);       // [out] may be null
+
+	// Binds the buffers and issues as many DrawIndexedPrimitive calls as
+	// MaxPrimitiveCount requires.
+	void DrawIndexedMesh(IDirect3DDevice9* device, const IndexedMesh& mesh, UINT maxPrimitives);
+
+	void ReleaseIndexedMesh(IndexedMesh& mesh);
+}
+
+#endif // __indexed_mesh__
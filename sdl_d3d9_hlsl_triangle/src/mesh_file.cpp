@@ -0,0 +1,267 @@
+#include "mesh_file.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	uint64_t AlignUp(uint64_t value)
+	{
+		return (value + mesh::MeshBlobAlignment - 1) & ~uint64_t(mesh::MeshBlobAlignment - 1);
+	}
+
+	// offset + size inside the file, without overflowing
+	bool BlobInside(uint64_t offset, uint64_t size, uint64_t fileSize)
+	{
+		return offset <= fileSize && size <= fileSize - offset;
+	}
+
+	bool HasFloat3Position(const mesh::MeshData& data)
+	{
+		return !data.elements.empty() && data.elements[0].offset == 0 &&
+			data.elements[0].type == mesh::MESH_FLOAT3 && data.elements[0].usage == mesh::MESH_POSITION;
+	}
+
+	const float* Position(const mesh::MeshData& data, uint32_t vertex)
+	{
+		return reinterpret_cast<const float*>(&data.vertices[size_t(vertex) * data.vertexStride]);
+	}
+
+	bool WriteAt(FILE* file, uint64_t& pos, uint64_t offset, const void* data, size_t size)
+	{
+		static const char zeros[mesh::MeshBlobAlignment] = {};
+		while (pos < offset)
+		{
+			size_t pad = static_cast<size_t>(std::min<uint64_t>(offset - pos, sizeof(zeros)));
+			if (fwrite(zeros, 1, pad, file) != pad)
+				return false;
+			pos += pad;
+		}
+		if (size && fwrite(data, 1, size, file) != size)
+			return false;
+		pos += size;
+		return true;
+	}
+}
+
+bool mesh::ValidateMeshHeader(const MeshFileHeader& header, uint64_t fileSize, std::string& error)
+{
+	const uint64_t indexBytes = (header.flags & MESH_INDEX32) ? 4 : 2;
+
+	if (fileSize < sizeof(MeshFileHeader) || header.magic != MeshFileMagic)
+		error = "not a cooked mesh file";
+	else if (header.version != MeshFileVersion || header.headerSize != sizeof(MeshFileHeader))
+		error = "unsupported mesh file version " + std::to_string(header.version);
+	else if (header.vertexStride == 0 || header.elementCount == 0 ||
+		header.vertexSize != uint64_t(header.vertexCount) * header.vertexStride ||
+		header.indexSize != uint64_t(header.indexCount) * indexBytes ||
+		header.indexCount % 3 != 0)
+		error = "inconsistent mesh header";
+	else if ((header.elementsOffset | header.vertexOffset | header.indexOffset | header.meshletOffset) %
+		MeshBlobAlignment != 0)
+		error = "misaligned mesh blobs";
+	else if (!BlobInside(header.elementsOffset, uint64_t(header.elementCount) * sizeof(MeshElement), fileSize) ||
+		!BlobInside(header.vertexOffset, header.vertexSize, fileSize) ||
+		!BlobInside(header.indexOffset, header.indexSize, fileSize) ||
+		!BlobInside(header.meshletOffset, uint64_t(header.meshletCount) * sizeof(MeshMeshlet), fileSize))
+		error = "truncated mesh file";
+	else
+		return true;
+	return false;
+}
+
+void mesh::BuildMeshlets(MeshData& data, unsigned maxVertices, unsigned maxTriangles)
+{
+	data.meshlets.clear();
+	if (!HasFloat3Position(data) || data.indices.empty())
+		return;
+
+	const uint32_t vertexCount = static_cast<uint32_t>(data.vertices.size() / data.vertexStride);
+	// marks the meshlet a vertex was last added to, so uniqueness is O(1)
+	std::vector<uint32_t> seen(vertexCount, ~0u);
+	std::vector<uint32_t> used;
+	used.reserve(maxVertices);
+
+	MeshMeshlet current = {};
+	auto finish = [&]()
+	{
+		if (!current.indexCount)
+			return;
+
+		float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		uint32_t minVertex = ~0u, maxVertex = 0;
+		for (uint32_t v : used)
+		{
+			const float* p = Position(data, v);
+			for (int k = 0; k < 3; k++)
+			{
+				lo[k] = std::min(lo[k], p[k]);
+				hi[k] = std::max(hi[k], p[k]);
+			}
+			minVertex = std::min(minVertex, v);
+			maxVertex = std::max(maxVertex, v);
+		}
+		float radius2 = 0.0f;
+		for (int k = 0; k < 3; k++)
+			current.center[k] = (lo[k] + hi[k]) * 0.5f;
+		for (uint32_t v : used)
+		{
+			const float* p = Position(data, v);
+			float dx = p[0] - current.center[0], dy = p[1] - current.center[1], dz = p[2] - current.center[2];
+			radius2 = std::max(radius2, dx * dx + dy * dy + dz * dz);
+		}
+		current.radius = std::sqrt(radius2);
+		current.minVertex = minVertex;
+		current.vertexCount = maxVertex - minVertex + 1;
+
+		data.meshlets.push_back(current);
+		current = MeshMeshlet();
+		current.firstIndex = data.meshlets.back().firstIndex + data.meshlets.back().indexCount;
+		used.clear();
+	};
+
+	for (size_t i = 0; i + 2 < data.indices.size(); i += 3)
+	{
+		const uint32_t* tri = &data.indices[i];
+		const uint32_t id = static_cast<uint32_t>(data.meshlets.size());
+		unsigned extra = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			bool repeated = (k > 0 && tri[k] == tri[0]) || (k > 1 && tri[k] == tri[1]);
+			if (seen[tri[k]] != id && !repeated)
+				extra++;
+		}
+		if (used.size() + extra > maxVertices || current.indexCount / 3 >= maxTriangles)
+			finish();
+
+		const uint32_t target = static_cast<uint32_t>(data.meshlets.size());
+		for (int k = 0; k < 3; k++)
+		{
+			if (seen[tri[k]] != target)
+			{
+				seen[tri[k]] = target;
+				used.push_back(tri[k]);
+			}
+		}
+		current.indexCount += 3;
+	}
+	finish();
+}
+
+bool mesh::WriteMeshFile(const char* path, const MeshData& data, std::string& error)
+{
+	if (!data.vertexStride || data.elements.empty() || data.vertices.size() % data.vertexStride)
+	{
+		error = "invalid mesh data";
+		return false;
+	}
+
+	const uint32_t vertexCount = static_cast<uint32_t>(data.vertices.size() / data.vertexStride);
+	const bool use32 = vertexCount > 0xffff;
+
+	MeshFileHeader header = {};
+	header.magic = MeshFileMagic;
+	header.version = MeshFileVersion;
+	header.headerSize = sizeof(MeshFileHeader);
+	header.flags = use32 ? MESH_INDEX32 : 0;
+	header.vertexCount = vertexCount;
+	header.vertexStride = data.vertexStride;
+	header.indexCount = static_cast<uint32_t>(data.indices.size());
+	header.fvf = data.fvf;
+	header.elementCount = static_cast<uint32_t>(data.elements.size());
+	header.meshletCount = static_cast<uint32_t>(data.meshlets.size());
+
+	header.elementsOffset = sizeof(MeshFileHeader);
+	header.vertexOffset = AlignUp(header.elementsOffset + data.elements.size() * sizeof(MeshElement));
+	header.vertexSize = data.vertices.size();
+	header.indexOffset = AlignUp(header.vertexOffset + header.vertexSize);
+	header.indexSize = data.indices.size() * (use32 ? 4 : 2);
+	header.meshletOffset = AlignUp(header.indexOffset + header.indexSize);
+
+	if (HasFloat3Position(data) && vertexCount)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			header.boundsMin[k] = FLT_MAX;
+			header.boundsMax[k] = -FLT_MAX;
+		}
+		for (uint32_t v = 0; v < vertexCount; v++)
+		{
+			const float* p = Position(data, v);
+			for (int k = 0; k < 3; k++)
+			{
+				header.boundsMin[k] = std::min(header.boundsMin[k], p[k]);
+				header.boundsMax[k] = std::max(header.boundsMax[k], p[k]);
+			}
+		}
+	}
+
+	std::vector<uint16_t> indices16;
+	const void* indexData = data.indices.data();
+	if (!use32)
+	{
+		indices16.assign(data.indices.begin(), data.indices.end());
+		indexData = indices16.data();
+	}
+
+	FILE* file = fopen(path, "wb");
+	if (!file)
+	{
+		error = std::string("can't create ") + path;
+		return false;
+	}
+
+	uint64_t pos = 0;
+	bool ok = WriteAt(file, pos, 0, &header, sizeof(header)) &&
+		WriteAt(file, pos, header.elementsOffset, data.elements.data(), data.elements.size() * sizeof(MeshElement)) &&
+		WriteAt(file, pos, header.vertexOffset, data.vertices.data(), data.vertices.size()) &&
+		WriteAt(file, pos, header.indexOffset, indexData, static_cast<size_t>(header.indexSize)) &&
+		WriteAt(file, pos, header.meshletOffset, data.meshlets.data(), data.meshlets.size() * sizeof(MeshMeshlet));
+	ok = fclose(file) == 0 && ok;
+	if (!ok)
+		error = std::string("can't write ") + path;
+	return ok;
+}
+
+void mesh::GenerateGridMesh(unsigned size, MeshData& data)
+{
+	struct GridVertex
+	{
+		float x, y, z;
+		uint32_t color;
+	};
+
+	data = MeshData();
+	data.elements.push_back({ 0, 0, MESH_FLOAT3, 0, MESH_POSITION, 0 });
+	data.elements.push_back({ 0, 12, MESH_D3DCOLOR, 0, MESH_COLOR, 0 });
+	data.vertexStride = sizeof(GridVertex);
+	data.fvf = 0x002 | 0x040; // D3DFVF_XYZ | D3DFVF_DIFFUSE
+
+	const unsigned side = size + 1;
+	data.vertices.resize(size_t(side) * side * sizeof(GridVertex));
+	GridVertex* vertices = reinterpret_cast<GridVertex*>(data.vertices.data());
+	for (unsigned y = 0; y < side; y++)
+	{
+		for (unsigned x = 0; x < side; x++)
+		{
+			GridVertex& v = vertices[y * side + x];
+			v.x = -0.95f + 1.9f * x / size;
+			v.y = -0.95f + 1.9f * y / size;
+			v.z = 0.5f;
+			v.color = 0xff000000 | ((x * 255 / size) << 16) | ((y * 255 / size) << 8);
+		}
+	}
+
+	data.indices.reserve(size_t(size) * size * 6);
+	for (unsigned y = 0; y < size; y++)
+	{
+		for (unsigned x = 0; x < size; x++)
+		{
+			uint32_t a = y * side + x, b = a + 1, c = a + side, d = c + 1;
+			data.indices.insert(data.indices.end(), { a, c, b, b, c, d });
+		}
+	}
+}
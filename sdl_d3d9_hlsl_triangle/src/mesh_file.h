@@ -0,0 +1,125 @@
+#ifndef __mesh_file__
+#define __mesh_file__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Cooked binary mesh (*.mesh). The file is meant to be mapped and copied
+// straight into locked D3D buffers, so every blob is stored exactly as the
+// GPU wants it and starts on a MeshBlobAlignment boundary:
+//
+//   MeshFileHeader | MeshElement[elementCount] | vertices | indices | MeshMeshlet[meshletCount]
+//
+// This header does not depend on d3d9.h so the offline tools can use it;
+// MeshElement has the layout of D3DVERTEXELEMENT9 and the enums below use
+// the D3DDECLTYPE / D3DDECLUSAGE values.
+
+namespace mesh
+{
+	const uint32_t MeshFileMagic = 0x3148534d; // "MSH1"
+	const uint32_t MeshFileVersion = 1;
+	const uint32_t MeshBlobAlignment = 64;
+
+	enum MeshFileFlags
+	{
+		MESH_INDEX32 = 1 << 0,
+	};
+
+	enum MeshElementType // D3DDECLTYPE
+	{
+		MESH_FLOAT2 = 1,
+		MESH_FLOAT3 = 2,
+		MESH_FLOAT4 = 3,
+		MESH_D3DCOLOR = 4,
+		MESH_UNUSED = 17,
+	};
+
+	enum MeshElementUsage // D3DDECLUSAGE
+	{
+		MESH_POSITION = 0,
+		MESH_NORMAL = 3,
+		MESH_TEXCOORD = 5,
+		MESH_COLOR = 10,
+	};
+
+#pragma pack(push, 1)
+	struct MeshElement // D3DVERTEXELEMENT9
+	{
+		uint16_t stream;
+		uint16_t offset;
+		uint8_t type;
+		uint8_t method;
+		uint8_t usage;
+		uint8_t usageIndex;
+	};
+
+	struct MeshMeshlet
+	{
+		uint32_t firstIndex;  // into the index blob
+		uint32_t indexCount;
+		uint32_t minVertex;   // vertex range referenced by the meshlet
+		uint32_t vertexCount;
+		float center[3];      // bounding sphere
+		float radius;
+	};
+
+	struct MeshFileHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t headerSize;     // sizeof(MeshFileHeader)
+		uint32_t flags;          // MeshFileFlags
+
+		uint32_t vertexCount;
+		uint32_t vertexStride;
+		uint32_t indexCount;
+		uint32_t fvf;            // matching FVF code, 0 if there is none
+
+		uint32_t elementCount;   // without the D3DDECL_END() terminator
+		uint32_t meshletCount;
+		uint32_t reserved[2];
+
+		uint64_t elementsOffset;
+		uint64_t vertexOffset;
+		uint64_t vertexSize;
+		uint64_t indexOffset;
+		uint64_t indexSize;
+		uint64_t meshletOffset;
+
+		float boundsMin[3];
+		float boundsMax[3];
+		uint32_t padding[2];
+	};
+#pragma pack(pop)
+
+	static_assert(sizeof(MeshElement) == 8, "MeshElement must match D3DVERTEXELEMENT9");
+	static_assert(sizeof(MeshFileHeader) % MeshBlobAlignment == 0, "header must keep blobs aligned");
+
+	// Checks magic, version and that every blob lies inside `fileSize`.
+	bool ValidateMeshHeader(const MeshFileHeader& header, uint64_t fileSize, std::string& error);
+
+	// In-memory mesh used by the writers (tools and generated test meshes).
+	struct MeshData
+	{
+		std::vector<MeshElement> elements;
+		uint32_t vertexStride = 0;
+		uint32_t fvf = 0;
+		std::vector<uint8_t> vertices;  // vertexCount * vertexStride bytes
+		std::vector<uint32_t> indices;  // narrowed to 16 bits when possible
+		std::vector<MeshMeshlet> meshlets;
+	};
+
+	// Greedy split of the index list into meshlets of at most maxVertices
+	// unique vertices and maxTriangles triangles. Positions are read as
+	// float3 at offset 0 of each vertex.
+	void BuildMeshlets(MeshData& data, unsigned maxVertices = 64, unsigned maxTriangles = 124);
+
+	bool WriteMeshFile(const char* path, const MeshData& data, std::string& error);
+
+	// Position (float3) + color grid, handy for benchmarks without assets.
+	void GenerateGridMesh(unsigned size, MeshData& data);
+}
+
+#endif // __mesh_file__
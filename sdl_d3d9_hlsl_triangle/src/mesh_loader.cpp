@@ -0,0 +1,245 @@
+#include "mesh_loader.h"
+#include "bench_util.h"
+#include "d3d_utility.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(mesh::MeshElement) == sizeof(D3DVERTEXELEMENT9), "MeshElement must match D3DVERTEXELEMENT9");
+static_assert(int(mesh::MESH_FLOAT3) == D3DDECLTYPE_FLOAT3 && int(mesh::MESH_D3DCOLOR) == D3DDECLTYPE_D3DCOLOR &&
+	int(mesh::MESH_UNUSED) == D3DDECLTYPE_UNUSED, "MeshElementType must use D3DDECLTYPE values");
+static_assert(int(mesh::MESH_POSITION) == D3DDECLUSAGE_POSITION && int(mesh::MESH_NORMAL) == D3DDECLUSAGE_NORMAL &&
+	int(mesh::MESH_TEXCOORD) == D3DDECLUSAGE_TEXCOORD && int(mesh::MESH_COLOR) == D3DDECLUSAGE_COLOR,
+	"MeshElementUsage must use D3DDECLUSAGE values");
+
+mesh::MappedFile::~MappedFile()
+{
+	Close();
+}
+
+#ifdef _WIN32
+
+bool mesh::MappedFile::Open(const char* path, std::string& error)
+{
+	Close();
+
+	file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		file = nullptr;
+		error = std::string("can't open ") + path;
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		error = std::string("empty file ") + path;
+		Close();
+		return false;
+	}
+	size = static_cast<uint64_t>(fileSize.QuadPart);
+
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping)
+		data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!data)
+	{
+		error = std::string("can't map ") + path;
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void mesh::MappedFile::Close()
+{
+	if (data)
+		UnmapViewOfFile(data);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file)
+		CloseHandle(file);
+	data = nullptr;
+	mapping = nullptr;
+	file = nullptr;
+	size = 0;
+}
+
+#else
+
+bool mesh::MappedFile::Open(const char* path, std::string& error)
+{
+	Close();
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		error = std::string("can't open ") + path;
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		error = std::string("empty file ") + path;
+		Close();
+		return false;
+	}
+	size = static_cast<uint64_t>(st.st_size);
+
+	void* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (view == MAP_FAILED)
+	{
+		error = std::string("can't map ") + path;
+		Close();
+		return false;
+	}
+	// the blobs are read once, front to back; advice values are not flags, one call each
+	madvise(view, size, MADV_SEQUENTIAL);
+	madvise(view, size, MADV_WILLNEED);
+	data = static_cast<const uint8_t*>(view);
+	return true;
+}
+
+void mesh::MappedFile::Close()
+{
+	if (data)
+		munmap(const_cast<uint8_t*>(data), size);
+	if (fd >= 0)
+		close(fd);
+	data = nullptr;
+	fd = -1;
+	size = 0;
+}
+
+#endif // _WIN32
+
+namespace
+{
+	template <class Buffer>
+	bool CopyToBuffer(Buffer* buffer, const uint8_t* src, uint64_t size, size_t chunkBytes)
+	{
+		const uint64_t chunk = chunkBytes ? chunkBytes : size;
+		for (uint64_t offset = 0; offset < size; offset += chunk)
+		{
+			const UINT bytes = static_cast<UINT>(std::min(chunk, size - offset));
+			void* dst = nullptr;
+			if (FAILED(buffer->Lock(static_cast<UINT>(offset), bytes, &dst, 0)))
+				return false;
+			memcpy(dst, src + offset, bytes);
+			buffer->Unlock();
+		}
+		return true;
+	}
+}
+
+bool mesh::LoadMeshFile(
+	IDirect3DDevice9* device,
+	const char* path,
+	LoadedMesh* mesh,
+	std::string& error,
+	size_t chunkBytes,
+	LoadStats* stats)
+{
+	const double start = bench::NowMs();
+
+	MappedFile file;
+	if (!file.Open(path, error))
+		return false;
+
+	MeshFileHeader header;
+	memcpy(&header, file.Data(), std::min<uint64_t>(sizeof(header), file.Size()));
+	if (!ValidateMeshHeader(header, file.Size(), error))
+		return false;
+	if (header.vertexSize > 0xffffffffu || header.indexSize > 0xffffffffu || header.elementCount > MAXD3DDECLLENGTH)
+	{
+		error = "mesh is too large for D3D9 buffers";
+		return false;
+	}
+
+	const bool use32 = (header.flags & MESH_INDEX32) != 0;
+	D3DCAPS9 caps;
+	device->GetDeviceCaps(&caps);
+	if (use32 && caps.MaxVertexIndex <= 0xffff)
+	{
+		error = "device has no 32-bit index support";
+		return false;
+	}
+
+	const double mapped = bench::NowMs();
+
+	LoadedMesh result;
+	result.buffers.vertexCount = header.vertexCount;
+	result.buffers.indexCount = header.indexCount;
+	result.buffers.stride = header.vertexStride;
+	result.buffers.indexFormat = use32 ? D3DFMT_INDEX32 : D3DFMT_INDEX16;
+	std::copy_n(header.boundsMin, 3, result.boundsMin);
+	std::copy_n(header.boundsMax, 3, result.boundsMax);
+
+	D3DVERTEXELEMENT9 elements[MAXD3DDECLLENGTH + 1];
+	memcpy(elements, file.Data() + header.elementsOffset, header.elementCount * sizeof(D3DVERTEXELEMENT9));
+	elements[header.elementCount] = D3DDECL_END();
+
+	if (FAILED(d3d::CreateVertexDeclaration(device, elements, &result.decl)))
+	{
+		error = "invalid vertex declaration";
+		ReleaseLoadedMesh(result);
+		return false;
+	}
+	if (FAILED(d3d::CreateVertexBuffer(device, static_cast<UINT>(header.vertexSize),
+			D3DUSAGE_WRITEONLY, 0, D3DPOOL_MANAGED, &result.buffers.vb)) ||
+		FAILED(d3d::CreateIndexBuffer(device, static_cast<UINT>(header.indexSize),
+			D3DUSAGE_WRITEONLY, result.buffers.indexFormat, D3DPOOL_MANAGED, &result.buffers.ib)))
+	{
+		error = "can't create mesh buffers";
+		ReleaseLoadedMesh(result);
+		return false;
+	}
+
+	if (!CopyToBuffer(result.buffers.vb, file.Data() + header.vertexOffset, header.vertexSize, chunkBytes) ||
+		!CopyToBuffer(result.buffers.ib, file.Data() + header.indexOffset, header.indexSize, chunkBytes))
+	{
+		error = "can't lock mesh buffers";
+		ReleaseLoadedMesh(result);
+		return false;
+	}
+
+	const MeshMeshlet* meshlets = reinterpret_cast<const MeshMeshlet*>(file.Data() + header.meshletOffset);
+	result.meshlets.assign(meshlets, meshlets + header.meshletCount);
+
+	const double end = bench::NowMs();
+	if (stats)
+	{
+		stats->bytes = header.vertexSize + header.indexSize;
+		stats->mapMs = mapped - start;
+		stats->copyMs = end - mapped;
+		stats->totalMs = end - start;
+	}
+
+	*mesh = std::move(result);
+	return true;
+}
+
+void mesh::DrawLoadedMesh(IDirect3DDevice9* device, const LoadedMesh& mesh, UINT maxPrimitives)
+{
+	device->SetVertexDeclaration(mesh.decl);
+	DrawIndexedMesh(device, mesh.buffers, maxPrimitives);
+}
+
+void mesh::ReleaseLoadedMesh(LoadedMesh& mesh)
+{
+	ReleaseIndexedMesh(mesh.buffers);
+	d3d::Release(mesh.decl);
+	mesh = LoadedMesh();
+}
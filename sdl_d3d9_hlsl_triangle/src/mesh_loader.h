@@ -0,0 +1,79 @@
+#ifndef __mesh_loader__
+#define __mesh_loader__
+
+#include "indexed_mesh.h"
+#include "mesh_file.h"
+
+#include <d3d9.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Loads cooked *.mesh files (see mesh_file.h). The file is mapped and the
+// vertex / index blobs are copied from the mapping into locked buffer memory
+// as they are, nothing is parsed or staged in between.
+
+namespace mesh
+{
+	// Read-only mapping of a whole file (mmap / CreateFileMapping).
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		~MappedFile();
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		bool Open(const char* path, std::string& error);
+		void Close();
+
+		const uint8_t* Data() const { return data; }
+		uint64_t Size() const { return size; }
+
+	private:
+		const uint8_t* data = nullptr;
+		uint64_t size = 0;
+#ifdef _WIN32
+		void* file = nullptr;
+		void* mapping = nullptr;
+#else
+		int fd = -1;
+#endif
+	};
+
+	struct LoadedMesh
+	{
+		IndexedMesh buffers;         // fvf is 0, the declaration is used instead
+		IDirect3DVertexDeclaration9* decl = nullptr;
+		std::vector<MeshMeshlet> meshlets;
+		float boundsMin[3] = {};
+		float boundsMax[3] = {};
+	};
+
+	struct LoadStats
+	{
+		uint64_t bytes = 0;          // vertex + index bytes copied
+		double mapMs = 0.0;          // open, map and validate
+		double copyMs = 0.0;         // create buffers, lock, copy, unlock
+		double totalMs = 0.0;
+	};
+
+	// Creates managed buffers for the file at `path` and fills them straight
+	// from the mapping. With chunkBytes > 0 each buffer is locked and copied
+	// in ranges of that size instead of with a single lock.
+	bool LoadMeshFile(
+		IDirect3DDevice9* device,
+		const char* path,
+		LoadedMesh* mesh,            // [out]
+		std::string& error,          // [out] set when false is returned
+		size_t chunkBytes = 0,
+		LoadStats* stats = nullptr); // [out] may be null
+
+	// Sets the declaration and draws the whole mesh.
+	void DrawLoadedMesh(IDirect3DDevice9* device, const LoadedMesh& mesh, UINT maxPrimitives);
+
+	void ReleaseLoadedMesh(LoadedMesh& mesh);
+}
+
+#endif // __mesh_loader__
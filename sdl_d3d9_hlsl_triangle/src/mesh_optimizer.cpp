@@ -0,0 +1,226 @@
+#include "mesh_optimizer.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	// Forsyth's tuning values.
+	const int CacheSize = 32;
+	const float CacheDecayPower = 1.5f;
+	const float LastTriScore = 0.75f;
+	const float ValenceBoostScale = 2.0f;
+	const float ValenceBoostPower = 0.5f;
+	const unsigned MaxValenceTable = 64;
+
+	struct ScoreTables
+	{
+		float cache[CacheSize];
+		float valence[MaxValenceTable];
+
+		ScoreTables()
+		{
+			for (int i = 0; i < CacheSize; i++)
+			{
+				if (i < 3)
+					cache[i] = LastTriScore;
+				else
+					cache[i] = powf(1.0f - float(i - 3) / float(CacheSize - 3), CacheDecayPower);
+			}
+			valence[0] = 0.0f;
+			for (unsigned i = 1; i < MaxValenceTable; i++)
+				valence[i] = ValenceBoostScale * powf(float(i), -ValenceBoostPower);
+		}
+	};
+
+	float VertexScore(const ScoreTables& tables, int cachePos, unsigned remaining)
+	{
+		if (remaining == 0)
+			return -1.0f; // no triangles left, never pick it
+
+		float score = cachePos >= 0 ? tables.cache[cachePos] : 0.0f;
+		if (remaining < MaxValenceTable)
+			score += tables.valence[remaining];
+		else
+			score += ValenceBoostScale * powf(float(remaining), -ValenceBoostPower);
+		return score;
+	}
+}
+
+mesh::CacheStats mesh::AnalyzeVertexCache(const uint32_t* indices, size_t indexCount,
+	size_t vertexCount, unsigned cacheSize)
+{
+	// A vertex is in the FIFO while fewer than `cacheSize` misses happened
+	// after it was inserted.
+	std::vector<uint64_t> insertedAt(vertexCount, 0);
+	std::vector<uint8_t> used(vertexCount, 0);
+	uint64_t misses = 0;
+	size_t unique = 0;
+
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		uint32_t v = indices[i];
+		if (!used[v])
+		{
+			used[v] = 1;
+			unique++;
+		}
+		if (insertedAt[v] == 0 || misses - insertedAt[v] >= cacheSize)
+		{
+			misses++;
+			insertedAt[v] = misses;
+		}
+	}
+
+	CacheStats stats;
+	stats.acmr = indexCount ? float(misses) / float(indexCount / 3) : 0.0f;
+	stats.atvr = unique ? float(misses) / float(unique) : 0.0f;
+	return stats;
+}
+
+void mesh::OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount)
+{
+	static const ScoreTables tables;
+
+	const size_t triCount = indexCount / 3;
+	if (triCount == 0)
+		return;
+
+	// Per-vertex list of triangles that still have to be emitted.
+	std::vector<uint32_t> remaining(vertexCount, 0);
+	for (size_t i = 0; i < triCount * 3; i++)
+		remaining[indices[i]]++;
+
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+		offsets[v + 1] = offsets[v] + remaining[v];
+
+	std::vector<uint32_t> adjacency(triCount * 3);
+	{
+		std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t t = 0; t < triCount; t++)
+			for (int k = 0; k < 3; k++)
+				adjacency[fill[indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+	}
+
+	std::vector<int> cachePos(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+		vertexScore[v] = VertexScore(tables, -1, remaining[v]);
+
+	std::vector<uint8_t> emitted(triCount, 0);
+
+	std::vector<uint32_t> output(triCount * 3);
+	uint32_t cache[CacheSize + 3];
+	int cacheCount = 0;
+
+	long long best = -1;
+	size_t cursor = 0;
+
+	for (size_t out = 0; out < triCount; out++)
+	{
+		if (best < 0)
+		{
+			// Nothing useful in the cache: continue with the next triangle in
+			// input order, which keeps the pass linear.
+			while (emitted[cursor])
+				cursor++;
+			best = static_cast<long long>(cursor);
+		}
+
+		const size_t t = static_cast<size_t>(best);
+		const uint32_t* tri = indices + t * 3;
+		memcpy(&output[out * 3], tri, 3 * sizeof(uint32_t));
+		emitted[t] = 1;
+
+		for (int k = 0; k < 3; k++)
+		{
+			uint32_t v = tri[k];
+			uint32_t* list = &adjacency[offsets[v]];
+			for (uint32_t i = 0; i < remaining[v]; i++)
+			{
+				if (list[i] == t)
+				{
+					list[i] = list[remaining[v] - 1];
+					remaining[v]--;
+					break;
+				}
+			}
+		}
+
+		// New cache: the triangle's vertices in front, then the old entries.
+		uint32_t newCache[CacheSize + 3];
+		int newCount = 0;
+		for (int k = 0; k < 3; k++)
+			newCache[newCount++] = tri[k];
+		for (int i = 0; i < cacheCount; i++)
+		{
+			uint32_t v = cache[i];
+			if (v != tri[0] && v != tri[1] && v != tri[2])
+				newCache[newCount++] = v;
+		}
+
+		for (int i = 0; i < newCount; i++)
+		{
+			uint32_t v = newCache[i];
+			cachePos[v] = i < CacheSize ? i : -1;
+			vertexScore[v] = VertexScore(tables, cachePos[v], remaining[v]);
+		}
+
+		// Rescore the triangles touching the cache and pick the best one.
+		best = -1;
+		float bestScore = -1.0f;
+		for (int i = 0; i < newCount; i++)
+		{
+			uint32_t v = newCache[i];
+			const uint32_t* list = &adjacency[offsets[v]];
+			for (uint32_t j = 0; j < remaining[v]; j++)
+			{
+				uint32_t t2 = list[j];
+				const uint32_t* tri2 = indices + t2 * 3;
+				float score = vertexScore[tri2[0]] + vertexScore[tri2[1]] + vertexScore[tri2[2]];
+				if (score > bestScore)
+				{
+					bestScore = score;
+					best = t2;
+				}
+			}
+		}
+
+		cacheCount = newCount < CacheSize ? newCount : CacheSize;
+		memcpy(cache, newCache, cacheCount * sizeof(uint32_t));
+	}
+
+	memcpy(indices, output.data(), triCount * 3 * sizeof(uint32_t));
+}
+
+void mesh::OptimizeVertexFetch(uint32_t* indices, size_t indexCount, size_t vertexCount,
+	std::vector<uint32_t>& remap)
+{
+	const uint32_t unused = ~0u;
+	remap.assign(vertexCount, unused);
+
+	uint32_t next = 0;
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		uint32_t& target = remap[indices[i]];
+		if (target == unused)
+			target = next++;
+		indices[i] = target;
+	}
+
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		if (remap[v] == unused)
+			remap[v] = next++;
+	}
+}
+
+void mesh::RemapVertices(void* dst, const void* src, size_t vertexCount, size_t stride,
+	const std::vector<uint32_t>& remap)
+{
+	const uint8_t* in = static_cast<const uint8_t*>(src);
+	uint8_t* out = static_cast<uint8_t*>(dst);
+	for (size_t v = 0; v < vertexCount; v++)
+		memcpy(out + remap[v] * stride, in + v * stride, stride);
+}
@@ -0,0 +1,39 @@
+#ifndef __mesh_optimizer__
+#define __mesh_optimizer__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Triangle list reordering for the post-transform vertex cache and for vertex
+// fetch locality. Works on 32-bit indices, the caller narrows to 16 bits when
+// the vertex count allows it.
+
+namespace mesh
+{
+	struct CacheStats
+	{
+		float acmr; // transformed vertices per triangle (0.5 .. 3, lower is better)
+		float atvr; // transformed vertices per unique vertex (1 is ideal)
+	};
+
+	// Simulates a FIFO post-transform cache of `cacheSize` entries.
+	CacheStats AnalyzeVertexCache(const uint32_t* indices, size_t indexCount,
+		size_t vertexCount, unsigned cacheSize = 16);
+
+	// Reorders triangles in place (Forsyth, "Linear-Speed Vertex Cache
+	// Optimisation"). The index values themselves are not changed.
+	void OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount);
+
+	// Renumbers vertices in order of first use so the vertex fetch walks the
+	// buffer front to back. Rewrites `indices` and fills `remap` with
+	// old index -> new index; unreferenced vertices go to the end.
+	void OptimizeVertexFetch(uint32_t* indices, size_t indexCount, size_t vertexCount,
+		std::vector<uint32_t>& remap);
+
+	// Applies a remap table from OptimizeVertexFetch() to a vertex array.
+	void RemapVertices(void* dst, const void* src, size_t vertexCount, size_t stride,
+		const std::vector<uint32_t>& remap);
+}
+
+#endif // __mesh_optimizer__
@@ -0,0 +1,361 @@
+#include "mip_generator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIP_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define MIP_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+	// Levels below this many pixels are left to the calling thread.
+	const UINT ParallelMinPixels = 128 * 128;
+	// Rows per chunk are chosen to give a chunk about this many pixels.
+	const UINT ChunkPixels = 64 * 1024;
+
+	// Source taps of destination pixel x: 2x + first + k, k in [0, taps).
+	struct Filter
+	{
+		int first;
+		int taps;
+		float weights[8];
+	};
+
+	double BesselI0(double x)
+	{
+		double sum = 1.0, term = 1.0;
+		for (int k = 1; k < 32; k++)
+		{
+			term *= (x / (2.0 * k)) * (x / (2.0 * k));
+			sum += term;
+		}
+		return sum;
+	}
+
+	// Sinc windowed by a Kaiser window 2 destination pixels wide, alpha 4,
+	// sampled at the 8 source pixel centers around the destination center.
+	Filter MakeFilter(tex::MipFilter type)
+	{
+		if (type == tex::MipFilter::Box)
+			return { 0, 2, { 0.5f, 0.5f } };
+
+		const double pi = 3.14159265358979323846, alpha = 4.0, width = 2.0;
+		Filter filter = { -3, 8, {} };
+		double weights[8], sum = 0.0;
+		for (int k = 0; k < 8; k++)
+		{
+			const double x = (k - 3.5) * 0.5; // in destination pixels
+			const double sinc = std::sin(pi * x) / (pi * x);
+			const double window = BesselI0(alpha * std::sqrt(1.0 - (x / width) * (x / width))) / BesselI0(alpha);
+			weights[k] = sinc * window;
+			sum += weights[k];
+		}
+		for (int k = 0; k < 8; k++)
+			filter.weights[k] = static_cast<float>(weights[k] / sum);
+		return filter;
+	}
+
+	struct SrgbTables
+	{
+		float toLinear[256];
+		uint8_t fromLinear[4096];
+
+		SrgbTables()
+		{
+			for (int i = 0; i < 256; i++)
+			{
+				const double c = i / 255.0;
+				toLinear[i] = static_cast<float>(c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4));
+			}
+			for (int i = 0; i < 4096; i++)
+			{
+				const double l = i / 4095.0;
+				const double c = l <= 0.0031308 ? l * 12.92 : 1.055 * std::pow(l, 1.0 / 2.4) - 0.055;
+				fromLinear[i] = static_cast<uint8_t>(std::lround(std::clamp(c, 0.0, 1.0) * 255.0));
+			}
+		}
+	};
+
+	const SrgbTables& Srgb()
+	{
+		static const SrgbTables tables;
+		return tables;
+	}
+
+	// Per thread: the last 8 source rows converted to float, a slot per row
+	// index modulo 8, the vertically filtered row and the finished one.
+	struct Scratch
+	{
+		std::vector<float> rows[8];
+		int tags[8];
+		std::vector<float> column;
+		std::vector<float> filtered;
+	};
+
+	void DecodeRow(const uint8_t* in, UINT width, const tex::MipOptions& options, float* out)
+	{
+		if (options.srgb)
+		{
+			// A table lookup per channel, no gather to vectorize it with.
+			const float* toLinear = Srgb().toLinear;
+			for (UINT i = 0; i < width * 4; i += 4)
+			{
+				out[i + 0] = toLinear[in[i + 0]];
+				out[i + 1] = toLinear[in[i + 1]];
+				out[i + 2] = toLinear[in[i + 2]];
+				out[i + 3] = in[i + 3] * (1.0f / 255.0f);
+			}
+			return;
+		}
+
+		UINT i = 0;
+#if MIP_SSE2
+		if (options.kernel == tex::Kernel::Simd)
+		{
+			const __m128i zero = _mm_setzero_si128();
+			const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+			for (; i + 4 <= width * 4; i += 4)
+			{
+				const __m128i bytes = _mm_cvtsi32_si128(*reinterpret_cast<const int*>(in + i));
+				const __m128i ints = _mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero);
+				_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(ints), scale));
+			}
+		}
+#elif MIP_NEON
+		if (options.kernel == tex::Kernel::Simd)
+		{
+			for (; i + 16 <= width * 4; i += 16)
+			{
+				const uint8x16_t bytes = vld1q_u8(in + i);
+				const uint16x8_t lo = vmovl_u8(vget_low_u8(bytes)), hi = vmovl_high_u8(bytes);
+				vst1q_f32(out + i + 0, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(lo))), 1.0f / 255.0f));
+				vst1q_f32(out + i + 4, vmulq_n_f32(vcvtq_f32_u32(vmovl_high_u16(lo)), 1.0f / 255.0f));
+				vst1q_f32(out + i + 8, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(hi))), 1.0f / 255.0f));
+				vst1q_f32(out + i + 12, vmulq_n_f32(vcvtq_f32_u32(vmovl_high_u16(hi)), 1.0f / 255.0f));
+			}
+		}
+#endif
+		for (; i < width * 4; i++)
+			out[i] = in[i] * (1.0f / 255.0f);
+	}
+
+	void EncodeRow(const float* in, UINT width, const tex::MipOptions& options, uint8_t* out)
+	{
+		if (options.srgb)
+		{
+			const uint8_t* fromLinear = Srgb().fromLinear;
+			for (UINT i = 0; i < width * 4; i += 4)
+			{
+				for (UINT c = 0; c < 3; c++)
+					out[i + c] = fromLinear[static_cast<int>(std::clamp(in[i + c], 0.0f, 1.0f) * 4095.0f + 0.5f)];
+				out[i + 3] = static_cast<uint8_t>(std::clamp(in[i + 3], 0.0f, 1.0f) * 255.0f + 0.5f);
+			}
+			return;
+		}
+
+		UINT i = 0;
+#if MIP_SSE2
+		if (options.kernel == tex::Kernel::Simd)
+		{
+			const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+			const __m128 scale = _mm_set1_ps(255.0f), half = _mm_set1_ps(0.5f);
+			for (; i + 4 <= width * 4; i += 4)
+			{
+				const __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i), zero), one);
+				const __m128i ints = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, scale), half));
+				const __m128i words = _mm_packs_epi32(ints, ints);
+				*reinterpret_cast<int*>(out + i) = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+			}
+		}
+#elif MIP_NEON
+		if (options.kernel == tex::Kernel::Simd)
+		{
+			const float32x4_t zero = vdupq_n_f32(0.0f), one = vdupq_n_f32(1.0f), half = vdupq_n_f32(0.5f);
+			for (; i + 8 <= width * 4; i += 8)
+			{
+				const float32x4_t a = vminq_f32(vmaxq_f32(vld1q_f32(in + i), zero), one);
+				const float32x4_t b = vminq_f32(vmaxq_f32(vld1q_f32(in + i + 4), zero), one);
+				const uint32x4_t ia = vcvtq_u32_f32(vmlaq_n_f32(half, a, 255.0f));
+				const uint32x4_t ib = vcvtq_u32_f32(vmlaq_n_f32(half, b, 255.0f));
+				vst1_u8(out + i, vmovn_u16(vcombine_u16(vmovn_u32(ia), vmovn_u32(ib))));
+			}
+		}
+#endif
+		for (; i < width * 4; i++)
+			out[i] = static_cast<uint8_t>(std::clamp(in[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+	}
+
+	const float* SourceRow(Scratch& scratch, const tex::MipLevel& src, int row, const tex::MipOptions& options)
+	{
+		const int slot = row & 7;
+		std::vector<float>& buffer = scratch.rows[slot];
+		if (scratch.tags[slot] != row)
+		{
+			buffer.resize(static_cast<size_t>(src.width) * 4);
+			DecodeRow(src.bits + static_cast<size_t>(row) * src.pitch, src.width, options, buffer.data());
+			scratch.tags[slot] = row;
+		}
+		return buffer.data();
+	}
+
+	// Vertical taps into scratch.column, then horizontal taps per pixel.
+	void FilterRow(Scratch& scratch, const tex::MipLevel& src, const tex::MipLevel& dst, const Filter& filter,
+		UINT y, const tex::MipOptions& options, float* out)
+	{
+		const float* rows[8];
+		for (int k = 0; k < filter.taps; k++)
+		{
+			const int row = std::clamp(static_cast<int>(y * 2) + filter.first + k, 0, static_cast<int>(src.height) - 1);
+			rows[k] = SourceRow(scratch, src, row, options);
+		}
+
+		const UINT floats = src.width * 4;
+		float* column = scratch.column.data();
+		const int lastColumn = static_cast<int>(src.width) - 1;
+#if MIP_SSE2
+		if (options.kernel == tex::Kernel::Simd)
+		{
+			for (UINT i = 0; i < floats; i += 4)
+			{
+				__m128 sum = _mm_mul_ps(_mm_loadu_ps(rows[0] + i), _mm_set1_ps(filter.weights[0]));
+				for (int k = 1; k < filter.taps; k++)
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows[k] + i), _mm_set1_ps(filter.weights[k])));
+				_mm_storeu_ps(column + i, sum);
+			}
+			for (UINT x = 0; x < dst.width; x++)
+			{
+				__m128 sum = _mm_setzero_ps();
+				for (int k = 0; k < filter.taps; k++)
+				{
+					const int c = std::clamp(static_cast<int>(x * 2) + filter.first + k, 0, lastColumn);
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(column + c * 4), _mm_set1_ps(filter.weights[k])));
+				}
+				_mm_storeu_ps(out + x * 4, sum);
+			}
+			return;
+		}
+#elif MIP_NEON
+		if (options.kernel == tex::Kernel::Simd)
+		{
+			for (UINT i = 0; i < floats; i += 4)
+			{
+				float32x4_t sum = vmulq_n_f32(vld1q_f32(rows[0] + i), filter.weights[0]);
+				for (int k = 1; k < filter.taps; k++)
+					sum = vmlaq_n_f32(sum, vld1q_f32(rows[k] + i), filter.weights[k]);
+				vst1q_f32(column + i, sum);
+			}
+			for (UINT x = 0; x < dst.width; x++)
+			{
+				float32x4_t sum = vdupq_n_f32(0.0f);
+				for (int k = 0; k < filter.taps; k++)
+				{
+					const int c = std::clamp(static_cast<int>(x * 2) + filter.first + k, 0, lastColumn);
+					sum = vmlaq_n_f32(sum, vld1q_f32(column + c * 4), filter.weights[k]);
+				}
+				vst1q_f32(out + x * 4, sum);
+			}
+			return;
+		}
+#endif
+		for (UINT i = 0; i < floats; i++)
+		{
+			float sum = 0.0f;
+			for (int k = 0; k < filter.taps; k++)
+				sum += rows[k][i] * filter.weights[k];
+			column[i] = sum;
+		}
+		for (UINT x = 0; x < dst.width; x++)
+			for (UINT c = 0; c < 4; c++)
+			{
+				float sum = 0.0f;
+				for (int k = 0; k < filter.taps; k++)
+				{
+					const int s = std::clamp(static_cast<int>(x * 2) + filter.first + k, 0, lastColumn);
+					sum += column[s * 4 + c] * filter.weights[k];
+				}
+				out[x * 4 + c] = sum;
+			}
+	}
+
+	void FilterRows(const tex::MipLevel& src, const tex::MipLevel& dst, const Filter& filter,
+		const tex::MipOptions& options, UINT firstRow, UINT rowCount)
+	{
+		thread_local Scratch scratch;
+		std::fill(std::begin(scratch.tags), std::end(scratch.tags), -1);
+		scratch.column.resize(static_cast<size_t>(src.width) * 4);
+		scratch.filtered.resize(static_cast<size_t>(dst.width) * 4);
+
+		for (UINT y = firstRow; y < firstRow + rowCount; y++)
+		{
+			FilterRow(scratch, src, dst, filter, y, options, scratch.filtered.data());
+			EncodeRow(scratch.filtered.data(), dst.width, options, dst.bits + static_cast<size_t>(y) * dst.pitch);
+		}
+	}
+}
+
+void tex::GenerateMips(const MipLevel* levels, UINT count, const MipOptions& options, task::ThreadPool* pool)
+{
+	const Filter filter = MakeFilter(options.filter);
+	for (UINT level = 1; level < count; level++)
+	{
+		const MipLevel& src = levels[level - 1];
+		const MipLevel& dst = levels[level];
+		if (!pool || dst.width * dst.height < ParallelMinPixels)
+		{
+			FilterRows(src, dst, filter, options, 0, dst.height);
+			continue;
+		}
+
+		pool->ParallelFor(dst.height, std::max(1u, ChunkPixels / dst.width), [&](size_t begin, size_t end)
+		{
+			FilterRows(src, dst, filter, options, static_cast<UINT>(begin), static_cast<UINT>(end - begin));
+		});
+	}
+}
+
+bool tex::GenerateMips(IDirect3DTexture9* texture, const MipOptions& options, task::ThreadPool* pool,
+	std::string& error)
+{
+	D3DSURFACE_DESC desc;
+	if (FAILED(texture->GetLevelDesc(0, &desc)))
+	{
+		error = "GetLevelDesc failed";
+		return false;
+	}
+	if (desc.Format != D3DFMT_A8R8G8B8 && desc.Format != D3DFMT_X8R8G8B8)
+	{
+		error = "mip generation needs a D3DFMT_A8R8G8B8 or D3DFMT_X8R8G8B8 texture";
+		return false;
+	}
+
+	const UINT count = texture->GetLevelCount();
+	std::vector<MipLevel> levels(count);
+	UINT locked = 0;
+	for (; locked < count; locked++)
+	{
+		D3DLOCKED_RECT rect;
+		if (FAILED(texture->GetLevelDesc(locked, &desc)) ||
+			FAILED(texture->LockRect(locked, &rect, nullptr, locked == 0 ? D3DLOCK_READONLY : 0)))
+			break;
+		levels[locked].bits = static_cast<uint8_t*>(rect.pBits);
+		levels[locked].pitch = static_cast<UINT>(rect.Pitch);
+		levels[locked].width = desc.Width;
+		levels[locked].height = desc.Height;
+	}
+
+	const bool ok = locked == count;
+	if (ok)
+		GenerateMips(levels.data(), count, options, pool);
+	else
+		error = "LockRect failed on level " + std::to_string(locked);
+
+	for (UINT level = 0; level < locked; level++)
+		texture->UnlockRect(level);
+	return ok;
+}
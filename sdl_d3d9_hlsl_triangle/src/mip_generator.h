@@ -0,0 +1,54 @@
+#ifndef __mip_generator__
+#define __mip_generator__
+
+#include "block_compress.h"
+#include "task_graph.h"
+
+#include <d3d9.h>
+#include <cstdint>
+#include <string>
+
+// Mip chains built on the CPU, so every backend gets the same levels
+// instead of whatever D3DUSAGE_AUTOGENMIPMAP does there. Each level is
+// filtered from the one above with a separable 2:1 filter in float; sRGB
+// color is decoded to linear light first and encoded again on the way out,
+// alpha is always linear. Rows of a level are split across the thread pool,
+// the small levels at the end of the chain run together on the calling
+// thread where a task would cost more than the work.
+//
+// Pixels are 32-bit with alpha in the high byte, as D3DFMT_A8R8G8B8.
+
+namespace tex
+{
+	enum class MipFilter
+	{
+		Box,    // 2x2 average
+		Kaiser, // 8x8 Kaiser-windowed sinc: sharper, can ring at hard edges
+	};
+
+	// One locked level, levels[0] is the finest.
+	struct MipLevel
+	{
+		uint8_t* bits = nullptr;
+		UINT pitch = 0;
+		UINT width = 0, height = 0;
+	};
+
+	struct MipOptions
+	{
+		MipFilter filter = MipFilter::Box;
+		bool srgb = false;             // color sampled with D3DSAMP_SRGBTEXTURE
+		Kernel kernel = Kernel::Simd;
+	};
+
+	// Fills levels[1, count) from levels[0]. Every level is half the size of
+	// the one above, rounded down, at least 1.
+	void GenerateMips(const MipLevel* levels, UINT count, const MipOptions& options, task::ThreadPool* pool = nullptr);
+
+	// Locks every level of a lockable D3DFMT_A8R8G8B8 / X8R8G8B8 texture
+	// and writes the chain straight into them.
+	bool GenerateMips(IDirect3DTexture9* texture, const MipOptions& options, task::ThreadPool* pool,
+		std::string& error);
+}
+
+#endif // __mip_generator__
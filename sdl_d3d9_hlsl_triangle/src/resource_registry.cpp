@@ -0,0 +1,286 @@
+#include "resource_registry.h"
+
+#include <mutex>
+#include <unordered_map>
+
+#include <SDL2/SDL.h>
+
+namespace
+{
+	struct Entry
+	{
+		d3d::ResourceType type;
+		int pool;
+		size_t bytes;
+		const char* file;
+		unsigned line;
+	};
+
+	struct Registry
+	{
+		std::mutex mutex;
+		std::unordered_map<const void*, Entry> objects;
+		d3d::ResourceCounter totals[static_cast<int>(d3d::ResourceType::Count)][d3d::ResourcePoolCount];
+	};
+
+	Registry& GetRegistry()
+	{
+		static Registry registry;
+		return registry;
+	}
+
+	const char* TypeName(d3d::ResourceType type)
+	{
+		static const char* names[] =
+		{
+			"vertex buffer", "index buffer", "texture", "surface",
+			"vertex shader", "pixel shader", "vertex declaration", "query",
+		};
+		return names[static_cast<int>(type)];
+	}
+
+	const char* PoolName(int pool)
+	{
+		static const char* names[] = { "default", "managed", "systemmem", "scratch", "-" };
+		return names[pool];
+	}
+
+	int PoolIndex(int pool)
+	{
+		return pool >= 0 && pool < d3d::ResourcePoolCount ? pool : d3d::ResourcePoolNone;
+	}
+
+	// Shader bytecode runs up to and including the 0x0000ffff end token.
+	size_t ShaderBytes(const DWORD* function)
+	{
+		size_t count = 1;
+		while (function[count - 1] != 0x0000ffff)
+			count++;
+		return count * sizeof(DWORD);
+	}
+
+	size_t MipChainBytes(D3DFORMAT format, UINT width, UINT height, UINT levels)
+	{
+		size_t bytes = 0;
+		for (UINT level = 0; levels == 0 || level < levels; level++)
+		{
+			bytes += d3d::SurfaceBytes(format, width, height);
+			if (width == 1 && height == 1)
+				break;
+			width = width > 1 ? width / 2 : 1;
+			height = height > 1 ? height / 2 : 1;
+		}
+		return bytes;
+	}
+}
+
+void d3d::TrackResource(const void* object, ResourceType type, int pool, size_t bytes,
+	const std::source_location& site)
+{
+	if (!object)
+		return;
+
+	Registry& r = GetRegistry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	Entry entry = { type, PoolIndex(pool), bytes, site.file_name(), site.line() };
+	auto inserted = r.objects.emplace(object, entry);
+	if (!inserted.second)
+		return; // already tracked, e.g. the same object handed out twice
+
+	ResourceCounter& counter = r.totals[static_cast<int>(type)][entry.pool];
+	counter.count++;
+	counter.bytes += bytes;
+}
+
+void d3d::UntrackResource(const void* object)
+{
+	if (!object)
+		return;
+
+	Registry& r = GetRegistry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	auto it = r.objects.find(object);
+	if (it == r.objects.end())
+		return;
+
+	ResourceCounter& counter = r.totals[static_cast<int>(it->second.type)][it->second.pool];
+	counter.count--;
+	counter.bytes -= it->second.bytes;
+	r.objects.erase(it);
+}
+
+d3d::ResourceCounter d3d::ResourceTotal(ResourceType type, int pool)
+{
+	Registry& r = GetRegistry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	return r.totals[static_cast<int>(type)][PoolIndex(pool)];
+}
+
+d3d::ResourceCounter d3d::ResourceTotal()
+{
+	Registry& r = GetRegistry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	ResourceCounter total;
+	for (const auto& type : r.totals)
+		for (const ResourceCounter& counter : type)
+		{
+			total.count += counter.count;
+			total.bytes += counter.bytes;
+		}
+	return total;
+}
+
+void d3d::LogResourceTotals(const char* title)
+{
+	Registry& r = GetRegistry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	size_t count = 0, bytes = 0;
+	for (int type = 0; type < static_cast<int>(ResourceType::Count); type++)
+		for (int pool = 0; pool < ResourcePoolCount; pool++)
+		{
+			const ResourceCounter& counter = r.totals[type][pool];
+			if (!counter.count)
+				continue;
+			SDL_Log("%s: %-18s %-9s %6zu objects %10.1f KB", title, TypeName(static_cast<ResourceType>(type)),
+				PoolName(pool), counter.count, counter.bytes / 1024.0);
+			count += counter.count;
+			bytes += counter.bytes;
+		}
+	SDL_Log("%s: %zu objects, %.2f MB", title, count, bytes / (1024.0 * 1024.0));
+}
+
+size_t d3d::DumpLeakedResources()
+{
+	Registry& r = GetRegistry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	for (const auto& object : r.objects)
+	{
+		const Entry& e = object.second;
+		SDL_Log("leak: %s %p, %s pool, %zu bytes, created at %s:%u", TypeName(e.type), object.first,
+			PoolName(e.pool), e.bytes, e.file, e.line);
+	}
+	return r.objects.size();
+}
+
+size_t d3d::SurfaceBytes(D3DFORMAT format, UINT width, UINT height)
+{
+	const size_t pixels = static_cast<size_t>(width) * height;
+	const size_t blocks = static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4);
+	switch (format)
+	{
+	case D3DFMT_DXT1:
+		return blocks * 8;
+	case D3DFMT_DXT2: case D3DFMT_DXT3: case D3DFMT_DXT4: case D3DFMT_DXT5:
+		return blocks * 16;
+	case D3DFMT_A8: case D3DFMT_L8: case D3DFMT_P8: case D3DFMT_A4L4: case D3DFMT_R3G3B2:
+		return pixels;
+	case D3DFMT_R5G6B5: case D3DFMT_X1R5G5B5: case D3DFMT_A1R5G5B5: case D3DFMT_A4R4G4B4:
+	case D3DFMT_X4R4G4B4: case D3DFMT_A8L8: case D3DFMT_V8U8: case D3DFMT_L16: case D3DFMT_R16F:
+	case D3DFMT_D16: case D3DFMT_D16_LOCKABLE: case D3DFMT_D15S1: case D3DFMT_A8R3G3B2:
+		return pixels * 2;
+	case D3DFMT_R8G8B8:
+		return pixels * 3;
+	case D3DFMT_A8R8G8B8: case D3DFMT_X8R8G8B8: case D3DFMT_A8B8G8R8: case D3DFMT_X8B8G8R8:
+	case D3DFMT_A2R10G10B10: case D3DFMT_A2B10G10R10: case D3DFMT_G16R16: case D3DFMT_G16R16F:
+	case D3DFMT_R32F: case D3DFMT_Q8W8V8U8: case D3DFMT_V16U16:
+	case D3DFMT_D24S8: case D3DFMT_D24X8: case D3DFMT_D24X4S4: case D3DFMT_D32: case D3DFMT_D32F_LOCKABLE:
+		return pixels * 4;
+	case D3DFMT_A16B16G16R16: case D3DFMT_A16B16G16R16F: case D3DFMT_G32R32F: case D3DFMT_Q16W16V16U16:
+		return pixels * 8;
+	case D3DFMT_A32B32G32R32F:
+		return pixels * 16;
+	default:
+		return 0;
+	}
+}
+
+HRESULT d3d::CreateVertexBuffer(IDirect3DDevice9* device, UINT length, DWORD usage, DWORD fvf, D3DPOOL pool,
+	IDirect3DVertexBuffer9** vb, const std::source_location& site)
+{
+	HRESULT hr = device->CreateVertexBuffer(length, usage, fvf, pool, vb, 0);
+	if (SUCCEEDED(hr))
+		TrackResource(*vb, ResourceType::VertexBuffer, pool, length, site);
+	return hr;
+}
+
+HRESULT d3d::CreateIndexBuffer(IDirect3DDevice9* device, UINT length, DWORD usage, D3DFORMAT format, D3DPOOL pool,
+	IDirect3DIndexBuffer9** ib, const std::source_location& site)
+{
+	HRESULT hr = device->CreateIndexBuffer(length, usage, format, pool, ib, 0);
+	if (SUCCEEDED(hr))
+		TrackResource(*ib, ResourceType::IndexBuffer, pool, length, site);
+	return hr;
+}
+
+HRESULT d3d::CreateTexture(IDirect3DDevice9* device, UINT width, UINT height, UINT levels, DWORD usage,
+	D3DFORMAT format, D3DPOOL pool, IDirect3DTexture9** texture, const std::source_location& site)
+{
+	HRESULT hr = device->CreateTexture(width, height, levels, usage, format, pool, texture, 0);
+	if (SUCCEEDED(hr))
+		TrackResource(*texture, ResourceType::Texture, pool,
+			MipChainBytes(format, width, height, (*texture)->GetLevelCount()), site);
+	return hr;
+}
+
+HRESULT d3d::CreateRenderTarget(IDirect3DDevice9* device, UINT width, UINT height, D3DFORMAT format,
+	D3DMULTISAMPLE_TYPE multiSample, DWORD quality, BOOL lockable, IDirect3DSurface9** surface,
+	const std::source_location& site)
+{
+	HRESULT hr = device->CreateRenderTarget(width, height, format, multiSample, quality, lockable, surface, 0);
+	if (SUCCEEDED(hr))
+		TrackResource(*surface, ResourceType::Surface, D3DPOOL_DEFAULT,
+			SurfaceBytes(format, width, height) * (multiSample > 1 ? multiSample : 1), site);
+	return hr;
+}
+
+HRESULT d3d::CreateDepthStencilSurface(IDirect3DDevice9* device, UINT width, UINT height, D3DFORMAT format,
+	D3DMULTISAMPLE_TYPE multiSample, DWORD quality, BOOL discard, IDirect3DSurface9** surface,
+	const std::source_location& site)
+{
+	HRESULT hr = device->CreateDepthStencilSurface(width, height, format, multiSample, quality, discard, surface, 0);
+	if (SUCCEEDED(hr))
+		TrackResource(*surface, ResourceType::Surface, D3DPOOL_DEFAULT,
+			SurfaceBytes(format, width, height) * (multiSample > 1 ? multiSample : 1), site);
+	return hr;
+}
+
+HRESULT d3d::CreateVertexShader(IDirect3DDevice9* device, const DWORD* function, IDirect3DVertexShader9** shader,
+	const std::source_location& site)
+{
+	HRESULT hr = device->CreateVertexShader(function, shader);
+	if (SUCCEEDED(hr))
+		TrackResource(*shader, ResourceType::VertexShader, ResourcePoolNone, ShaderBytes(function), site);
+	return hr;
+}
+
+HRESULT d3d::CreatePixelShader(IDirect3DDevice9* device, const DWORD* function, IDirect3DPixelShader9** shader,
+	const std::source_location& site)
+{
+	HRESULT hr = device->CreatePixelShader(function, shader);
+	if (SUCCEEDED(hr))
+		TrackResource(*shader, ResourceType::PixelShader, ResourcePoolNone, ShaderBytes(function), site);
+	return hr;
+}
+
+HRESULT d3d::CreateVertexDeclaration(IDirect3DDevice9* device, const D3DVERTEXELEMENT9* elements,
+	IDirect3DVertexDeclaration9** decl, const std::source_location& site)
+{
+	HRESULT hr = device->CreateVertexDeclaration(elements, decl);
+	if (SUCCEEDED(hr))
+	{
+		size_t count = 1;
+		while (elements[count - 1].Stream != 0xff)
+			count++;
+		TrackResource(*decl, ResourceType::VertexDeclaration, ResourcePoolNone, count * sizeof(D3DVERTEXELEMENT9), site);
+	}
+	return hr;
+}
+
+HRESULT d3d::CreateQuery(IDirect3DDevice9* device, D3DQUERYTYPE type, IDirect3DQuery9** query,
+	const std::source_location& site)
+{
+	HRESULT hr = device->CreateQuery(type, query);
+	if (SUCCEEDED(hr) && query)
+		TrackResource(*query, ResourceType::Query, ResourcePoolNone, 0, site);
+	return hr;
+}
@@ -0,0 +1,80 @@
+#ifndef __resource_registry__
+#define __resource_registry__
+
+#include <d3d9.h>
+#include <cstddef>
+#include <source_location>
+
+// Process-wide list of live D3D9 objects with their estimated size, pool
+// and creation site. Objects made through the Create* wrappers below are
+// tracked and stop being tracked when d3d::Release drops the last
+// reference, so anything still listed at shutdown leaked.
+
+namespace d3d
+{
+	enum class ResourceType
+	{
+		VertexBuffer,
+		IndexBuffer,
+		Texture,
+		Surface,
+		VertexShader,
+		PixelShader,
+		VertexDeclaration,
+		Query,
+		Count
+	};
+
+	// D3DPOOL_DEFAULT .. D3DPOOL_SCRATCH, plus one slot for objects that
+	// have no pool (shaders, declarations, queries).
+	const int ResourcePoolCount = 5;
+	const int ResourcePoolNone = 4;
+
+	struct ResourceCounter
+	{
+		size_t count = 0;
+		size_t bytes = 0;
+	};
+
+	void TrackResource(const void* object, ResourceType type, int pool, size_t bytes,
+		const std::source_location& site = std::source_location::current());
+	void UntrackResource(const void* object);
+
+	// Live totals, pool is a D3DPOOL value or ResourcePoolNone.
+	ResourceCounter ResourceTotal(ResourceType type, int pool);
+	ResourceCounter ResourceTotal(); // everything
+
+	// One SDL_Log line per non-empty pool / type pair.
+	void LogResourceTotals(const char* title);
+	// Logs every tracked object with its creation site, returns how many.
+	size_t DumpLeakedResources();
+
+	// Estimated bytes of a width x height surface, compressed formats
+	// included. 0 for unknown formats.
+	size_t SurfaceBytes(D3DFORMAT format, UINT width, UINT height);
+
+	// IDirect3DDevice9 calls that register what they create.
+	HRESULT CreateVertexBuffer(IDirect3DDevice9* device, UINT length, DWORD usage, DWORD fvf, D3DPOOL pool,
+		IDirect3DVertexBuffer9** vb, const std::source_location& site = std::source_location::current());
+	HRESULT CreateIndexBuffer(IDirect3DDevice9* device, UINT length, DWORD usage, D3DFORMAT format, D3DPOOL pool,
+		IDirect3DIndexBuffer9** ib, const std::source_location& site = std::source_location::current());
+	HRESULT CreateTexture(IDirect3DDevice9* device, UINT width, UINT height, UINT levels, DWORD usage,
+		D3DFORMAT format, D3DPOOL pool, IDirect3DTexture9** texture,
+		const std::source_location& site = std::source_location::current());
+	HRESULT CreateRenderTarget(IDirect3DDevice9* device, UINT width, UINT height, D3DFORMAT format,
+		D3DMULTISAMPLE_TYPE multiSample, DWORD quality, BOOL lockable, IDirect3DSurface9** surface,
+		const std::source_location& site = std::source_location::current());
+	HRESULT CreateDepthStencilSurface(IDirect3DDevice9* device, UINT width, UINT height, D3DFORMAT format,
+		D3DMULTISAMPLE_TYPE multiSample, DWORD quality, BOOL discard, IDirect3DSurface9** surface,
+		const std::source_location& site = std::source_location::current());
+	HRESULT CreateVertexShader(IDirect3DDevice9* device, const DWORD* function, IDirect3DVertexShader9** shader,
+		const std::source_location& site = std::source_location::current());
+	HRESULT CreatePixelShader(IDirect3DDevice9* device, const DWORD* function, IDirect3DPixelShader9** shader,
+		const std::source_location& site = std::source_location::current());
+	HRESULT CreateVertexDeclaration(IDirect3DDevice9* device, const D3DVERTEXELEMENT9* elements,
+		IDirect3DVertexDeclaration9** decl, const std::source_location& site = std::source_location::current());
+	HRESULT CreateQuery(IDirect3DDevice9* device, D3DQUERYTYPE type, IDirect3DQuery9** query,
+		const std::source_location& site = std::source_location::current());
+}
+
+#endif // __resource_registry__
@@ -1,9 +1,21 @@
 
+#include "bench_util.h"
+#include "benchmarks.h"
+#include "buffer_pool.h"
+#include "cpu_vertex_pipeline.h"
+#include "d3d_math.h"
 #include "d3d_utility.h"
-
+#include "device_reset.h"
+#include "dynamic_resolution.h"
+#include "mesh_loader.h"
+#include "shader_util.h"
+#include "task_graph.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
-#include <filesystem>
-#include <fstream>
+#include <vector>
 
 #include <SDL2/SDL.h>
 
@@ -15,10 +27,28 @@ const int Width = 640;
 const int Height = 480;
 const int SECOND = 1000;
 
-IDirect3DVertexBuffer9* Triangle = 0;
+d3d::BufferPool StaticPool; // static geometry, sub-allocated from shared buffers
+d3d::PoolAllocation Triangle;
 IDirect3DVertexShader9* ShaderVS = 0;
 IDirect3DPixelShader9* ShaderPS = 0;
 
+mesh::LoadedMesh Mesh; // --mesh=file.mesh, drawn instead of the triangle
+UINT MaxPrimitives = 0;
+
+bool DynamicResolutionMode = false; // --dynamic-resolution[=budget ms]
+d3d::DynamicResolution DynamicResolution;
+d3d::ResolutionController ResolutionControl;
+float ResolutionScale = 1.0f;
+
+// --cpu-vertices, or a device without hardware T&L: the triangle is
+// transformed by our own pipeline and drawn pretransformed.
+bool CpuVertexMode = false;
+vtx::CpuVertexPipeline CpuVertices;
+vtx::VertexSoA TriangleSoA;
+
+UINT BackBufferWidth = Width;   // follows the window, see ResizeBackBuffer
+UINT BackBufferHeight = Height;
+
 // Classes and Structures
 
 struct Vertex
@@ -37,102 +67,77 @@ struct Vertex
 };
 const uint32_t Vertex::FVF = D3DFVF_XYZ | D3DFVF_DIFFUSE;
 
-// Additional functions
+// Startup assets. Everything in here is produced on worker threads while the
+// device is being created, only the Create* calls happen on the main thread.
 
-bool LoadFile(const char* file_name, char** ppBuffer, uint32_t* dwSize)
+struct ShaderAsset
 {
-	if (ppBuffer == nullptr)
-		return false;
+	ShaderAsset(const char* stage, const char* profile) : stage(stage), profile(profile) {}
+
+	const char* stage;          // "vs" or "ps"
+	const char* profile;        // HLSL target profile
+	std::string path;
+	std::vector<char> source;   // file contents (HLSL text or bytecode)
+	std::vector<char> bytecode; // ready for Create*Shader
+	std::string error;
+};
 
-	std::ifstream fileS(file_name, std::ios::binary);
-	if (!fileS.is_open())
-	{
-		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", "Can't open file", nullptr);
-		return false;
-	}
-	const auto dwLowSize = std::filesystem::file_size(file_name);
-	if (dwSize)
-	{
-		*dwSize = dwLowSize;
-	}
-	if (dwLowSize == 0)
+struct StartupAssets
+{
+	ShaderAsset vs{ "vs", "vs_1_1" };
+	ShaderAsset ps{ "ps", "ps_2_0" };
+	std::vector<Vertex> vertices;
+};
+
+bool ReadShader(const std::string &shFolder, ShaderAsset& asset)
+{
+	asset.path = "shaders/" + shFolder + "/min_" + asset.stage + "." + shFolder;
+	return d3d::LoadFile(asset.path.c_str(), asset.source, asset.error);
+}
+
+bool CompileShader(const std::string &shFolder, ShaderAsset& asset)
+{
+	if (shFolder.compare(hlslFolder))
 	{
-		*ppBuffer = nullptr;
-		return false;
+		// Precompiled bytecode - nothing to do.
+		asset.bytecode = std::move(asset.source);
+		return true;
 	}
 
-	*ppBuffer = new char[dwLowSize];
-	fileS.exceptions(std::fstream::failbit | std::fstream::badbit);
-	fileS.read(*ppBuffer, dwLowSize);
-	fileS.close();
+	return d3d::CompileShaderSource(asset.source, asset.path.c_str(), asset.profile,
+		asset.bytecode, asset.error);
+}
+
+bool GenerateVertices(StartupAssets& assets)
+{
+	assets.vertices.resize(3);
+	assets.vertices[0] = Vertex(-1.0f, -1.0f, 0.0f, 0xff0000ff);
+	assets.vertices[1] = Vertex( 0.0f,  1.0f, 0.0f, 0xff00ff00);
+	assets.vertices[2] = Vertex( 1.0f, -1.0f, 0.0f, 0xffff0000);
 	return true;
 }
 
 // Framework Functions
 
-bool Setup(const std::string &shFolder)
+bool Setup(const StartupAssets& assets)
 {
-	// Create the vertex buffer.
-
-	Device->CreateVertexBuffer(
-		3 * sizeof(Vertex), // size in bytes
-		D3DUSAGE_WRITEONLY, // flags
-		Vertex::FVF,        // vertex format
-		D3DPOOL_MANAGED,    // managed memory pool
-		&Triangle,          // return create vertex buffer
-		0);                 // not used - set to 0
-
-	// Fill the buffers with the triangle data.
-
-	Vertex* vertices;
-	Triangle->Lock(0, 0, (void**)&vertices, 0);
+	// Copy the triangle into the static geometry pool.
 
-	vertices[0] = Vertex(-1.0f, -1.0f, 0.0f, 0xff0000ff);
-	vertices[1] = Vertex( 0.0f,  1.0f, 0.0f, 0xff00ff00);
-	vertices[2] = Vertex( 1.0f, -1.0f, 0.0f, 0xffff0000);
-
-	Triangle->Unlock();
-
-	// Vertex shader
-
-	HRESULT hr = 0;
-	ID3DBlob* shader;
-	ID3DBlob* errorMsg;
-
-	char* data = nullptr;
-	uint32_t size = 0;
-	std::string shPath = "shaders/" + shFolder + "/min_vs." + shFolder;
-	if (LoadFile(shPath.c_str(), &data, &size) == false || !data)
+	StaticPool.Init(Device, sizeof(Vertex), Vertex::FVF, 4096, 0);
+	std::string error;
+	if (!StaticPool.Allocate(assets.vertices.data(), static_cast<UINT>(assets.vertices.size()),
+		nullptr, 0, &Triangle, error))
 	{
-		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", "Can't load VS file", nullptr);
+		error = "BufferPool::Allocate - FAILED: " + error;
+		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", error.c_str(), nullptr);
 		return false;
 	}
 
-	if (!shFolder.compare(hlslFolder))
-	{
-		hr = D3DCompile(data, size, nullptr, nullptr, nullptr, "main", "vs_1_1", 0, 0, &shader, &errorMsg);
-		if (errorMsg)
-		{
-			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", (char*)errorMsg->GetBufferPointer(), nullptr);
-			errorMsg->Release();
-		}
-
-		if (FAILED(hr))
-		{
-			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", "D3DCompile() - FAILED for VS", nullptr);
-			return false;
-		}
+	// Vertex shader
 
-		hr = Device->CreateVertexShader(
-			(DWORD*)shader->GetBufferPointer(),
-			&ShaderVS);
-	}
-	else
-	{
-		hr = Device->CreateVertexShader(
-			(DWORD*)data,
-			&ShaderVS);
-	}
+	HRESULT hr = d3d::CreateVertexShader(Device,
+		(DWORD*)assets.vs.bytecode.data(),
+		&ShaderVS);
 
 	if (FAILED(hr))
 	{
@@ -142,83 +147,162 @@ bool Setup(const std::string &shFolder)
 
 	// Pixel shader
 
-	delete[] data;
-	data = nullptr;
-	size = 0;
-	shPath = "shaders/" + shFolder + "/min_ps." + shFolder;
-	if (LoadFile(shPath.c_str(), &data, &size) == false || !data)
+	hr = d3d::CreatePixelShader(Device,
+		(DWORD*)assets.ps.bytecode.data(),
+		&ShaderPS);
+
+	if (FAILED(hr))
 	{
-		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", "Can't load PS file", nullptr);
+		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", "CreatePixelShader - FAILED", nullptr);
 		return false;
 	}
 
-	if (!shFolder.compare(hlslFolder))
-	{
-		hr = D3DCompile(data, size, nullptr, nullptr, nullptr, "main", "ps_2_0", 0, 0, &shader, &errorMsg);
-		if (errorMsg)
-		{
-			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", (char*)errorMsg->GetBufferPointer(), nullptr);
-			errorMsg->Release();
-		}
+	return true;
+}
 
-		if (FAILED(hr))
-		{
-			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", "D3DCompile() - FAILED for PS", nullptr);
-			return false;
-		}
+bool SetupCpuVertices(const StartupAssets& assets)
+{
+	CpuVertexMode = CpuVertexMode || d3d::UsesSoftwareVertexProcessing(Device);
+	if (!CpuVertexMode)
+		return true;
 
-		hr = Device->CreatePixelShader(
-			(DWORD*)shader->GetBufferPointer(),
-			&ShaderPS);
-	}
-	else
+	TriangleSoA.Resize(assets.vertices.size());
+	for (size_t i = 0; i < assets.vertices.size(); i++)
 	{
-		hr = Device->CreatePixelShader(
-			(DWORD*)data,
-			&ShaderPS);
+		const Vertex& v = assets.vertices[i];
+		TriangleSoA.Set(i, v._x, v._y, v._z, v._color);
 	}
 
-	if (FAILED(hr))
+	std::string error;
+	if (!CpuVertices.Create(Device, 1024, error))
 	{
-		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", "CreatePixelShader - FAILED", nullptr);
+		error = "CpuVertexPipeline::Create - FAILED: " + error;
+		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", error.c_str(), nullptr);
 		return false;
 	}
 
-	delete[] data;
-	if (!shFolder.compare(hlslFolder))
+	SDL_Log("vertex processing: CPU pipeline, %s kernel", vtx::PipelineSimdName());
+	return true;
+}
+
+// The triangle is already in clip space, as for min_vs. The vertex shader is
+// bypassed, so it shows its vertex colors.
+void DrawCpuTriangle()
+{
+	vtx::PipelineState state;
+	d3d::MatrixIdentity(&state.world);
+	d3d::MatrixIdentity(&state.view);
+	d3d::MatrixIdentity(&state.projection);
+	Device->GetViewport(&state.viewport);
+	CpuVertices.SetState(state);
+
+	const uint32_t indices[] = { 0, 1, 2 };
+	if (CpuVertices.Process(TriangleSoA, indices, 3))
+		CpuVertices.Draw(Device);
+}
+
+bool LoadMesh(const std::string& path)
+{
+	D3DCAPS9 caps;
+	Device->GetDeviceCaps(&caps);
+	MaxPrimitives = caps.MaxPrimitiveCount ? caps.MaxPrimitiveCount : 65535;
+
+	mesh::LoadStats stats;
+	std::string error;
+	if (!mesh::LoadMeshFile(Device, path.c_str(), &Mesh, error, 0, &stats))
 	{
-		shader->Release();
+		error = "LoadMeshFile(" + path + ") - FAILED: " + error;
+		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", error.c_str(), nullptr);
+		return false;
 	}
 
+	SDL_Log("%s: %u vertices, %u triangles, %.2f ms", path.c_str(),
+		Mesh.buffers.vertexCount, Mesh.buffers.indexCount / 3, stats.totalMs);
 	return true;
 }
 
 void Cleanup()
 {
-	Triangle->Release();
-	ShaderVS->Release();
-	ShaderPS->Release();
+	StaticPool.Free(Triangle);
+	StaticPool.Release();
+	d3d::Release(ShaderVS);
+	d3d::Release(ShaderPS);
+	mesh::ReleaseLoadedMesh(Mesh);
+	DynamicResolution.Release();
+	CpuVertices.Release();
+
+	// Everything created through the registry should be gone by now.
+	if (size_t leaks = d3d::DumpLeakedResources())
+		SDL_Log("%zu D3D9 objects leaked", leaks);
 }
 
 void ShowPrimitive()
 {
 	if (Device)
 	{
+		if (DynamicResolutionMode)
+			DynamicResolution.Begin(Device, ResolutionScale);
+
 		Device->Clear(0, 0, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER, 0xffffffff, 1.0f, 0);
 		Device->BeginScene();
 
-		Device->SetStreamSource(0, Triangle, 0, sizeof(Vertex));
-		Device->SetFVF(Vertex::FVF);
-
 		Device->SetVertexShader(ShaderVS);
 		Device->SetPixelShader(ShaderPS);
-		Device->DrawPrimitive(D3DPT_TRIANGLELIST, 0, 1);
+
+		if (Mesh.buffers.vb)
+		{
+			mesh::DrawLoadedMesh(Device, Mesh, MaxPrimitives);
+		}
+		else if (CpuVertexMode)
+		{
+			DrawCpuTriangle();
+		}
+		else
+		{
+			StaticPool.Draw(Triangle);
+		}
 
 		Device->EndScene();
+		if (DynamicResolutionMode)
+			DynamicResolution.End(Device);
 		Device->Present(0, 0, 0, 0);
 	}
 }
 
+// Releases and recreates what lives in D3DPOOL_DEFAULT around a Reset.
+// Managed buffers and shaders are kept as they are.
+void RegisterResetCallbacks()
+{
+	d3d::AddResetCallbacks(
+		[]()
+		{
+			DynamicResolution.Release();
+			CpuVertices.Release();
+		},
+		[](IDirect3DDevice9* device, UINT width, UINT height)
+		{
+			StaticPool.Unbind(); // Reset clears the stream and index bindings
+			std::string error;
+			bool ok = !DynamicResolutionMode || DynamicResolution.Create(device, width, height, error);
+			return (!CpuVertexMode || CpuVertices.Create(device, 1024, error)) && ok;
+		});
+}
+
+// Resets the device to a new back buffer size, also used to recover from a
+// lost device.
+bool ResizeBackBuffer(UINT width, UINT height)
+{
+	d3d::ResetTimings timings;
+	if (!d3d::ResetDevice(Device, width, height, &timings))
+		return false;
+
+	BackBufferWidth = width;
+	BackBufferHeight = height;
+	SDL_Log("resize to %ux%u: %.2f ms (release %.2f, Reset %.2f, recreate %.2f)", width, height,
+		timings.lostMs + timings.resetMs + timings.restoreMs, timings.lostMs, timings.resetMs, timings.restoreMs);
+	return true;
+}
+
 // init ... The init function, it calls the SDL init function.
 int initSDL() {
 	if (SDL_Init(SDL_INIT_EVERYTHING) != 0) {
@@ -239,6 +323,7 @@ SDL_Window* createWindowContext(std::string title) {
 #else // for DXVK Native
 	flags = SDL_WINDOW_VULKAN;
 #endif
+	flags |= SDL_WINDOW_RESIZABLE;
 
 	//Creating the window and passing that reference to the previously declared variable.
 	Window = SDL_CreateWindow("Hello World!", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, Width, Height, flags);
@@ -247,36 +332,243 @@ SDL_Window* createWindowContext(std::string title) {
 	return Window;
 }
 
+// OptionValue ... Number after '=' in "--option=value", or the default.
+size_t OptionValue(const std::string& arg, size_t defaultValue) {
+	size_t eq = arg.find('=');
+	if (eq == std::string::npos)
+		return defaultValue;
+
+	return std::strtoull(arg.c_str() + eq + 1, nullptr, 10);
+}
+
+// OptionString ... Text after '=' in "--option=value", or an empty string.
+std::string OptionString(const std::string& arg) {
+	size_t eq = arg.find('=');
+	return eq == std::string::npos ? std::string() : arg.substr(eq + 1);
+}
+
 // main ... The main function, right now it just calls the initialization of SDL.
 int main(int argc, char* argv[]) {
 
 	// You can add this line to launch.vs.json: "args": [ "fxc"],
-	std::string shFolder;
-	if (argc == 2)
-		shFolder = argv[1];
-	else
-		shFolder = hlslFolder;
+	// Draw a cooked mesh instead of the triangle: --mesh=file.mesh
+	// Scale the resolution to hold a frame time budget: --dynamic-resolution[=ms]
+	// Multisampled back buffer: --msaa[=samples]
+	// Transform on the CPU even with hardware T&L: --cpu-vertices
+	// Benchmark modes: --bench-vertex-formats[=vertices] --bench-indexed-mesh[=grid]
+	//                  --bench-mesh-load[=file.mesh] --bench-culling[=instances]
+	//                  --bench-upload-arena[=quads] --bench-buffer-pool[=meshes]
+	//                  --bench-multi-device[=max] --bench-msaa
+	//                  --bench-cpu-vertices[=vertices] --bench-texture-streaming[=textures]
+	//                  --bench-block-compress[=size] --bench-mips[=size]
+	//                  --bench-shader-constants[=objects] --bench-transforms[=nodes]
+	std::string shFolder = hlslFolder;
+	std::string meshPath;
+	size_t benchVertexFormats = 0;
+	size_t benchIndexedMesh = 0;
+	bool benchMeshLoad = false;
+	size_t benchCulling = 0;
+	size_t benchUploadArena = 0;
+	size_t benchBufferPool = 0;
+	bool benchMultiDevice = false;
+	size_t benchMaxDevices = 0;
+	bool benchMsaa = false;
+	size_t benchCpuVertices = 0;
+	size_t benchTextureStreaming = 0;
+	size_t benchBlockCompress = 0;
+	size_t benchMips = 0;
+	size_t benchShaderConstants = 0;
+	size_t benchTransforms = 0;
+	std::string benchMeshPath;
+	D3DMULTISAMPLE_TYPE multiSample = D3DMULTISAMPLE_NONE;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg.rfind("--bench-vertex-formats", 0) == 0)
+			benchVertexFormats = OptionValue(arg, 1 << 20);
+		else if (arg.rfind("--bench-indexed-mesh", 0) == 0)
+			benchIndexedMesh = OptionValue(arg, 700);
+		else if (arg.rfind("--bench-mesh-load", 0) == 0)
+		{
+			benchMeshLoad = true;
+			benchMeshPath = OptionString(arg);
+		}
+		else if (arg.rfind("--bench-culling", 0) == 0)
+			benchCulling = OptionValue(arg, 100000);
+		else if (arg.rfind("--bench-upload-arena", 0) == 0)
+			benchUploadArena = OptionValue(arg, 50000);
+		else if (arg.rfind("--bench-buffer-pool", 0) == 0)
+			benchBufferPool = OptionValue(arg, 5000);
+		else if (arg.rfind("--bench-multi-device", 0) == 0)
+		{
+			benchMultiDevice = true;
+			benchMaxDevices = OptionValue(arg, 0);
+		}
+		else if (arg == "--bench-msaa")
+			benchMsaa = true;
+		else if (arg.rfind("--bench-cpu-vertices", 0) == 0)
+			benchCpuVertices = OptionValue(arg, 250000);
+		else if (arg.rfind("--bench-texture-streaming", 0) == 0)
+			benchTextureStreaming = OptionValue(arg, 512);
+		else if (arg.rfind("--bench-block-compress", 0) == 0)
+			benchBlockCompress = OptionValue(arg, 1024);
+		else if (arg.rfind("--bench-mips", 0) == 0)
+			benchMips = OptionValue(arg, 4096);
+		else if (arg.rfind("--bench-shader-constants", 0) == 0)
+			benchShaderConstants = OptionValue(arg, 10000);
+		else if (arg.rfind("--bench-transforms", 0) == 0)
+			benchTransforms = OptionValue(arg, 1 << 20);
+		else if (arg == "--cpu-vertices")
+			CpuVertexMode = true;
+		else if (arg.rfind("--mesh=", 0) == 0)
+			meshPath = OptionString(arg);
+		else if (arg.rfind("--dynamic-resolution", 0) == 0)
+		{
+			// Fractional budget in ms, the controller's default when missing.
+			DynamicResolutionMode = true;
+			const std::string budget = OptionString(arg);
+			const double budgetMs = budget.empty() ? 0.0 : std::strtod(budget.c_str(), nullptr);
+			ResolutionControl = budgetMs > 0.0 ? d3d::ResolutionController(budgetMs) : d3d::ResolutionController();
+		}
+		else if (arg.rfind("--msaa", 0) == 0)
+		{
+			// 1 would be D3DMULTISAMPLE_NONMASKABLE, which isn't a sample count.
+			const size_t samples = std::min<size_t>(OptionValue(arg, 4), 16);
+			if (samples < 2)
+				SDL_Log("%s: multisampling needs at least 2 samples, it stays off", arg.c_str());
+			else
+				multiSample = static_cast<D3DMULTISAMPLE_TYPE>(samples);
+		}
+		else if (arg.rfind("--", 0) == 0)
+		{
+			// A typo would otherwise be taken for the shader folder.
+			SDL_Log("Unknown option %s", arg.c_str());
+			return 1;
+		}
+		else
+			shFolder = arg;
+	}
+
+	// StretchRect can't upscale into a multisampled back buffer.
+	if (DynamicResolutionMode && multiSample != D3DMULTISAMPLE_NONE)
+	{
+		SDL_Log("--msaa is ignored with --dynamic-resolution");
+		multiSample = D3DMULTISAMPLE_NONE;
+	}
+
+	// Startup graph: SDL and the device are created on this thread while the
+	// shaders are read and compiled and the vertex data is generated on the
+	// workers. Setup() joins everything and does the Create* calls.
+
+	StartupAssets assets;
+	SDL_Window* Window = nullptr;
+	task::TaskGraph startup;
+
+	int window = startup.Add("window", [&]()
+	{
+		//Calling the SDL init stuff.
+		initSDL();
+
+		//Creating the context for SDL2.
+		Window = createWindowContext("Hello World!");
+		return Window != nullptr;
+	}, {}, true);
 
-	//Calling the SDL init stuff.
-	initSDL();
+	int device = startup.Add("create device", [&]()
+	{
+		return d3d::InitD3D(Window,
+			Width, Height, true, D3DDEVTYPE_HAL, &Device, multiSample);
+	}, { window }, true);
+
+	int readVS = startup.Add("read vs", [&]() { return ReadShader(shFolder, assets.vs); });
+	int readPS = startup.Add("read ps", [&]() { return ReadShader(shFolder, assets.ps); });
+	int compileVS = startup.Add("compile vs", [&]() { return CompileShader(shFolder, assets.vs); }, { readVS });
+	int compilePS = startup.Add("compile ps", [&]() { return CompileShader(shFolder, assets.ps); }, { readPS });
+	int vertices = startup.Add("vertices", [&]() { return GenerateVertices(assets); });
+
+	int setup = startup.Add("setup", [&]() { return Setup(assets); },
+		{ device, compileVS, compilePS, vertices }, true);
+
+	startup.Add("cpu vertices", [&]() { return SetupCpuVertices(assets); }, { device, vertices }, true);
+
+	if (!meshPath.empty())
+		startup.Add("load mesh", [&]() { return LoadMesh(meshPath); }, { setup }, true);
+
+	if (DynamicResolutionMode)
+		startup.Add("dynamic resolution", [&]()
+		{
+			std::string error;
+			if (DynamicResolution.Create(Device, Width, Height, error))
+				return true;
+			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", error.c_str(), nullptr);
+			return false;
+		}, { device }, true);
 
-	//Creating the context for SDL2.
-	SDL_Window* Window = createWindowContext("Hello World!");
+	bool started = startup.Run(task::ThreadPool::Shared());
+	startup.LogTimings("startup");
+	d3d::LogResourceTotals("resources");
 
-	if (!d3d::InitD3D(Window,
-		Width, Height, true, D3DDEVTYPE_HAL, &Device))
+	if (!started)
 	{
-		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", "InitD3D() - FAILED", nullptr);
+		const char* error = "Setup() - FAILED";
+		if (!Device)
+			error = "InitD3D() - FAILED";
+		else if (!assets.vs.error.empty())
+			error = assets.vs.error.c_str();
+		else if (!assets.ps.error.empty())
+			error = assets.ps.error.c_str();
+		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", error, nullptr);
 		return 0;
 	}
 
-	if (!Setup(shFolder))
+	// Before the benchmarks, some of them Reset the device.
+	RegisterResetCallbacks();
+
+	if (benchVertexFormats || benchIndexedMesh || benchMeshLoad || benchCulling || benchUploadArena || benchBufferPool ||
+		benchMultiDevice || benchMsaa || benchCpuVertices || benchTextureStreaming ||
+		benchBlockCompress || benchMips || benchShaderConstants || benchTransforms)
 	{
-		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", "Setup() - FAILED", nullptr);
-		return 0;
+		bool ok = true;
+		if (benchVertexFormats)
+			ok = bench::RunVertexFormats(Device, benchVertexFormats, 100) && ok;
+		if (benchIndexedMesh)
+			ok = bench::RunIndexedMesh(Device, static_cast<unsigned>(benchIndexedMesh), 100) && ok;
+		if (benchMeshLoad)
+			ok = bench::RunMeshLoad(Device, benchMeshPath.c_str(), 20) && ok;
+		if (benchCulling)
+			ok = bench::RunCulling(Device, Window, benchCulling, 600) && ok;
+		if (benchUploadArena)
+			ok = bench::RunUploadArena(Device, benchUploadArena, 300) && ok;
+		if (benchBufferPool)
+			ok = bench::RunBufferPool(Device, benchBufferPool, 100) && ok;
+		if (benchMultiDevice)
+			ok = bench::RunMultiDevice(benchMaxDevices, 300) && ok;
+		if (benchMsaa)
+			ok = bench::RunMsaa(Device, 300) && ok;
+		if (benchCpuVertices)
+			ok = bench::RunCpuVertices(Device, benchCpuVertices, 200) && ok;
+		if (benchTextureStreaming)
+			ok = bench::RunTextureStreaming(Device, benchTextureStreaming, 600) && ok;
+		if (benchBlockCompress)
+			ok = bench::RunBlockCompress(Device, static_cast<UINT>(std::min<size_t>(benchBlockCompress, 16384)), 10) && ok;
+		if (benchMips)
+			ok = bench::RunMips(Device, static_cast<UINT>(std::min<size_t>(benchMips, 16384)), 5) && ok;
+		if (benchShaderConstants)
+			ok = bench::RunShaderConstants(Device, benchShaderConstants, 300) && ok;
+		if (benchTransforms)
+			ok = bench::RunTransforms(benchTransforms, 100) && ok;
+
+		Cleanup();
+		Device->Release();
+		SDL_Quit();
+		return ok ? 0 : 1;
 	}
 
+	// The pending size outlives a lost device and a failed Reset, it is only
+	// cleared once the back buffer has it.
+	UINT resizeWidth = 0, resizeHeight = 0;
 	bool running = true;
+	double lastFrame = bench::NowMs();
 	while (running)
 	{
 		SDL_Event ev;
@@ -288,8 +580,50 @@ int main(int argc, char* argv[]) {
 				running = false;
 				break;
 			}
+			// R - live resource counters per pool and type
+			if (SDL_KEYDOWN == ev.type && SDL_SCANCODE_R == ev.key.keysym.scancode)
+				d3d::LogResourceTotals("resources");
+			// Several size changes per frame while dragging, keep the last one.
+			if (SDL_WINDOWEVENT == ev.type && SDL_WINDOWEVENT_SIZE_CHANGED == ev.window.event)
+			{
+				resizeWidth = static_cast<UINT>(ev.window.data1);
+				resizeHeight = static_cast<UINT>(ev.window.data2);
+			}
+		}
+
+		HRESULT state = Device->TestCooperativeLevel();
+		if (D3DERR_DEVICELOST == state)
+		{
+			SDL_Delay(10); // can't reset yet
+			continue;
+		}
+		if (D3DERR_DEVICENOTRESET == state && !resizeWidth)
+		{
+			resizeWidth = BackBufferWidth;
+			resizeHeight = BackBufferHeight;
+		}
+		if (resizeWidth && resizeHeight) // 0 while minimized
+		{
+			if (ResizeBackBuffer(resizeWidth, resizeHeight))
+				resizeWidth = resizeHeight = 0;
+			else
+				SDL_Delay(10); // lost again or out of memory, retried next frame
 		}
+
 		ShowPrimitive();
+
+		const double now = bench::NowMs();
+		if (DynamicResolutionMode)
+		{
+			const double frameMs = now - lastFrame;
+			ResolutionScale = ResolutionControl.Update(frameMs);
+
+			char title[128];
+			snprintf(title, sizeof(title), "scale %.2f (%ux%u), %.2f ms, budget %.1f ms", ResolutionScale,
+				DynamicResolution.Width(), DynamicResolution.Height(), frameMs, ResolutionControl.BudgetMs());
+			SDL_SetWindowTitle(Window, title);
+		}
+		lastFrame = now;
 	}
 
 	//Cleaning up everything.
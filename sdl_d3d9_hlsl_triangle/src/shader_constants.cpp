@@ -0,0 +1,101 @@
+#include "shader_constants.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace
+{
+	const UINT Words = d3d::ShaderConstants::VertexRegisters / 64;
+
+	// First register at or after `from` whose bit equals `set`, `limit` if none.
+	UINT NextBit(const uint64_t* bits, UINT from, UINT limit, bool set)
+	{
+		for (UINT word = from / 64; word < Words && word * 64 < limit; word++)
+		{
+			uint64_t value = set ? bits[word] : ~bits[word];
+			if (word == from / 64)
+				value &= ~0ull << (from % 64);
+			if (value)
+				return std::min(word * 64 + static_cast<UINT>(std::countr_zero(value)), limit);
+		}
+		return limit;
+	}
+}
+
+d3d::ShaderConstants::ShaderConstants()
+{
+	memset(_files, 0, sizeof(_files));
+	_files[Vertex].registers = VertexRegisters;
+	_files[Pixel].registers = PixelRegisters;
+}
+
+void d3d::ShaderConstants::Set(Stage stage, UINT start, const float* data, UINT count)
+{
+	File& file = _files[stage];
+	if (start >= file.registers)
+		return;
+	count = std::min(count, file.registers - start);
+
+	for (UINT i = 0; i < count; i++, data += 4)
+	{
+		const UINT reg = start + i;
+		const uint64_t bit = 1ull << (reg % 64);
+		if ((file.written[reg / 64] & bit) && memcmp(file.values[reg], data, sizeof(file.values[reg])) == 0)
+		{
+			_stats.unchangedRegisters++;
+			continue;
+		}
+		memcpy(file.values[reg], data, sizeof(file.values[reg]));
+		file.dirty[reg / 64] |= bit;
+		file.written[reg / 64] |= bit;
+	}
+}
+
+void d3d::ShaderConstants::Flush(IDirect3DDevice9* device)
+{
+	FlushFile(device, Vertex);
+	FlushFile(device, Pixel);
+	_stats.peakFrameRegisters = std::max(_stats.peakFrameRegisters, _stats.frameRegisters);
+}
+
+void d3d::ShaderConstants::FlushFile(IDirect3DDevice9* device, Stage stage)
+{
+	File& file = _files[stage];
+	UINT start = NextBit(file.dirty, 0, file.registers, true);
+	while (start < file.registers)
+	{
+		// Grow the range over dirty runs while the clean gaps stay short.
+		UINT end = NextBit(file.dirty, start, file.registers, false);
+		UINT next = NextBit(file.dirty, end, file.registers, true);
+		while (next < file.registers && next - end <= MergeGap)
+		{
+			end = NextBit(file.dirty, next, file.registers, false);
+			next = NextBit(file.dirty, end, file.registers, true);
+		}
+
+		const UINT count = end - start;
+		if (stage == Vertex)
+			device->SetVertexShaderConstantF(start, file.values[start], count);
+		else
+			device->SetPixelShaderConstantF(start, file.values[start], count);
+		_stats.frameCalls++;
+		_stats.calls++;
+		_stats.frameRegisters += count;
+		_stats.registers += count;
+		start = next;
+	}
+	memset(file.dirty, 0, sizeof(file.dirty));
+}
+
+void d3d::ShaderConstants::Invalidate()
+{
+	for (File& file : _files)
+		memcpy(file.dirty, file.written, sizeof(file.dirty));
+}
+
+void d3d::ShaderConstants::BeginFrame()
+{
+	_stats.frameCalls = 0;
+	_stats.frameRegisters = 0;
+}
@@ -0,0 +1,83 @@
+#ifndef __shader_constants__
+#define __shader_constants__
+
+#include <d3d9.h>
+#include <cstdint>
+
+// Shadow copy of the float constant registers, c0-c255 of the vertex shader
+// and c0-c223 of the pixel shader. Set*() only write the shadow and mark
+// the registers that changed; Flush() before a draw sends every dirty range
+// with one Set*ShaderConstantF call, joining ranges separated by a few
+// clean registers, so per-object values set one by one still go out as a
+// single call and values that didn't change don't go out at all.
+//
+// Nothing else may write float constants while the shadow is in use, or
+// Invalidate() has to be called afterwards, as after a device Reset.
+
+namespace d3d
+{
+	struct ShaderConstantStats
+	{
+		// Since the last BeginFrame().
+		uint64_t frameCalls = 0;
+		uint64_t frameRegisters = 0;
+		// Since construction.
+		uint64_t calls = 0;
+		uint64_t registers = 0;
+		uint64_t unchangedRegisters = 0; // set to the value they already had
+		uint64_t peakFrameRegisters = 0;
+	};
+
+	class ShaderConstants
+	{
+	public:
+		static const UINT VertexRegisters = 256;
+		static const UINT PixelRegisters = 224;
+
+		enum Stage
+		{
+			Vertex,
+			Pixel,
+		};
+
+		ShaderConstants();
+
+		// `count` float4 registers from `start`.
+		void Set(Stage stage, UINT start, const float* data, UINT count);
+		void SetVertex(UINT start, const float* data, UINT count) { Set(Vertex, start, data, count); }
+		void SetPixel(UINT start, const float* data, UINT count) { Set(Pixel, start, data, count); }
+		// A D3DMATRIX as 4 registers, for row_major float4x4 in HLSL.
+		void SetVertexMatrix(UINT start, const D3DMATRIX& matrix) { Set(Vertex, start, &matrix.m[0][0], 4); }
+
+		// Uploads the dirty ranges of both stages.
+		void Flush(IDirect3DDevice9* device);
+
+		// Every register set so far goes out again with the next Flush().
+		void Invalidate();
+
+		// Starts counting the next frame's uploads.
+		void BeginFrame();
+
+		const ShaderConstantStats& Stats() const { return _stats; }
+
+	private:
+		// Clean registers between two dirty ranges that are uploaded
+		// anyway, a register is cheaper than another call.
+		static const UINT MergeGap = 4;
+
+		struct File
+		{
+			float values[VertexRegisters][4];
+			uint64_t dirty[VertexRegisters / 64];
+			uint64_t written[VertexRegisters / 64]; // set at least once
+			UINT registers;
+		};
+
+		void FlushFile(IDirect3DDevice9* device, Stage stage);
+
+		File _files[2];
+		ShaderConstantStats _stats;
+	};
+}
+
+#endif // __shader_constants__
@@ -0,0 +1,103 @@
+#include "shader_util.h"
+
+#include <filesystem>
+#include <fstream>
+
+bool d3d::LoadFile(const char* file_name, std::vector<char>& buffer, std::string& error)
+{
+	std::ifstream fileS(file_name, std::ios::binary);
+	if (!fileS.is_open())
+	{
+		error = std::string("Can't open file ") + file_name;
+		return false;
+	}
+	const auto dwLowSize = std::filesystem::file_size(file_name);
+	if (dwLowSize == 0)
+	{
+		error = std::string("Empty file ") + file_name;
+		return false;
+	}
+
+	buffer.resize(dwLowSize);
+	fileS.exceptions(std::fstream::failbit | std::fstream::badbit);
+	fileS.read(buffer.data(), dwLowSize);
+	fileS.close();
+	return true;
+}
+
+bool d3d::CompileShaderSource(
+	const std::vector<char>& source,
+	const char* name,
+	const char* profile,
+	std::vector<char>& bytecode,
+	std::string& error)
+{
+	ID3DBlob* shader = nullptr;
+	ID3DBlob* errorMsg = nullptr;
+	HRESULT hr = D3DCompile(source.data(), source.size(), name,
+		nullptr, nullptr, "main", profile, 0, 0, &shader, &errorMsg);
+	if (errorMsg)
+	{
+		error = (char*)errorMsg->GetBufferPointer();
+		errorMsg->Release();
+	}
+
+	if (FAILED(hr))
+	{
+		error = std::string("D3DCompile() - FAILED for ") + name + "\n" + error;
+		return false;
+	}
+
+	const char* code = (const char*)shader->GetBufferPointer();
+	bytecode.assign(code, code + shader->GetBufferSize());
+	shader->Release();
+	return true;
+}
+
+namespace
+{
+	bool LoadAndCompile(const char* path, const char* profile, std::vector<char>& bytecode)
+	{
+		std::vector<char> source;
+		std::string error;
+		if (!d3d::LoadFile(path, source, error) ||
+			!d3d::CompileShaderSource(source, path, profile, bytecode, error))
+		{
+			SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", error.c_str(), nullptr);
+			return false;
+		}
+		return true;
+	}
+}
+
+IDirect3DVertexShader9* d3d::LoadVertexShader(IDirect3DDevice9* device, const char* path, const char* profile,
+	const std::source_location& site)
+{
+	std::vector<char> bytecode;
+	if (!LoadAndCompile(path, profile, bytecode))
+		return nullptr;
+
+	IDirect3DVertexShader9* shader = nullptr;
+	if (FAILED(d3d::CreateVertexShader(device, (DWORD*)bytecode.data(), &shader, site)))
+	{
+		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", "CreateVertexShader - FAILED", nullptr);
+		return nullptr;
+	}
+	return shader;
+}
+
+IDirect3DPixelShader9* d3d::LoadPixelShader(IDirect3DDevice9* device, const char* path, const char* profile,
+	const std::source_location& site)
+{
+	std::vector<char> bytecode;
+	if (!LoadAndCompile(path, profile, bytecode))
+		return nullptr;
+
+	IDirect3DPixelShader9* shader = nullptr;
+	if (FAILED(d3d::CreatePixelShader(device, (DWORD*)bytecode.data(), &shader, site)))
+	{
+		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", "CreatePixelShader - FAILED", nullptr);
+		return nullptr;
+	}
+	return shader;
+}
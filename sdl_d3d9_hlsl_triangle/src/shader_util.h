@@ -0,0 +1,32 @@
+#ifndef __shader_util__
+#define __shader_util__
+
+#include "d3d_utility.h"
+
+#include <string>
+#include <vector>
+
+namespace d3d
+{
+	// Reads a whole file. On failure `error` says why.
+	bool LoadFile(const char* file_name, std::vector<char>& buffer, std::string& error);
+
+	// Compiles HLSL source with entry point "main". Safe to call from worker
+	// threads, no device needed.
+	bool CompileShaderSource(
+		const std::vector<char>& source,
+		const char* name,             // file name used in compiler messages
+		const char* profile,          // "vs_1_1", "ps_2_0", ...
+		std::vector<char>& bytecode,  // [out]
+		std::string& error);          // [out] compiler messages
+
+	// LoadFile + CompileShaderSource + Create*Shader for the extra shaders the
+	// benchmark modes need. Shows a message box on failure.
+	// The caller's location is what the resource registry records.
+	IDirect3DVertexShader9* LoadVertexShader(IDirect3DDevice9* device, const char* path, const char* profile = "vs_1_1",
+		const std::source_location& site = std::source_location::current());
+	IDirect3DPixelShader9* LoadPixelShader(IDirect3DDevice9* device, const char* path, const char* profile = "ps_2_0",
+		const std::source_location& site = std::source_location::current());
+}
+
+#endif // __shader_util__
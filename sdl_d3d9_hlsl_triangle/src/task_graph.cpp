@@ -0,0 +1,288 @@
+#include "task_graph.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+#include <SDL2/SDL.h>
+
+namespace
+{
+	double NowMs()
+	{
+		using namespace std::chrono;
+		return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+	}
+}
+
+// ThreadPool
+
+task::ThreadPool::ThreadPool(unsigned workers)
+{
+	if (workers == 0)
+	{
+		unsigned cores = std::thread::hardware_concurrency();
+		workers = cores > 1 ? cores - 1 : 1;
+	}
+
+	for (unsigned i = 0; i < workers; i++)
+		_threads.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+task::ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_wake.notify_all();
+
+	for (std::thread& t : _threads)
+		t.join();
+}
+
+void task::ThreadPool::Submit(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_jobs.push_back(std::move(job));
+	}
+	_wake.notify_one();
+}
+
+void task::ThreadPool::WorkerLoop()
+{
+	for (;;)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_wake.wait(lock, [this] { return _stop || !_jobs.empty(); });
+			if (_stop && _jobs.empty())
+				return;
+			job = std::move(_jobs.front());
+			_jobs.pop_front();
+		}
+		job();
+	}
+}
+
+void task::ThreadPool::ParallelFor(size_t count, size_t grain,
+	const std::function<void(size_t begin, size_t end)>& fn)
+{
+	if (count == 0)
+		return;
+	if (grain == 0)
+		grain = 1;
+
+	const size_t maxChunks = (static_cast<size_t>(WorkerCount()) + 1) * 4;
+	const size_t chunks = std::min((count + grain - 1) / grain, maxChunks);
+	if (chunks <= 1)
+	{
+		fn(0, count);
+		return;
+	}
+
+	// Shared with the helper jobs, which may still be queued after we return.
+	struct State
+	{
+		std::atomic<size_t> next{ 0 };
+		std::atomic<size_t> done{ 0 };
+		std::mutex mutex;
+		std::condition_variable finished;
+	};
+	auto state = std::make_shared<State>();
+	const size_t chunkSize = (count + chunks - 1) / chunks;
+
+	auto drain = [state, chunks, chunkSize, count, &fn]()
+	{
+		for (;;)
+		{
+			size_t chunk = state->next.fetch_add(1);
+			if (chunk >= chunks)
+				return;
+
+			size_t begin = chunk * chunkSize;
+			size_t end = std::min(begin + chunkSize, count);
+			if (begin < end)
+				fn(begin, end);
+
+			if (state->done.fetch_add(1) + 1 == chunks)
+			{
+				std::lock_guard<std::mutex> lock(state->mutex);
+				state->finished.notify_all();
+			}
+		}
+	};
+
+	const size_t helpers = std::min(chunks - 1, static_cast<size_t>(WorkerCount()));
+	for (size_t i = 0; i < helpers; i++)
+		Submit(drain);
+
+	drain();
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->finished.wait(lock, [&] { return state->done.load() == chunks; });
+}
+
+task::ThreadPool& task::ThreadPool::Shared()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+// TaskGraph
+
+int task::TaskGraph::Add(const char* name, Job job, std::vector<int> deps, bool mainThread)
+{
+	Node node;
+	node.name = name;
+	node.job = std::move(job);
+	node.deps = std::move(deps);
+	node.mainThread = mainThread;
+	_nodes.push_back(std::move(node));
+	return static_cast<int>(_nodes.size()) - 1;
+}
+
+bool task::TaskGraph::Run(ThreadPool& pool)
+{
+	const size_t total = _nodes.size();
+	for (Node& node : _nodes)
+	{
+		node.pending = static_cast<int>(node.deps.size());
+		node.dependants.clear();
+		node.ok = node.ran = false;
+	}
+	for (size_t i = 0; i < total; i++)
+		for (int dep : _nodes[i].deps)
+			_nodes[dep].dependants.push_back(static_cast<int>(i));
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::vector<int> mainReady;
+	size_t finished = 0;
+	const double start = NowMs();
+
+	// Called with `mutex` held once a node is done (or skipped).
+	std::function<void(int)> complete;
+	std::function<void(int)> schedule;
+
+	schedule = [&](int index)
+	{
+		Node& node = _nodes[index];
+		for (int dep : node.deps)
+		{
+			if (!_nodes[dep].ok)
+			{
+				// A dependency failed - skip this node and everything after it.
+				node.startMs = node.endMs = NowMs() - start;
+				complete(index);
+				return;
+			}
+		}
+
+		if (node.mainThread)
+		{
+			mainReady.push_back(index);
+			wake.notify_all();
+			return;
+		}
+
+		pool.Submit([&, index]()
+		{
+			Node& n = _nodes[index];
+			n.startMs = NowMs() - start;
+			bool ok = n.job();
+			n.endMs = NowMs() - start;
+
+			std::lock_guard<std::mutex> lock(mutex);
+			n.ok = ok;
+			n.ran = true;
+			complete(index);
+		});
+	};
+
+	complete = [&](int index)
+	{
+		finished++;
+		for (int dependant : _nodes[index].dependants)
+		{
+			if (--_nodes[dependant].pending == 0)
+				schedule(dependant);
+		}
+		wake.notify_all();
+	};
+
+	std::unique_lock<std::mutex> lock(mutex);
+	for (size_t i = 0; i < total; i++)
+	{
+		if (_nodes[i].pending == 0)
+			schedule(static_cast<int>(i));
+	}
+
+	while (finished < total)
+	{
+		wake.wait(lock, [&] { return finished == total || !mainReady.empty(); });
+		if (mainReady.empty())
+			continue;
+
+		int index = mainReady.front();
+		mainReady.erase(mainReady.begin());
+		lock.unlock();
+
+		Node& node = _nodes[index];
+		node.startMs = NowMs() - start;
+		bool ok = node.job();
+		node.endMs = NowMs() - start;
+
+		lock.lock();
+		node.ok = ok;
+		node.ran = true;
+		complete(index);
+	}
+
+	_wallMs = NowMs() - start;
+
+	return std::all_of(_nodes.begin(), _nodes.end(), [](const Node& n) { return n.ok; });
+}
+
+double task::TaskGraph::SequentialMs() const
+{
+	double sum = 0.0;
+	for (const Node& node : _nodes)
+		sum += node.endMs - node.startMs;
+	return sum;
+}
+
+double task::TaskGraph::CriticalPathMs() const
+{
+	// Nodes are added after their dependencies, so one forward pass is enough.
+	std::vector<double> finish(_nodes.size(), 0.0);
+	double longest = 0.0;
+	for (size_t i = 0; i < _nodes.size(); i++)
+	{
+		double ready = 0.0;
+		for (int dep : _nodes[i].deps)
+			ready = std::max(ready, finish[dep]);
+		finish[i] = ready + (_nodes[i].endMs - _nodes[i].startMs);
+		longest = std::max(longest, finish[i]);
+	}
+	return longest;
+}
+
+void task::TaskGraph::LogTimings(const char* title) const
+{
+	for (const Node& node : _nodes)
+	{
+		SDL_Log("%s: %-16s %8.2f .. %8.2f ms (%7.2f ms)%s%s", title, node.name.c_str(),
+			node.startMs, node.endMs, node.endMs - node.startMs,
+			node.mainThread ? " [main]" : "",
+			node.ran ? (node.ok ? "" : " FAILED") : " skipped");
+	}
+
+	const double sequential = SequentialMs();
+	SDL_Log("%s: sequential %.2f ms, critical path %.2f ms, wall %.2f ms, saved %.2f ms (%.0f%%)",
+		title, sequential, CriticalPathMs(), _wallMs, sequential - _wallMs,
+		sequential > 0.0 ? 100.0 * (sequential - _wallMs) / sequential : 0.0);
+}
@@ -0,0 +1,90 @@
+#ifndef __task_graph__
+#define __task_graph__
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace task
+{
+	// Fixed set of worker threads fed from one FIFO queue.
+	class ThreadPool
+	{
+	public:
+		explicit ThreadPool(unsigned workers = 0); // 0 - one worker per core minus the caller
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		void Submit(std::function<void()> job);
+
+		// Splits [0, count) into chunks of at least `grain` items and runs
+		// fn(begin, end) on the workers and on the calling thread. Returns
+		// when every chunk is done.
+		void ParallelFor(size_t count, size_t grain,
+			const std::function<void(size_t begin, size_t end)>& fn);
+
+		unsigned WorkerCount() const { return static_cast<unsigned>(_threads.size()); }
+
+		// Process-wide pool, created on first use.
+		static ThreadPool& Shared();
+
+	private:
+		void WorkerLoop();
+
+		std::vector<std::thread> _threads;
+		std::deque<std::function<void()>> _jobs;
+		std::mutex _mutex;
+		std::condition_variable _wake;
+		bool _stop = false;
+	};
+
+	// Small dependency graph of named jobs. Jobs flagged as main-thread run on
+	// the thread that calls Run() (device calls), everything else goes to the
+	// pool as soon as its dependencies are finished.
+	class TaskGraph
+	{
+	public:
+		typedef std::function<bool()> Job; // false - job failed, dependants are skipped
+
+		int Add(const char* name, Job job, std::vector<int> deps = {}, bool mainThread = false);
+
+		// Returns true when every job ran and succeeded.
+		bool Run(ThreadPool& pool);
+
+		// Sum of all job durations, i.e. the cost of running them one by one.
+		double SequentialMs() const;
+		// Longest dependency chain by measured job durations.
+		double CriticalPathMs() const;
+		double WallMs() const { return _wallMs; }
+
+		// Writes one line per job and the totals through SDL_Log.
+		void LogTimings(const char* title) const;
+
+	private:
+		struct Node
+		{
+			std::string name;
+			Job job;
+			std::vector<int> deps;
+			std::vector<int> dependants;
+			bool mainThread = false;
+			int pending = 0;
+			bool ok = false;
+			bool ran = false;
+			double startMs = 0.0;
+			double endMs = 0.0;
+		};
+
+		std::vector<Node> _nodes;
+		double _wallMs = 0.0;
+	};
+}
+
+#endif // __task_graph__
@@ -0,0 +1,486 @@
+#include "texture_streamer.h"
+#include "d3d_utility.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+	double NowMs()
+	{
+		using namespace std::chrono;
+		return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+	}
+
+	UINT LevelSize(UINT size, UINT level)
+	{
+		return std::max(size >> level, 1u);
+	}
+
+	bool SameShape(const d3d::StreamedTextureInfo& a, const d3d::StreamedTextureInfo& b)
+	{
+		return a.width == b.width && a.height == b.height && a.levels == b.levels && a.format == b.format;
+	}
+
+	size_t LevelBytes(const d3d::StreamedTextureInfo& info, UINT level)
+	{
+		return d3d::SurfaceBytes(info.format, LevelSize(info.width, level), LevelSize(info.height, level));
+	}
+}
+
+bool d3d::TextureStreamer::Create(IDirect3DDevice9* device, const TextureStreamerDesc& desc, DescribeFn describe,
+	DecodeFn decode, std::string& error)
+{
+	Release();
+	if (!describe || !decode || desc.stagingTextures == 0)
+	{
+		error = "texture streamer needs a describe and a decode function and at least one staging texture";
+		return false;
+	}
+
+	_device = device;
+	_desc = desc;
+	_describe = std::move(describe);
+	_decode = std::move(decode);
+	_decoders = std::make_unique<task::ThreadPool>(std::max(desc.decodeThreads, 1u));
+	_staging.resize(desc.stagingTextures);
+	return true;
+}
+
+void d3d::TextureStreamer::Release()
+{
+	// Joins the decode threads once their queue is empty, so every job has
+	// finished writing into its staging texture.
+	_decoders.reset();
+
+	for (auto& item : _entries)
+	{
+		Entry& entry = item.second;
+		if (entry.state == State::Decoding)
+			for (UINT level = 0; level < entry.info.levels; level++)
+				_staging[entry.staging].texture->UnlockRect(level);
+		d3d::Release(entry.texture);
+	}
+	for (Staging& staging : _staging)
+	{
+		d3d::Release(staging.texture);
+		d3d::Release(staging.fence);
+	}
+	for (Spare& spare : _spares)
+		d3d::Release(spare.texture);
+
+	_entries.clear();
+	_requests.clear();
+	_decoding.clear();
+	_uploading.clear();
+	_staging.clear();
+	_spares.clear();
+	_committedBytes = 0;
+	_device = nullptr;
+}
+
+void d3d::TextureStreamer::Request(uint32_t id, float priority)
+{
+	Entry& entry = _entries[id];
+	entry.requestedFrame = _frame;
+	entry.priority = priority;
+	_requests.push_back({ id, priority });
+}
+
+IDirect3DTexture9* d3d::TextureStreamer::Get(uint32_t id, DWORD* maxMipLevel) const
+{
+	auto it = _entries.find(id);
+	if (it == _entries.end() || !it->second.texture || it->second.residentLevel >= it->second.info.levels)
+		return nullptr;
+
+	*maxMipLevel = it->second.residentLevel;
+	return it->second.texture;
+}
+
+void d3d::TextureStreamer::Update()
+{
+	if (!_device)
+		return;
+
+	const double start = NowMs();
+
+	// Staging textures whose copies the GPU has done are free again. Without
+	// event queries the next lock is left to the driver to synchronize.
+	for (Staging& staging : _staging)
+		if (staging.fenced && (!staging.fence || staging.fence->GetData(nullptr, 0, 0) != S_FALSE))
+			staging.fenced = false;
+
+	CollectDecodes();
+	StartDecodes();
+	Upload(start);
+
+	_requests.clear();
+	_frame++;
+
+	const double ms = NowMs() - start;
+	_stats.peakUpdateMs = std::max(_stats.peakUpdateMs, ms);
+	if (ms > _desc.uploadBudgetMs)
+		_stats.overBudgetUpdates++;
+	_stats.residentBytes = _committedBytes;
+}
+
+void d3d::TextureStreamer::CollectDecodes()
+{
+	for (size_t i = 0; i < _decoding.size();)
+	{
+		const uint32_t id = _decoding[i];
+		Entry& entry = _entries[id];
+		const int result = entry.job->result.load(std::memory_order_acquire);
+		if (result == DecodeRunning)
+		{
+			i++;
+			continue;
+		}
+
+		Staging& staging = _staging[entry.staging];
+		for (UINT level = 0; level < entry.info.levels; level++)
+			staging.texture->UnlockRect(level);
+		entry.job.reset();
+		_decoding[i] = _decoding.back();
+		_decoding.pop_back();
+
+		if (result == DecodeFailed)
+		{
+			_stats.decodeFailures++;
+			RetireStaging(entry, false);
+			_committedBytes -= entry.bytes;
+			KeepSpare(entry);
+			entry.state = State::Unloaded;
+			continue;
+		}
+
+		_stats.decodes++;
+		entry.state = State::Uploading;
+		_uploading.push_back(id);
+	}
+}
+
+bool d3d::TextureStreamer::Describe(uint32_t id, Entry& entry)
+{
+	if (entry.described)
+		return true;
+
+	StreamedTextureInfo info;
+	if (!_describe(id, &info) || info.width == 0 || info.height == 0)
+		return false;
+
+	UINT fullChain = 1;
+	while ((std::max(info.width, info.height) >> fullChain) > 0)
+		fullChain++;
+	info.levels = info.levels == 0 ? fullChain : std::min(info.levels, fullChain);
+
+	entry.info = info;
+	entry.bytes = 0;
+	for (UINT level = 0; level < info.levels; level++)
+		entry.bytes += LevelBytes(info, level);
+	entry.residentLevel = info.levels;
+	entry.described = true;
+	return true;
+}
+
+int d3d::TextureStreamer::AcquireStaging(const StreamedTextureInfo& info)
+{
+	// A free one of the same shape, else any free slot gets a new texture.
+	int empty = -1, idle = -1;
+	for (size_t i = 0; i < _staging.size(); i++)
+	{
+		const Staging& staging = _staging[i];
+		if (staging.busy || staging.fenced)
+			continue;
+		if (staging.texture && SameShape(staging.info, info))
+			return static_cast<int>(i);
+		if (!staging.texture && empty < 0)
+			empty = static_cast<int>(i);
+		else if (staging.texture && idle < 0)
+			idle = static_cast<int>(i);
+	}
+
+	const int slot = empty >= 0 ? empty : idle;
+	if (slot < 0)
+		return -1;
+
+	Staging& staging = _staging[slot];
+	d3d::Release(staging.texture);
+	if (FAILED(d3d::CreateTexture(_device, info.width, info.height, info.levels, 0, info.format,
+		D3DPOOL_SYSTEMMEM, &staging.texture)))
+		return -1;
+	if (!staging.fence && FAILED(d3d::CreateQuery(_device, D3DQUERYTYPE_EVENT, &staging.fence)))
+		staging.fence = nullptr;
+	staging.info = info;
+	_stats.stagingCreated++;
+	return slot;
+}
+
+void d3d::TextureStreamer::RetireStaging(Entry& entry, bool fence)
+{
+	if (entry.staging < 0)
+		return;
+
+	Staging& staging = _staging[entry.staging];
+	if (fence && staging.fence)
+	{
+		staging.fence->Issue(D3DISSUE_END);
+		staging.fenced = true;
+	}
+	staging.busy = false;
+	entry.staging = -1;
+}
+
+// Spares keep their memory, so their bytes stay committed until a texture of
+// the same shape takes them over or MakeRoom() releases them.
+IDirect3DTexture9* d3d::TextureStreamer::TakeSpare(const StreamedTextureInfo& info)
+{
+	for (size_t i = 0; i < _spares.size(); i++)
+	{
+		D3DSURFACE_DESC desc;
+		_spares[i].texture->GetLevelDesc(0, &desc);
+		if (desc.Width == info.width && desc.Height == info.height && desc.Format == info.format &&
+			_spares[i].texture->GetLevelCount() == info.levels)
+		{
+			IDirect3DTexture9* texture = _spares[i].texture;
+			_committedBytes -= _spares[i].bytes;
+			_spares[i] = _spares.back();
+			_spares.pop_back();
+			return texture;
+		}
+	}
+	return nullptr;
+}
+
+void d3d::TextureStreamer::KeepSpare(Entry& entry)
+{
+	if (!entry.texture)
+		return;
+	if (_spares.size() < _staging.size())
+	{
+		_spares.push_back({ entry.texture, entry.bytes });
+		_committedBytes += entry.bytes;
+		entry.texture = nullptr;
+	}
+	else
+		d3d::Release(entry.texture);
+}
+
+bool d3d::TextureStreamer::ReleaseSpares(size_t bytes)
+{
+	while (!_spares.empty() && _committedBytes + bytes > _desc.residentBudgetBytes)
+	{
+		_committedBytes -= _spares.back().bytes;
+		d3d::Release(_spares.back().texture);
+		_spares.pop_back();
+	}
+	return _committedBytes + bytes <= _desc.residentBudgetBytes;
+}
+
+IDirect3DTexture9* d3d::TextureStreamer::AcquireTexture(const StreamedTextureInfo& info)
+{
+	// The entry's bytes are committed already, a spare's go.
+	if (IDirect3DTexture9* spare = TakeSpare(info))
+		return spare;
+
+	IDirect3DTexture9* texture = nullptr;
+	if (FAILED(d3d::CreateTexture(_device, info.width, info.height, info.levels, 0, info.format,
+		D3DPOOL_DEFAULT, &texture)))
+		return nullptr;
+	_stats.texturesCreated++;
+	return texture;
+}
+
+void d3d::TextureStreamer::Evict(uint32_t id)
+{
+	Entry& entry = _entries[id];
+	if (entry.state == State::Uploading)
+	{
+		// Levels copied so far may still be reading the staging texture.
+		RetireStaging(entry, true);
+		_uploading.erase(std::find(_uploading.begin(), _uploading.end(), id));
+	}
+	else if (entry.state == State::Resident)
+	{
+		_stats.residentTextures--;
+	}
+
+	_committedBytes -= entry.bytes;
+	KeepSpare(entry);
+	entry.residentLevel = entry.info.levels;
+	entry.state = State::Unloaded;
+	_stats.evictions++;
+}
+
+bool d3d::TextureStreamer::MakeRoom(Entry& entry)
+{
+	// A spare of the same shape becomes the entry's texture and its bytes
+	// move over, so only a new shape needs room.
+	if (!entry.texture)
+		entry.texture = TakeSpare(entry.info);
+
+	// Spares go before anything that may still be drawn.
+	if (ReleaseSpares(entry.bytes))
+		return true;
+
+	// Least recently wanted first. Textures being decoded have their
+	// staging texture locked and are left alone.
+	std::vector<std::pair<uint64_t, uint32_t>> candidates;
+	for (const auto& item : _entries)
+	{
+		const Entry& other = item.second;
+		if ((other.state == State::Uploading || other.state == State::Resident) &&
+			_frame - other.requestedFrame >= _desc.keepFrames)
+			candidates.push_back({ other.requestedFrame, item.first });
+	}
+	std::sort(candidates.begin(), candidates.end(),
+		[](const auto& a, const auto& b) { return a.first < b.first; });
+
+	// An evicted texture turns into a spare: taken over when it has the
+	// right shape, released otherwise.
+	for (const auto& candidate : candidates)
+	{
+		Evict(candidate.second);
+		if (!entry.texture)
+			entry.texture = TakeSpare(entry.info);
+		if (ReleaseSpares(entry.bytes))
+			return true;
+	}
+	return false;
+}
+
+void d3d::TextureStreamer::StartDecodes()
+{
+	std::sort(_requests.begin(), _requests.end(),
+		[](const RequestItem& a, const RequestItem& b) { return a.priority > b.priority; });
+
+	for (const RequestItem& request : _requests)
+	{
+		Entry& entry = _entries[request.id];
+		if (entry.state != State::Unloaded)
+			continue;
+		if (!Describe(request.id, entry))
+		{
+			_stats.decodeFailures++;
+			continue;
+		}
+		// Everything that fits is wanted more than what is left.
+		if (!MakeRoom(entry))
+		{
+			KeepSpare(entry);
+			break;
+		}
+
+		const int slot = AcquireStaging(entry.info);
+		if (slot < 0)
+		{
+			KeepSpare(entry);
+			break;
+		}
+
+		auto job = std::make_shared<DecodeJob>();
+		job->id = request.id;
+		job->info = entry.info;
+		job->levels.resize(entry.info.levels);
+		Staging& staging = _staging[slot];
+		UINT locked = 0;
+		for (; locked < entry.info.levels; locked++)
+		{
+			D3DLOCKED_RECT rect;
+			if (FAILED(staging.texture->LockRect(locked, &rect, nullptr, 0)))
+				break;
+			StreamedLevel& level = job->levels[locked];
+			level.bits = static_cast<uint8_t*>(rect.pBits);
+			level.pitch = static_cast<UINT>(rect.Pitch);
+			level.width = LevelSize(entry.info.width, locked);
+			level.height = LevelSize(entry.info.height, locked);
+		}
+		if (locked < entry.info.levels)
+		{
+			while (locked > 0)
+				staging.texture->UnlockRect(--locked);
+			KeepSpare(entry);
+			_stats.decodeFailures++;
+			continue;
+		}
+
+		staging.busy = true;
+		entry.staging = slot;
+		entry.job = job;
+		entry.state = State::Decoding;
+		_committedBytes += entry.bytes;
+		_decoding.push_back(request.id);
+
+		_decoders->Submit([this, job]()
+		{
+			const bool ok = _decode(job->id, job->info, job->levels.data());
+			job->result.store(ok ? DecodeDone : DecodeFailed, std::memory_order_release);
+		});
+	}
+}
+
+void d3d::TextureStreamer::Upload(double startMs)
+{
+	// Coarse levels of every texture before fine levels of any: the next
+	// copy is always the smallest one pending.
+	bool uploaded = false;
+	while (!_uploading.empty())
+	{
+		const double elapsed = NowMs() - startMs;
+		if (elapsed >= _desc.uploadBudgetMs)
+			break;
+
+		size_t pick = 0;
+		size_t pickBytes = 0;
+		for (size_t i = 0; i < _uploading.size(); i++)
+		{
+			const Entry& entry = _entries[_uploading[i]];
+			const size_t bytes = LevelBytes(entry.info, entry.residentLevel - 1);
+			if (i == 0 || bytes < pickBytes ||
+				(bytes == pickBytes && entry.priority > _entries[_uploading[pick]].priority))
+			{
+				pick = i;
+				pickBytes = bytes;
+			}
+		}
+
+		// One copy per frame always goes through, or a level bigger than the
+		// budget would never finish.
+		const double predictedMs = pickBytes / (1024.0 * 1024.0) * _msPerMegabyte;
+		if (uploaded && elapsed + predictedMs > _desc.uploadBudgetMs)
+			break;
+
+		Entry& entry = _entries[_uploading[pick]];
+		if (!entry.texture && !(entry.texture = AcquireTexture(entry.info)))
+			break; // out of video memory, try again next frame
+
+		const UINT level = entry.residentLevel - 1;
+		IDirect3DSurface9* source = nullptr;
+		IDirect3DSurface9* target = nullptr;
+		const double copyStart = NowMs();
+		_staging[entry.staging].texture->GetSurfaceLevel(level, &source);
+		entry.texture->GetSurfaceLevel(level, &target);
+		const HRESULT hr = _device->UpdateSurface(source, nullptr, target, nullptr);
+		source->Release();
+		target->Release();
+		if (FAILED(hr))
+			break;
+
+		const double copyMs = NowMs() - copyStart;
+		const double msPerMegabyte = copyMs / std::max(pickBytes / (1024.0 * 1024.0), 1.0 / 1024.0);
+		_msPerMegabyte = _msPerMegabyte == 0.0 ? msPerMegabyte : _msPerMegabyte * 0.9 + msPerMegabyte * 0.1;
+		_stats.levelsUploaded++;
+		_stats.bytesUploaded += pickBytes;
+		uploaded = true;
+
+		entry.residentLevel = level;
+		if (level == 0)
+		{
+			RetireStaging(entry, true);
+			entry.state = State::Resident;
+			_stats.residentTextures++;
+			_uploading[pick] = _uploading.back();
+			_uploading.pop_back();
+		}
+	}
+}
@@ -0,0 +1,192 @@
+#ifndef __texture_streamer__
+#define __texture_streamer__
+
+#include "task_graph.h"
+
+#include <d3d9.h>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Textures decoded on a background thread and uploaded by the render thread
+// a few mip levels per frame. The decoder writes straight into a locked
+// D3DPOOL_SYSTEMMEM staging texture; Update() copies its levels into a
+// D3DPOOL_DEFAULT texture with UpdateSurface, coarsest first, for as long as
+// the frame's upload budget lasts, and Get() hands out the finest level that
+// is already there for D3DSAMP_MAXMIPLEVEL. The render thread never waits:
+// finished decodes are polled, and a staging texture is locked again only
+// after the event query issued behind its last copy has signaled.
+
+namespace d3d
+{
+	struct StreamedTextureInfo
+	{
+		UINT width = 0, height = 0;
+		UINT levels = 0;                    // 0 - full mip chain
+		D3DFORMAT format = D3DFMT_A8R8G8B8;
+	};
+
+	// One locked level of a staging texture, levels[0] is the finest.
+	struct StreamedLevel
+	{
+		uint8_t* bits = nullptr;
+		UINT pitch = 0;
+		UINT width = 0, height = 0;
+	};
+
+	struct TextureStreamerDesc
+	{
+		double uploadBudgetMs = 1.0;            // render thread time per Update()
+		size_t residentBudgetBytes = 64 << 20;  // D3DPOOL_DEFAULT textures, in flight and spares included
+		unsigned stagingTextures = 8;           // decodes and uploads in flight
+		unsigned decodeThreads = 1;
+		unsigned keepFrames = 1;                // frames since the last Request() before a texture may go
+	};
+
+	struct TextureStreamerStats
+	{
+		uint64_t decodes = 0;
+		uint64_t decodeFailures = 0;
+		uint64_t levelsUploaded = 0;
+		uint64_t bytesUploaded = 0;
+		uint64_t evictions = 0;
+		uint64_t texturesCreated = 0;  // D3DPOOL_DEFAULT textures not taken from the spares
+		uint64_t stagingCreated = 0;
+		uint64_t overBudgetUpdates = 0;
+		double peakUpdateMs = 0.0;
+		size_t residentBytes = 0;
+		size_t residentTextures = 0;   // every level uploaded
+	};
+
+	class TextureStreamer
+	{
+	public:
+		// Render thread, cheap: size and format of a texture (an image header).
+		typedef std::function<bool(uint32_t id, StreamedTextureInfo* info)> DescribeFn;
+		// Decode thread: fills every level of the texture.
+		typedef std::function<bool(uint32_t id, const StreamedTextureInfo& info, const StreamedLevel* levels)> DecodeFn;
+
+		TextureStreamer() = default;
+		~TextureStreamer() { Release(); }
+
+		TextureStreamer(const TextureStreamer&) = delete;
+		TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+		bool Create(IDirect3DDevice9* device, const TextureStreamerDesc& desc, DescribeFn describe, DecodeFn decode,
+			std::string& error);
+		// Waits for the decodes in flight, then releases every texture.
+		void Release();
+
+		// The texture is wanted this frame, higher priorities stream in
+		// first. Requests are dropped by the next Update().
+		void Request(uint32_t id, float priority);
+
+		// The texture and the finest resident level, nullptr until the
+		// coarsest level has been uploaded.
+		IDirect3DTexture9* Get(uint32_t id, DWORD* maxMipLevel) const;
+
+		// Once per frame before drawing: picks up finished decodes, evicts
+		// what isn't wanted to stay under the resident budget, starts new
+		// decodes and uploads levels until the budget is spent.
+		void Update();
+
+		const TextureStreamerStats& Stats() const { return _stats; }
+
+	private:
+		enum class State
+		{
+			Unloaded,
+			Decoding,
+			Uploading,
+			Resident,
+		};
+
+		enum DecodeResult
+		{
+			DecodeRunning,
+			DecodeDone,
+			DecodeFailed,
+		};
+
+		// Shared with the decode thread until it sets `result`.
+		struct DecodeJob
+		{
+			uint32_t id = 0;
+			StreamedTextureInfo info;
+			std::vector<StreamedLevel> levels;
+			std::atomic<int> result{ DecodeRunning };
+		};
+
+		struct Staging
+		{
+			IDirect3DTexture9* texture = nullptr;
+			IDirect3DQuery9* fence = nullptr;
+			StreamedTextureInfo info;
+			bool busy = false;    // owned by an entry
+			bool fenced = false;  // copies from it may still be pending
+		};
+
+		struct Entry
+		{
+			State state = State::Unloaded;
+			bool described = false;
+			StreamedTextureInfo info;
+			size_t bytes = 0;
+			IDirect3DTexture9* texture = nullptr; // D3DPOOL_DEFAULT
+			int staging = -1;
+			std::shared_ptr<DecodeJob> job;
+			UINT residentLevel = 0;               // == info.levels while nothing is uploaded
+			float priority = 0.0f;
+			uint64_t requestedFrame = 0;
+		};
+
+		struct RequestItem
+		{
+			uint32_t id;
+			float priority;
+		};
+
+		struct Spare
+		{
+			IDirect3DTexture9* texture;
+			size_t bytes;
+		};
+
+		void CollectDecodes();
+		bool MakeRoom(Entry& entry);
+		void StartDecodes();
+		void Upload(double startMs);
+
+		bool Describe(uint32_t id, Entry& entry);
+		int AcquireStaging(const StreamedTextureInfo& info);
+		void RetireStaging(Entry& entry, bool fence);
+		IDirect3DTexture9* TakeSpare(const StreamedTextureInfo& info);
+		void KeepSpare(Entry& entry);
+		bool ReleaseSpares(size_t bytes);
+		IDirect3DTexture9* AcquireTexture(const StreamedTextureInfo& info);
+		void Evict(uint32_t id);
+
+		IDirect3DDevice9* _device = nullptr;
+		TextureStreamerDesc _desc;
+		DescribeFn _describe;
+		DecodeFn _decode;
+		std::unique_ptr<task::ThreadPool> _decoders;
+
+		std::unordered_map<uint32_t, Entry> _entries;
+		std::vector<RequestItem> _requests;
+		std::vector<uint32_t> _decoding, _uploading;
+		std::vector<Staging> _staging;
+		std::vector<Spare> _spares;  // evicted D3DPOOL_DEFAULT textures for reuse, on the budget
+
+		size_t _committedBytes = 0;
+		double _msPerMegabyte = 0.0;  // measured UpdateSurface cost
+		uint64_t _frame = 0;
+		TextureStreamerStats _stats;
+	};
+}
+
+#endif // __texture_streamer__
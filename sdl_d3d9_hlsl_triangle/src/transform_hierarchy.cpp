@@ -0,0 +1,291 @@
+#include "transform_hierarchy.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCENE_SSE2 1
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define SCENE_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+	const D3DMATRIX Identity =
+	{
+		1.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f,
+	};
+
+	void UpdateScalar(scene::TransformHierarchy& h, size_t i)
+	{
+		const float x = h.rx[i], y = h.ry[i], z = h.rz[i], w = h.rw[i];
+		const float local[4][3] =
+		{
+			{ (1.0f - 2.0f * (y * y + z * z)) * h.sx[i], 2.0f * (x * y + z * w) * h.sx[i], 2.0f * (x * z - y * w) * h.sx[i] },
+			{ 2.0f * (x * y - z * w) * h.sy[i], (1.0f - 2.0f * (x * x + z * z)) * h.sy[i], 2.0f * (y * z + x * w) * h.sy[i] },
+			{ 2.0f * (x * z + y * w) * h.sz[i], 2.0f * (y * z - x * w) * h.sz[i], (1.0f - 2.0f * (x * x + y * y)) * h.sz[i] },
+			{ h.tx[i], h.ty[i], h.tz[i] },
+		};
+
+		D3DMATRIX& out = h.world[i];
+		if (h.parent[i] == scene::NoParent)
+		{
+			for (int r = 0; r < 4; r++)
+			{
+				out.m[r][0] = local[r][0];
+				out.m[r][1] = local[r][1];
+				out.m[r][2] = local[r][2];
+				out.m[r][3] = r == 3 ? 1.0f : 0.0f;
+			}
+			return;
+		}
+
+		const D3DMATRIX& p = h.world[h.parent[i]];
+		for (int r = 0; r < 4; r++)
+			for (int c = 0; c < 4; c++)
+				out.m[r][c] = local[r][0] * p.m[0][c] + local[r][1] * p.m[1][c] + local[r][2] * p.m[2][c] +
+					(r == 3 ? p.m[3][c] : 0.0f);
+	}
+
+#if SCENE_SSE2
+
+	// Rows of 4 node matrices from the SoA locals, then each row times the
+	// parent's world matrix, one float4 row at a time.
+	void UpdateSimd4(scene::TransformHierarchy& h, size_t i)
+	{
+		const __m128 x = _mm_loadu_ps(&h.rx[i]), y = _mm_loadu_ps(&h.ry[i]);
+		const __m128 z = _mm_loadu_ps(&h.rz[i]), w = _mm_loadu_ps(&h.rw[i]);
+		const __m128 sx = _mm_loadu_ps(&h.sx[i]), sy = _mm_loadu_ps(&h.sy[i]), sz = _mm_loadu_ps(&h.sz[i]);
+		const __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f);
+		const __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+		const __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+		const __m128 xw = _mm_mul_ps(x, w), yw = _mm_mul_ps(y, w), zw = _mm_mul_ps(z, w);
+
+		__m128 rows[4][4] =
+		{
+			{ _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx),
+			  _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, zw)), sx),
+			  _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, yw)), sx), _mm_setzero_ps() },
+			{ _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, zw)), sy),
+			  _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy),
+			  _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, xw)), sy), _mm_setzero_ps() },
+			{ _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, yw)), sz),
+			  _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, xw)), sz),
+			  _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz), _mm_setzero_ps() },
+			{ _mm_loadu_ps(&h.tx[i]), _mm_loadu_ps(&h.ty[i]), _mm_loadu_ps(&h.tz[i]), one },
+		};
+		// rows[r][c] is component c of row r for the 4 nodes, transposed
+		// rows[r][n] is row r of node n.
+		for (int r = 0; r < 4; r++)
+			_MM_TRANSPOSE4_PS(rows[r][0], rows[r][1], rows[r][2], rows[r][3]);
+
+		for (int n = 0; n < 4; n++)
+		{
+			float* out = &h.world[i + n].m[0][0];
+			const uint32_t parent = h.parent[i + n];
+			if (parent == scene::NoParent)
+			{
+				for (int r = 0; r < 4; r++)
+					_mm_storeu_ps(out + r * 4, rows[r][n]);
+				continue;
+			}
+
+			const float* p = &h.world[parent].m[0][0];
+			const __m128 p0 = _mm_loadu_ps(p), p1 = _mm_loadu_ps(p + 4), p2 = _mm_loadu_ps(p + 8), p3 = _mm_loadu_ps(p + 12);
+			for (int r = 0; r < 4; r++)
+			{
+				const __m128 l = rows[r][n];
+				__m128 row = _mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(l, l, _MM_SHUFFLE(0, 0, 0, 0)), p0),
+						_mm_mul_ps(_mm_shuffle_ps(l, l, _MM_SHUFFLE(1, 1, 1, 1)), p1)),
+					_mm_mul_ps(_mm_shuffle_ps(l, l, _MM_SHUFFLE(2, 2, 2, 2)), p2));
+				if (r == 3)
+					row = _mm_add_ps(row, p3);
+				_mm_storeu_ps(out + r * 4, row);
+			}
+		}
+	}
+
+#elif SCENE_NEON
+
+	void UpdateSimd4(scene::TransformHierarchy& h, size_t i)
+	{
+		const float32x4_t x = vld1q_f32(&h.rx[i]), y = vld1q_f32(&h.ry[i]);
+		const float32x4_t z = vld1q_f32(&h.rz[i]), w = vld1q_f32(&h.rw[i]);
+		const float32x4_t sx = vld1q_f32(&h.sx[i]), sy = vld1q_f32(&h.sy[i]), sz = vld1q_f32(&h.sz[i]);
+		const float32x4_t one = vdupq_n_f32(1.0f), zero = vdupq_n_f32(0.0f);
+		const float32x4_t xx = vmulq_f32(x, x), yy = vmulq_f32(y, y), zz = vmulq_f32(z, z);
+		const float32x4_t xy = vmulq_f32(x, y), xz = vmulq_f32(x, z), yz = vmulq_f32(y, z);
+		const float32x4_t xw = vmulq_f32(x, w), yw = vmulq_f32(y, w), zw = vmulq_f32(z, w);
+
+		// vst4q interleaves the 4 components of a row, which leaves the rows
+		// of node 0, 1, 2, 3 one after the other.
+		float rows[4][16];
+		float32x4x4_t r0 = { { vmulq_f32(vmlsq_n_f32(one, vaddq_f32(yy, zz), 2.0f), sx),
+			vmulq_f32(vmulq_n_f32(vaddq_f32(xy, zw), 2.0f), sx),
+			vmulq_f32(vmulq_n_f32(vsubq_f32(xz, yw), 2.0f), sx), zero } };
+		float32x4x4_t r1 = { { vmulq_f32(vmulq_n_f32(vsubq_f32(xy, zw), 2.0f), sy),
+			vmulq_f32(vmlsq_n_f32(one, vaddq_f32(xx, zz), 2.0f), sy),
+			vmulq_f32(vmulq_n_f32(vaddq_f32(yz, xw), 2.0f), sy), zero } };
+		float32x4x4_t r2 = { { vmulq_f32(vmulq_n_f32(vaddq_f32(xz, yw), 2.0f), sz),
+			vmulq_f32(vmulq_n_f32(vsubq_f32(yz, xw), 2.0f), sz),
+			vmulq_f32(vmlsq_n_f32(one, vaddq_f32(xx, yy), 2.0f), sz), zero } };
+		float32x4x4_t r3 = { { vld1q_f32(&h.tx[i]), vld1q_f32(&h.ty[i]), vld1q_f32(&h.tz[i]), one } };
+		vst4q_f32(rows[0], r0);
+		vst4q_f32(rows[1], r1);
+		vst4q_f32(rows[2], r2);
+		vst4q_f32(rows[3], r3);
+
+		for (int n = 0; n < 4; n++)
+		{
+			float* out = &h.world[i + n].m[0][0];
+			const uint32_t parent = h.parent[i + n];
+			if (parent == scene::NoParent)
+			{
+				for (int r = 0; r < 4; r++)
+					vst1q_f32(out + r * 4, vld1q_f32(rows[r] + n * 4));
+				continue;
+			}
+
+			const float* p = &h.world[parent].m[0][0];
+			const float32x4_t p0 = vld1q_f32(p), p1 = vld1q_f32(p + 4), p2 = vld1q_f32(p + 8), p3 = vld1q_f32(p + 12);
+			for (int r = 0; r < 4; r++)
+			{
+				const float32x4_t l = vld1q_f32(rows[r] + n * 4);
+				float32x4_t row = vmulq_laneq_f32(p0, l, 0);
+				row = vmlaq_laneq_f32(row, p1, l, 1);
+				row = vmlaq_laneq_f32(row, p2, l, 2);
+				if (r == 3)
+					row = vaddq_f32(row, p3);
+				vst1q_f32(out + r * 4, row);
+			}
+		}
+	}
+
+#endif
+}
+
+const char* scene::SimdName()
+{
+#if SCENE_SSE2
+	return "SSE2";
+#elif SCENE_NEON
+	return "NEON";
+#else
+	return "scalar";
+#endif
+}
+
+bool scene::TransformHierarchy::Build(const std::vector<uint32_t>& parents, std::vector<uint32_t>* remap)
+{
+	const size_t count = parents.size();
+	for (uint32_t p : parents)
+		if (p != NoParent && p >= count)
+			return false;
+
+	// Depth of every node, walking up to the first node with a known depth.
+	// A walk longer than the node count has gone around a cycle.
+	std::vector<uint32_t> depth(count, NoParent);
+	std::vector<uint32_t> path;
+	for (size_t i = 0; i < count; i++)
+	{
+		path.clear();
+		uint32_t node = static_cast<uint32_t>(i);
+		while (node != NoParent && depth[node] == NoParent)
+		{
+			if (path.size() > count)
+				return false;
+			path.push_back(node);
+			node = parents[node];
+		}
+		uint32_t d = node == NoParent ? 0 : depth[node] + 1;
+		for (size_t k = path.size(); k-- > 0; d++)
+			depth[path[k]] = d;
+	}
+
+	// Counting sort by depth, input order kept within a level.
+	size_t levels = 0;
+	for (uint32_t d : depth)
+		levels = std::max<size_t>(levels, d + 1);
+	_levels.assign(levels + 1, 0);
+	for (uint32_t d : depth)
+		_levels[d + 1]++;
+	for (size_t level = 0; level < levels; level++)
+		_levels[level + 1] += _levels[level];
+
+	std::vector<size_t> next(_levels.begin(), _levels.end() - 1);
+	std::vector<uint32_t> order(count);
+	for (size_t i = 0; i < count; i++)
+		order[i] = static_cast<uint32_t>(next[depth[i]]++);
+
+	parent.resize(count);
+	for (size_t i = 0; i < count; i++)
+		parent[order[i]] = parents[i] == NoParent ? NoParent : order[parents[i]];
+
+	tx.assign(count, 0.0f);
+	ty.assign(count, 0.0f);
+	tz.assign(count, 0.0f);
+	rx.assign(count, 0.0f);
+	ry.assign(count, 0.0f);
+	rz.assign(count, 0.0f);
+	rw.assign(count, 1.0f);
+	sx.assign(count, 1.0f);
+	sy.assign(count, 1.0f);
+	sz.assign(count, 1.0f);
+	world.assign(count, Identity);
+
+	if (remap)
+		*remap = std::move(order);
+	return true;
+}
+
+void scene::TransformHierarchy::SetLocal(size_t i, const float translation[3], const float rotation[4],
+	const float scale[3])
+{
+	tx[i] = translation[0];
+	ty[i] = translation[1];
+	tz[i] = translation[2];
+	rx[i] = rotation[0];
+	ry[i] = rotation[1];
+	rz[i] = rotation[2];
+	rw[i] = rotation[3];
+	sx[i] = scale[0];
+	sy[i] = scale[1];
+	sz[i] = scale[2];
+}
+
+void scene::TransformHierarchy::UpdateRange(size_t begin, size_t end, Kernel kernel)
+{
+	size_t i = begin;
+#if SCENE_SSE2 || SCENE_NEON
+	if (kernel == Kernel::Simd)
+		for (; i + 4 <= end; i += 4)
+			UpdateSimd4(*this, i);
+#endif
+	for (; i < end; i++)
+		UpdateScalar(*this, i);
+}
+
+void scene::TransformHierarchy::UpdateWorld(task::ThreadPool* pool, size_t grain, Kernel kernel)
+{
+	for (size_t level = 0; level < LevelCount(); level++)
+	{
+		const size_t begin = _levels[level], end = _levels[level + 1];
+		if (!pool || end - begin <= grain)
+		{
+			UpdateRange(begin, end, kernel);
+			continue;
+		}
+
+		// ParallelFor returns once the whole level is done: the next one
+		// reads these matrices.
+		pool->ParallelFor(end - begin, grain, [&](size_t first, size_t last)
+		{
+			UpdateRange(begin + first, begin + last, kernel);
+		});
+	}
+}
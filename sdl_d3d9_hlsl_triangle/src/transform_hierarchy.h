@@ -0,0 +1,70 @@
+#ifndef __transform_hierarchy__
+#define __transform_hierarchy__
+
+#include "task_graph.h"
+
+#include <d3d9.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Scene nodes as flat arrays: local translation / rotation / scale, parent
+// index and world matrix each in their own array, nodes sorted by depth so
+// every parent comes before its children and each depth is one contiguous
+// range. World matrices are then computed level by level: the nodes of a
+// level only read the level above, so a level is split across the thread
+// pool and the SIMD kernel does 4 nodes at a time (SSE2, NEON) with no
+// pointers to follow.
+//
+// Matrices follow the D3D row-vector convention: world = local * parent
+// world, local = scale * rotation * translation.
+
+namespace scene
+{
+	const uint32_t NoParent = 0xffffffff;
+
+	enum class Kernel
+	{
+		Scalar,
+		Simd,
+	};
+
+	// "SSE2", "NEON" or "scalar" - what Kernel::Simd compiles to.
+	const char* SimdName();
+
+	class TransformHierarchy
+	{
+	public:
+		// Local transforms, one array per component. The rotation is a unit
+		// quaternion (x, y, z, w).
+		std::vector<float> tx, ty, tz;
+		std::vector<float> rx, ry, rz, rw;
+		std::vector<float> sx, sy, sz;
+		std::vector<uint32_t> parent;  // NoParent for roots
+		std::vector<D3DMATRIX> world;
+
+		// Sorts nodes given by their parents in any order. `remap`, if given,
+		// receives the new index of every input node. Locals are reset to
+		// identity. False if the parents contain a cycle or a bad index.
+		bool Build(const std::vector<uint32_t>& parents, std::vector<uint32_t>* remap = nullptr);
+
+		size_t Count() const { return parent.size(); }
+		// Nodes at depth d are [LevelBegin(d), LevelBegin(d + 1)).
+		size_t LevelCount() const { return _levels.empty() ? 0 : _levels.size() - 1; }
+		size_t LevelBegin(size_t level) const { return _levels[level]; }
+
+		void SetLocal(size_t i, const float translation[3], const float rotation[4], const float scale[3]);
+
+		// Recomputes every world matrix. Levels with more than `grain`
+		// nodes are split across the pool when given.
+		void UpdateWorld(task::ThreadPool* pool = nullptr, size_t grain = 4096, Kernel kernel = Kernel::Simd);
+
+		// Nodes [begin, end) of one level, the level above must be up to date.
+		void UpdateRange(size_t begin, size_t end, Kernel kernel = Kernel::Simd);
+
+	private:
+		std::vector<size_t> _levels;
+	};
+}
+
+#endif // __transform_hierarchy__
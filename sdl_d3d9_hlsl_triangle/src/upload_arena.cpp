@@ -0,0 +1,199 @@
+#include "upload_arena.h"
+#include "d3d_utility.h"
+
+#include <chrono>
+#include <thread>
+
+bool d3d::UploadArena::Create(IDirect3DDevice9* device, UINT vertexBytes, UINT indexBytes,
+	unsigned framesInFlight, std::string& error)
+{
+	Release();
+	if (framesInFlight == 0)
+		framesInFlight = 1;
+
+	_slots.resize(framesInFlight);
+	_vertexBytes = vertexBytes;
+	_indexBytes = indexBytes & ~1u;
+
+	for (Slot& slot : _slots)
+	{
+		if (FAILED(d3d::CreateVertexBuffer(device, _vertexBytes, D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY,
+				0, D3DPOOL_DEFAULT, &slot.vb)) ||
+			FAILED(d3d::CreateIndexBuffer(device, _indexBytes, D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY,
+				D3DFMT_INDEX16, D3DPOOL_DEFAULT, &slot.ib)))
+		{
+			error = "can't create the dynamic vertex or index buffer";
+			Release();
+			return false;
+		}
+
+		// Optional, the slots are then renamed by the driver instead.
+		if (FAILED(d3d::CreateQuery(device, D3DQUERYTYPE_EVENT, &slot.fence)))
+			slot.fence = nullptr;
+	}
+
+	_current = _slots.size() - 1;
+	return true;
+}
+
+void d3d::UploadArena::Release()
+{
+	if (_inFrame)
+		Unlock();
+	_inFrame = false;
+
+	for (Slot& slot : _slots)
+	{
+		d3d::Release(slot.vb);
+		d3d::Release(slot.ib);
+		d3d::Release(slot.fence);
+	}
+	_slots.clear();
+}
+
+void d3d::UploadArena::BeginFrame()
+{
+	if (_slots.empty())
+		return;
+	if (_inFrame)
+		EndFrame();
+
+	_current = (_current + 1) % _slots.size();
+	Slot& slot = _slots[_current];
+	if (slot.fence && slot.fenced)
+	{
+		if (slot.fence->GetData(nullptr, 0, 0) == S_FALSE)
+		{
+			using namespace std::chrono;
+			const steady_clock::time_point start = steady_clock::now();
+			while (slot.fence->GetData(nullptr, 0, D3DGETDATA_FLUSH) == S_FALSE)
+				std::this_thread::yield();
+			_stats.waits++;
+			_stats.waitMs += duration<double, std::milli>(steady_clock::now() - start).count();
+		}
+		slot.fenced = false;
+	}
+
+	_vertexCursor = _indexCursor = 0;
+	_vertexLockedOnce = _indexLockedOnce = false;
+	_inFrame = true;
+}
+
+void d3d::UploadArena::EndFrame()
+{
+	if (!_inFrame)
+		return;
+
+	Unlock();
+	Slot& slot = _slots[_current];
+	if (slot.fence)
+	{
+		slot.fence->Issue(D3DISSUE_END);
+		slot.fenced = true;
+	}
+
+	if (_vertexCursor > _stats.peakVertexBytes)
+		_stats.peakVertexBytes = _vertexCursor;
+	if (_indexCursor > _stats.peakIndexBytes)
+		_stats.peakIndexBytes = _indexCursor;
+	_stats.frames++;
+	_inFrame = false;
+}
+
+bool d3d::UploadArena::LockVertices()
+{
+	if (_vertexData)
+		return true;
+
+	// A fenced slot is idle, every lock may skip the sync. An unfenced one
+	// is discarded once per frame and appended to after that.
+	Slot& slot = _slots[_current];
+	DWORD flags = slot.fence || _vertexLockedOnce ? D3DLOCK_NOOVERWRITE : D3DLOCK_DISCARD;
+	void* data = nullptr;
+	if (FAILED(slot.vb->Lock(0, 0, &data, flags)))
+		return false;
+
+	_vertexData = static_cast<uint8_t*>(data);
+	_vertexLockedOnce = true;
+	_stats.locks++;
+	return true;
+}
+
+bool d3d::UploadArena::LockIndices()
+{
+	if (_indexData)
+		return true;
+
+	Slot& slot = _slots[_current];
+	DWORD flags = slot.fence || _indexLockedOnce ? D3DLOCK_NOOVERWRITE : D3DLOCK_DISCARD;
+	void* data = nullptr;
+	if (FAILED(slot.ib->Lock(0, 0, &data, flags)))
+		return false;
+
+	_indexData = static_cast<uint8_t*>(data);
+	_indexLockedOnce = true;
+	_stats.locks++;
+	return true;
+}
+
+bool d3d::UploadArena::AllocVertices(UINT count, UINT stride, VertexUpload* upload)
+{
+	if (!_inFrame || stride == 0)
+		return false;
+
+	// Round up to the stride so the allocation can also be addressed by
+	// StartVertex on a stream bound at offset 0.
+	const UINT offset = (_vertexCursor + stride - 1) / stride * stride;
+	const UINT bytes = count * stride;
+	if (offset > _vertexBytes || bytes > _vertexBytes - offset || !LockVertices())
+	{
+		_stats.overflows++;
+		return false;
+	}
+
+	upload->vb = _slots[_current].vb;
+	upload->offset = offset;
+	upload->startVertex = offset / stride;
+	upload->data = _vertexData + offset;
+	_vertexCursor = offset + bytes;
+	return true;
+}
+
+bool d3d::UploadArena::AllocIndices(UINT count, IndexUpload* upload)
+{
+	if (!_inFrame)
+		return false;
+
+	const UINT offset = _indexCursor;
+	const UINT bytes = count * sizeof(uint16_t);
+	if (bytes > _indexBytes - offset || !LockIndices())
+	{
+		_stats.overflows++;
+		return false;
+	}
+
+	upload->ib = _slots[_current].ib;
+	upload->offset = offset;
+	upload->startIndex = offset / sizeof(uint16_t);
+	upload->data = reinterpret_cast<uint16_t*>(_indexData + offset);
+	_indexCursor = offset + bytes;
+	return true;
+}
+
+void d3d::UploadArena::Unlock()
+{
+	if (_slots.empty())
+		return;
+
+	Slot& slot = _slots[_current];
+	if (_vertexData)
+	{
+		slot.vb->Unlock();
+		_vertexData = nullptr;
+	}
+	if (_indexData)
+	{
+		slot.ib->Unlock();
+		_indexData = nullptr;
+	}
+}
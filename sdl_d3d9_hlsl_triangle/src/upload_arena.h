@@ -0,0 +1,103 @@
+#ifndef __upload_arena__
+#define __upload_arena__
+
+#include <d3d9.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Frame-scoped linear allocator for transient geometry. One dynamic vertex
+// buffer and one 16-bit index buffer per frame in flight, handed out with a
+// bump pointer. A slot is reused only after the event query issued at the
+// end of its frame has signaled, so its buffers are written with
+// D3DLOCK_NOOVERWRITE and nothing is created or freed after Create().
+
+namespace d3d
+{
+	struct VertexUpload
+	{
+		IDirect3DVertexBuffer9* vb = nullptr;
+		UINT offset = 0;       // bytes, a multiple of the stride
+		UINT startVertex = 0;  // offset / stride, for Draw*Primitive with stream offset 0
+		void* data = nullptr;  // write-only
+	};
+
+	struct IndexUpload
+	{
+		IDirect3DIndexBuffer9* ib = nullptr;
+		UINT offset = 0;       // bytes
+		UINT startIndex = 0;
+		uint16_t* data = nullptr;
+	};
+
+	struct UploadArenaStats
+	{
+		uint64_t frames = 0;
+		uint64_t locks = 0;
+		uint64_t waits = 0;      // BeginFrame calls that had to block on a fence
+		double waitMs = 0.0;
+		uint64_t overflows = 0;  // allocations that did not fit
+		UINT peakVertexBytes = 0;
+		UINT peakIndexBytes = 0;
+	};
+
+	class UploadArena
+	{
+	public:
+		UploadArena() = default;
+		~UploadArena() { Release(); }
+
+		UploadArena(const UploadArena&) = delete;
+		UploadArena& operator=(const UploadArena&) = delete;
+
+		// Creates the buffers and fences of every slot. Without event query
+		// support the first lock of each frame falls back to D3DLOCK_DISCARD.
+		bool Create(IDirect3DDevice9* device, UINT vertexBytes, UINT indexBytes,
+			unsigned framesInFlight, std::string& error);
+		void Release();
+
+		// Moves to the next slot, waiting for the GPU to finish the frame
+		// that used it last, and rewinds its bump pointers.
+		void BeginFrame();
+		// Unlocks and fences the current slot.
+		void EndFrame();
+
+		// Room for `count` vertices of `stride` bytes or `count` indices in
+		// the current frame. Returns false if the slot is full.
+		bool AllocVertices(UINT count, UINT stride, VertexUpload* upload);
+		bool AllocIndices(UINT count, IndexUpload* upload);
+
+		// Buffers must be unlocked before they are drawn from. Allocations
+		// made after this lock again with D3DLOCK_NOOVERWRITE.
+		void Unlock();
+
+		unsigned FramesInFlight() const { return static_cast<unsigned>(_slots.size()); }
+		const UploadArenaStats& Stats() const { return _stats; }
+
+	private:
+		struct Slot
+		{
+			IDirect3DVertexBuffer9* vb = nullptr;
+			IDirect3DIndexBuffer9* ib = nullptr;
+			IDirect3DQuery9* fence = nullptr;
+			bool fenced = false;
+		};
+
+		bool LockVertices();
+		bool LockIndices();
+
+		std::vector<Slot> _slots;
+		UINT _vertexBytes = 0, _indexBytes = 0;
+		size_t _current = 0;
+		bool _inFrame = false;
+
+		UINT _vertexCursor = 0, _indexCursor = 0;
+		uint8_t* _vertexData = nullptr; // whole buffer while locked
+		uint8_t* _indexData = nullptr;
+		bool _vertexLockedOnce = false, _indexLockedOnce = false;
+
+		UploadArenaStats _stats;
+	};
+}
+
+#endif // __upload_arena__
@@ -0,0 +1,345 @@
+#include "vertex_formats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VTX_SSE2 1
+#include <emmintrin.h>
+#if defined(__F16C__) || defined(__AVX2__)
+#define VTX_F16C 1
+#include <immintrin.h>
+#endif
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define VTX_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+	const vtx::FormatInfo Formats[vtx::POS_FORMAT_COUNT] =
+	{
+		{ "float3",  16, 12, D3DDECLTYPE_FLOAT3,    0                  },
+		{ "half4",   12,  8, D3DDECLTYPE_FLOAT16_4, D3DDTCAPS_FLOAT16_4 },
+		{ "short4n", 12,  8, D3DDECLTYPE_SHORT4N,   D3DDTCAPS_SHORT4N  },
+		{ "ubyte4n",  8,  4, D3DDECLTYPE_UBYTE4N,   D3DDTCAPS_UBYTE4N  },
+		{ "dec3n",    8,  4, D3DDECLTYPE_DEC3N,     D3DDTCAPS_DEC3N    },
+	};
+
+	// (p - center) * invExtent maps the bounds onto [-1, 1]; w is forced to 1.
+	struct Normalizer
+	{
+		float center[4];
+		float invExtent[4];
+
+		explicit Normalizer(const vtx::QuantizeBounds& bounds)
+		{
+			for (int i = 0; i < 3; i++)
+			{
+				center[i] = bounds.center[i];
+				invExtent[i] = 1.0f / bounds.extent[i];
+			}
+			center[3] = 0.0f;
+			invExtent[3] = 0.0f;
+		}
+
+		void Apply(const float* xyz, float n[4]) const
+		{
+			for (int i = 0; i < 3; i++)
+				n[i] = std::min(1.0f, std::max(-1.0f, (xyz[i] - center[i]) * invExtent[i]));
+			n[3] = 1.0f;
+		}
+
+#if VTX_SSE2
+		__m128 Apply(const float* xyz) const
+		{
+			__m128 p = _mm_setr_ps(xyz[0], xyz[1], xyz[2], 0.0f);
+			__m128 n = _mm_mul_ps(_mm_sub_ps(p, _mm_loadu_ps(center)), _mm_loadu_ps(invExtent));
+			n = _mm_min_ps(_mm_max_ps(n, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+			return _mm_add_ps(n, _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f));
+		}
+#elif VTX_NEON
+		float32x4_t Apply(const float* xyz) const
+		{
+			float32x4_t p = { xyz[0], xyz[1], xyz[2], 0.0f };
+			float32x4_t n = vmulq_f32(vsubq_f32(p, vld1q_f32(center)), vld1q_f32(invExtent));
+			n = vminq_f32(vmaxq_f32(n, vdupq_n_f32(-1.0f)), vdupq_n_f32(1.0f));
+			float32x4_t w = { 0.0f, 0.0f, 0.0f, 1.0f };
+			return vaddq_f32(n, w);
+		}
+#endif
+	};
+
+	inline int RoundToInt(float v)
+	{
+		return static_cast<int>(std::lrint(v));
+	}
+
+#if VTX_SSE2 && !VTX_F16C
+	// Four floats to four halves (in the low 16 bits of each lane, sign
+	// extended so _mm_packs_epi32 keeps them intact). Round to nearest even.
+	__m128i FloatToHalfSSE2(__m128 f)
+	{
+		const __m128i f16max = _mm_set1_epi32((127 + 16) << 23);
+		const __m128i minNormal = _mm_set1_epi32((127 - 14) << 23);
+		const __m128i subnormMagic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+		const __m128i normalBias = _mm_set1_epi32(0xfff - ((127 - 15) << 23));
+		const __m128i infOrNan = _mm_set1_epi32(0x7c00);
+
+		__m128 sign = _mm_and_ps(f, _mm_set1_ps(-0.0f));
+		__m128 absf = _mm_xor_ps(f, sign);
+		__m128i absi = _mm_castps_si128(absf);
+
+		__m128i isRegular = _mm_cmpgt_epi32(f16max, absi);
+		__m128i isSubnormal = _mm_cmpgt_epi32(minNormal, absi);
+		__m128i nanBit = _mm_and_si128(_mm_castps_si128(_mm_cmpunord_ps(absf, absf)), _mm_set1_epi32(0x200));
+
+		__m128i subnormal = _mm_sub_epi32(
+			_mm_castps_si128(_mm_add_ps(absf, _mm_castsi128_ps(subnormMagic))), subnormMagic);
+
+		__m128i mantOdd = _mm_srai_epi32(_mm_slli_epi32(absi, 31 - 13), 31);
+		__m128i normal = _mm_srli_epi32(_mm_sub_epi32(_mm_add_epi32(absi, normalBias), mantOdd), 13);
+
+		__m128i finite = _mm_or_si128(_mm_and_si128(subnormal, isSubnormal), _mm_andnot_si128(isSubnormal, normal));
+		__m128i joined = _mm_or_si128(_mm_and_si128(finite, isRegular),
+			_mm_andnot_si128(isRegular, _mm_or_si128(nanBit, infOrNan)));
+
+		return _mm_or_si128(joined, _mm_srai_epi32(_mm_castps_si128(sign), 16));
+	}
+#endif
+
+	void PackFloat3(const float* xyz, const uint32_t* colors, size_t count, uint8_t* dst)
+	{
+		for (size_t i = 0; i < count; i++, dst += 16)
+		{
+			memcpy(dst, xyz + i * 3, 12);
+			memcpy(dst + 12, colors + i, 4);
+		}
+	}
+
+	void PackHalf4(const float* xyz, const uint32_t* colors, size_t count,
+		const Normalizer& norm, uint8_t* dst)
+	{
+		for (size_t i = 0; i < count; i++, dst += 12)
+		{
+#if VTX_F16C
+			_mm_storel_epi64((__m128i*)dst, _mm_cvtps_ph(norm.Apply(xyz + i * 3), _MM_FROUND_TO_NEAREST_INT));
+#elif VTX_SSE2
+			__m128i h = FloatToHalfSSE2(norm.Apply(xyz + i * 3));
+			_mm_storel_epi64((__m128i*)dst, _mm_packs_epi32(h, h));
+#elif VTX_NEON
+			vst1_u16((uint16_t*)dst, vreinterpret_u16_f16(vcvt_f16_f32(norm.Apply(xyz + i * 3))));
+#else
+			float n[4];
+			norm.Apply(xyz + i * 3, n);
+			uint16_t h[4] = { vtx::FloatToHalf(n[0]), vtx::FloatToHalf(n[1]), vtx::FloatToHalf(n[2]), vtx::FloatToHalf(n[3]) };
+			memcpy(dst, h, 8);
+#endif
+			memcpy(dst + 8, colors + i, 4);
+		}
+	}
+
+	void PackShort4N(const float* xyz, const uint32_t* colors, size_t count,
+		const Normalizer& norm, uint8_t* dst)
+	{
+		for (size_t i = 0; i < count; i++, dst += 12)
+		{
+#if VTX_SSE2
+			__m128i v = _mm_cvtps_epi32(_mm_mul_ps(norm.Apply(xyz + i * 3), _mm_set1_ps(32767.0f)));
+			_mm_storel_epi64((__m128i*)dst, _mm_packs_epi32(v, v));
+#elif VTX_NEON
+			int32x4_t v = vcvtnq_s32_f32(vmulq_n_f32(norm.Apply(xyz + i * 3), 32767.0f));
+			vst1_s16((int16_t*)dst, vqmovn_s32(v));
+#else
+			float n[4];
+			norm.Apply(xyz + i * 3, n);
+			int16_t s[4];
+			for (int c = 0; c < 4; c++)
+				s[c] = static_cast<int16_t>(RoundToInt(n[c] * 32767.0f));
+			memcpy(dst, s, 8);
+#endif
+			memcpy(dst + 8, colors + i, 4);
+		}
+	}
+
+	void PackUByte4N(const float* xyz, const uint32_t* colors, size_t count,
+		const Normalizer& norm, uint8_t* dst)
+	{
+		// [-1, 1] -> [0, 255]; DecodeConstants() undoes the remap.
+		for (size_t i = 0; i < count; i++, dst += 8)
+		{
+#if VTX_SSE2
+			__m128 u = _mm_add_ps(_mm_mul_ps(norm.Apply(xyz + i * 3), _mm_set1_ps(127.5f)), _mm_set1_ps(127.5f));
+			__m128i v = _mm_cvtps_epi32(u);
+			v = _mm_packs_epi32(v, v);
+			v = _mm_packus_epi16(v, v);
+			uint32_t packed = static_cast<uint32_t>(_mm_cvtsi128_si32(v));
+			memcpy(dst, &packed, 4);
+#elif VTX_NEON
+			float32x4_t u = vmlaq_n_f32(vdupq_n_f32(127.5f), norm.Apply(xyz + i * 3), 127.5f);
+			uint16x4_t w = vqmovn_u32(vcvtnq_u32_f32(u));
+			uint8x8_t b = vqmovn_u16(vcombine_u16(w, w));
+			vst1_lane_u32((uint32_t*)dst, vreinterpret_u32_u8(b), 0);
+#else
+			float n[4];
+			norm.Apply(xyz + i * 3, n);
+			for (int c = 0; c < 4; c++)
+				dst[c] = static_cast<uint8_t>(RoundToInt(n[c] * 127.5f + 127.5f));
+#endif
+			memcpy(dst + 4, colors + i, 4);
+		}
+	}
+
+	void PackDec3N(const float* xyz, const uint32_t* colors, size_t count,
+		const Normalizer& norm, uint8_t* dst)
+	{
+		for (size_t i = 0; i < count; i++, dst += 8)
+		{
+			int32_t q[4];
+#if VTX_SSE2
+			_mm_storeu_si128((__m128i*)q, _mm_cvtps_epi32(_mm_mul_ps(norm.Apply(xyz + i * 3), _mm_set1_ps(511.0f))));
+#elif VTX_NEON
+			vst1q_s32(q, vcvtnq_s32_f32(vmulq_n_f32(norm.Apply(xyz + i * 3), 511.0f)));
+#else
+			float n[4];
+			norm.Apply(xyz + i * 3, n);
+			for (int c = 0; c < 3; c++)
+				q[c] = RoundToInt(n[c] * 511.0f);
+#endif
+			uint32_t packed = (static_cast<uint32_t>(q[0]) & 0x3ff)
+				| ((static_cast<uint32_t>(q[1]) & 0x3ff) << 10)
+				| ((static_cast<uint32_t>(q[2]) & 0x3ff) << 20);
+			memcpy(dst, &packed, 4);
+			memcpy(dst + 4, colors + i, 4);
+		}
+	}
+}
+
+const vtx::FormatInfo& vtx::Info(PositionFormat format)
+{
+	return Formats[format];
+}
+
+bool vtx::IsSupported(PositionFormat format, const D3DCAPS9& caps)
+{
+	DWORD required = Formats[format].requiredDeclCaps;
+	return !required || (caps.DeclTypes & required);
+}
+
+void vtx::BuildDeclaration(PositionFormat format, D3DVERTEXELEMENT9 elements[3])
+{
+	const FormatInfo& info = Formats[format];
+
+	elements[0].Stream = 0;
+	elements[0].Offset = 0;
+	elements[0].Type = static_cast<BYTE>(info.declType);
+	elements[0].Method = D3DDECLMETHOD_DEFAULT;
+	elements[0].Usage = D3DDECLUSAGE_POSITION;
+	elements[0].UsageIndex = 0;
+
+	elements[1].Stream = 0;
+	elements[1].Offset = static_cast<WORD>(info.positionSize);
+	elements[1].Type = D3DDECLTYPE_D3DCOLOR;
+	elements[1].Method = D3DDECLMETHOD_DEFAULT;
+	elements[1].Usage = D3DDECLUSAGE_COLOR;
+	elements[1].UsageIndex = 0;
+
+	D3DVERTEXELEMENT9 end = D3DDECL_END();
+	elements[2] = end;
+}
+
+vtx::QuantizeBounds vtx::ComputeBounds(const float* xyz, size_t count)
+{
+	float lo[3] = { 0.0f, 0.0f, 0.0f };
+	float hi[3] = { 0.0f, 0.0f, 0.0f };
+	for (size_t i = 0; i < count; i++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			float v = xyz[i * 3 + c];
+			if (i == 0 || v < lo[c]) lo[c] = v;
+			if (i == 0 || v > hi[c]) hi[c] = v;
+		}
+	}
+
+	QuantizeBounds bounds;
+	for (int c = 0; c < 3; c++)
+	{
+		bounds.center[c] = 0.5f * (lo[c] + hi[c]);
+		bounds.extent[c] = std::max(0.5f * (hi[c] - lo[c]), 1e-6f);
+	}
+	return bounds;
+}
+
+void vtx::DecodeConstants(PositionFormat format, const QuantizeBounds& bounds,
+	float scale[4], float bias[4])
+{
+	for (int c = 0; c < 3; c++)
+	{
+		switch (format)
+		{
+		case POS_FLOAT3:
+			scale[c] = 1.0f;
+			bias[c] = 0.0f;
+			break;
+		case POS_UBYTE4N:
+			// stored (n + 1) / 2
+			scale[c] = 2.0f * bounds.extent[c];
+			bias[c] = bounds.center[c] - bounds.extent[c];
+			break;
+		default:
+			scale[c] = bounds.extent[c];
+			bias[c] = bounds.center[c];
+			break;
+		}
+	}
+	scale[3] = 0.0f;
+	bias[3] = 1.0f;
+}
+
+void vtx::PackVertices(PositionFormat format, const float* xyz, const uint32_t* colors,
+	size_t count, const QuantizeBounds& bounds, void* dst)
+{
+	Normalizer norm(bounds);
+	uint8_t* out = static_cast<uint8_t*>(dst);
+
+	switch (format)
+	{
+	case POS_FLOAT3:  PackFloat3(xyz, colors, count, out); break;
+	case POS_HALF4:   PackHalf4(xyz, colors, count, norm, out); break;
+	case POS_SHORT4N: PackShort4N(xyz, colors, count, norm, out); break;
+	case POS_UBYTE4N: PackUByte4N(xyz, colors, count, norm, out); break;
+	case POS_DEC3N:   PackDec3N(xyz, colors, count, norm, out); break;
+	default: break;
+	}
+}
+
+uint16_t vtx::FloatToHalf(float value)
+{
+	uint32_t f;
+	memcpy(&f, &value, 4);
+
+	const uint32_t sign = (f >> 16) & 0x8000;
+	f &= 0x7fffffff;
+
+	if (f >= 0x47800000) // overflow, inf or nan
+		return static_cast<uint16_t>(sign | (f > 0x7f800000 ? 0x7e00 : 0x7c00));
+
+	if (f < 0x38800000) // subnormal half
+	{
+		float magic;
+		uint32_t magicBits = ((127 - 15) + (23 - 10) + 1) << 23;
+		memcpy(&magic, &magicBits, 4);
+		float absValue;
+		memcpy(&absValue, &f, 4);
+		absValue += magic;
+		uint32_t bits;
+		memcpy(&bits, &absValue, 4);
+		return static_cast<uint16_t>(sign | (bits - magicBits));
+	}
+
+	uint32_t mantOdd = (f >> 13) & 1;
+	f += (static_cast<uint32_t>(15 - 127) << 23) + 0xfff + mantOdd;
+	return static_cast<uint16_t>(sign | (f >> 13));
+}
@@ -0,0 +1,66 @@
+#ifndef __vertex_formats__
+#define __vertex_formats__
+
+#include <d3d9.h>
+#include <cstddef>
+#include <cstdint>
+
+// Compressed vertex layouts built on vertex declarations instead of FVF codes.
+// Every layout stores a quantized position followed by a D3DCOLOR; the
+// packed_vs shader turns the normalized position back into object space with
+// the scale/bias from DecodeConstants(). Only the position is packed: the
+// color already is a 4 byte D3DCOLOR and these meshes carry no normals.
+
+namespace vtx
+{
+	enum PositionFormat
+	{
+		POS_FLOAT3,   // 12 + 4 bytes, same as the FVF path
+		POS_HALF4,    //  8 + 4 bytes, D3DDECLTYPE_FLOAT16_4
+		POS_SHORT4N,  //  8 + 4 bytes, D3DDECLTYPE_SHORT4N
+		POS_UBYTE4N,  //  4 + 4 bytes, D3DDECLTYPE_UBYTE4N
+		POS_DEC3N,    //  4 + 4 bytes, D3DDECLTYPE_DEC3N (10:10:10)
+		POS_FORMAT_COUNT
+	};
+
+	struct FormatInfo
+	{
+		const char* name;
+		UINT stride;             // bytes per vertex
+		UINT positionSize;       // bytes of the position element
+		D3DDECLTYPE declType;
+		DWORD requiredDeclCaps;  // D3DCAPS9::DeclTypes bit, 0 - always supported
+	};
+
+	const FormatInfo& Info(PositionFormat format);
+
+	bool IsSupported(PositionFormat format, const D3DCAPS9& caps);
+
+	// Position at offset 0, color right after it, then D3DDECL_END().
+	void BuildDeclaration(PositionFormat format, D3DVERTEXELEMENT9 elements[3]);
+
+	// Axis-aligned box the positions are quantized into.
+	struct QuantizeBounds
+	{
+		float center[3];
+		float extent[3]; // half size, never zero
+	};
+
+	QuantizeBounds ComputeBounds(const float* xyz, size_t count);
+
+	// Vertex shader constants (c0 = scale, c1 = bias) that map the decoded
+	// element value back to the original position: pos = in * scale + bias.
+	void DecodeConstants(PositionFormat format, const QuantizeBounds& bounds,
+		float scale[4], float bias[4]);
+
+	// Packs `count` vertices given as float xyz triplets and D3DCOLORs into
+	// `dst` (count * Info(format).stride bytes). Uses SSE2/F16C or NEON when
+	// the compiler targets them and falls back to scalar code otherwise.
+	void PackVertices(PositionFormat format, const float* xyz, const uint32_t* colors,
+		size_t count, const QuantizeBounds& bounds, void* dst);
+
+	// Scalar IEEE half conversion (round to nearest even), exposed for reuse.
+	uint16_t FloatToHalf(float value);
+}
+
+#endif // __vertex_formats__
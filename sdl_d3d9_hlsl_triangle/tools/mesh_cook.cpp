@@ -0,0 +1,286 @@
+// mesh_cook: converts Wavefront OBJ files to the cooked *.mesh format read by
+// mesh::LoadMeshFile().
+//
+//   mesh_cook [--no-optimize] [--no-meshlets] input.obj output.mesh
+//   mesh_cook --grid=N output.mesh
+
+#include "../src/mesh_file.h"
+#include "../src/mesh_optimizer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+	struct ObjData
+	{
+		std::vector<float> positions; // 3 per vertex
+		std::vector<float> normals;   // 3 per normal
+		std::vector<float> texcoords; // 2 per texcoord
+		struct Corner { int p, t, n; };
+		std::vector<Corner> corners;  // 3 per triangle
+	};
+
+	struct CornerHash
+	{
+		size_t operator()(const ObjData::Corner& c) const
+		{
+			return (size_t(c.p) * 73856093u) ^ (size_t(c.t + 1) * 19349663u) ^ (size_t(c.n + 1) * 83492791u);
+		}
+	};
+
+	struct CornerEqual
+	{
+		bool operator()(const ObjData::Corner& a, const ObjData::Corner& b) const
+		{
+			return a.p == b.p && a.t == b.t && a.n == b.n;
+		}
+	};
+
+	// OBJ indices are 1-based, negative ones count from the end.
+	int ResolveIndex(int index, size_t count)
+	{
+		if (index > 0)
+			return index - 1;
+		if (index < 0)
+			return static_cast<int>(count) + index;
+		return -1;
+	}
+
+	bool ParseObj(const char* path, ObjData& obj)
+	{
+		std::ifstream in(path);
+		if (!in)
+		{
+			fprintf(stderr, "can't open %s\n", path);
+			return false;
+		}
+
+		std::string line;
+		std::vector<ObjData::Corner> face;
+		while (std::getline(in, line))
+		{
+			std::istringstream ss(line);
+			std::string tag;
+			ss >> tag;
+			if (tag == "v")
+			{
+				float x = 0, y = 0, z = 0;
+				ss >> x >> y >> z;
+				obj.positions.insert(obj.positions.end(), { x, y, z });
+			}
+			else if (tag == "vn")
+			{
+				float x = 0, y = 0, z = 0;
+				ss >> x >> y >> z;
+				obj.normals.insert(obj.normals.end(), { x, y, z });
+			}
+			else if (tag == "vt")
+			{
+				float u = 0, v = 0;
+				ss >> u >> v;
+				obj.texcoords.insert(obj.texcoords.end(), { u, 1.0f - v });
+			}
+			else if (tag == "f")
+			{
+				face.clear();
+				std::string vertex;
+				while (ss >> vertex)
+				{
+					int p = 0, t = 0, n = 0;
+					if (sscanf(vertex.c_str(), "%d/%d/%d", &p, &t, &n) != 3 &&
+						sscanf(vertex.c_str(), "%d//%d", &p, &n) != 2 &&
+						sscanf(vertex.c_str(), "%d/%d", &p, &t) != 2)
+						sscanf(vertex.c_str(), "%d", &p);
+					ObjData::Corner c = {
+						ResolveIndex(p, obj.positions.size() / 3),
+						ResolveIndex(t, obj.texcoords.size() / 2),
+						ResolveIndex(n, obj.normals.size() / 3) };
+					if (c.p < 0 || c.p >= static_cast<int>(obj.positions.size() / 3))
+					{
+						fprintf(stderr, "%s: bad face index '%s'\n", path, vertex.c_str());
+						return false;
+					}
+					face.push_back(c);
+				}
+				// triangle fan
+				for (size_t k = 2; k < face.size(); k++)
+					obj.corners.insert(obj.corners.end(), { face[0], face[k - 1], face[k] });
+			}
+		}
+		return true;
+	}
+
+	// Layout in FVF order: position, [normal], diffuse, [texcoord0].
+	void BuildMesh(const ObjData& obj, mesh::MeshData& data)
+	{
+		const bool hasNormals = !obj.normals.empty();
+		const bool hasTexcoords = !obj.texcoords.empty();
+
+		data = mesh::MeshData();
+		uint16_t offset = 0;
+		data.elements.push_back({ 0, offset, mesh::MESH_FLOAT3, 0, mesh::MESH_POSITION, 0 });
+		offset += 12;
+		data.fvf = 0x002; // D3DFVF_XYZ
+		if (hasNormals)
+		{
+			data.elements.push_back({ 0, offset, mesh::MESH_FLOAT3, 0, mesh::MESH_NORMAL, 0 });
+			offset += 12;
+			data.fvf |= 0x010; // D3DFVF_NORMAL
+		}
+		data.elements.push_back({ 0, offset, mesh::MESH_D3DCOLOR, 0, mesh::MESH_COLOR, 0 });
+		offset += 4;
+		data.fvf |= 0x040; // D3DFVF_DIFFUSE
+		if (hasTexcoords)
+		{
+			data.elements.push_back({ 0, offset, mesh::MESH_FLOAT2, 0, mesh::MESH_TEXCOORD, 0 });
+			offset += 8;
+			data.fvf |= 0x100; // D3DFVF_TEX1
+		}
+		data.vertexStride = offset;
+
+		// one vertex per unique position/texcoord/normal triple
+		std::unordered_map<ObjData::Corner, uint32_t, CornerHash, CornerEqual> unique;
+		std::vector<uint8_t> vertex(data.vertexStride);
+		for (const ObjData::Corner& c : obj.corners)
+		{
+			const int t = c.t >= 0 && c.t < static_cast<int>(obj.texcoords.size() / 2) ? c.t : -1;
+			const int n = c.n >= 0 && c.n < static_cast<int>(obj.normals.size() / 3) ? c.n : -1;
+			const ObjData::Corner key = { c.p, t, n };
+			auto it = unique.find(key);
+			if (it != unique.end())
+			{
+				data.indices.push_back(it->second);
+				continue;
+			}
+
+			uint8_t* out = vertex.data();
+			memcpy(out, &obj.positions[c.p * 3], 12);
+			out += 12;
+			float normal[3] = { 0.0f, 0.0f, 1.0f };
+			if (hasNormals)
+			{
+				if (n >= 0)
+					memcpy(normal, &obj.normals[n * 3], 12);
+				memcpy(out, normal, 12);
+				out += 12;
+			}
+			// normal as color so untextured meshes are readable with min_ps
+			uint32_t color = 0xff000000;
+			for (int k = 0; k < 3; k++)
+			{
+				float v = normal[k] * 0.5f + 0.5f;
+				color |= uint32_t(v < 0.0f ? 0 : v > 1.0f ? 255 : v * 255.0f) << (16 - 8 * k);
+			}
+			memcpy(out, &color, 4);
+			out += 4;
+			if (hasTexcoords)
+			{
+				float uv[2] = {};
+				if (t >= 0)
+					memcpy(uv, &obj.texcoords[t * 2], 8);
+				memcpy(out, uv, 8);
+			}
+
+			const uint32_t index = static_cast<uint32_t>(data.vertices.size() / data.vertexStride);
+			data.vertices.insert(data.vertices.end(), vertex.begin(), vertex.end());
+			unique.emplace(key, index);
+			data.indices.push_back(index);
+		}
+	}
+
+	void Optimize(mesh::MeshData& data)
+	{
+		const size_t vertexCount = data.vertices.size() / data.vertexStride;
+		mesh::CacheStats before = mesh::AnalyzeVertexCache(data.indices.data(), data.indices.size(), vertexCount);
+
+		mesh::OptimizeVertexCache(data.indices.data(), data.indices.size(), vertexCount);
+		std::vector<uint32_t> remap;
+		mesh::OptimizeVertexFetch(data.indices.data(), data.indices.size(), vertexCount, remap);
+		std::vector<uint8_t> vertices(data.vertices.size());
+		mesh::RemapVertices(vertices.data(), data.vertices.data(), vertexCount, data.vertexStride, remap);
+		data.vertices.swap(vertices);
+
+		mesh::CacheStats after = mesh::AnalyzeVertexCache(data.indices.data(), data.indices.size(), vertexCount);
+		printf("ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", before.acmr, after.acmr, before.atvr, after.atvr);
+	}
+
+	void Usage()
+	{
+		fprintf(stderr,
+			"usage: mesh_cook [--no-optimize] [--no-meshlets] input.obj output.mesh\n"
+			"       mesh_cook [--no-meshlets] --grid=N output.mesh\n");
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	bool optimize = true;
+	bool meshlets = true;
+	unsigned grid = 0;
+	std::vector<const char*> paths;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "--no-optimize"))
+			optimize = false;
+		else if (!strcmp(argv[i], "--no-meshlets"))
+			meshlets = false;
+		else if (!strncmp(argv[i], "--grid=", 7))
+			grid = static_cast<unsigned>(strtoul(argv[i] + 7, nullptr, 10));
+		else if (argv[i][0] == '-')
+		{
+			Usage();
+			return 1;
+		}
+		else
+			paths.push_back(argv[i]);
+	}
+
+	if (paths.size() != (grid ? 1u : 2u))
+	{
+		Usage();
+		return 1;
+	}
+
+	mesh::MeshData data;
+	if (grid)
+	{
+		mesh::GenerateGridMesh(grid, data);
+	}
+	else
+	{
+		ObjData obj;
+		if (!ParseObj(paths[0], obj))
+			return 1;
+		if (obj.corners.empty())
+		{
+			fprintf(stderr, "%s: no faces\n", paths[0]);
+			return 1;
+		}
+		BuildMesh(obj, data);
+		if (optimize)
+			Optimize(data);
+	}
+
+	if (meshlets)
+		mesh::BuildMeshlets(data);
+
+	std::string error;
+	const char* output = paths.back();
+	if (!mesh::WriteMeshFile(output, data, error))
+	{
+		fprintf(stderr, "%s\n", error.c_str());
+		return 1;
+	}
+
+	printf("%s: %zu vertices (%u bytes each), %zu triangles, %zu meshlets\n", output,
+		data.vertices.size() / data.vertexStride, data.vertexStride, data.indices.size() / 3, data.meshlets.size());
+	return 0;
+}
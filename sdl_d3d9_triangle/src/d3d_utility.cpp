@@ -11,6 +11,7 @@
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
 #include "d3d_utility.h"
+#include "device_cache.h"
 
 #include <SDL2/SDL_syswm.h>
 
@@ -82,7 +83,36 @@ bool d3d::InitD3D(
 	d3dpp.FullScreen_RefreshRateInHz = D3DPRESENT_RATE_DEFAULT;
 	d3dpp.PresentationInterval       = D3DPRESENT_INTERVAL_IMMEDIATE;
 
-	// Step 4: Create the device.
+	// Step 4: Create the device, starting with the configuration that worked
+	// last time on this adapter and driver.
+
+	const std::string adapterKey = d3d::AdapterKey(d3d9, D3DADAPTER_DEFAULT, deviceType);
+	const uint64_t capsHash = d3d::CapsFingerprint(caps);
+
+	d3d::DeviceConfig cached;
+	if( d3d::LoadDeviceConfig(adapterKey, capsHash, &cached) )
+	{
+		d3dpp.AutoDepthStencilFormat = cached.depthFormat;
+
+		hr = d3d9->CreateDevice(
+			D3DADAPTER_DEFAULT,
+			deviceType,
+			hwnd,
+			cached.behaviorFlags,
+			&d3dpp,
+			device);
+
+		if( SUCCEEDED(hr) )
+		{
+			SDL_Log("device cache: hit for %s", adapterKey.c_str());
+			d3d9->Release(); // done with d3d9 object
+			return true;
+		}
+
+		SDL_Log("device cache: cached configuration failed, probing again");
+		d3d::ForgetDeviceConfig(adapterKey);
+		d3dpp.AutoDepthStencilFormat = D3DFMT_D24S8;
+	}
 
 	hr = d3d9->CreateDevice(
 		D3DADAPTER_DEFAULT, // primary adapter
@@ -113,6 +143,13 @@ bool d3d::InitD3D(
 		}
 	}
 
+	d3d::DeviceConfig config;
+	config.behaviorFlags = vp;
+	config.depthFormat = d3dpp.AutoDepthStencilFormat;
+	config.capsHash = capsHash;
+	d3d::StoreDeviceConfig(adapterKey, config);
+	SDL_Log("device cache: stored configuration for %s", adapterKey.c_str());
+
 	d3d9->Release(); // done with d3d9 object
 	
 	return true;
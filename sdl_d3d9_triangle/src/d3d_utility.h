@@ -27,7 +27,7 @@ namespace d3d
 		D3DDEVTYPE deviceType,     // [in] HAL or REF
 		IDirect3DDevice9** device);// [out]The created device.
 
-	template<class T> void Release(T t)
+	template<class T> void Release(T& t)
 	{
 		if( t )
 		{
@@ -0,0 +1,32 @@
+#ifndef __device_cache__
+#define __device_cache__
+
+#include <d3d9.h>
+#include <cstdint>
+#include <string>
+
+namespace d3d
+{
+	// Device creation parameters that are known to work for one adapter.
+	struct DeviceConfig
+	{
+		DWORD behaviorFlags;   // D3DCREATE_*_VERTEXPROCESSING
+		D3DFORMAT depthFormat; // AutoDepthStencilFormat
+		uint64_t capsHash;     // CapsFingerprint() of the caps the entry was made with
+	};
+
+	// Identifies backend, adapter and driver: "dxvk|10de:2484|...". Changes
+	// whenever GetAdapterIdentifier() reports something different, which
+	// makes cached entries for the old adapter unreachable.
+	std::string AdapterKey(IDirect3D9* d3d9, UINT adapter, D3DDEVTYPE deviceType);
+
+	uint64_t CapsFingerprint(const D3DCAPS9& caps);
+
+	// On-disk cache in the SDL preferences folder. Lookups that find an entry
+	// with a different caps fingerprint report a miss.
+	bool LoadDeviceConfig(const std::string& key, uint64_t capsHash, DeviceConfig* config);
+	void StoreDeviceConfig(const std::string& key, const DeviceConfig& config);
+	void ForgetDeviceConfig(const std::string& key);
+}
+
+#endif // __device_cache__
@@ -69,6 +69,45 @@ D3DMATRIX* MatrixPerspectiveFovLH(D3DMATRIX* pout, float fovy, float aspect, flo
 
 // Framework Functions
 
+// Device state that Reset() throws away.
+void SetupState(int width, int height)
+{
+	// Set the projection matrix.
+
+	D3DMATRIX proj;
+	MatrixPerspectiveFovLH(
+		&proj,                        // result
+		M_PI * 0.5f,                  // 90 - degrees
+		(float)width / (float)height, // aspect ratio
+		1.0f,                         // near plane
+		1000.0f);                     // far plane
+	Device->SetTransform(D3DTS_PROJECTION, &proj);
+
+	// Set wireframe mode render state.
+
+	Device->SetRenderState(D3DRS_FILLMODE, D3DFILL_WIREFRAME);
+}
+
+// Resets the device to the new window size. The vertex buffer is managed and
+// survives, there is nothing in D3DPOOL_DEFAULT to recreate.
+bool Resize(int width, int height)
+{
+	D3DPRESENT_PARAMETERS d3dpp;
+	IDirect3DSwapChain9* swapChain = 0;
+	if (FAILED(Device->GetSwapChain(0, &swapChain)))
+		return false;
+	swapChain->GetPresentParameters(&d3dpp);
+	d3d::Release<IDirect3DSwapChain9*>(swapChain);
+
+	d3dpp.BackBufferWidth = width;
+	d3dpp.BackBufferHeight = height;
+	if (FAILED(Device->Reset(&d3dpp)))
+		return false;
+
+	SetupState(width, height);
+	return true;
+}
+
 bool Setup()
 {
 	// Create the vertex buffer.
@@ -92,20 +131,7 @@ bool Setup()
 
 	Triangle->Unlock();
 
-	// Set the projection matrix.
-
-	D3DMATRIX proj;
-	MatrixPerspectiveFovLH(
-		&proj,                        // result
-		M_PI * 0.5f,                  // 90 - degrees
-		(float)Width / (float)Height, // aspect ratio
-		1.0f,                         // near plane
-		1000.0f);                     // far plane
-	Device->SetTransform(D3DTS_PROJECTION, &proj);
-
-	// Set wireframe mode render state.
-
-	Device->SetRenderState(D3DRS_FILLMODE, D3DFILL_WIREFRAME);
+	SetupState(Width, Height);
 
 	return true;
 }
@@ -155,6 +181,7 @@ SDL_Window* createWindowContext(std::string title) {
 #else // for DXVK Native
 	flags = SDL_WINDOW_VULKAN;
 #endif
+	flags |= SDL_WINDOW_RESIZABLE;
 
 	//Creating the window and passing that reference to the previously declared variable.
 	Window = SDL_CreateWindow("Hello World!", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, Width, Height, flags);
@@ -184,6 +211,10 @@ int main(int argc, char* argv[]) {
 		return 0;
 	}
 
+	// Size changes are coalesced: the window sends a stream of them while it
+	// is dragged, only the last one per frame is worth a Reset.
+	int backBufferWidth = Width, backBufferHeight = Height;
+	int resizeWidth = 0, resizeHeight = 0;
 	bool running = true;
 	while (running)
 	{
@@ -196,7 +227,42 @@ int main(int argc, char* argv[]) {
 				running = false;
 				break;
 			}
+			if (SDL_WINDOWEVENT == ev.type && SDL_WINDOWEVENT_SIZE_CHANGED == ev.window.event)
+			{
+				resizeWidth = ev.window.data1;
+				resizeHeight = ev.window.data2;
+			}
 		}
+
+		// A lost device (fullscreen alt-tab, lock screen) can't be reset until
+		// it reports D3DERR_DEVICENOTRESET; the pending size is kept meanwhile.
+		HRESULT state = Device->TestCooperativeLevel();
+		if (D3DERR_DEVICELOST == state)
+		{
+			SDL_Delay(10);
+			continue;
+		}
+		if (D3DERR_DEVICENOTRESET == state && !resizeWidth)
+		{
+			resizeWidth = backBufferWidth;
+			resizeHeight = backBufferHeight;
+		}
+		if (resizeWidth > 0 && resizeHeight > 0) // 0 while minimized
+		{
+			if (Resize(resizeWidth, resizeHeight))
+			{
+				backBufferWidth = resizeWidth;
+				backBufferHeight = resizeHeight;
+			}
+			else
+			{
+				SDL_Log("Reset(%dx%d) - FAILED", resizeWidth, resizeHeight);
+				if (D3DERR_DEVICENOTRESET == state)
+					SDL_Delay(10);
+			}
+			resizeWidth = resizeHeight = 0;
+		}
+
 		ShowPrimitive();
 	}
 